@@ -24,12 +24,18 @@
 #include <stdio.h>
 #include <float.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <string.h>
 #include <libgen.h>
 #include <locale.h>
 #include <expat.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
 #include "gcode_util.h"
 #include "gcode_sim.h"
+#include "gcode_post.h"
 
 /**
  * Attaches 'block' as the first (and only) element of 'sel_block's' extruder;
@@ -866,6 +872,8 @@ gcode_init (gcode_t *gcode)
 
   gcode->progress_callback = NULL;
   gcode->message_callback = NULL;
+  gcode->preview_callback = NULL;
+  gcode->stream_callback = NULL;
 
   gcode->zero_offset.side = 0.0;                                                // This only exists so new blocks have something to link to
   gcode->zero_offset.tool = 0.0;
@@ -883,6 +891,22 @@ gcode_init (gcode_t *gcode)
   gcode->voxel_number[2] = 0;
 
   gcode->voxel_map = NULL;
+  gcode->voxel_memory = 0;
+
+  gcode->stock_model = GCODE_STOCK_VOXEL;
+  gcode->height_map = NULL;
+  gcode->simulation_threads = 0;
+  gcode->checkpoint = NULL;
+  gcode->checkpoint_num = 0;
+  gcode->simulation_levels = 1;
+  gcode->simulation_level = 0;
+  gcode->simulation_stop = 0;
+  gcode->dirty_tiles = NULL;
+  gcode->removal_log = NULL;
+  gcode->deviation_map = NULL;
+  gcode->starting_stock = NULL;
+  gcode->collect_stats = 0;
+  gcode->line_stats = NULL;
 
   gcode->tool_xpos = FLT_MAX;
   gcode->tool_ypos = FLT_MAX;
@@ -898,15 +922,26 @@ gcode_init (gcode_t *gcode)
 
   gcode->machine_options = 0;
   gcode->decimals = 5;
+  gcode->optimize_output = 0;
+  gcode->arc_tolerance = 0.0;
+  gcode->compact_output = 0;
+  gcode->machine_resolution[0] = 0.0;
+  gcode->machine_resolution[1] = 0.0;
+  gcode->machine_resolution[2] = 0.0;
   gcode->project_number = 0;
 }
 
-void
-gcode_prep (gcode_t *gcode)
+/**
+ * Number of voxels along each axis for a given resolution: the total is split
+ * in proportion to the material size, with at least one voxel per axis.
+ */
+
+static void
+gcode_prep_number (gcode_t *gcode, uint32_t resolution, uint32_t *number)
 {
-  uint32_t size;
   gcode_vec3d_t portion;
   gfloat_t inv_den;
+  int i;
 
   inv_den = 1.0 / (gcode->material_size[0] + gcode->material_size[1] + gcode->material_size[2]);
 
@@ -914,32 +949,85 @@ gcode_prep (gcode_t *gcode)
   portion[1] = gcode->material_size[1] * inv_den;
   portion[2] = gcode->material_size[2] * inv_den;
 
+  for (i = 0; i < 3; i++)
+  {
+    number[i] = (uint32_t)(resolution * portion[i]);
+
+    if (number[i] == 0)
+      number[i] = 1;
+  }
+}
+
+/**
+ * (Re)allocate the stock at 'resolution' and make it whole again
+ */
+
+static void
+gcode_prep_stock (gcode_t *gcode, uint32_t resolution)
+{
+  float *height_map;
+  size_t size;
+
   /* Setup voxels */
-  gcode->voxel_number[0] = (uint16_t)(gcode->voxel_resolution * portion[0]);
-  gcode->voxel_number[1] = (uint16_t)(gcode->voxel_resolution * portion[1]);
-  gcode->voxel_number[2] = (uint16_t)(gcode->voxel_resolution * portion[2]);
+  gcode_prep_number (gcode, resolution, gcode->voxel_number);
 
-  if (gcode->voxel_number[0] == 0)
-    gcode->voxel_number[0] = 1;
+  /**
+   * The height field model only keeps the top surface of each XY column, so it
+   * does not need the voxel map at all (and vice versa).
+   */
+
+  if (gcode->stock_model == GCODE_STOCK_HEIGHT)
+  {
+    size = (size_t)gcode->voxel_number[0] * gcode->voxel_number[1];
+
+    gcode_voxel_free (gcode);
+
+    height_map = realloc (gcode->height_map, size * sizeof (float));
+
+    if (!height_map)                                                            // The old map no longer fits the voxel numbers;
+    {
+      REMARK ("Failed to allocate memory for the height map\n");
+      free (gcode->height_map);
+      gcode->height_map = NULL;
+      return;
+    }
 
-  if (gcode->voxel_number[1] == 0)
-    gcode->voxel_number[1] = 1;
+    gcode->height_map = height_map;
+    gcode_stock_fill (gcode);
+  }
+  else
+  {
+    free (gcode->height_map);
+    gcode->height_map = NULL;
 
-  if (gcode->voxel_number[2] == 0)
-    gcode->voxel_number[2] = 1;
+    if (gcode_voxel_init (gcode) == 0)
+      gcode_stock_fill (gcode);
+  }
+}
 
-  size = gcode->voxel_number[0] * gcode->voxel_number[1] * gcode->voxel_number[2];
+void
+gcode_prep (gcode_t *gcode)
+{
+  gcode_sim_checkpoint_free (gcode);                                            // None of them would fit the new stock,
+  gcode_sim_log_free (gcode);                                                   // nor would the removal log;
+  gcode_deviation_free (gcode);                                                 // nor anything it was compared with;
 
-  gcode->voxel_map = realloc (gcode->voxel_map, size);
-  memset (gcode->voxel_map, 1, size);
+  gcode_prep_stock (gcode, gcode->voxel_resolution);
 }
 
 void
 gcode_free (gcode_t *gcode)
 {
   gcode_list_free (&gcode->listhead);
-  free (gcode->voxel_map);
-  gcode->voxel_map = NULL;
+  gcode_sim_checkpoint_free (gcode);
+  gcode_sim_log_free (gcode);
+  gcode_deviation_free (gcode);
+  gcode_stock_free (gcode);
+  gcode_stats_free (gcode);
+  gcode_sim_dirty_free (gcode);
+  gcode_voxel_free (gcode);
+  free (gcode->height_map);
+  gcode->height_map = NULL;
 }
 
 int
@@ -1458,6 +1546,33 @@ gcode_load (gcode_t *gcode, char *filename)
   return (result);
 }
 
+/**
+ * Make all the code the way it gets exported: with the appropriate number of
+ * decimals for the driver.
+ */
+
+void
+gcode_export_prep (gcode_t *gcode)
+{
+  switch (gcode->driver)
+  {
+    case GCODE_DRIVER_HAAS:
+
+      gcode->decimals = 4;
+
+      break;
+
+    default:
+
+      gcode->decimals = 5;
+
+      break;
+  }
+
+  /* Make all */
+  gcode_list_make (gcode);
+}
+
 int
 gcode_export (gcode_t *gcode, char *filename)
 {
@@ -1465,6 +1580,7 @@ gcode_export (gcode_t *gcode, char *filename)
   char *code;
   size_t code_size;
   gcode_block_t *index_block;
+  gcode_ir_t program;
 
   fh = fopen (filename, "w");
 
@@ -1474,317 +1590,837 @@ gcode_export (gcode_t *gcode, char *filename)
     return (1);
   }
 
-  /**
-   * Set appropriate number of decimals given driver
-   */
+  gcode_export_prep (gcode);
 
-  switch (gcode->driver)
+  /* The toolpath of the whole program, for it to be post-processed in one go */
+  gcode_ir_init (&program);
+
+  for (index_block = gcode->listhead; index_block; index_block = index_block->next)
+    gcode_ir_append (&program, &index_block->ir);
+
+  if (program.failed)
   {
-    case GCODE_DRIVER_HAAS:
+    gcode_ir_free (&program);
+    fclose (fh);
+    return (1);
+  }
 
-      gcode->decimals = 4;
+  gcode_post_process (gcode, &program);                                         // Left as it is if it fails;
+  gcode_post_compact (gcode, &program);
 
-      break;
+  code = gcode_ir_format (gcode, &program, &code_size);
 
-    default:
+  gcode_ir_free (&program);
 
-      gcode->decimals = 5;
+  if (!code)
+  {
+    fclose (fh);
+    return (1);
+  }
 
-      break;
+  if (gcode->compact_output)
+    gcode_util_filter_blanks (code);                                            // Compact output goes without empty lines or spaces ending lines;
+  else
+    gcode_util_filter_newlines (code);                                          // This just removes multiple empty lines in the text (leaving max. one);
+
+  code_size = strlen (code);                                                    // Sine we messed with the text, its length should be re-evaluated;
+
+  fwrite (code, 1, code_size, fh);
+
+  fclose (fh);
+
+  free (code);
+
+  if (gcode->progress_callback)
+    gcode->progress_callback (gcode->gui, 0.0);
+
+  return (0);
+}
+
+/**
+ * If the comment of 'line' starts with 'keyword' return where the text after
+ * the keyword begins, NULL otherwise.
+ */
+
+static char *
+gcode_render_final_comment (gcode_sim_line_t *line, const char *keyword)
+{
+  char *sp;
+  size_t len;
+
+  if (!line->comment)
+    return (NULL);
+
+  sp = line->comment;
+  len = strlen (keyword);
+
+  while ((sp < line->comment_end) && (*sp == ' '))
+    sp++;
+
+  if ((size_t)(line->comment_end - sp) < len || strncmp (sp, keyword, len) != 0)
+    return (NULL);
+
+  sp += len;
+
+  while ((sp < line->comment_end) && (*sp == ' '))
+    sp++;
+
+  return (sp);
+}
+
+/**
+ * Simulate one line: besides the code itself, comments of the program that
+ * name the tool and the origin of the material set up the simulator.
+ */
+
+static void
+gcode_render_final_line (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line)
+{
+  char *gv;
+  gfloat_t origin;
+  int i;
+
+  /* Scan for comments of the form (Tool Diameter: VALUE) */
+  gv = gcode_render_final_comment (line, "Tool Diameter:");
+
+  if (gv)
+  {
+    sim->tool_diameter = gcode_sim_number (gv, line->comment_end, &gv);
+    sim->tool_shape = GCODE_TOOL_SHAPE_FLAT;                                    // Unless a shape comment follows;
   }
 
-  /* Make all */
-  gcode_list_make (gcode);
+  /* Scan for comments of the form (Tool Shape: ball nose) or (Tool Shape: v-bit ANGLE) */
+  gv = gcode_render_final_comment (line, "Tool Shape:");
 
-  code_size = 1;
+  if (gv)
+  {
+    if ((line->comment_end - gv >= 9) && (strncmp (gv, "ball nose", 9) == 0))
+    {
+      sim->tool_shape = GCODE_TOOL_SHAPE_BALL;
+    }
+    else if ((line->comment_end - gv >= 5) && (strncmp (gv, "v-bit", 5) == 0))
+    {
+      gv += 5;
 
-  code = malloc (code_size);
+      while ((gv < line->comment_end) && (*gv == ' '))
+        gv++;
 
-  if (!code)
+      sim->tool_shape = GCODE_TOOL_SHAPE_VEE;
+      sim->tool_angle = gcode_sim_number (gv, line->comment_end, &gv);
+    }
+  }
+
+  /* Scan for comments of the form (Origin Offset: X=VALUE Y=VALUE Z=VALUE) */
+  gv = gcode_render_final_comment (line, "Origin Offset:");
+
+  if (gv)
   {
-    REMARK ("Failed to allocate memory for G-code export buffer\n");
-    fclose (fh);
-    return (1);
+    for (i = 0; i < 3; i++)
+    {
+      gv = memchr (gv, '=', line->comment_end - gv);
+
+      if (!gv)
+        break;
+
+      origin = gcode_sim_number (gv + 1, line->comment_end, &gv);
+
+      sim->pos[i] += origin - sim->origin[i];
+      sim->origin[i] = origin;
+    }
   }
 
-  code[0] = '\0';
+  gcode_sim_line (gcode, sim, line);
+}
 
-  index_block = gcode->listhead;
+/**
+ * Take checkpoint 'index' as the simulation reaches 'block'; none can be taken
+ * while in the middle of a line straddling two blocks. While motions are being
+ * recorded for a progressive render only the state of the simulator is kept,
+ * the stock gets saved when the final pass replays up to the same motion.
+ */
 
-  while (index_block)
+static void
+gcode_render_final_checkpoint (gcode_t *gcode, gcode_sim_t *sim, uint32_t index, gcode_block_t *block, uint64_t hash, int straddling)
+{
+  gcode_sim_checkpoint_t *checkpoint;
+
+  if (index >= gcode->checkpoint_num)
+    return;
+
+  checkpoint = &gcode->checkpoint[index];
+
+  checkpoint->block = block;
+  checkpoint->hash = hash;
+  checkpoint->pending = 0;
+
+  free (checkpoint->stock);
+  checkpoint->stock = NULL;
+
+  if (straddling)
+    return;
+
+  gcode_sim_checkpoint_save_state (sim, checkpoint);
+
+  if (sim->record)
   {
-    code_size += strlen (index_block->code);
+    checkpoint->motion = sim->record_num;
+    checkpoint->pending = 1;
+  }
+  else
+  {
+    gcode_sim_checkpoint_save_stock (gcode, sim, checkpoint);
+  }
+}
+
+/**
+ * Simulate the code of 'block' and of every block after it; 'index' is the
+ * number of 'block' among the top level blocks and checkpoints get taken from
+ * block 'checkpoint_from' on. A pass that keeps no record for later passes
+ * gives up if 'simulation_stop' gets raised (by the progress callback), leaving
+ * the stock as far as it got; returns non-zero if it did.
+ */
+
+static int
+gcode_render_final_walk (gcode_t *gcode, gcode_sim_t *sim, gcode_block_t *block, uint32_t index, uint64_t *hash, uint32_t checkpoint_from)
+{
+  gcode_block_t *index_block;
+  gcode_sim_reader_t reader;
+  size_t op_num, op_done;
+  uint32_t progress = 0;
 
-    code = realloc (code, code_size);
+  /* Total up the ops left to simulate, purely to have something to show progress by */
+  op_num = 1;
 
-    if (!code)
+  for (index_block = block; index_block; index_block = index_block->next)
+    op_num += index_block->ir.op_num;
+
+  /**
+   * Read the lines of every block right off its toolpath; a line its ops leave
+   * unfinished carries on into the next block, just as it would in the text.
+   */
+  op_done = 0;
+
+  gcode_sim_reader_init (&reader);
+
+  for (index_block = block; index_block; index_block = index_block->next, index++)
+  {
+    if (index >= checkpoint_from)
+      gcode_render_final_checkpoint (gcode, sim, index, index_block, hash[index], reader.pending);
+
+    gcode_sim_reader_start (&reader, &index_block->ir);
+
+    while (gcode_sim_read (gcode, &reader))
     {
-      REMARK ("Failed to reallocate memory for G-code export buffer\n");
-      fclose (fh);
-      return (1);
+      gcode_render_final_line (gcode, sim, &reader.line);
+      sim->line++;
+
+      if (gcode->progress_callback && ((256 * (op_done + reader.op)) / op_num != progress))
+      {
+        progress = (256 * (op_done + reader.op)) / op_num;
+        gcode->progress_callback (gcode->gui, (gfloat_t)(op_done + reader.op) / (gfloat_t)op_num);
+      }
+
+      if (gcode->simulation_stop && !sim->record)
+      {
+        gcode_sim_flush (gcode, sim);
+        return (1);
+      }
     }
 
-    strcat (code, index_block->code);
+    op_done += index_block->ir.op_num;
+  }
 
-    index_block = index_block->next;
+  if (index >= checkpoint_from)
+    gcode_render_final_checkpoint (gcode, sim, index, NULL, 0, reader.pending);
+
+  if (reader.pending)                                                           // A last line without a newline;
+  {
+    gcode_render_final_line (gcode, sim, &reader.line);
+    sim->line++;
   }
 
-  gcode_util_filter_newlines (code);                                            // This just removes multiple empty lines in the text (leaving max. one);
+  /* Apply whatever motions are still buffered */
+  gcode_sim_flush (gcode, sim);
 
-  code_size = strlen (code);                                                    // Sine we messed with the text, its length should be re-evaluated;
+  return (0);
+}
 
-  fwrite (code, 1, code_size, fh);
+/**
+ * Start a pass of the simulation on a whole new stock at 'resolution'; only a
+ * pass at full resolution gets its removal logged.
+ */
 
-  fclose (fh);
+static void
+gcode_render_final_pass (gcode_t *gcode, gcode_sim_t *sim, uint32_t resolution)
+{
+  gcode_prep_stock (gcode, resolution);
 
-  free (code);
+  sim->log = resolution == gcode->voxel_resolution ? gcode_sim_log_start (gcode, 0) : NULL;
+
+  sim->vn_inv[0] = 1.0 / (gfloat_t)gcode->voxel_number[0];
+  sim->vn_inv[1] = 1.0 / (gfloat_t)gcode->voxel_number[1];
+  sim->vn_inv[2] = 1.0 / (gfloat_t)gcode->voxel_number[2];
 
   if (gcode->progress_callback)
     gcode->progress_callback (gcode->gui, 0.0);
+}
 
-  return (0);
+/**
+ * Simulate the whole program coarse to fine: the first pass runs at a fraction
+ * of the voxel resolution, parses the code and records every motion; each pass
+ * after that doubles the resolution and replays the record, the last one at
+ * full resolution also saving the stock of the checkpoints. The stock of every
+ * pass but the last is handed to the preview callback. If 'simulation_stop' is
+ * raised the pass underway is abandoned and the previous one is restored.
+ */
+
+static void
+gcode_render_final_progressive (gcode_t *gcode, gcode_sim_t *sim, uint64_t *hash)
+{
+  gcode_sim_checkpoint_t coarse, *checkpoint;
+  uint32_t resolution, coarse_resolution, i;
+  size_t begin;
+  int stopped;
+
+  sim->record = malloc (GCODE_SIM_BATCH_SIZE * sizeof (gcode_sim_motion_t));
+  sim->record_max = GCODE_SIM_BATCH_SIZE;
+
+  if (!sim->record)
+  {
+    REMARK ("Failed to allocate memory for simulation motion record\n");
+    sim->record_max = 0;
+  }
+
+  gcode->simulation_level = 1;
+  resolution = sim->record ? gcode->voxel_resolution >> (gcode->simulation_levels - 1) : gcode->voxel_resolution;
+
+  gcode_render_final_pass (gcode, sim, resolution);
+  gcode_render_final_walk (gcode, sim, gcode->listhead, 0, hash, 0);
+
+  if (!sim->record)                                                             // Nothing to replay, so make the one pass count;
+  {
+    if (resolution != gcode->voxel_resolution)
+    {
+      /* The record was lost along the way: start over at full resolution */
+      gcode_sim_free (sim);
+      gcode_sim_init (sim, gcode);
+
+      gcode->simulation_level = gcode->simulation_levels;
+      gcode_render_final_pass (gcode, sim, gcode->voxel_resolution);
+      gcode_render_final_walk (gcode, sim, gcode->listhead, 0, hash, 0);
+    }
+
+    if (gcode->simulation_stop && sim->log)                                     // Stopped halfway, with only part of the program logged;
+    {
+      gcode_sim_log_free (gcode);
+      sim->log = NULL;
+    }
+
+    gcode->simulation_level = 0;
+    return;
+  }
+
+  coarse.stock = NULL;
+  stopped = 0;
+
+  while (gcode->simulation_level < gcode->simulation_levels)
+  {
+    if (gcode->preview_callback)
+      gcode->preview_callback (gcode->gui);
+
+    if (gcode->simulation_stop)
+      break;
+
+    /* Keep the stock of this pass to fall back on in case the next one gets stopped */
+    gcode_sim_checkpoint_save_stock (gcode, sim, &coarse);
+
+    if (!coarse.stock)
+      break;
+
+    coarse_resolution = resolution;
+
+    gcode->simulation_level++;
+    resolution = gcode->voxel_resolution >> (gcode->simulation_levels - gcode->simulation_level);
+
+    gcode_render_final_pass (gcode, sim, resolution);
+
+    begin = 0;
+
+    if (gcode->simulation_level == gcode->simulation_levels)
+    {
+      for (i = 0; (i < gcode->checkpoint_num) && !stopped; i++)
+      {
+        checkpoint = &gcode->checkpoint[i];
+
+        if (!checkpoint->pending)
+          continue;
+
+        stopped = gcode_sim_replay (gcode, sim, begin, checkpoint->motion);
+
+        if (!stopped)
+          gcode_sim_checkpoint_save_stock (gcode, sim, checkpoint);
+
+        checkpoint->pending = 0;
+        begin = checkpoint->motion;
+      }
+    }
+
+    if (!stopped)
+      stopped = gcode_sim_replay (gcode, sim, begin, sim->record_num);
+
+    if (stopped)
+    {
+      gcode->simulation_level--;
+
+      gcode_prep_stock (gcode, coarse_resolution);
+      gcode_sim_checkpoint_restore_stock (gcode, &coarse);
+      break;
+    }
+  }
+
+  if (gcode->simulation_level != gcode->simulation_levels)                      // Stopped short of full resolution;
+  {
+    gcode_sim_log_free (gcode);
+    sim->log = NULL;
+  }
+
+  free (coarse.stock);
+
+  free (sim->record);
+  sim->record = NULL;
+
+  gcode->simulation_level = 0;
 }
 
+/**
+ * Simulate the program on the stock, resuming from the last checkpoint still
+ * valid if there is one; otherwise, with more than one simulation level, the
+ * program gets simulated coarse to fine.
+ */
+
 void
 gcode_render_final (gcode_t *gcode, gfloat_t *time_elapsed)
 {
-  char *code;
-  size_t code_size;
-  gcode_block_t *index_block;
+  gcode_block_t *index_block, *resume_block;
+  gcode_sim_checkpoint_t *checkpoint;
   gcode_sim_t sim;
-  char line[256], *sp, *tsp, *gv;
-  uint32_t size, line_count, line_index, mode = 0;
-  gfloat_t G83_depth = 0.0;
-  gfloat_t G83_retract = 0.0;
+  uint64_t *hash;
+  uint32_t block_num, resume, number[3], i;
+  gfloat_t start;
+  int resumed, stopped;
+
+  start = gcode_stats_clock ();
 
   /* Make all */
   gcode_list_make (gcode);
 
+  gcode->simulation_stop = 0;
+
+  gcode_deviation_free (gcode);                                                 // Whatever gets simulated now wasn't compared to anything yet;
+  gcode_stats_free (gcode);                                                     // Nor counted;
+
+  /* A render stopped short of the last pass leaves the stock at a lower resolution */
+  gcode_prep_number (gcode, gcode->voxel_resolution, number);
+
+  if ((number[0] != gcode->voxel_number[0]) || (number[1] != gcode->voxel_number[1]) || (number[2] != gcode->voxel_number[2]))
+    gcode_prep_stock (gcode, gcode->voxel_resolution);
+
   gcode_sim_init (&sim, gcode);
 
   sim.vn_inv[0] = 1.0 / (gfloat_t)gcode->voxel_number[0];
   sim.vn_inv[1] = 1.0 / (gfloat_t)gcode->voxel_number[1];
   sim.vn_inv[2] = 1.0 / (gfloat_t)gcode->voxel_number[2];
 
-  /* Turn all the voxels back on */
-  size = gcode->voxel_number[0] * gcode->voxel_number[1] * gcode->voxel_number[2];
-  memset (gcode->voxel_map, 1, size);
+  if (gcode->collect_stats)
+    sim.stats = gcode_stats_start (gcode, GCODE_STATS_SOURCE_PROJECT);
 
-  code_size = 1;
+  /* Hash the code of every top level block to tell which ones changed since the last render */
+  block_num = 0;
 
-  code = malloc (code_size);
+  for (index_block = gcode->listhead; index_block; index_block = index_block->next)
+    block_num++;
 
-  if (!code)
+  hash = malloc ((block_num + 1) * sizeof (uint64_t));
+
+  if (!hash)
   {
-    REMARK ("Failed to allocate memory for G-code simulation buffer\n");
+    REMARK ("Failed to allocate memory for G-code simulation checkpoints\n");
+    gcode_sim_free (&sim);
     return;
   }
 
-  code[0] = '\0';
+  for (i = 0, index_block = gcode->listhead; index_block; i++, index_block = index_block->next)
+    hash[i] = gcode_ir_hash (&index_block->ir) + gcode->decimals;               // Values of the toolpath read as rounded to the decimals;
 
-  index_block = gcode->listhead;
+  hash[block_num] = 0;
 
-  while (index_block)
-  {
-    code_size += strlen (index_block->code);
+  /**
+   * Find the last checkpoint that can be resumed from: checkpoint 'i' is good
+   * as long as it was taken at the same block as this time and the code of all
+   * blocks before it is still the same; past the first changed block none is.
+   */
+  resume = 0;
+  resumed = 0;
+  stopped = 0;
 
-    code = realloc (code, code_size);
+  for (i = 0, index_block = gcode->listhead; (i < gcode->checkpoint_num) && (i <= block_num); i++)
+  {
+    if (gcode->checkpoint[i].block != index_block)
+      break;
 
-    if (!code)
+    if (gcode->checkpoint[i].stock)
     {
-      REMARK ("Failed to reallocate memory for G-code simulation buffer\n");
-      return;
+      resume = i;
+      resumed = 1;
     }
 
-    strcat (code, index_block->code);
+    if (!index_block || (gcode->checkpoint[i].hash != hash[i]))
+      break;
 
     index_block = index_block->next;
   }
 
-  /* Count the number of lines */
-  line_count = 0;
-  sp = code;
+  /* Keep the checkpoints up to the one resumed from, make room for one per block (and one past the last) */
+  for (i = resumed ? resume + 1 : 0; i < gcode->checkpoint_num; i++)
+  {
+    free (gcode->checkpoint[i].stock);
+    gcode->checkpoint[i].stock = NULL;
+    gcode->checkpoint[i].pending = 0;
+  }
 
-  while ((tsp = strchr (sp, '\n')))
+  checkpoint = realloc (gcode->checkpoint, (block_num + 1) * sizeof (gcode_sim_checkpoint_t));
+
+  if (checkpoint)
   {
-    sp = tsp + 1;
-    line_count++;
+    for (i = gcode->checkpoint_num; i <= block_num; i++)
+    {
+      checkpoint[i].block = NULL;
+      checkpoint[i].stock = NULL;
+      checkpoint[i].pending = 0;
+    }
+
+    gcode->checkpoint = checkpoint;
+    gcode->checkpoint_num = block_num + 1;
+  }
+  else
+  {
+    REMARK ("Failed to allocate memory for G-code simulation checkpoints\n");
+    gcode_sim_checkpoint_free (gcode);
+    resumed = 0;
   }
 
-  /* Isolate each line */
-  line_index = 0;
-  sp = code;
+  if (sim.stats)                                                                // Every line has to be counted, at full resolution;
+    resumed = 0;
 
-  while ((tsp = strchr (sp, '\n')))
+  if (resumed)
   {
-    uint8_t sind;
+    gcode_sim_checkpoint_restore (gcode, &sim, &gcode->checkpoint[resume]);
 
-    if (gcode->progress_callback)
-      gcode->progress_callback (gcode->gui, (gfloat_t)line_index / (gfloat_t)line_count);
+    sim.log = gcode_sim_log_start (gcode, sim.line);
 
-    memset (line, 0, 256);
-    memcpy (line, sp, tsp - sp);
-    sp = tsp + 1;
-    sind = 0;
+    resume_block = gcode->listhead;
 
-    /**
-     * Parse the line
-     */
+    for (i = 0; i < resume; i++)
+      resume_block = resume_block->next;
+
+    stopped = gcode_render_final_walk (gcode, &sim, resume_block, resume, hash, resume + 1);
+  }
+  else if ((gcode->simulation_levels > 1) && !sim.stats)
+  {
+    gcode_render_final_progressive (gcode, &sim, hash);
+  }
+  else
+  {
+    /* Turn all the voxels back on (or raise every column back to the top) */
+    gcode_stock_fill (gcode);
+
+    sim.log = gcode_sim_log_start (gcode, 0);
 
-    /* Scan for comments of the form (Tool diameter: VALUE) */
-    gv = strstr (line, "Tool Diameter:");
+    stopped = gcode_render_final_walk (gcode, &sim, gcode->listhead, 0, hash, 0);
+  }
+
+  free (hash);
+
+  if (stopped && sim.log)                                                       // A render stopped halfway logged only part of the program;
+  {
+    gcode_sim_log_free (gcode);
+    sim.log = NULL;
+  }
+
+  if (sim.log)
+    gcode_sim_log_finish (gcode, &sim);
+
+  if (sim.stats)
+    sim.stats->total_time = gcode_stats_clock () - start;
 
-    if (gv)
+  /* Elapsed time in seconds */
+  *time_elapsed = 60.0 * sim.time_elapsed;
+  gcode_sim_free (&sim);
+}
+
+/**
+ * Take on the diameter and shape of the tool numbered 'number' among the tools
+ * of the project (or of the first one there is for a negative 'number'); tools
+ * the project doesn't have leave the simulator as it was.
+ */
+
+static void
+gcode_render_file_tool (gcode_t *gcode, gcode_sim_t *sim, int number)
+{
+  gcode_block_t *index_block;
+  gcode_tool_t *tool;
+
+  for (index_block = gcode->listhead; index_block; index_block = index_block->next)
+  {
+    if (index_block->type != GCODE_TYPE_TOOL)
+      continue;
+
+    tool = (gcode_tool_t *)index_block->pdata;
+
+    if ((number >= 0) && (tool->number != number))
+      continue;
+
+    sim->tool_diameter = tool->diameter;
+    sim->tool_shape = tool->shape;
+    sim->tool_angle = tool->angle;
+    return;
+  }
+}
+
+/**
+ * Get the text of file 'filename' into memory, read-only, its length going to
+ * 'size': mapped where files can be, read into a buffer of its own elsewhere
+ * (WIN32). An empty file leaves 'code' NULL. Returns non-zero on failure.
+ */
+
+static int
+gcode_render_file_map (const char *filename, char **code, size_t *size)
+{
+#ifndef WIN32
+  struct stat st;
+  int fd;
+#else
+  FILE *fh;
+  long length;
+#endif
+
+  *code = NULL;
+  *size = 0;
+
+#ifndef WIN32
+  fd = open (filename, O_RDONLY);
+
+  if (fd < 0)
+  {
+    REMARK ("Failed to open file '%s'\n", basename ((char *)filename));
+    return (1);
+  }
+
+  if (fstat (fd, &st) != 0)
+  {
+    REMARK ("Failed to read file '%s'\n", basename ((char *)filename));
+    close (fd);
+    return (1);
+  }
+
+  if (st.st_size > 0)
+  {
+    *code = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (*code == MAP_FAILED)
     {
-      char string[256];
-      uint8_t len;
-
-      gv = strpbrk (line, ".0123456789");
-      len = strspn (gv, ".0123456789");
-      memset (string, 0, 256);
-      memcpy (string, gv, len);
-      sim.tool_diameter = atof (string);
+      REMARK ("Failed to map file '%s'\n", basename ((char *)filename));
+      *code = NULL;
+      close (fd);
+      return (1);
     }
 
-    /* Scan for comments of the form (Origin offset: X=VALUE Y=VALUE Z=VALUE) */
-    gv = strstr (line, "Origin Offset:");
+    madvise (*code, st.st_size, MADV_SEQUENTIAL);
+
+    *size = st.st_size;
+  }
+
+  close (fd);                                                                   // The mapping outlives the descriptor;
+#else
+  fh = fopen (filename, "rb");
+
+  if (!fh)
+  {
+    REMARK ("Failed to open file '%s'\n", basename ((char *)filename));
+    return (1);
+  }
+
+  if ((fseek (fh, 0, SEEK_END) != 0) || ((length = ftell (fh)) < 0) || (fseek (fh, 0, SEEK_SET) != 0))
+  {
+    REMARK ("Failed to read file '%s'\n", basename ((char *)filename));
+    fclose (fh);
+    return (1);
+  }
 
-    if (gv)
+  if (length > 0)
+  {
+    *code = malloc (length);
+
+    if (!*code)
     {
-      char string[256];
-      uint8_t len;
-
-      gv = strpbrk (gv, ".0123456789");
-      len = strspn (gv, ".0123456789");
-      memset (string, 0, 256);
-      memcpy (string, gv, len);
-      sim.origin[0] = atof (string);
-      sim.pos[0] += sim.origin[0];
-
-      gv += len;
-      gv = strpbrk (gv, ".0123456789");
-      len = strspn (gv, ".0123456789");
-      memset (string, 0, 256);
-      memcpy (string, gv, len);
-      sim.origin[1] = atof (string);
-      sim.pos[1] += sim.origin[1];
-
-      gv += len;
-      gv = strpbrk (gv, ".0123456789");
-      len = strspn (gv, ".0123456789");
-      memset (string, 0, 256);
-      memcpy (string, gv, len);
-      sim.origin[2] = atof (string);
-      sim.pos[2] += sim.origin[2];
+      REMARK ("Failed to allocate memory for file '%s'\n", basename ((char *)filename));
+      fclose (fh);
+      return (1);
     }
 
-    /* Remove the spaces */
-    gcode_util_remove_spaces (line);
+    if (fread (*code, 1, length, fh) != (size_t)length)
+    {
+      REMARK ("Failed to read file '%s'\n", basename ((char *)filename));
+      free (*code);
+      *code = NULL;
+      fclose (fh);
+      return (1);
+    }
 
-    /* Strip comments */
-    gcode_util_remove_comment (line);
+    *size = length;
+  }
 
-    switch (line[sind])
-    {
-      case 'G':
-      {
-        uint8_t len;
-        char string[256];
+  fclose (fh);
+#endif
 
-        sind++;
+  return (0);
+}
 
-        /* The Number */
-        len = strspn (&line[sind], "0123456789");
-        memset (string, 0, 256);
-        memcpy (string, &line[sind], len);
-        sind += len;
+/**
+ * Let go of the text gcode_render_file_map () got into memory
+ */
 
-        switch (atoi (string))
-        {
-          case 0:
-            gcode_sim_G00 (gcode, &sim, &line[sind]);
-            break;
+static void
+gcode_render_file_unmap (char *code, size_t size)
+{
+  if (!code)
+    return;
 
-          case 1:
-            gcode_sim_G01 (gcode, &sim, &line[sind]);
-            break;
+#ifndef WIN32
+  munmap (code, size);
+#else
+  free (code);
+#endif
+}
 
-          case 2:
-            gcode_sim_G02 (gcode, &sim, &line[sind]);
-            break;
+/**
+ * Simulate the G-code in file 'filename' on the stock of the project, as if it
+ * were the code of the project itself; the file is mapped (where files can be)
+ * and walked in place, line after line. Programs that don't say otherwise are
+ * taken to start out with the first tool of the project and with the origin of
+ * its material; a T word switches to the tool of the project with that number.
+ * Returns non-zero if the file could not be mapped or read.
+ */
 
-          case 3:
-            gcode_sim_G03 (gcode, &sim, &line[sind]);
-            break;
+int
+gcode_render_file (gcode_t *gcode, const char *filename, gfloat_t *time_elapsed)
+{
+  gcode_sim_t sim;
+  gcode_sim_line_t line;
+  char *code, *sp, *tsp, *ep;
+  size_t code_size;
+  uint32_t progress, number[3];
+  gfloat_t start;
+  int i;
 
-          case 4:
-            /* Dwell */
-            break;
+  *time_elapsed = 0.0;
 
-          case 20:
-            break;
+  start = gcode_stats_clock ();
 
-          case 21:
-            break;
+  if (gcode_render_file_map (filename, &code, &code_size))
+    return (1);
 
-          case 81:
-          case 83:
-            gcode_sim_G83 (gcode, &sim, &line[sind], &G83_depth, &G83_retract, 1);
-            mode = 83;
-            break;
+  gcode->simulation_stop = 0;
 
-          case 90:
-            sim.absolute = 1;
-            break;
+  gcode_deviation_free (gcode);                                                 // The design of the project says nothing about this code;
+  gcode_stats_free (gcode);
+  gcode_sim_checkpoint_free (gcode);                                            // Nor does the code of the project about this stock;
 
-          case 91:
-            sim.absolute = 0;
-            break;
+  gcode_prep_number (gcode, gcode->voxel_resolution, number);
 
-          default:
-            break;
-        }
-        break;
-      }
+  if ((number[0] != gcode->voxel_number[0]) || (number[1] != gcode->voxel_number[1]) || (number[2] != gcode->voxel_number[2]))
+    gcode_prep_stock (gcode, gcode->voxel_resolution);
 
-      case 'F':
-      {
-        char string[256];
-        uint8_t len;
+  gcode_stock_fill (gcode);
 
-        sind++;
+  gcode_sim_init (&sim, gcode);
 
-        len = strspn (&line[sind], ".0123456789");
-        memset (string, 0, 256);
-        memcpy (string, &line[sind], len);
-        sim.feed = atof (string);
-        break;
-      }
+  sim.vn_inv[0] = 1.0 / (gfloat_t)gcode->voxel_number[0];
+  sim.vn_inv[1] = 1.0 / (gfloat_t)gcode->voxel_number[1];
+  sim.vn_inv[2] = 1.0 / (gfloat_t)gcode->voxel_number[2];
 
-      case 'X':
-      case 'Y':
-      {
-        if (mode == 83)
-        {
-          gcode_sim_G83 (gcode, &sim, &line[sind], &G83_depth, &G83_retract, 0);
-        }
-        break;
-      }
+  for (i = 0; i < 3; i++)
+  {
+    sim.origin[i] = gcode->material_origin[i];
+    sim.pos[i] += sim.origin[i];
+  }
 
-      default:
-        break;
+  gcode_render_file_tool (gcode, &sim, -1);
+
+  sim.log = gcode_sim_log_start (gcode, 0);
+
+  if (gcode->collect_stats)
+    sim.stats = gcode_stats_start (gcode, GCODE_STATS_SOURCE_FILE);
+
+  if (gcode->progress_callback)
+    gcode->progress_callback (gcode->gui, 0.0);
+
+  progress = 0;
+
+  sp = code;
+  ep = code + code_size;
+
+  while (sp < ep)
+  {
+    tsp = memchr (sp, '\n', ep - sp);
+
+    if (!tsp)                                                                   // A last line without a newline;
+      tsp = ep;
+
+    gcode_sim_tokenize (&line, sp, tsp);
+
+    for (i = 0; i < line.word_num; i++)
+      if (line.letter[i] == 'T')
+        gcode_render_file_tool (gcode, &sim, (int)line.value[i]);
+
+    gcode_render_final_line (gcode, &sim, &line);
+    sim.line++;
+
+    sp = tsp + 1;
+
+    if (gcode->progress_callback && ((256 * (sp - code)) / (ep - code) != progress))
+    {
+      progress = (256 * (sp - code)) / (ep - code);
+      gcode->progress_callback (gcode->gui, (gfloat_t)(sp - code) / (gfloat_t)(ep - code));
     }
 
-    line_index++;
+    if (gcode->simulation_stop)                                                 // Keep the stock as far as it got;
+      break;
   }
 
-  free (code);
+  /* Apply whatever motions are still buffered */
+  gcode_sim_flush (gcode, &sim);
 
-  /* Calculate elapsed time */
-  sim.time_elapsed = 60 * sim.time_elapsed / sim.feed;
+  if (gcode->simulation_stop && sim.log)                                        // Stopped halfway, with only part of the file logged;
+  {
+    gcode_sim_log_free (gcode);
+    sim.log = NULL;
+  }
+
+  if (sim.log)
+    gcode_sim_log_finish (gcode, &sim);
+
+  if (sim.stats)
+    sim.stats->total_time = gcode_stats_clock () - start;
+
+  gcode_render_file_unmap (code, code_size);
+
+  /* Elapsed time in seconds */
+  *time_elapsed = 60.0 * sim.time_elapsed;
 
-  *time_elapsed = sim.time_elapsed;
   gcode_sim_free (&sim);
+
+  return (0);
 }
 
 void
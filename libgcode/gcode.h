@@ -76,9 +76,11 @@ void gcode_free (gcode_t *gcode);
 
 int gcode_save (gcode_t *gcode, char *filename);
 int gcode_load (gcode_t *gcode, char *filename);
+void gcode_export_prep (gcode_t *gcode);
 int gcode_export (gcode_t *gcode, char *filename);
 
 void gcode_render_final (gcode_t *gcode, gfloat_t *time_elapsed);
+int gcode_render_file (gcode_t *gcode, const char *filename, gfloat_t *time_elapsed);
 
 void gcode_dump_tree (gcode_t *gcode, gcode_block_t *block);
 
@@ -100,5 +102,13 @@ void gcode_dump_tree (gcode_t *gcode, gcode_block_t *block);
 #include "gcode_svg.h"
 #include "gcode_image.h"
 #include "gcode_stl.h"
+#include "gcode_voxel.h"
+#include "gcode_sim.h"
+#include "gcode_deviation.h"
+#include "gcode_feed.h"
+#include "gcode_time.h"
+#include "gcode_mesh.h"
+#include "gcode_stock.h"
+#include "gcode_stats.h"
 
 #endif
@@ -76,7 +76,7 @@ gcode_arc_init (gcode_block_t **block, gcode_t *gcode, gcode_block_t *parent)
 void
 gcode_arc_free (gcode_block_t **block)
 {
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
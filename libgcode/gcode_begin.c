@@ -58,7 +58,7 @@ gcode_begin_init (gcode_block_t **block, gcode_t *gcode, gcode_block_t *parent)
 void
 gcode_begin_free (gcode_block_t **block)
 {
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
@@ -160,22 +160,22 @@ gcode_begin_make (gcode_block_t *block)
   }
 
   sprintf (string, "Project: %s", block->gcode->name);
-  GCODE_COMMENT (block, string);
+  GCODE_HEADER (block, string);
 
   timer = time (NULL);
   strcpy (date_string, asctime (localtime (&timer)));
   date_string[strlen (date_string) - 1] = 0;
   sprintf (string, "Created: %s with GCAM SE v%s", date_string, VERSION);
-  GCODE_COMMENT (block, string);
+  GCODE_HEADER (block, string);
 
   gsprintf (string, block->gcode->decimals, "Material Size: X=%z Y=%z Z=%z", block->gcode->material_size[0], block->gcode->material_size[1], block->gcode->material_size[2]);
-  GCODE_COMMENT (block, string);
+  GCODE_HEADER (block, string);
 
   gsprintf (string, block->gcode->decimals, "Origin Offset: X=%z Y=%z Z=%z", block->gcode->material_origin[0], block->gcode->material_origin[1], block->gcode->material_origin[2]);
-  GCODE_COMMENT (block, string);
+  GCODE_HEADER (block, string);
 
   sprintf (string, "Notes: %s", block->gcode->notes);
-  GCODE_COMMENT (block, string);
+  GCODE_HEADER (block, string);
 
   GCODE_NEWLINE (block);
 
@@ -110,7 +110,7 @@ gcode_bolt_holes_free (gcode_block_t **block)
     tmp->free (&tmp);
   }
 
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
@@ -271,8 +271,7 @@ gcode_bolt_holes_make (gcode_block_t *block)
         offset_block->offset->z[0] = z;                                         // Thankfully, this is the trivial part - everything happens at 'z';
         offset_block->offset->z[1] = z;
 
-        offset_block->make (offset_block);                                      // There is only ever 1 arc...
-        GCODE_APPEND (block, offset_block->code);
+        GCODE_MAKE_INTO (block, offset_block);                                  // There is only ever 1 arc...
 
         free (offset_block->offset);                                            // The specially created zero-offset is no longer needed;
         gcode_list_free (&offset_block);                                        // This depth has been built - get rid of the snapshot;
@@ -312,6 +311,59 @@ gcode_bolt_holes_make (gcode_block_t *block)
   bolt_holes->offset.eval = 0.0;
 }
 
+/**
+ * Collect the outlines the holes are meant to have at depth 'z' (each hole with
+ * the extrusion profile offset applied but not the tool radius), as separate
+ * zero-offset lists the caller disposes of.
+ */
+
+int
+gcode_bolt_holes_outline (gcode_block_t *block, gfloat_t z, gcode_block_t ***outline_array, int *outline_num)
+{
+  gcode_bolt_holes_t *bolt_holes;
+  gcode_block_t *index_block, *offset_block, **array;
+  int error;
+
+  *outline_array = NULL;
+  *outline_num = 0;
+
+  bolt_holes = (gcode_bolt_holes_t *)block->pdata;
+
+  bolt_holes->offset.origin[0] = block->offset->origin[0];
+  bolt_holes->offset.origin[1] = block->offset->origin[1];
+  bolt_holes->offset.rotation = block->offset->rotation;
+  bolt_holes->offset.side = -1.0;
+  bolt_holes->offset.tool = 0.0;
+
+  gcode_extrusion_evaluate_offset (block->extruder, z, &bolt_holes->offset.eval);
+
+  error = 0;
+
+  for (index_block = block->listhead; index_block; index_block = index_block->next)
+  {
+    array = realloc (*outline_array, (*outline_num + 1) * sizeof (gcode_block_t *));
+
+    if (!array)
+    {
+      error = 1;
+      break;
+    }
+
+    *outline_array = array;
+
+    gcode_util_get_sublist_snapshot (&offset_block, index_block, index_block);
+    gcode_util_convert_to_no_offset (offset_block);
+
+    array[(*outline_num)++] = offset_block;
+  }
+
+  bolt_holes->offset.side = 0.0;
+  bolt_holes->offset.tool = 0.0;
+  bolt_holes->offset.eval = 0.0;
+
+  return (error);
+}
+
 void
 gcode_bolt_holes_save (gcode_block_t *block, FILE *fh)
 {
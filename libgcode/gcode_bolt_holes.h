@@ -63,6 +63,7 @@ void gcode_bolt_holes_free (gcode_block_t **block);
 void gcode_bolt_holes_save (gcode_block_t *block, FILE *fh);
 void gcode_bolt_holes_load (gcode_block_t *block, FILE *fh);
 void gcode_bolt_holes_make (gcode_block_t *block);
+int gcode_bolt_holes_outline (gcode_block_t *block, gfloat_t z, gcode_block_t ***outline_array, int *outline_num);
 void gcode_bolt_holes_draw (gcode_block_t *block, gcode_block_t *selected);
 void gcode_bolt_holes_aabb (gcode_block_t *block, gcode_vec2d_t min, gcode_vec2d_t max);
 void gcode_bolt_holes_move (gcode_block_t *block, gcode_vec2d_t delta);
@@ -46,6 +46,7 @@ gcode_code_init (gcode_block_t **block, gcode_t *gcode, gcode_block_t *parent)
 void
 gcode_code_free (gcode_block_t **block)
 {
+  gcode_ir_free (&(*block)->ir);
   free (*block);
   *block = NULL;
 }
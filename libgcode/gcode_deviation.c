@@ -0,0 +1,755 @@
+/**
+ *  gcode_deviation.c
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gcode_deviation.h"
+#include "gcode_sketch.h"
+#include "gcode_bolt_holes.h"
+#include "gcode_extrusion.h"
+#include "gcode_tool.h"
+#include "gcode.h"
+#include <string.h>
+
+#define GCODE_DEVIATION_FAR  1e20                                               /* Squared distance standing for "no such voxel in the slice" */
+
+#define BRICK_INDEX(_map, _bx, _by, _bz) \
+        (((_by) * (_map)->brick_number[0] + (_bx)) * (_map)->brick_number[2] + (_bz))
+
+/**
+ * A sketch or a set of bolt holes taking part in the comparison, with what it
+ * is meant to remove from the slice it was last asked about; a feature only ever
+ * changes from slice to slice through its profile offset and taper, so 'removed'
+ * gets reused as long as those stay the same (all the way down for plain walls).
+ */
+
+typedef int gcode_deviation_outline_t (gcode_block_t *block, gfloat_t z, gcode_block_t ***outline_array, int *outline_num);
+
+typedef struct gcode_deviation_feature_s
+{
+  gcode_block_t *block;
+  gcode_deviation_outline_t *outline;
+  gcode_vec2d_t taper_offset;
+  uint8_t cut_side;
+  uint8_t whole;                                                                // Pocketed: all of the inside goes, not just what's within reach of the wall;
+  gfloat_t diameter;
+  gfloat_t z0, z1;
+  gfloat_t z1_offset;                                                           // Profile offset at the bottom (outward tapers pocket out to that);
+  int kmin, kmax;                                                               // Slices the feature cuts into: kmin <= k < kmax;
+  gfloat_t key[3];                                                              // Profile offset, taper fraction and reach 'removed' was made for;
+  uint8_t *removed;
+} gcode_deviation_feature_t;
+
+typedef struct gcode_deviation_slice_s
+{
+  int n[2];
+  gfloat_t pitch[2];
+  gfloat_t origin[2];
+  uint8_t *inside;                                                              // Scratch for rasterizing one outline;
+  uint8_t *removed;                                                             // What the design removes from the current slice;
+  uint8_t *previous;                                                            // What it removed when the distance fields were last computed;
+  float *to_kept;                                                               // Squared distance to the nearest voxel the design keeps,
+  float *to_removed;                                                            // and to the nearest one it removes;
+  float *field;                                                                 // Scratch for the reach of wall-following cuts;
+  float *f;                                                                     // Scratch of the one dimensional transform;
+  int *v;
+  gfloat_t *z;
+} gcode_deviation_slice_t;
+
+/**
+ * Squared Euclidean distance transform of 'n' samples 'pitch' apart and 'stride'
+ * apart in 'data', in place: every sample becomes the smallest of f(q) + (pitch
+ * * (p - q))^2 over all q. That is the lower envelope of one parabola rooted at
+ * each sample (Felzenszwalb & Huttenlocher), built in a single sweep and read
+ * back in another, so the cost is linear in 'n' whatever the data looks like.
+ */
+
+static void
+gcode_deviation_transform_line (gcode_deviation_slice_t *slice, float *data, size_t stride, int n, gfloat_t pitch)
+{
+  float *f;
+  int *v;
+  gfloat_t *z;
+  gfloat_t s, pp;
+  int q, k;
+
+  f = slice->f;
+  v = slice->v;
+  z = slice->z;
+
+  pp = pitch * pitch;
+
+  for (q = 0; q < n; q++)
+    f[q] = data[q * stride];
+
+  k = 0;
+  v[0] = 0;
+  z[0] = -HUGE_VAL;
+  z[1] = HUGE_VAL;
+
+  for (q = 1; q < n; q++)
+  {
+    s = ((f[q] + pp * q * q) - (f[v[k]] + pp * v[k] * v[k])) / (2.0 * pp * (q - v[k]));       // Where the parabola of 'q' overtakes the last one on the envelope;
+
+    while (s <= z[k])                                                           // If that is before the last one even took over, it is hidden for good;
+    {
+      k--;
+      s = ((f[q] + pp * q * q) - (f[v[k]] + pp * v[k] * v[k])) / (2.0 * pp * (q - v[k]));
+    }
+
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = HUGE_VAL;
+  }
+
+  k = 0;
+
+  for (q = 0; q < n; q++)
+  {
+    while (z[k + 1] < q)
+      k++;
+
+    data[q * stride] = pp * (q - v[k]) * (q - v[k]) + f[v[k]];
+  }
+}
+
+/**
+ * Squared distance from every voxel of the slice to the nearest one where the
+ * field was 0 (the others come in as GCODE_DEVIATION_FAR): rows, then columns.
+ */
+
+static void
+gcode_deviation_transform (gcode_deviation_slice_t *slice, float *field)
+{
+  int i, j;
+
+  for (j = 0; j < slice->n[1]; j++)
+    gcode_deviation_transform_line (slice, &field[(size_t)j * slice->n[0]], 1, slice->n[0], slice->pitch[0]);
+
+  for (i = 0; i < slice->n[0]; i++)
+    gcode_deviation_transform_line (slice, &field[i], slice->n[0], slice->n[1], slice->pitch[1]);
+}
+
+/**
+ * Rasterize the inside of a closed outline into 'slice->inside' row by row: the
+ * outline is crossed at the height of each row of voxel centres by evaluating
+ * all of its primitives, and the spans between every other pair of crossings
+ * are filled in. Rows are nudged up by a hair so they never pass through a
+ * vertex exactly (which would count as one crossing or two depending on the
+ * shape of the corner).
+ */
+
+static int
+gcode_deviation_fill (gcode_deviation_slice_t *slice, gcode_block_t *outline)
+{
+  gcode_block_t *index_block;
+  gfloat_t *x_array, y;
+  uint32_t x_index, i, count;
+  int j, x0, x1, x;
+
+  count = 0;
+
+  for (index_block = outline; index_block; index_block = index_block->next)
+    count++;
+
+  x_array = malloc ((2 * count + 2) * sizeof (gfloat_t));                       // Every primitive crosses a row at most twice;
+
+  if (!x_array)
+    return (1);
+
+  memset (slice->inside, 0, (size_t)slice->n[0] * slice->n[1]);
+
+  for (j = 0; j < slice->n[1]; j++)
+  {
+    y = j * slice->pitch[1] - slice->origin[1] + 2.0 * GCODE_PRECISION;
+
+    x_index = 0;
+
+    for (index_block = outline; index_block; index_block = index_block->next)
+      index_block->eval (index_block, y, x_array, &x_index);
+
+    qsort (x_array, x_index, sizeof (gfloat_t), gcode_util_qsort_compare_asc);
+
+    for (i = 0; i + 1 < x_index; i += 2)
+    {
+      x0 = (int)ceil ((x_array[i] + slice->origin[0]) / slice->pitch[0]);
+      x1 = (int)floor ((x_array[i + 1] + slice->origin[0]) / slice->pitch[0]);
+
+      if (x0 < 0)
+        x0 = 0;
+
+      if (x1 >= slice->n[0])
+        x1 = slice->n[0] - 1;
+
+      for (x = x0; x <= x1; x++)
+        slice->inside[(size_t)j * slice->n[0] + x] = 1;
+    }
+  }
+
+  free (x_array);
+
+  return (0);
+}
+
+/**
+ * Work out what 'feature' is meant to remove from the slice at depth 'z': all of
+ * the inside of its outlines if it is pocketed, otherwise whatever lies within
+ * the reach of the tool on the cut side of each outline (an outside profile is
+ * not meant to flatten the rest of the stock, nor is a plain inside contour
+ * meant to take out the island it leaves behind).
+ */
+
+static int
+gcode_deviation_feature_slice (gcode_deviation_slice_t *slice, gcode_deviation_feature_t *feature, gfloat_t z)
+{
+  gcode_block_t **outline;
+  gfloat_t offset, taper, reach;
+  size_t i, size;
+  int o, outline_num, error;
+  uint8_t wanted;
+
+  gcode_extrusion_evaluate_offset (feature->block->extruder, z, &offset);
+
+  if (((fabs (feature->taper_offset[0]) > GCODE_PRECISION) ||
+       (fabs (feature->taper_offset[1]) > GCODE_PRECISION)) && (feature->z0 - feature->z1 > GCODE_PRECISION))
+    taper = (feature->z0 - z) / (feature->z0 - feature->z1);
+  else
+    taper = 0.0;
+
+  reach = feature->diameter + fabs (feature->z1_offset - offset) + 0.25 * (slice->pitch[0] + slice->pitch[1]);
+
+  if ((feature->key[0] == offset) && (feature->key[1] == taper) && (feature->key[2] == reach))
+    return (0);
+
+  size = (size_t)slice->n[0] * slice->n[1];
+
+  memset (feature->removed, 0, size);
+
+  if (feature->outline (feature->block, z, &outline, &outline_num))
+    return (1);
+
+  error = 0;
+
+  wanted = (feature->cut_side == GCODE_EXTRUSION_INSIDE) ? 1 : 0;                // Which side of the wall the cut is on;
+
+  for (o = 0; o < outline_num; o++)
+  {
+    if (!error)
+      error = gcode_deviation_fill (slice, outline[o]);
+
+    if (!error)
+    {
+      if (feature->whole)
+      {
+        for (i = 0; i < size; i++)
+          feature->removed[i] |= slice->inside[i];
+      }
+      else
+      {
+        for (i = 0; i < size; i++)
+          slice->field[i] = (slice->inside[i] == wanted) ? GCODE_DEVIATION_FAR : 0.0;
+
+        gcode_deviation_transform (slice, slice->field);
+
+        for (i = 0; i < size; i++)
+          if ((slice->inside[i] == wanted) && (slice->field[i] <= reach * reach))
+            feature->removed[i] = 1;
+      }
+    }
+
+    free (outline[o]->offset);
+    gcode_list_free (&outline[o]);
+  }
+
+  free (outline);
+
+  if (error)
+    return (1);
+
+  feature->key[0] = offset;
+  feature->key[1] = taper;
+  feature->key[2] = reach;
+
+  return (0);
+}
+
+/**
+ * Gather every sketch that leaves a wall behind (that is, cuts inside or outside
+ * its outline, not along it) and every set of bolt holes from the list starting
+ * with 'block', descending into templates; suppressed blocks don't cut anything.
+ */
+
+static int
+gcode_deviation_collect (gcode_t *gcode, gcode_block_t *block, gcode_deviation_feature_t **feature_array, int *feature_num)
+{
+  gcode_deviation_feature_t *feature;
+  gcode_extrusion_t *extrusion;
+  gcode_tool_t *tool;
+  gcode_vec2d_t p0, p1;
+  gfloat_t scale, depth;
+
+  scale = (gfloat_t)gcode->voxel_number[2] / gcode->material_size[2];
+
+  depth = gcode->material_size[2] - gcode->material_origin[2];                  // Slices are numbered from the bottom of the material up;
+
+  for (; block; block = block->next)
+  {
+    if (block->flags & GCODE_FLAGS_SUPPRESS)
+      continue;
+
+    if (block->type == GCODE_TYPE_TEMPLATE)
+    {
+      if (gcode_deviation_collect (gcode, block->listhead, feature_array, feature_num))
+        return (1);
+
+      continue;
+    }
+
+    if (((block->type != GCODE_TYPE_SKETCH) && (block->type != GCODE_TYPE_BOLT_HOLES)) || !block->listhead || !block->extruder)
+      continue;
+
+    extrusion = (gcode_extrusion_t *)block->extruder->pdata;
+    tool = gcode_tool_find (block);
+
+    if (!tool)
+      continue;
+
+    if ((block->type == GCODE_TYPE_SKETCH) && (extrusion->cut_side == GCODE_EXTRUSION_ALONG))
+      continue;
+
+    feature = realloc (*feature_array, (*feature_num + 1) * sizeof (gcode_deviation_feature_t));
+
+    if (!feature)
+      return (1);
+
+    *feature_array = feature;
+    feature = &feature[*feature_num];
+
+    feature->removed = malloc ((size_t)gcode->voxel_number[0] * gcode->voxel_number[1]);
+
+    if (!feature->removed)
+      return (1);
+
+    (*feature_num)++;
+
+    feature->block = block;
+    feature->diameter = tool->diameter;
+
+    if (block->type == GCODE_TYPE_SKETCH)
+    {
+      gcode_sketch_t *sketch;
+
+      sketch = (gcode_sketch_t *)block->pdata;
+
+      feature->outline = gcode_sketch_outline;
+      feature->taper_offset[0] = sketch->taper_offset[0];
+      feature->taper_offset[1] = sketch->taper_offset[1];
+      feature->cut_side = extrusion->cut_side;
+      feature->whole = (extrusion->cut_side == GCODE_EXTRUSION_INSIDE) && (sketch->pocket || gcode_extrusion_taper_exists (block->extruder));
+    }
+    else
+    {
+      gcode_bolt_holes_t *bolt_holes;
+
+      bolt_holes = (gcode_bolt_holes_t *)block->pdata;
+
+      feature->outline = gcode_bolt_holes_outline;
+      feature->taper_offset[0] = 0.0;
+      feature->taper_offset[1] = 0.0;
+      feature->cut_side = GCODE_EXTRUSION_INSIDE;                               // Holes are always cut on the inside, and a hole no wider than
+      feature->whole = bolt_holes->pocket || (bolt_holes->hole_diameter <= 2.0 * tool->diameter);       // two tools gets cleared by its contour alone;
+    }
+
+    block->extruder->ends (block->extruder, p0, p1, GCODE_GET);
+
+    feature->z0 = fmax (p0[1], p1[1]);
+    feature->z1 = fmin (p0[1], p1[1]);
+
+    gcode_extrusion_evaluate_offset (block->extruder, feature->z1, &feature->z1_offset);
+
+    feature->kmin = (int)floor (scale * (depth + feature->z1));                 // Same rounding as the simulator clearing a column down to 'z1';
+    feature->kmax = (int)ceil (scale * (depth + feature->z0));
+
+    if (feature->kmin < 0)
+      feature->kmin = 0;
+
+    if (feature->kmax > (int)gcode->voxel_number[2])
+      feature->kmax = gcode->voxel_number[2];
+
+    feature->key[0] = NAN;                                                      // Never matches, so the first slice gets rasterized;
+    feature->key[1] = NAN;
+    feature->key[2] = NAN;
+  }
+
+  return (0);
+}
+
+/**
+ * Whether voxel (x, y, z) of the stock is still there, for either stock model.
+ */
+
+static int
+gcode_deviation_solid (gcode_t *gcode, int x, int y, int z)
+{
+  gfloat_t top;
+
+  if (gcode->stock_model == GCODE_STOCK_HEIGHT)
+  {
+    top = gcode->height_map[(size_t)y * gcode->voxel_number[0] + x];
+
+    return (z < (int)((gfloat_t)gcode->voxel_number[2] / gcode->material_size[2] * (gcode->material_size[2] + top)));
+  }
+
+  return (gcode_voxel_get (gcode, x, y, z));
+}
+
+/**
+ * Voxels on a side wall cut into the stock: solid, with a cleared neighbour in
+ * X or Y. Floors, the top and the untouched sides of the stock are not walls of
+ * any feature.
+ */
+
+static int
+gcode_deviation_wall (gcode_t *gcode, int x, int y, int z)
+{
+  if (!gcode_deviation_solid (gcode, x, y, z))
+    return (0);
+
+  return (((x > 0) && !gcode_deviation_solid (gcode, x - 1, y, z)) ||
+          ((x < (int)gcode->voxel_number[0] - 1) && !gcode_deviation_solid (gcode, x + 1, y, z)) ||
+          ((y > 0) && !gcode_deviation_solid (gcode, x, y - 1, z)) ||
+          ((y < (int)gcode->voxel_number[1] - 1) && !gcode_deviation_solid (gcode, x, y + 1, z)));
+}
+
+static int
+gcode_deviation_put (gcode_deviation_map_t *map, size_t x, size_t y, size_t z, float deviation)
+{
+  uint32_t *id;
+  float *value;
+  uint32_t i;
+
+  id = &map->brick[BRICK_INDEX (map, x >> GCODE_VOXEL_BRICK_BITS, y >> GCODE_VOXEL_BRICK_BITS, z >> GCODE_VOXEL_BRICK_BITS)];
+
+  if (*id == GCODE_DEVIATION_BRICK_NONE)
+  {
+    if (map->brick_used == map->brick_max)
+    {
+      value = realloc (map->value, (size_t)map->brick_max * 2 * GCODE_DEVIATION_BRICK_VOXELS * sizeof (float));
+
+      if (!value)
+        return (1);
+
+      map->value = value;
+      map->brick_max *= 2;
+    }
+
+    *id = map->brick_used++;
+
+    for (i = 0; i < GCODE_DEVIATION_BRICK_VOXELS; i++)
+      map->value[(size_t)*id * GCODE_DEVIATION_BRICK_VOXELS + i] = NAN;
+  }
+
+  map->value[(size_t)*id * GCODE_DEVIATION_BRICK_VOXELS + (((z & 7) << 6) | ((y & 7) << 3) | (x & 7))] = deviation;
+
+  if (map->count == 0)
+  {
+    map->min = deviation;
+    map->max = deviation;
+  }
+  else
+  {
+    map->min = fmin (map->min, deviation);
+    map->max = fmax (map->max, deviation);
+  }
+
+  map->count++;
+
+  return (0);
+}
+
+static void
+gcode_deviation_slice_free (gcode_deviation_slice_t *slice)
+{
+  free (slice->inside);
+  free (slice->removed);
+  free (slice->previous);
+  free (slice->to_kept);
+  free (slice->to_removed);
+  free (slice->field);
+  free (slice->f);
+  free (slice->v);
+  free (slice->z);
+}
+
+/**
+ * Compare the stock left by the last render with what the sketches and bolt
+ * holes describe. The design is taken one slice of voxels at a time: each one
+ * deep enough to reach the slice rasterizes what it is meant to remove (its
+ * outlines at the depth of the slice, taper and profile offset included), and
+ * two distance transforms give every voxel of the slice its distance to the
+ * nearest voxel the design keeps and to the nearest one it removes - linear in
+ * the size of the slice, and redone only when the design changes from one slice
+ * to the next. A voxel on a wall of the stock then simply reads its deviation
+ * from the field of the side it is on.
+ * Returns non-zero if there was nothing to compare or no memory.
+ */
+
+int
+gcode_deviation_build (gcode_t *gcode)
+{
+  gcode_deviation_map_t *map;
+  gcode_deviation_feature_t *feature;
+  gcode_deviation_slice_t slice;
+  gfloat_t scale, z, pitch, d2, deviation;
+  size_t i, size, bricks;
+  int s, feature_num, k, x, y, active, valid, error;
+
+  gcode_deviation_free (gcode);
+
+  if (!gcode->voxel_map && !gcode->height_map)
+  {
+    REMARK ("There is no simulated stock to compare to the design\n");
+    return (1);
+  }
+
+  feature = NULL;
+  feature_num = 0;
+
+  error = gcode_deviation_collect (gcode, gcode->listhead, &feature, &feature_num);
+
+  if (!error && (feature_num == 0))
+  {
+    REMARK ("There are no sketches or holes leaving walls to compare the stock to\n");
+    free (feature);
+    return (1);
+  }
+
+  memset (&slice, 0, sizeof (slice));
+
+  slice.n[0] = gcode->voxel_number[0];
+  slice.n[1] = gcode->voxel_number[1];
+  slice.pitch[0] = gcode->material_size[0] / gcode->voxel_number[0];
+  slice.pitch[1] = gcode->material_size[1] / gcode->voxel_number[1];
+  slice.origin[0] = gcode->material_origin[0];
+  slice.origin[1] = gcode->material_origin[1];
+
+  size = (size_t)slice.n[0] * slice.n[1];
+
+  slice.inside = malloc (size);
+  slice.removed = malloc (size);
+  slice.previous = malloc (size);
+  slice.to_kept = malloc (size * sizeof (float));
+  slice.to_removed = malloc (size * sizeof (float));
+  slice.field = malloc (size * sizeof (float));
+  slice.f = malloc ((slice.n[0] + slice.n[1]) * sizeof (float));
+  slice.v = malloc ((slice.n[0] + slice.n[1]) * sizeof (int));
+  slice.z = malloc ((slice.n[0] + slice.n[1] + 1) * sizeof (gfloat_t));
+
+  map = calloc (1, sizeof (gcode_deviation_map_t));
+
+  if (map)
+  {
+    for (i = 0; i < 3; i++)
+      map->brick_number[i] = ((size_t)gcode->voxel_number[i] + GCODE_VOXEL_BRICK_SIZE - 1) >> GCODE_VOXEL_BRICK_BITS;
+
+    bricks = map->brick_number[0] * map->brick_number[1] * map->brick_number[2];
+
+    map->brick = malloc (bricks * sizeof (uint32_t));
+    map->brick_max = 64;
+    map->value = malloc ((size_t)map->brick_max * GCODE_DEVIATION_BRICK_VOXELS * sizeof (float));
+
+    if (map->brick)
+      for (i = 0; i < bricks; i++)
+        map->brick[i] = GCODE_DEVIATION_BRICK_NONE;
+  }
+
+  if (!slice.inside || !slice.removed || !slice.previous || !slice.to_kept || !slice.to_removed ||
+      !slice.field || !slice.f || !slice.v || !slice.z || !map || !map->brick || !map->value)
+    error = 1;
+
+  if (!error)
+  {
+    map->band = 0.0;
+
+    for (s = 0; s < feature_num; s++)
+      map->band = fmax (map->band, feature[s].diameter);
+  }
+
+  scale = (gfloat_t)gcode->voxel_number[2] / gcode->material_size[2];
+  pitch = fmax (slice.pitch[0], slice.pitch[1]);
+
+  valid = 0;
+
+  for (k = 0; !error && (k < (int)gcode->voxel_number[2]); k++)
+  {
+    if (gcode->progress_callback)
+      gcode->progress_callback (gcode->gui, (gfloat_t)(k + 1) / (gfloat_t)gcode->voxel_number[2]);
+
+    z = (k + 0.5) / scale - gcode->material_size[2] + gcode->material_origin[2]; // Middle of the slice in program coordinates;
+
+    memset (slice.removed, 0, size);
+
+    active = 0;
+
+    for (s = 0; s < feature_num; s++)
+    {
+      if ((k < feature[s].kmin) || (k >= feature[s].kmax))
+        continue;
+
+      if (gcode_deviation_feature_slice (&slice, &feature[s], fmax (feature[s].z1, fmin (feature[s].z0, z))))
+      {
+        error = 1;
+        break;
+      }
+
+      for (i = 0; i < size; i++)
+      {
+        slice.removed[i] |= feature[s].removed[i];
+        active |= feature[s].removed[i];
+      }
+    }
+
+    if (error || !active)                                                       // Nothing in this slice is meant to go, so it has no walls to check;
+      continue;
+
+    if (!valid || memcmp (slice.removed, slice.previous, size))
+    {
+      for (i = 0; i < size; i++)
+      {
+        slice.to_kept[i] = slice.removed[i] ? GCODE_DEVIATION_FAR : 0.0;
+        slice.to_removed[i] = slice.removed[i] ? 0.0 : GCODE_DEVIATION_FAR;
+      }
+
+      gcode_deviation_transform (&slice, slice.to_kept);
+      gcode_deviation_transform (&slice, slice.to_removed);
+
+      memcpy (slice.previous, slice.removed, size);
+      valid = 1;
+    }
+
+    for (y = 0; !error && (y < slice.n[1]); y++)
+    {
+      for (x = 0; x < slice.n[0]; x++)
+      {
+        if (!gcode_deviation_wall (gcode, x, y, k))
+          continue;
+
+        i = (size_t)y * slice.n[0] + x;
+
+        d2 = slice.removed[i] ? slice.to_kept[i] : slice.to_removed[i];         // Distance to the nearest voxel on the other side of the design wall;
+
+        if (d2 >= GCODE_DEVIATION_FAR * 0.5)
+          continue;
+
+        if (slice.removed[i])                                                   // Left standing: as far out as the nearest voxel the design keeps;
+          deviation = sqrt (d2);
+        else                                                                    // Cut away: the last voxel kept against the wall is right on it;
+          deviation = fmin (0.0, pitch - sqrt (d2));
+
+        if (fabs (deviation) > map->band)                                       // Too far from any wall of the design to be one of its walls;
+          continue;
+
+        if (gcode_deviation_put (map, x, y, k, (float)deviation))
+        {
+          error = 1;
+          break;
+        }
+      }
+    }
+  }
+
+  if (gcode->progress_callback)
+    gcode->progress_callback (gcode->gui, 0.0);
+
+  for (s = 0; s < feature_num; s++)
+    free (feature[s].removed);
+
+  free (feature);
+
+  gcode_deviation_slice_free (&slice);
+
+  if (error)
+  {
+    REMARK ("Failed to allocate memory for the deviation analysis\n");
+
+    if (map)
+    {
+      free (map->brick);
+      free (map->value);
+      free (map);
+    }
+
+    return (1);
+  }
+
+  gcode->deviation_map = map;
+
+  return (0);
+}
+
+void
+gcode_deviation_free (gcode_t *gcode)
+{
+  gcode_deviation_map_t *map;
+
+  map = gcode->deviation_map;
+
+  if (!map)
+    return;
+
+  free (map->brick);
+  free (map->value);
+  free (map);
+
+  gcode->deviation_map = NULL;
+}
+
+/**
+ * Look up the deviation of voxel (x, y, z); returns zero if it has none (not a
+ * wall, or too far from the design for the two to be compared).
+ */
+
+int
+gcode_deviation_get (gcode_t *gcode, size_t x, size_t y, size_t z, gfloat_t *deviation)
+{
+  gcode_deviation_map_t *map;
+  uint32_t id;
+  float value;
+
+  map = gcode->deviation_map;
+
+  if (!map)
+    return (0);
+
+  id = map->brick[BRICK_INDEX (map, x >> GCODE_VOXEL_BRICK_BITS, y >> GCODE_VOXEL_BRICK_BITS, z >> GCODE_VOXEL_BRICK_BITS)];
+
+  if (id == GCODE_DEVIATION_BRICK_NONE)
+    return (0);
+
+  value = map->value[(size_t)id * GCODE_DEVIATION_BRICK_VOXELS + (((z & 7) << 6) | ((y & 7) << 3) | (x & 7))];
+
+  if (isnan (value))
+    return (0);
+
+  *deviation = value;
+
+  return (1);
+}
@@ -0,0 +1,58 @@
+/**
+ *  gcode_deviation.h
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GCODE_DEVIATION_H
+#define _GCODE_DEVIATION_H
+
+#include "gcode_internal.h"
+#include "gcode_voxel.h"
+
+/**
+ * Deviation of the simulated stock from the design: every voxel on a side wall
+ * of the stock near a wall some sketch is meant to leave gets the signed
+ * distance between the two - positive where material was left standing past
+ * the design (undercut), negative where the cut went into it (gouge). Values
+ * are kept in bricks laid out like those of the voxel map, and only bricks that
+ * hold at least one value get any storage.
+ */
+
+#define GCODE_DEVIATION_BRICK_NONE    0xFFFFFFFF
+#define GCODE_DEVIATION_BRICK_VOXELS  (GCODE_VOXEL_BRICK_SIZE * GCODE_VOXEL_BRICK_SIZE * GCODE_VOXEL_BRICK_SIZE)
+
+typedef struct gcode_deviation_map_s
+{
+  size_t brick_number[3];                                                       /* bricks along each axis, same as the voxel map */
+  uint32_t *brick;                                                              /* NONE or the index of a brick of values; Z runs fastest */
+  float *value;                                                                 /* 512 values per brick, NAN for voxels without one */
+  uint32_t brick_used;
+  uint32_t brick_max;
+  gfloat_t band;                                                                /* walls further than this from the design are not compared */
+  gfloat_t min;                                                                 /* extremes of the deviations found */
+  gfloat_t max;
+  size_t count;                                                                 /* voxels that got a deviation */
+} gcode_deviation_map_t;
+
+int gcode_deviation_build (gcode_t *gcode);
+void gcode_deviation_free (gcode_t *gcode);
+int gcode_deviation_get (gcode_t *gcode, size_t x, size_t y, size_t z, gfloat_t *deviation);
+
+#endif
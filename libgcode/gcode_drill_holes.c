@@ -91,7 +91,7 @@ gcode_drill_holes_free (gcode_block_t **block)
     tmp->free (&tmp);
   }
 
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
@@ -62,7 +62,7 @@ gcode_end_init (gcode_block_t **block, gcode_t *gcode, gcode_block_t *parent)
 void
 gcode_end_free (gcode_block_t **block)
 {
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
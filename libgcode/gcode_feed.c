@@ -0,0 +1,472 @@
+/**
+ *  gcode_feed.c
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gcode_feed.h"
+#include "gcode_tool.h"
+#include "gcode_sim.h"
+#include "gcode_post.h"
+#include "gcode.h"
+#include <string.h>
+#include <libgen.h>
+
+#define GCODE_FEED_MOVE_NONE    0x00                                            /* No move, or a rapid one */
+#define GCODE_FEED_MOVE_SIDE    0x01                                            /* Feed move cutting sideways (ramps included) */
+#define GCODE_FEED_MOVE_PLUNGE  0x02                                            /* Feed move going mostly straight down */
+#define GCODE_FEED_MOVE_KEEP    0x03                                            /* Feed move left at its own feed (canned cycles) */
+
+/**
+ * What a line of the program does, as far as its feed is concerned: how long
+ * the path of its move is, how much material the move removed and the feed it
+ * runs at as programmed and as adapted.
+ */
+
+typedef struct gcode_feed_move_s
+{
+  gcode_tool_t *tool;                                                           /* tool in charge of the line, NULL if none yet */
+  gfloat_t length;
+  gfloat_t volume;
+  gfloat_t feed;
+  gfloat_t adapted;
+  uint8_t kind;
+} gcode_feed_move_t;
+
+/**
+ * Removal rate each tool is held to: the heaviest one the program asks of it
+ */
+
+typedef struct gcode_feed_target_s
+{
+  gcode_tool_t *tool;
+  gfloat_t rate;
+} gcode_feed_target_t;
+
+typedef struct gcode_feed_s
+{
+  gcode_t *gcode;
+  gcode_sim_t sim;                                                              /* dry simulator following the code */
+  gcode_feed_move_t *move;                                                      /* one per line of the program */
+  uint32_t move_num;
+  uint32_t line;                                                                /* line being looked at */
+  gcode_ir_t out;                                                               /* toolpath of the program with the adapted feeds */
+  gfloat_t feed;                                                                /* feed in effect in the output so far, 0 if none */
+  gfloat_t saved;                                                               /* minutes saved by the adapted feeds */
+} gcode_feed_t;
+
+/**
+ * First pass: follow the code of a line with the dry simulator and note what
+ * its move (if any) is like and how much the render saw it remove.
+ */
+
+static void
+gcode_feed_follow (void *data, gcode_block_t *block, gcode_sim_line_t *line)
+{
+  gcode_feed_t *feed;
+  gcode_feed_move_t *move;
+  gfloat_t distance, drop;
+
+  feed = (gcode_feed_t *)data;
+
+  if (feed->line >= feed->move_num)
+    return;
+
+  move = &feed->move[feed->line];
+
+  distance = feed->sim.distance;
+  drop = feed->sim.pos[2];
+
+  gcode_sim_line (feed->gcode, &feed->sim, line);
+
+  move->tool = gcode_tool_find (block);
+  move->length = feed->sim.distance - distance;
+  move->volume = gcode_sim_log_volume (feed->gcode, feed->line);
+  move->feed = feed->sim.feed;
+  move->adapted = feed->sim.feed;
+  move->kind = GCODE_FEED_MOVE_NONE;
+
+  drop -= feed->sim.pos[2];
+
+  if ((move->length > GCODE_PRECISION) && (feed->sim.mode != 0) && !feed->sim.inverse_time && (move->feed > GCODE_PRECISION))
+  {
+    if ((feed->sim.mode > 3) || !move->tool)
+      move->kind = GCODE_FEED_MOVE_KEEP;
+    else if ((drop > 0.0) && (2.0 * drop * drop > move->length * move->length)) // Down at more than 45 degrees;
+      move->kind = GCODE_FEED_MOVE_PLUNGE;
+    else
+      move->kind = GCODE_FEED_MOVE_SIDE;
+  }
+
+  feed->line++;
+}
+
+/**
+ * Work out the feed every move gets: moves that cut nothing (or next to
+ * nothing) run at the feed of the tool; moves cutting sideways run as fast as
+ * they can without removing material faster than the heaviest cut the program
+ * makes with the same tool (at its own feed), and never faster than the feed
+ * of the tool; plunges that cut are never sped up, as what limits them is how
+ * the chips get out of the hole rather than the removal rate.
+ */
+
+static int
+gcode_feed_adapt (gcode_feed_t *feed)
+{
+  gcode_feed_target_t *target;
+  gcode_feed_move_t *move;
+  uint32_t target_num, i, t;
+  gfloat_t cap, rate, air;
+
+  target = NULL;
+  target_num = 0;
+
+  /* A couple of voxels is as good as nothing: no more than what grazing a wall leaves behind */
+  air = 2.0 * (feed->gcode->material_size[0] / feed->gcode->voxel_number[0]) *
+              (feed->gcode->material_size[1] / feed->gcode->voxel_number[1]) *
+              (feed->gcode->material_size[2] / feed->gcode->voxel_number[2]);
+
+  for (i = 0; i < feed->move_num; i++)
+  {
+    move = &feed->move[i];
+
+    if (move->kind == GCODE_FEED_MOVE_NONE || move->kind == GCODE_FEED_MOVE_KEEP)
+      continue;
+
+    t = 0;
+
+    while ((t < target_num) && (target[t].tool != move->tool))
+      t++;
+
+    if (t == target_num)
+    {
+      target = realloc (target, (target_num + 1) * sizeof (gcode_feed_target_t));
+
+      if (!target)
+      {
+        REMARK ("Failed to allocate memory for adaptive feed targets\n");
+        return (1);
+      }
+
+      target[t].tool = move->tool;
+      target[t].rate = 0.0;
+      target_num++;
+    }
+
+    if ((move->kind == GCODE_FEED_MOVE_SIDE) && (move->volume > air))
+    {
+      rate = move->volume / move->length * fmin (move->feed, move->tool->feed);
+
+      if (rate > target[t].rate)
+        target[t].rate = rate;
+    }
+  }
+
+  for (i = 0; i < feed->move_num; i++)
+  {
+    move = &feed->move[i];
+
+    if (move->kind == GCODE_FEED_MOVE_NONE || move->kind == GCODE_FEED_MOVE_KEEP)
+      continue;
+
+    t = 0;
+
+    while (target[t].tool != move->tool)
+      t++;
+
+    cap = move->tool->feed;
+
+    if (move->volume <= air)
+      move->adapted = cap;
+    else if (move->kind == GCODE_FEED_MOVE_PLUNGE)
+      move->adapted = fmin (move->feed, cap);
+    else
+      move->adapted = fmin (cap, target[t].rate * move->length / move->volume);
+  }
+
+  free (target);
+
+  return (0);
+}
+
+/**
+ * Copy op 'index' of 'ir' over to the output, with an F word of 'value' if
+ * 'words' has one (in place of the one the op has, if any).
+ */
+
+static void
+gcode_feed_copy (gcode_feed_t *feed, gcode_ir_t *ir, uint32_t index, uint8_t words, gfloat_t value)
+{
+  gcode_ir_op_t *op;
+  gfloat_t *op_value;
+  int w;
+
+  op = &ir->op[index];
+
+  if (op->type == GCODE_IR_TEXT)
+  {
+    gcode_ir_text (&feed->out, &ir->text[op->arg]);
+    return;
+  }
+
+  if (op->type == GCODE_IR_COMMENT)
+  {
+    if (op->flags & GCODE_IR_HEADER)
+      gcode_ir_header (&feed->out, &ir->text[op->arg]);
+    else
+      gcode_ir_comment (&feed->out, &ir->text[op->arg]);
+
+    return;
+  }
+
+  op_value = &ir->value[op->arg];
+
+  gcode_ir_op (&feed->out, op->type, op->flags);
+
+  if ((op->type == GCODE_IR_SPEED) || (op->type == GCODE_IR_TOOL_CHANGE))
+    gcode_ir_word (&feed->out, GCODE_IR_VALUE, *op_value++);
+
+  for (w = 0; w < 8; w++)
+  {
+    if (op->words & (1 << w))
+      gcode_ir_word (&feed->out, 1 << w, (words & (1 << w)) ? value : *op_value);
+    else if (words & (1 << w))
+      gcode_ir_word (&feed->out, 1 << w, value);
+
+    if (op->words & (1 << w))
+      op_value++;
+  }
+}
+
+/**
+ * Second pass: copy the ops [begin, end) of 'ir' that make up a line of the
+ * program ('line', as read) over to the output with the feed its move is to
+ * run at; a move gets an F word of its own only if the feed in effect differs
+ * from the adapted one by more than the hysteresis (and never if that would
+ * make it faster than adapted). Moves left at their own feed get it back if an
+ * adapted move before them changed it. Lines whose move or F word is in text
+ * rather than in ops are left as they are.
+ */
+
+static void
+gcode_feed_write (gcode_feed_t *feed, gcode_ir_t *ir, gcode_sim_line_t *line, uint32_t begin, uint32_t end)
+{
+  gcode_feed_move_t *move;
+  gcode_ir_op_t *op;
+  gfloat_t want, have, given;
+  uint32_t i, target;
+  int has;
+
+  move = feed->line < feed->move_num ? &feed->move[feed->line] : NULL;
+  feed->line++;
+
+  has = 0;
+  given = 0.0;
+
+  for (i = 0; i < line->word_num; i++)
+  {
+    if (line->letter[i] == 'F')
+    {
+      has = 1;
+      given = line->value[i];
+    }
+  }
+
+  /* The op to carry the F word: the one that has it, or else the last with any words */
+  target = end;
+
+  for (i = begin; i < end; i++)
+  {
+    op = &ir->op[i];
+
+    if ((op->type == GCODE_IR_TEXT) || (op->type == GCODE_IR_COMMENT) || (op->type == GCODE_IR_SPEED) || (op->type == GCODE_IR_TOOL_CHANGE))
+      continue;
+
+    if ((target == end) || !(ir->op[target].words & GCODE_IR_F))
+      target = i;
+  }
+
+  if (!move || (move->kind == GCODE_FEED_MOVE_NONE) || (target == end) || (has && !(ir->op[target].words & GCODE_IR_F)))
+  {
+    if (has)
+      feed->feed = given;
+
+    for (i = begin; i < end; i++)
+      gcode_feed_copy (feed, ir, i, 0, 0.0);
+
+    return;
+  }
+
+  want = move->kind == GCODE_FEED_MOVE_KEEP ? move->feed : move->adapted;
+  have = feed->feed;
+
+  if (move->kind != GCODE_FEED_MOVE_KEEP)
+  {
+    if ((have > want) || (have < (1.0 - GCODE_FEED_HYSTERESIS) * want))
+      have = want;
+
+    feed->saved += move->length / move->feed - move->length / have;
+  }
+  else
+  {
+    have = want;
+  }
+
+  for (i = begin; i < end; i++)                                                 // Put the feed in place of the one on the line, or add one;
+    gcode_feed_copy (feed, ir, i, (i == target) && (has || (fabs (have - feed->feed) > GCODE_PRECISION)) ? GCODE_IR_F : 0, have);
+
+  feed->feed = have;
+}
+
+/**
+ * Export the program to 'filename' with feeds adapted to how much material
+ * each move removes (see gcode_feed_adapt); the program gets rendered first,
+ * as the removal log of the render is what tells the volumes. 'time_before'
+ * and 'time_after' get the estimated build time (seconds) with the feeds as
+ * programmed and as adapted. Returns non-zero on failure.
+ */
+
+int
+gcode_feed_export (gcode_t *gcode, char *filename, gfloat_t *time_before, gfloat_t *time_after)
+{
+  gcode_feed_t feed;
+  gcode_block_t *index_block;
+  gcode_sim_reader_t reader;
+  gcode_ir_t program;
+  FILE *fh;
+  char *code;
+  size_t code_size;
+  uint32_t begin, end;
+  int read;
+
+  *time_before = 0.0;
+  *time_after = 0.0;
+
+  gcode_export_prep (gcode);
+  gcode_render_final (gcode, time_before);
+
+  *time_after = *time_before;
+
+  if (!gcode->removal_log || (gcode->removal_log->line_num == 0))
+  {
+    REMARK ("No removal log to adapt the feed rates by\n");
+    return (1);
+  }
+
+  feed.gcode = gcode;
+  feed.move_num = gcode->removal_log->line_num;
+  feed.move = calloc (feed.move_num, sizeof (gcode_feed_move_t));               // Lines the walk doesn't get to stay as they are;
+
+  if (!feed.move)
+  {
+    REMARK ("Failed to allocate memory for adaptive feed rates\n");
+    return (1);
+  }
+
+  gcode_sim_init (&feed.sim, gcode);
+  feed.sim.dry = 1;
+
+  feed.line = 0;
+  gcode_sim_walk (gcode, &feed, gcode_feed_follow);
+
+  gcode_sim_free (&feed.sim);
+
+  if (gcode_feed_adapt (&feed))
+  {
+    free (feed.move);
+    return (1);
+  }
+
+  /* The toolpath of the whole program, for its lines to be read off in one go */
+  gcode_ir_init (&program);
+
+  for (index_block = gcode->listhead; index_block; index_block = index_block->next)
+    gcode_ir_append (&program, &index_block->ir);
+
+  if (program.failed)
+  {
+    gcode_ir_free (&program);
+    free (feed.move);
+    return (1);
+  }
+
+  gcode_ir_init (&feed.out);
+
+  feed.line = 0;
+  feed.feed = 0.0;
+  feed.saved = 0.0;
+
+  /**
+   * Every line read takes the ops the reader went past along; a text op holding
+   * more than one line goes with the first of them.
+   */
+  gcode_sim_reader_init (&reader);
+  gcode_sim_reader_start (&reader, &program);
+
+  begin = 0;
+
+  do
+  {
+    read = gcode_sim_read (gcode, &reader);
+    end = reader.offset ? reader.op + 1 : reader.op;
+
+    if (read || reader.pending)                                                 // A last line without a newline too;
+      gcode_feed_write (&feed, &program, &reader.line, begin, end);
+
+    begin = end;
+  }
+  while (read);
+
+  gcode_ir_free (&program);
+
+  free (feed.move);
+
+  gcode_post_compact (gcode, &feed.out);                                        // Edits each op where it is, so the lines stay in step with the removal log;
+
+  code = feed.out.failed ? NULL : gcode_ir_format (gcode, &feed.out, &code_size);
+
+  gcode_ir_free (&feed.out);
+
+  if (!code)
+    return (1);
+
+  if (gcode->compact_output)                                                    // Empty lines and spaces ending lines as gcode_export () leaves them;
+    gcode_util_filter_blanks (code);
+  else
+    gcode_util_filter_newlines (code);
+
+  fh = fopen (filename, "w");
+
+  if (!fh)
+  {
+    REMARK ("Failed to open file '%s'\n", basename (filename));
+    free (code);
+    return (1);
+  }
+
+  fwrite (code, 1, strlen (code), fh);
+
+  fclose (fh);
+
+  free (code);
+
+  *time_after = *time_before - 60.0 * feed.saved;
+
+  return (0);
+}
@@ -0,0 +1,39 @@
+/**
+ *  gcode_feed.h
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GCODE_FEED_H
+#define _GCODE_FEED_H
+
+#include "gcode_internal.h"
+
+/**
+ * Feed rates adapted to engagement: every feed move of the program gets its
+ * feed set from how much material the simulation saw it remove, so that the
+ * removal rate of each tool stays near the heaviest one the program already
+ * asks of it, without ever going past the feed the tool is set up for.
+ */
+
+#define GCODE_FEED_HYSTERESIS   0.05                                            /* Feed changes smaller than this (relative) are not worth a new F word */
+
+int gcode_feed_export (gcode_t *gcode, char *filename, gfloat_t *time_before, gfloat_t *time_after);
+
+#endif
@@ -77,7 +77,7 @@ gcode_image_free (gcode_block_t **block)
 
   free (image->dmap);
 
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
@@ -44,7 +44,8 @@ gcode_internal_init (gcode_block_t *block, gcode_t *gcode, gcode_block_t *parent
   block->offref = NULL;
   block->offset = NULL;
   block->pdata = NULL;
-  block->code = NULL;
+  gcode_ir_init (&block->ir);
+  block->sink = &block->ir;
 
   block->free = NULL;
   block->save = NULL;
@@ -62,62 +63,40 @@ gcode_internal_init (gcode_block_t *block, gcode_t *gcode, gcode_block_t *parent
   block->clone = NULL;
 }
 
-static void
-format_z (char *format, char **format2, unsigned int number)
-{
-  unsigned int i, j, s;
-
-  if (number > 9)
-    return;
+/**
+ * Write 'format' to 'target' with every "%z" in it replaced by the next value
+ * (a double) of the arguments, with 'number' decimals, and "%%" by '%'; other
+ * characters are copied as they are. Numbers are written by gcode_ir_number,
+ * so nothing gets allocated and the locale plays no part.
+ */
 
-  s = strlen (format) + 1;
-  *format2 = malloc (2 * s);
-  memcpy (*format2, format, s);
+void
+gsprintf (char *target, unsigned int number, char *format, ...)
+{
+  va_list arglist;
+  char *sp;
 
-  j = 0;
+  va_start (arglist, format);
 
-  for (i = 0; i < s - 1; i++)
+  for (sp = format; *sp; sp++)
   {
-    if (format[i] == '%' && format[i + 1] == 'z')
+    if ((sp[0] == '%') && (sp[1] == 'z'))
     {
-      /* copy % */
-      (*format2)[j] = format[i];
-      j++;
-      i += 1;
-
-      (*format2)[j] = '.';
-      j++;
-
-      sprintf (&(*format2)[j], "%d", number);
-      j++;
-
-      (*format2)[j] = 'f';
-      j++;
+      target += gcode_ir_number (target, va_arg (arglist, double), number);
+      sp++;
+    }
+    else if ((sp[0] == '%') && (sp[1] == '%'))
+    {
+      *target++ = '%';
+      sp++;
     }
     else
     {
-      (*format2)[j] = format[i];
-      j++;
+      *target++ = *sp;
     }
   }
 
-  (*format2)[j] = 0;
-}
-
-void
-gsprintf (char *target, unsigned int number, char *format, ...)
-{
-  va_list arglist;
-  char *format2;
-
-  va_start (arglist, format);
-
-  format2 = NULL;
-
-  format_z (format, &format2, number);
-  vsprintf (target, format2, arglist);
-
-  free (format2);
+  *target = '\0';
 
   va_end (arglist);
 }
@@ -31,6 +31,7 @@
 #include <stdbool.h>
 #include <inttypes.h>
 #include "gcode_math.h"
+#include "gcode_ir.h"
 
 #define NONE              0
 
@@ -90,6 +91,9 @@
 #define GCODE_POCKETING_TRADITIONAL   0x00
 #define GCODE_POCKETING_ALTERNATE_1   0x01
 
+#define GCODE_STOCK_VOXEL             0x00
+#define GCODE_STOCK_HEIGHT            0x01
+
 /* *INDENT-OFF* */
 
 enum
@@ -243,6 +247,8 @@ typedef void gcode_clone_t (struct gcode_block_s **block, struct gcode_s *gcode,
 
 typedef void gcode_progress_callback_t (void *gui, gfloat_t progress);
 typedef void gcode_message_callback_t (void *gui, char *message);
+typedef void gcode_preview_callback_t (void *gui);
+typedef void gcode_stream_callback_t (void *gui);
 
 /**
  * Type definitions for commonly used structs
@@ -281,9 +287,8 @@ typedef struct gcode_block_s
 
   void *pdata;
 
-  int code_alloc;
-  int code_len;
-  char *code;
+  gcode_ir_t ir;                                                                /* toolpath made of the block, written out as G-code on export */
+  gcode_ir_t *sink;                                                             /* toolpath its make function writes to: 'ir', or that of a parent */
 
   gcode_free_t *free;
   gcode_save_t *save;
@@ -319,12 +324,30 @@ typedef struct gcode_s
 
   gcode_progress_callback_t *progress_callback;
   gcode_message_callback_t *message_callback;
+  gcode_preview_callback_t *preview_callback;                                   // Shows the stock left by a coarse pass of the simulation
+  gcode_stream_callback_t *stream_callback;                                     // Shows the stock as the simulation cuts it, tile by tile
 
   gcode_offset_t zero_offset;
 
-  uint16_t voxel_resolution;
-  uint16_t voxel_number[3];
-  uint8_t *voxel_map;
+  uint32_t voxel_resolution;
+  uint32_t voxel_number[3];
+  struct gcode_voxel_map_s *voxel_map;                                          // Only ever accessed through the 'gcode_voxel_xxx' functions
+  uint32_t voxel_memory;                                                        // Megabytes a voxel map may take in memory before going to a file (0 = no limit)
+
+  uint8_t stock_model;                                                          // Full voxel map or top surface height field
+  float *height_map;                                                            // One top surface height per XY column (height field model only)
+  int simulation_threads;                                                       // Workers applying motions to the stock (0 = one per processor)
+  struct gcode_sim_checkpoint_s *checkpoint;                                    // Stock and simulator state at each top level block of the last render
+  uint32_t checkpoint_num;
+  uint8_t simulation_levels;                                                    // Coarse to fine passes of a full render, halving the resolution per level
+  uint8_t simulation_level;                                                     // Pass being simulated (1 = coarsest), 0 while not rendering
+  uint8_t simulation_stop;                                                      // Raised to stop a render; a progressive one falls back on its last full pass
+  struct gcode_sim_dirty_s *dirty_tiles;                                        // Tiles of the stock changed since the viewer last looked (streaming only)
+  struct gcode_sim_log_s *removal_log;                                          // Voxels cleared by each line of the last render, for scrubbing through it
+  struct gcode_deviation_map_s *deviation_map;                                  // Signed distance of the walls of the stock from the design, if compared
+  struct gcode_stock_start_s *starting_stock;                                   // Stock left by an earlier setup to render from, NULL for a whole block
+  uint8_t collect_stats;                                                        // Count what each line of the program costs the simulation on renders
+  struct gcode_stats_s *line_stats;                                             // What it cost on the last render, if counted
 
   gfloat_t tool_xpos;
   gfloat_t tool_ypos;
@@ -341,6 +364,10 @@ typedef struct gcode_s
   uint8_t pocketing_style;
 
   uint32_t decimals;                                                            // Number of decimal places to print
+  uint8_t optimize_output;                                                      // Leave words in effect already and moves going nowhere out on export
+  gfloat_t arc_tolerance;                                                       // How far arcs put in place of runs of feed moves may stray (inches), 0 for none
+  uint8_t compact_output;                                                       // Export without comments (but headers), spaces or trailing zeros
+  gfloat_t machine_resolution[3];                                               // Smallest step of each axis of the machine (inches), 0 if not known
 
   uint32_t project_number;                                                      // For Haas Machines only
 } gcode_t;
@@ -393,76 +420,66 @@ void strswp (char *target, char oldchar, char newchar);
         EQUIV_UNITS(_gcode->units, _num)
 
 #define GCODE_INIT(_block) { \
-        _block->code = NULL; }
+        gcode_ir_init (&_block->ir); \
+        _block->sink = &_block->ir; }
 
 #define GCODE_CLEAR(_block) { \
-        _block->code_len = 1; \
-        _block->code_alloc = 1; \
-        _block->code = realloc (_block->code, _block->code_alloc); \
-        _block->code[0] = '\0'; }
+        gcode_ir_clear (&_block->ir); }
+
+/**
+ * Make 'child' straight into the toolpath 'block' writes to, so that the code
+ * of the child goes in place rather than into a toolpath of its own only to be
+ * copied over; the child is left writing to its own toolpath (empty) after.
+ */
+
+#define GCODE_MAKE_INTO(_block, _child) { \
+        _child->sink = _block->sink; \
+        _child->make (_child); \
+        _child->sink = &_child->ir; }
 
 /**
- * increase by 64kB + string length + 1 if request to append greater than current buffer size.
- * includes optimized manual strcat code to vastly improve performance for large strings.
+ * The macros below append ops to the toolpath the block writes to (see
+ * gcode_ir.h) rather than text: anything without an op of its own goes in as
+ * text.
  */
 
 #define GCODE_APPEND(_block, _str) { \
-        int _slen = strlen (_str) + 1, _i; \
-        if (_block->code_len + _slen > _block->code_alloc) \
-        { \
-          _block->code_alloc +=  (1 << 16) + _slen; \
-          _block->code = realloc (_block->code, _block->code_alloc); \
-        } \
-        for (_i = 0; _i < _slen; _i++) \
-          _block->code[_block->code_len + _i - 1] = _str[_i]; \
-        _block->code_len += _slen - 1; }
+        gcode_ir_text (_block->sink, _str); }
 
 #define GCODE_NEWLINE(_block) { \
         GCODE_APPEND (_block, "\n"); }
 
 #define GCODE_PADDING(_block, _comment) { \
         if (*_comment) \
-          GCODE_APPEND (_block, " "); }
+          gcode_ir_space (_block->sink); }
 
 #define GCODE_COMMENT(_block, _comment) { \
-        char _buffer[256]; \
-        char _string[256]; \
-        if (*_comment) \
-        { \
-          strncpy (_buffer, _comment, 200); \
-          _buffer[200] = '\0'; \
-          strswp (_buffer, '(', '['); \
-          strswp (_buffer, ')', ']'); \
-          if (_block->gcode->driver == GCODE_DRIVER_TURBOCNC) \
-            sprintf (_string, "; %s\n", _buffer); \
-          else \
-            sprintf (_string, "(%s)\n", _buffer); \
-        } \
-        else \
-        { \
-          sprintf (_string, "\n"); \
-        } \
-        GCODE_APPEND (_block, _string); }
+        gcode_ir_comment (_block->sink, _comment); }
+
+#define GCODE_HEADER(_block, _comment) { \
+        gcode_ir_header (_block->sink, _comment); }
 
 #define GCODE_COMMAND(_block, _command, _comment) { \
-        char _string[256]; \
-        sprintf (_string, "%s ", _command); \
-        GCODE_APPEND (_block, _string); \
+        GCODE_APPEND (_block, _command); \
+        GCODE_APPEND (_block, " "); \
+        GCODE_COMMENT (_block, _comment); }
+
+#define GCODE_TOOL_CHANGE(_block, _number, _comment) { \
+        gcode_ir_op (_block->sink, GCODE_IR_TOOL_CHANGE, GCODE_IR_SPACE); \
+        gcode_ir_word (_block->sink, GCODE_IR_VALUE, _number); \
         GCODE_COMMENT (_block, _comment); }
 
 /* Feed and speed macros */
 
 #define GCODE_F_VALUE(_block, _feed, _comment) { \
-        char _string[256]; \
-        sprintf (_string, "F%.3f", _feed); \
-        GCODE_APPEND (_block, _string); \
+        gcode_ir_op (_block->sink, GCODE_IR_WORDS, 0); \
+        gcode_ir_word (_block->sink, GCODE_IR_F, _feed); \
         GCODE_PADDING (_block, _comment); \
         GCODE_COMMENT (_block, _comment); }
 
 #define GCODE_S_VALUE(_block, _speed, _comment) { \
-        char _string[256]; \
-        sprintf (_string, "S%d", _speed); \
-        GCODE_APPEND (_block, _string); \
+        gcode_ir_op (_block->sink, GCODE_IR_SPEED, 0); \
+        gcode_ir_word (_block->sink, GCODE_IR_VALUE, _speed); \
         GCODE_PADDING (_block, _comment); \
         GCODE_COMMENT (_block, _comment); }
 
@@ -472,12 +489,12 @@ void strswp (char *target, char oldchar, char newchar);
         gfloat_t _z = _block->gcode->material_origin[2] + _depth; \
         if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_zpos, _z)) \
         { \
-          char _string[256]; \
-          gsprintf (_string, _block->gcode->decimals, "G01 Z%z F%.3f ", _z, _tool->feed * _tool->plunge_ratio); \
-          GCODE_APPEND (_block, _string); \
+          gcode_ir_op (_block->sink, GCODE_IR_LINE, GCODE_IR_SPACE); \
+          gcode_ir_word (_block->sink, GCODE_IR_Z, _z); \
+          gcode_ir_word (_block->sink, GCODE_IR_F, _tool->feed * _tool->plunge_ratio); \
           GCODE_COMMENT (_block, "slow plunge"); \
-          sprintf (_string, "F%.3f ", _tool->feed); \
-          GCODE_APPEND (_block, _string); \
+          gcode_ir_op (_block->sink, GCODE_IR_WORDS, GCODE_IR_SPACE); \
+          gcode_ir_word (_block->sink, GCODE_IR_F, _tool->feed); \
           GCODE_COMMENT (_block, "restore feed rate"); \
           _block->gcode->tool_zpos = _z; \
         }}
@@ -486,9 +503,8 @@ void strswp (char *target, char oldchar, char newchar);
         gfloat_t _z = _block->gcode->material_origin[2] + _depth; \
         if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_zpos, _z)) \
         { \
-          char _string[256]; \
-          gsprintf (_string, _block->gcode->decimals, "G00 Z%z ", _z); \
-          GCODE_APPEND (_block, _string); \
+          gcode_ir_op (_block->sink, GCODE_IR_RAPID, GCODE_IR_SPACE); \
+          gcode_ir_word (_block->sink, GCODE_IR_Z, _z); \
           GCODE_COMMENT (_block, "fast plunge"); \
           _block->gcode->tool_zpos = _z; \
         }}
@@ -497,9 +513,8 @@ void strswp (char *target, char oldchar, char newchar);
         gfloat_t _z = _block->gcode->material_origin[2] + _depth; \
         if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_zpos, _z)) \
         { \
-          char _string[256]; \
-          gsprintf (_string, _block->gcode->decimals, "G00 Z%z ", _z); \
-          GCODE_APPEND (_block, _string); \
+          gcode_ir_op (_block->sink, GCODE_IR_RAPID, GCODE_IR_SPACE); \
+          gcode_ir_word (_block->sink, GCODE_IR_Z, _z); \
           GCODE_COMMENT (_block, "retract"); \
           _block->gcode->tool_zpos = _z; \
         }}
@@ -507,9 +522,8 @@ void strswp (char *target, char oldchar, char newchar);
 #define GCODE_PULL_UP(_block, _depth) { \
         if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_zpos, _depth)) \
         { \
-          char _string[256]; \
-          gsprintf (_string, _block->gcode->decimals, "G00 Z%z ", _depth); \
-          GCODE_APPEND (_block, _string); \
+          gcode_ir_op (_block->sink, GCODE_IR_RAPID, GCODE_IR_SPACE); \
+          gcode_ir_word (_block->sink, GCODE_IR_Z, _depth); \
           GCODE_COMMENT (_block, "retract"); \
           _block->gcode->tool_zpos = _depth; \
         }}
@@ -517,9 +531,9 @@ void strswp (char *target, char oldchar, char newchar);
 /* Line and arc movement macros */
 
 #define GCODE_XY_PAIR(_block, _x, _y, _comment) { \
-        char _string[256]; \
-        gsprintf (_string, _block->gcode->decimals, "X%z Y%z", _x, _y); \
-        GCODE_APPEND (_block, _string); \
+        gcode_ir_op (_block->sink, GCODE_IR_WORDS, 0); \
+        gcode_ir_word (_block->sink, GCODE_IR_X, _x); \
+        gcode_ir_word (_block->sink, GCODE_IR_Y, _y); \
         GCODE_PADDING (_block, _comment); \
         GCODE_COMMENT (_block, _comment); \
         _block->gcode->tool_xpos = _x; \
@@ -529,18 +543,11 @@ void strswp (char *target, char oldchar, char newchar);
         if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_xpos, _x) || \
             !GCODE_MATH_IS_EQUAL (_block->gcode->tool_ypos, _y)) \
         { \
-          char _string[256]; \
-          GCODE_APPEND (_block, "G00"); \
+          gcode_ir_op (_block->sink, GCODE_IR_RAPID, 0); \
           if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_xpos, _x)) \
-          { \
-            gsprintf (_string, _block->gcode->decimals, " X%z", _x); \
-            GCODE_APPEND (_block, _string); \
-          } \
+            gcode_ir_word (_block->sink, GCODE_IR_X, _x); \
           if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_ypos, _y)) \
-          { \
-            gsprintf (_string, _block->gcode->decimals, " Y%z", _y); \
-            GCODE_APPEND (_block, _string); \
-          } \
+            gcode_ir_word (_block->sink, GCODE_IR_Y, _y); \
           GCODE_PADDING (_block, _comment); \
           GCODE_COMMENT (_block, _comment); \
           _block->gcode->tool_xpos = _x; \
@@ -551,18 +558,11 @@ void strswp (char *target, char oldchar, char newchar);
         if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_xpos, _x) || \
             !GCODE_MATH_IS_EQUAL (_block->gcode->tool_ypos, _y)) \
         { \
-          char _string[256]; \
-          GCODE_APPEND (_block, "G01"); \
+          gcode_ir_op (_block->sink, GCODE_IR_LINE, 0); \
           if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_xpos, _x)) \
-          { \
-            gsprintf (_string, _block->gcode->decimals, " X%z", _x); \
-            GCODE_APPEND (_block, _string); \
-          } \
+            gcode_ir_word (_block->sink, GCODE_IR_X, _x); \
           if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_ypos, _y)) \
-          { \
-            gsprintf (_string, _block->gcode->decimals, " Y%z", _y); \
-            GCODE_APPEND (_block, _string); \
-          } \
+            gcode_ir_word (_block->sink, GCODE_IR_Y, _y); \
           GCODE_PADDING (_block, _comment); \
           GCODE_COMMENT (_block, _comment); \
           _block->gcode->tool_xpos = _x; \
@@ -574,23 +574,13 @@ void strswp (char *target, char oldchar, char newchar);
             !GCODE_MATH_IS_EQUAL (_block->gcode->tool_ypos, _y) || \
             !GCODE_MATH_IS_EQUAL (_block->gcode->tool_zpos, _z)) \
         { \
-          char _string[256]; \
-          GCODE_APPEND (_block, "G01"); \
+          gcode_ir_op (_block->sink, GCODE_IR_LINE, 0); \
           if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_xpos, _x)) \
-          { \
-            gsprintf (_string, _block->gcode->decimals, " X%z", _x); \
-            GCODE_APPEND (_block, _string); \
-          } \
+            gcode_ir_word (_block->sink, GCODE_IR_X, _x); \
           if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_ypos, _y)) \
-          { \
-            gsprintf (_string, _block->gcode->decimals, " Y%z", _y); \
-            GCODE_APPEND (_block, _string); \
-          } \
+            gcode_ir_word (_block->sink, GCODE_IR_Y, _y); \
           if (!GCODE_MATH_IS_EQUAL (_block->gcode->tool_zpos, _z)) \
-          { \
-            gsprintf (_string, _block->gcode->decimals, " Z%z", _z); \
-            GCODE_APPEND (_block, _string); \
-          } \
+            gcode_ir_word (_block->sink, GCODE_IR_Z, _z); \
           GCODE_PADDING (_block, _comment); \
           GCODE_COMMENT (_block, _comment); \
           _block->gcode->tool_xpos = _x; \
@@ -599,34 +589,44 @@ void strswp (char *target, char oldchar, char newchar);
         }}
 
 #define GCODE_2D_ARC_CW(_block, _x, _y, _i, _j, _comment) { \
-        char _string[256]; \
-        gsprintf (_string, _block->gcode->decimals, "G02 X%z Y%z I%z J%z ", _x, _y, _i, _j); \
-        GCODE_APPEND (_block, _string); \
+        gcode_ir_op (_block->sink, GCODE_IR_ARC_CW, GCODE_IR_SPACE); \
+        gcode_ir_word (_block->sink, GCODE_IR_X, _x); \
+        gcode_ir_word (_block->sink, GCODE_IR_Y, _y); \
+        gcode_ir_word (_block->sink, GCODE_IR_I, _i); \
+        gcode_ir_word (_block->sink, GCODE_IR_J, _j); \
         GCODE_COMMENT (_block, _comment); \
         _block->gcode->tool_xpos = _x; \
         _block->gcode->tool_ypos = _y; }
 
 #define GCODE_3D_ARC_CW(_block, _x, _y, _z, _i, _j, _comment) { \
-        char _string[256]; \
-        gsprintf (_string, _block->gcode->decimals, "G02 X%z Y%z Z%z I%z J%z ", _x, _y, _z, _i, _j); \
-        GCODE_APPEND (_block, _string); \
+        gcode_ir_op (_block->sink, GCODE_IR_ARC_CW, GCODE_IR_SPACE); \
+        gcode_ir_word (_block->sink, GCODE_IR_X, _x); \
+        gcode_ir_word (_block->sink, GCODE_IR_Y, _y); \
+        gcode_ir_word (_block->sink, GCODE_IR_Z, _z); \
+        gcode_ir_word (_block->sink, GCODE_IR_I, _i); \
+        gcode_ir_word (_block->sink, GCODE_IR_J, _j); \
         GCODE_COMMENT (_block, _comment); \
         _block->gcode->tool_xpos = _x; \
         _block->gcode->tool_ypos = _y; \
         _block->gcode->tool_zpos = _z; }
 
 #define GCODE_2D_ARC_CCW(_block, _x, _y, _i, _j, _comment) { \
-        char _string[256]; \
-        gsprintf (_string, _block->gcode->decimals, "G03 X%z Y%z I%z J%z ", _x, _y, _i, _j); \
-        GCODE_APPEND (_block, _string); \
+        gcode_ir_op (_block->sink, GCODE_IR_ARC_CCW, GCODE_IR_SPACE); \
+        gcode_ir_word (_block->sink, GCODE_IR_X, _x); \
+        gcode_ir_word (_block->sink, GCODE_IR_Y, _y); \
+        gcode_ir_word (_block->sink, GCODE_IR_I, _i); \
+        gcode_ir_word (_block->sink, GCODE_IR_J, _j); \
         GCODE_COMMENT (_block, _comment); \
         _block->gcode->tool_xpos = _x; \
         _block->gcode->tool_ypos = _y; }
 
 #define GCODE_3D_ARC_CCW(_block, _x, _y, _z, _i, _j, _comment) { \
-        char _string[256]; \
-        gsprintf (_string, _block->gcode->decimals, "G03 X%z Y%z Z%z I%z J%z ", _x, _y, _z, _i, _j); \
-        GCODE_APPEND (_block, _string); \
+        gcode_ir_op (_block->sink, GCODE_IR_ARC_CCW, GCODE_IR_SPACE); \
+        gcode_ir_word (_block->sink, GCODE_IR_X, _x); \
+        gcode_ir_word (_block->sink, GCODE_IR_Y, _y); \
+        gcode_ir_word (_block->sink, GCODE_IR_Z, _z); \
+        gcode_ir_word (_block->sink, GCODE_IR_I, _i); \
+        gcode_ir_word (_block->sink, GCODE_IR_J, _j); \
         GCODE_COMMENT (_block, _comment); \
         _block->gcode->tool_xpos = _x; \
         _block->gcode->tool_ypos = _y; \
@@ -635,23 +635,25 @@ void strswp (char *target, char oldchar, char newchar);
 /* Canned cycle macros */
 
 #define GCODE_DRILL(_block, _z, _f, _r) { \
-        char _string[256]; \
-        gsprintf (_string, _block->gcode->decimals, "G81 Z%z F%.3f R%z ", _z, _f, _r); \
-        GCODE_APPEND (_block, _string); \
+        gcode_ir_op (_block->sink, GCODE_IR_DRILL, GCODE_IR_SPACE); \
+        gcode_ir_word (_block->sink, GCODE_IR_Z, _z); \
+        gcode_ir_word (_block->sink, GCODE_IR_F, _f); \
+        gcode_ir_word (_block->sink, GCODE_IR_R, _r); \
         _block->gcode->tool_zpos = FLT_MAX; }
 
 #define GCODE_PECK_DRILL(_block, _z, _f, _r, _q) { \
-        char _string[256]; \
-        gsprintf (_string, _block->gcode->decimals, "G83 Z%z F%.3f R%z Q%z ", _z, _f, _r, _q); \
-        GCODE_APPEND (_block, _string); \
+        gcode_ir_op (_block->sink, GCODE_IR_PECK_DRILL, GCODE_IR_SPACE); \
+        gcode_ir_word (_block->sink, GCODE_IR_Z, _z); \
+        gcode_ir_word (_block->sink, GCODE_IR_F, _f); \
+        gcode_ir_word (_block->sink, GCODE_IR_R, _r); \
+        gcode_ir_word (_block->sink, GCODE_IR_Q, _q); \
         _block->gcode->tool_zpos = FLT_MAX; }
 
 /* Other command macros */
 
 #define GCODE_GO_HOME(_block, _depth) { \
-        char _string[256]; \
-        gsprintf (_string, _block->gcode->decimals, "G28 Z%z ", (_block->gcode->material_origin[2] + _depth)); \
-        GCODE_APPEND (_block, _string); \
+        gcode_ir_op (_block->sink, GCODE_IR_HOME, GCODE_IR_SPACE); \
+        gcode_ir_word (_block->sink, GCODE_IR_Z, _block->gcode->material_origin[2] + _depth); \
         GCODE_COMMENT (_block, "return to home"); \
         _block->gcode->tool_xpos = FLT_MAX; \
         _block->gcode->tool_ypos = FLT_MAX; \
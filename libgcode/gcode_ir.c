@@ -0,0 +1,703 @@
+/**
+ *  gcode_ir.c
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gcode_ir.h"
+#include "gcode_internal.h"
+#include "gcode_util.h"
+#include <math.h>
+
+#define GCODE_IR_OP_SIZE  512                                                   /* Longest an op other than text can get once written */
+
+static const double gcode_ir_power[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+
+void
+gcode_ir_init (gcode_ir_t *ir)
+{
+  ir->op = NULL;
+  ir->value = NULL;
+  ir->text = NULL;
+  ir->op_num = 0;
+  ir->op_max = 0;
+  ir->value_num = 0;
+  ir->value_max = 0;
+  ir->text_len = 0;
+  ir->text_max = 0;
+  ir->failed = 0;
+}
+
+/**
+ * Empty 'ir' for the block to be made anew; the memory stays for reuse
+ */
+
+void
+gcode_ir_clear (gcode_ir_t *ir)
+{
+  ir->op_num = 0;
+  ir->value_num = 0;
+  ir->text_len = 0;
+  ir->failed = 0;
+}
+
+void
+gcode_ir_free (gcode_ir_t *ir)
+{
+  free (ir->op);
+  free (ir->value);
+  free (ir->text);
+
+  gcode_ir_init (ir);
+}
+
+/**
+ * Number of values 'op' has
+ */
+
+static uint32_t
+gcode_ir_values (gcode_ir_op_t *op)
+{
+  uint32_t count;
+  uint8_t words;
+
+  if ((op->type == GCODE_IR_SPEED) || (op->type == GCODE_IR_TOOL_CHANGE))
+    return (1);
+
+  for (count = 0, words = op->words; words; words &= words - 1)
+    count++;
+
+  return (count);
+}
+
+/**
+ * Make room for 'ops' more ops, 'values' more values and 'chars' more
+ * characters of text; growth is geometric, so appending stays cheap however
+ * long the toolpath gets. Returns non-zero (and marks 'ir' as failed) if
+ * there is no memory for it.
+ */
+
+static int
+gcode_ir_reserve (gcode_ir_t *ir, uint32_t ops, uint32_t values, uint32_t chars)
+{
+  gcode_ir_op_t *op;
+  gfloat_t *value;
+  char *text;
+  uint32_t max;
+
+  if (ir->failed)
+    return (1);
+
+  if (ir->op_num + ops > ir->op_max)
+  {
+    max = 2 * ir->op_max > ir->op_num + ops + 64 ? 2 * ir->op_max : ir->op_num + ops + 64;
+    op = realloc (ir->op, max * sizeof (gcode_ir_op_t));
+
+    if (!op)
+      goto fail;
+
+    ir->op = op;
+    ir->op_max = max;
+  }
+
+  if (ir->value_num + values > ir->value_max)
+  {
+    max = 2 * ir->value_max > ir->value_num + values + 256 ? 2 * ir->value_max : ir->value_num + values + 256;
+    value = realloc (ir->value, max * sizeof (gfloat_t));
+
+    if (!value)
+      goto fail;
+
+    ir->value = value;
+    ir->value_max = max;
+  }
+
+  if (ir->text_len + chars > ir->text_max)
+  {
+    max = 2 * ir->text_max > ir->text_len + chars + 1024 ? 2 * ir->text_max : ir->text_len + chars + 1024;
+    text = realloc (ir->text, max);
+
+    if (!text)
+      goto fail;
+
+    ir->text = text;
+    ir->text_max = max;
+  }
+
+  return (0);
+
+fail:
+
+  REMARK ("Failed to allocate memory for the toolpath of a block\n");
+  ir->failed = 1;
+
+  return (1);
+}
+
+/**
+ * Append an op of 'type' whose text is the 'len' characters at 'text'; text
+ * following text just gets added to it.
+ */
+
+static void
+gcode_ir_add_text (gcode_ir_t *ir, uint8_t type, const char *text, size_t len)
+{
+  gcode_ir_op_t *op;
+
+  if (gcode_ir_reserve (ir, 1, 0, len + 1))
+    return;
+
+  if ((type == GCODE_IR_TEXT) && ir->op_num && (ir->op[ir->op_num - 1].type == GCODE_IR_TEXT))
+  {
+    ir->text_len--;                                                             // The text of the last op is the last in the pool;
+  }
+  else
+  {
+    op = &ir->op[ir->op_num++];
+
+    op->type = type;
+    op->words = 0;
+    op->flags = 0;
+    op->arg = ir->text_len;
+  }
+
+  memcpy (&ir->text[ir->text_len], text, len);
+  ir->text_len += len;
+  ir->text[ir->text_len++] = '\0';
+}
+
+/**
+ * Append 'text' as it is
+ */
+
+void
+gcode_ir_text (gcode_ir_t *ir, const char *text)
+{
+  size_t len;
+
+  len = strlen (text);
+
+  if (len)
+    gcode_ir_add_text (ir, GCODE_IR_TEXT, text, len);
+}
+
+/**
+ * End the line with 'comment' (none if it is empty); the comment gets cut short
+ * and has its parentheses turned into brackets, so that it cannot end early.
+ */
+
+void
+gcode_ir_comment (gcode_ir_t *ir, const char *comment)
+{
+  char buffer[GCODE_IR_COMMENT_MAX + 1];
+
+  strncpy (buffer, comment, GCODE_IR_COMMENT_MAX);
+  buffer[GCODE_IR_COMMENT_MAX] = '\0';
+
+  strswp (buffer, '(', '[');
+  strswp (buffer, ')', ']');
+
+  gcode_ir_add_text (ir, GCODE_IR_COMMENT, buffer, strlen (buffer));
+}
+
+/**
+ * End the line with 'comment' as above, marked as part of a header: the lines
+ * describing the program and its tools, that even compact output keeps.
+ */
+
+void
+gcode_ir_header (gcode_ir_t *ir, const char *comment)
+{
+  gcode_ir_comment (ir, comment);
+
+  if (!ir->failed)
+    ir->op[ir->op_num - 1].flags |= GCODE_IR_HEADER;
+}
+
+/**
+ * Append an op of 'type' with no words yet (see gcode_ir_word)
+ */
+
+void
+gcode_ir_op (gcode_ir_t *ir, uint8_t type, uint16_t flags)
+{
+  gcode_ir_op_t *op;
+
+  if (gcode_ir_reserve (ir, 1, 0, 0))
+    return;
+
+  op = &ir->op[ir->op_num++];
+
+  op->type = type;
+  op->words = 0;
+  op->flags = flags;
+  op->arg = ir->value_num;
+}
+
+/**
+ * Give the last op appended a value for 'word'; words have to come in the order
+ * they are written in (that of GCODE_IR_LETTERS).
+ */
+
+void
+gcode_ir_word (gcode_ir_t *ir, uint8_t word, gfloat_t value)
+{
+  if (gcode_ir_reserve (ir, 0, 1, 0))
+    return;
+
+  ir->op[ir->op_num - 1].words |= word;
+  ir->value[ir->value_num++] = value;
+}
+
+/**
+ * Have a space follow the words of the last op appended
+ */
+
+void
+gcode_ir_space (gcode_ir_t *ir)
+{
+  if (!ir->failed && ir->op_num)
+    ir->op[ir->op_num - 1].flags |= GCODE_IR_SPACE;
+}
+
+/**
+ * Append all of 'other' (the toolpath of a child block) to 'ir'
+ */
+
+void
+gcode_ir_append (gcode_ir_t *ir, gcode_ir_t *other)
+{
+  gcode_ir_op_t *op;
+  uint32_t i, count;
+
+  if (other->failed)
+    ir->failed = 1;
+
+  if (gcode_ir_reserve (ir, other->op_num, other->value_num, other->text_len))
+    return;
+
+  for (i = 0; i < other->op_num; i++)
+  {
+    op = &other->op[i];
+
+    if (op->type == GCODE_IR_TEXT)
+    {
+      gcode_ir_text (ir, &other->text[op->arg]);
+    }
+    else if (op->type == GCODE_IR_COMMENT)
+    {
+      gcode_ir_add_text (ir, GCODE_IR_COMMENT, &other->text[op->arg], strlen (&other->text[op->arg]));
+
+      ir->op[ir->op_num - 1].flags = op->flags;
+    }
+    else
+    {
+      count = gcode_ir_values (op);
+
+      ir->op[ir->op_num] = *op;
+      ir->op[ir->op_num].arg = ir->value_num;
+      ir->op_num++;
+
+      memcpy (&ir->value[ir->value_num], &other->value[op->arg], count * sizeof (gfloat_t));
+      ir->value_num += count;
+    }
+  }
+}
+
+/**
+ * Hash of everything in 'ir', to tell whether the toolpath of a block changed
+ */
+
+uint64_t
+gcode_ir_hash (gcode_ir_t *ir)
+{
+  uint64_t hash;
+
+  hash = gcode_util_hash ((const char *)ir->op, ir->op_num * sizeof (gcode_ir_op_t));
+  hash = (hash ^ gcode_util_hash ((const char *)ir->value, ir->value_num * sizeof (gfloat_t))) * 0x100000001b3ULL;
+  hash = (hash ^ gcode_util_hash (ir->text, ir->text_len)) * 0x100000001b3ULL;
+
+  return (hash);
+}
+
+/**
+ * Round 'value' to 'decimals' decimal places the way printf () does: to nearest
+ * (ties to even) from the exact value of the double. The product with the power
+ * of ten is split into a rounded part and the (exact) error of that rounding to
+ * tell where the exact value falls. The magnitude of the result goes to
+ * 'digits', in units of the last decimal; returns non-zero if it has too many
+ * digits to be worked out this way (or 'value' is not a number at all).
+ */
+
+static int
+gcode_ir_round (gfloat_t value, uint32_t decimals, uint64_t *digits)
+{
+  gfloat_t scaled, error, whole, rest;
+
+  scaled = fabs (value) * (decimals < 16 ? gcode_ir_power[decimals] : 0.0);
+
+  if ((decimals >= 16) || !(scaled < 4503599627370496.0))
+    return (1);
+
+  error = fma (fabs (value), gcode_ir_power[decimals], -scaled);
+  whole = floor (scaled);
+  rest = scaled - whole;
+
+  if ((rest > 0.5) || ((rest == 0.5) && ((error > 0.0) || ((error == 0.0) && (fmod (whole, 2.0) != 0.0)))))
+    whole += 1.0;
+
+  *digits = (uint64_t)whole;
+
+  return (0);
+}
+
+/**
+ * The value 'value' reads back as once written with 'decimals' decimal places:
+ * the reader divides the digits it gets by a power of ten, so the same can be
+ * had from the digits alone.
+ */
+
+gfloat_t
+gcode_ir_value (gfloat_t value, uint32_t decimals)
+{
+  char string[GCODE_IR_OP_SIZE], *tail;
+  uint64_t digits;
+  gfloat_t whole;
+
+  if (gcode_ir_round (value, decimals, &digits))
+  {
+    snprintf (string, sizeof (string), "%.*f", (int)decimals, value);
+    return (strtod (string, &tail));
+  }
+
+  whole = (gfloat_t)digits / gcode_ir_power[decimals];
+
+  return (signbit (value) ? -whole : whole);
+}
+
+/**
+ * Write 'value' to 'string' with 'decimals' decimal places, just as "%.*f"
+ * would in the C locale but without going through printf (): the digits come
+ * straight from gcode_ir_round. Returns the length written, terminating null
+ * aside; 'string' has to hold at least GCODE_IR_NUMBER_SIZE characters.
+ */
+
+size_t
+gcode_ir_number (char *string, gfloat_t value, uint32_t decimals)
+{
+  char digit[24];
+  uint64_t digits;
+  size_t len;
+  int count, i;
+
+  if (gcode_ir_round (value, decimals, &digits))                                // Far too big for a coordinate: written as best it fits;
+  {
+    count = snprintf (string, GCODE_IR_NUMBER_SIZE, "%.*f", (int)decimals, value);
+
+    return (count < GCODE_IR_NUMBER_SIZE ? (size_t)count : GCODE_IR_NUMBER_SIZE - 1);
+  }
+
+  count = 0;
+
+  do
+  {
+    digit[count++] = '0' + digits % 10;
+    digits /= 10;
+  }
+  while (digits);
+
+  while (count <= (int)decimals)                                                // At least one digit before the point;
+    digit[count++] = '0';
+
+  len = 0;
+
+  if (signbit (value))                                                          // printf () keeps the sign of what rounds to zero too;
+    string[len++] = '-';
+
+  for (i = count - 1; i >= 0; i--)
+  {
+    string[len++] = digit[i];
+
+    if (i && (i == (int)decimals))
+      string[len++] = '.';
+  }
+
+  string[len] = '\0';
+
+  return (len);
+}
+
+/**
+ * Write the whole number 'value' to 'string' with at least 'width' digits
+ */
+
+static size_t
+gcode_ir_integer (char *string, int value, int width)
+{
+  char digit[16];
+  unsigned int magnitude;
+  size_t len;
+  int count;
+
+  magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+  count = 0;
+
+  do
+  {
+    digit[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  }
+  while (magnitude);
+
+  while (count < width)
+    digit[count++] = '0';
+
+  len = 0;
+
+  if (value < 0)
+    string[len++] = '-';
+
+  while (count)
+    string[len++] = digit[--count];
+
+  string[len] = '\0';
+
+  return (len);
+}
+
+/**
+ * Decimals the X, Y and Z words of compact output get: no more than it takes to
+ * tell apart the smallest steps the axes of the machine make, if known, and no
+ * more than the program has to begin with.
+ */
+
+static void
+gcode_ir_axis_decimals (gcode_t *gcode, uint32_t *decimals)
+{
+  gfloat_t resolution;
+  int a;
+
+  for (a = 0; a < 3; a++)
+  {
+    decimals[a] = gcode->decimals;
+
+    resolution = gcode->machine_resolution[a];
+
+    if (resolution <= 0.0)
+      continue;
+
+    if (gcode->units == GCODE_UNITS_MILLIMETER)
+      resolution *= GCODE_INCH2MM;
+
+    if (resolution >= 1.0)
+      decimals[a] = 0;
+    else if (ceil (-log10 (resolution) - GCODE_PRECISION) < decimals[a])
+      decimals[a] = (uint32_t)ceil (-log10 (resolution) - GCODE_PRECISION);
+  }
+}
+
+/**
+ * Write word 'letter' with 'value' to 'string'; compact words lose the zeros
+ * trailing their decimals (but not the decimal point, for controllers reading
+ * numbers without one as counts of their smallest step) and the sign of zero.
+ */
+
+static size_t
+gcode_ir_format_word (char *string, char letter, uint32_t decimals, gfloat_t value, int compact)
+{
+  size_t len;
+
+  string[0] = letter;
+  len = 1 + gcode_ir_number (&string[1], value, decimals);
+
+  if (!compact || !decimals)
+    return (len);
+
+  while (string[len - 1] == '0')
+    len--;
+
+  if ((len == 4) && (string[1] == '-') && (string[2] == '0'))                   // "-0." is no different from "0.";
+  {
+    string[1] = '0';
+    string[2] = '.';
+    len = 3;
+  }
+
+  string[len] = '\0';
+
+  return (len);
+}
+
+/**
+ * Write op 'index' of 'ir' (other than text) to 'string', which has to hold at
+ * least GCODE_IR_OP_SIZE characters; returns the length written. 'axis' holds
+ * the decimals of the axis words of compact ops.
+ */
+
+static size_t
+gcode_ir_format_op (gcode_t *gcode, gcode_ir_t *ir, uint32_t index, uint32_t *axis, char *string)
+{
+  static const char prefix[][4] = { "", "", "", "G00", "G01", "G02", "G03", "G81", "G83", "G28" };
+  gcode_ir_op_t *op;
+  gfloat_t *value;
+  const char *text;
+  size_t len, size;
+  int w, compact;
+
+  op = &ir->op[index];
+  compact = (op->flags & GCODE_IR_COMPACT) != 0;
+  value = &ir->value[op->arg];
+
+  if (op->type == GCODE_IR_COMMENT)
+  {
+    text = &ir->text[op->arg];
+    len = 0;
+
+    if (*text)
+    {
+      if (gcode->driver == GCODE_DRIVER_TURBOCNC)
+      {
+        memcpy (string, "; ", 2);
+        len = 2;
+      }
+      else
+      {
+        string[len++] = '(';
+      }
+
+      size = strlen (text);                                                     // No longer than GCODE_IR_COMMENT_MAX;
+      memcpy (&string[len], text, size);
+      len += size;
+
+      if (gcode->driver != GCODE_DRIVER_TURBOCNC)
+        string[len++] = ')';
+    }
+
+    string[len++] = '\n';
+    string[len] = '\0';
+
+    return (len);
+  }
+
+  if (op->type == GCODE_IR_SPEED)
+  {
+    string[0] = 'S';
+    len = 1 + gcode_ir_integer (&string[1], (int)value[0], 1);
+  }
+  else if (op->type == GCODE_IR_TOOL_CHANGE)
+  {
+    memcpy (string, compact ? "M06T" : "M06 T", compact ? 4 : 5);
+    len = compact ? 4 : 5;
+    len += gcode_ir_integer (&string[len], (int)value[0], 2);
+  }
+  else if (!(op->flags & GCODE_IR_MODAL))
+  {
+    len = strlen (prefix[op->type]);
+    memcpy (string, prefix[op->type], len);
+  }
+  else
+  {
+    len = 0;
+  }
+
+  for (w = 0; w < 8; w++)
+  {
+    if (!(op->words & (1 << w)))
+      continue;
+
+    if (len && !compact)
+      string[len++] = ' ';
+
+    if ((1 << w) == GCODE_IR_F)
+      len += gcode_ir_format_word (&string[len], 'F', 3, *value++, compact);
+    else if (compact && ((1 << w) & (GCODE_IR_X | GCODE_IR_Y | GCODE_IR_Z)))
+      len += gcode_ir_format_word (&string[len], GCODE_IR_LETTERS[w], axis[w], *value++, compact);
+    else
+      len += gcode_ir_format_word (&string[len], GCODE_IR_LETTERS[w], gcode->decimals, *value++, compact);
+  }
+
+  if (op->flags & GCODE_IR_SPACE)
+    string[len++] = ' ';
+
+  string[len] = '\0';
+
+  return (len);
+}
+
+/**
+ * Write the whole of 'ir' out as G-code text; returns the text (to be freed by
+ * the caller) and its length in 'length', or NULL if there is no memory for it.
+ */
+
+char *
+gcode_ir_format (gcode_t *gcode, gcode_ir_t *ir, size_t *length)
+{
+  char *code, *grown;
+  size_t len, max, need;
+  uint32_t i, axis[3];
+
+  gcode_ir_axis_decimals (gcode, axis);
+
+  max = (size_t)ir->text_len + 64 * (size_t)ir->op_num + GCODE_IR_OP_SIZE;
+  code = malloc (max);
+
+  if (!code)
+  {
+    REMARK ("Failed to allocate memory for G-code text\n");
+    return (NULL);
+  }
+
+  len = 0;
+
+  for (i = 0; i < ir->op_num; i++)
+  {
+    need = ir->op[i].type == GCODE_IR_TEXT ? strlen (&ir->text[ir->op[i].arg]) : GCODE_IR_OP_SIZE;
+
+    if (len + need + 1 > max)
+    {
+      max = 2 * max > len + need + 1 ? 2 * max : len + need + 1;
+      grown = realloc (code, max);
+
+      if (!grown)
+      {
+        REMARK ("Failed to allocate memory for G-code text\n");
+        free (code);
+        return (NULL);
+      }
+
+      code = grown;
+    }
+
+    if (ir->op[i].type == GCODE_IR_TEXT)
+    {
+      memcpy (&code[len], &ir->text[ir->op[i].arg], need);
+      len += need;
+    }
+    else
+    {
+      len += gcode_ir_format_op (gcode, ir, i, axis, &code[len]);
+    }
+  }
+
+  code[len] = '\0';
+  *length = len;
+
+  return (code);
+}
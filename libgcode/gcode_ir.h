@@ -0,0 +1,113 @@
+/**
+ *  gcode_ir.h
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _GCODE_IR_H
+#define _GCODE_IR_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "gcode_math.h"
+
+/**
+ * Toolpath of a block as its make function puts it together: a list of typed
+ * ops (motions, canned cycles, feed, speed and tool change words and the ends
+ * of lines with their comments), the values of their words and the text of the
+ * comments and of anything without an op of its own. G-code text only gets
+ * written from it on export (see gcode_ir_format); the simulator takes the
+ * words of the ops as they are.
+ */
+
+#define GCODE_IR_TEXT           0x00                                            /* Text taken as it is */
+#define GCODE_IR_COMMENT        0x01                                            /* End of a line, with a comment unless it is empty */
+#define GCODE_IR_WORDS          0x02                                            /* Words alone (a position, a feed rate) */
+#define GCODE_IR_RAPID          0x03                                            /* G00 */
+#define GCODE_IR_LINE           0x04                                            /* G01 */
+#define GCODE_IR_ARC_CW         0x05                                            /* G02, with the centre relative to the start */
+#define GCODE_IR_ARC_CCW        0x06                                            /* G03 */
+#define GCODE_IR_DRILL          0x07                                            /* G81 */
+#define GCODE_IR_PECK_DRILL     0x08                                            /* G83 */
+#define GCODE_IR_HOME           0x09                                            /* G28 */
+#define GCODE_IR_SPEED          0x0A                                            /* S word alone */
+#define GCODE_IR_TOOL_CHANGE    0x0B                                            /* M06 with the T word of the tool */
+
+#define GCODE_IR_X              0x01                                            /* Words an op can have, in the order they are written in */
+#define GCODE_IR_Y              0x02
+#define GCODE_IR_Z              0x04
+#define GCODE_IR_I              0x08
+#define GCODE_IR_J              0x10
+#define GCODE_IR_F              0x20                                            /* Always written with 3 decimals */
+#define GCODE_IR_R              0x40
+#define GCODE_IR_Q              0x80
+
+#define GCODE_IR_LETTERS        "XYZIJFRQ"
+
+#define GCODE_IR_VALUE          0x00                                            /* The one value of a speed or tool change op */
+
+#define GCODE_IR_SPACE          0x01                                            /* A space follows the words of the op */
+#define GCODE_IR_MODAL          0x02                                            /* The G word of the op is left out, being in effect already */
+#define GCODE_IR_HEADER         0x04                                            /* The comment heads the program or a tool (kept in compact output) */
+#define GCODE_IR_COMPACT        0x08                                            /* Words written without spaces or trailing zeros (see gcode_post_compact) */
+
+#define GCODE_IR_COMMENT_MAX    200                                             /* Comments get cut short past this many characters */
+#define GCODE_IR_NUMBER_SIZE    64                                              /* Room gcode_ir_number () may need, terminating null included */
+
+typedef struct gcode_ir_op_s
+{
+  uint8_t type;
+  uint8_t words;                                                                /* words the op has a value for (none for text and comments) */
+  uint16_t flags;
+  uint32_t arg;                                                                 /* first value of the op in 'value', or its text in 'text' */
+} gcode_ir_op_t;
+
+typedef struct gcode_ir_s
+{
+  gcode_ir_op_t *op;
+  gfloat_t *value;
+  char *text;                                                                   /* text of every op that has any, each one terminated */
+  uint32_t op_num;
+  uint32_t op_max;
+  uint32_t value_num;
+  uint32_t value_max;
+  uint32_t text_len;
+  uint32_t text_max;
+  uint8_t failed;                                                               /* an op got lost for lack of memory */
+} gcode_ir_t;
+
+struct gcode_s;
+
+void gcode_ir_init (gcode_ir_t *ir);
+void gcode_ir_clear (gcode_ir_t *ir);
+void gcode_ir_free (gcode_ir_t *ir);
+void gcode_ir_text (gcode_ir_t *ir, const char *text);
+void gcode_ir_comment (gcode_ir_t *ir, const char *comment);
+void gcode_ir_header (gcode_ir_t *ir, const char *comment);
+void gcode_ir_op (gcode_ir_t *ir, uint8_t type, uint16_t flags);
+void gcode_ir_word (gcode_ir_t *ir, uint8_t word, gfloat_t value);
+void gcode_ir_space (gcode_ir_t *ir);
+void gcode_ir_append (gcode_ir_t *ir, gcode_ir_t *other);
+uint64_t gcode_ir_hash (gcode_ir_t *ir);
+gfloat_t gcode_ir_value (gfloat_t value, uint32_t decimals);
+size_t gcode_ir_number (char *string, gfloat_t value, uint32_t decimals);
+char *gcode_ir_format (struct gcode_s *gcode, gcode_ir_t *ir, size_t *length);
+
+#endif
@@ -71,7 +71,7 @@ gcode_line_init (gcode_block_t **block, gcode_t *gcode, gcode_block_t *parent)
 void
 gcode_line_free (gcode_block_t **block)
 {
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
@@ -0,0 +1,479 @@
+/**
+ *  gcode_mesh.c
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gcode_mesh.h"
+#include "gcode_voxel.h"
+#include "gcode.h"
+#include <string.h>
+#include <libgen.h>
+#include <pthread.h>
+
+#define GCODE_MESH_TRIANGLE_SIZE  50                                            /* Bytes per triangle in binary STL */
+
+/**
+ * What all workers share: the stock, where in the cell each of the 256 ways the
+ * surface can cut a cell puts its vertex, and how voxel indices map to program
+ * coordinates.
+ */
+
+typedef struct gcode_mesh_s
+{
+  gcode_t *gcode;
+  int number[3];                                                                /* voxels along each axis */
+  gcode_vec3d_t pitch;
+  gcode_vec3d_t offset;                                                         /* program coordinates of voxel centre (-0.5, -0.5, -0.5) */
+  float vertex[256][3];                                                         /* vertex offset within a cell, by which corners are solid */
+} gcode_mesh_t;
+
+/**
+ * A worker and the layer it builds: samples of the three layers of voxels
+ * around it (padded with an empty border) and the triangles it came up with.
+ */
+
+typedef struct gcode_mesh_worker_s
+{
+  gcode_mesh_t *mesh;
+  int layer;                                                                    /* voxel layer (Z index) the quads of this worker start from */
+  uint8_t *sample[3];                                                           /* layers 'layer' - 1 to 'layer' + 1 */
+  char *triangle;                                                               /* binary STL records */
+  size_t triangle_num;
+  size_t triangle_max;
+  uint8_t failed;
+} gcode_mesh_worker_t;
+
+/**
+ * For each way the eight corners of a cell can be solid or empty, the mean of
+ * the midpoints of the cell edges joining a solid corner to an empty one.
+ */
+
+static void
+gcode_mesh_vertex_table (gcode_mesh_t *mesh)
+{
+  int mask, a, b, e, n, i;
+
+  for (mask = 0; mask < 256; mask++)
+  {
+    mesh->vertex[mask][0] = 0.0;
+    mesh->vertex[mask][1] = 0.0;
+    mesh->vertex[mask][2] = 0.0;
+    n = 0;
+
+    for (e = 0; e < 12; e++)                                                    // Corner 'a' and the one one step along axis e / 4 from it;
+    {
+      i = e >> 2;
+      a = ((e & 1) << ((i + 1) % 3)) | (((e >> 1) & 1) << ((i + 2) % 3));
+      b = a | (1 << i);
+
+      if (((mask >> a) & 1) == ((mask >> b) & 1))
+        continue;
+
+      mesh->vertex[mask][0] += i == 0 ? 0.5 : (a & 1);
+      mesh->vertex[mask][1] += i == 1 ? 0.5 : ((a >> 1) & 1);
+      mesh->vertex[mask][2] += i == 2 ? 0.5 : ((a >> 2) & 1);
+      n++;
+    }
+
+    if (n)
+    {
+      mesh->vertex[mask][0] /= n;
+      mesh->vertex[mask][1] /= n;
+      mesh->vertex[mask][2] /= n;
+    }
+  }
+}
+
+/**
+ * Fill 'sample' with which voxels of layer 'z' are solid, one byte each with a
+ * border of empty ones all around; layers outside the stock are all empty.
+ */
+
+static void
+gcode_mesh_load (gcode_mesh_t *mesh, int z, uint8_t *sample)
+{
+  gcode_t *gcode;
+  uint32_t state;
+  gfloat_t scale;
+  int stride, x, y, bx, by, xe, ye;
+
+  gcode = mesh->gcode;
+  stride = mesh->number[0] + 2;
+
+  memset (sample, 0, (size_t)stride * (mesh->number[1] + 2));
+
+  if ((z < 0) || (z >= mesh->number[2]))
+    return;
+
+  if (gcode->stock_model == GCODE_STOCK_HEIGHT)
+  {
+    scale = (gfloat_t)mesh->number[2] / gcode->material_size[2];
+
+    for (y = 0; y < mesh->number[1]; y++)
+      for (x = 0; x < mesh->number[0]; x++)
+        sample[(y + 1) * stride + x + 1] = z < (int)(scale * (gcode->material_size[2] + gcode->height_map[(size_t)y * mesh->number[0] + x]));
+
+    return;
+  }
+
+  /* Bricks all solid or all empty need no looking into */
+  for (by = 0; by * GCODE_VOXEL_BRICK_SIZE < mesh->number[1]; by++)
+  {
+    ye = (by + 1) * GCODE_VOXEL_BRICK_SIZE < mesh->number[1] ? (by + 1) * GCODE_VOXEL_BRICK_SIZE : mesh->number[1];
+
+    for (bx = 0; bx * GCODE_VOXEL_BRICK_SIZE < mesh->number[0]; bx++)
+    {
+      xe = (bx + 1) * GCODE_VOXEL_BRICK_SIZE < mesh->number[0] ? (bx + 1) * GCODE_VOXEL_BRICK_SIZE : mesh->number[0];
+
+      state = gcode_voxel_brick (gcode, bx, by, z >> GCODE_VOXEL_BRICK_BITS);
+
+      if (state == GCODE_VOXEL_BRICK_EMPTY)
+        continue;
+
+      for (y = by * GCODE_VOXEL_BRICK_SIZE; y < ye; y++)
+        for (x = bx * GCODE_VOXEL_BRICK_SIZE; x < xe; x++)
+          sample[(y + 1) * stride + x + 1] = state == GCODE_VOXEL_BRICK_SOLID ? 1 : gcode_voxel_get (gcode, x, y, z);
+    }
+  }
+}
+
+/**
+ * Position (program coordinates) of the vertex of cell (x, y, z) - the cell
+ * whose lowest corner is the centre of voxel (x, y, z) - its corners being
+ * looked up in the samples of the worker.
+ */
+
+static void
+gcode_mesh_cell (gcode_mesh_worker_t *worker, int x, int y, int z, float *vertex)
+{
+  gcode_mesh_t *mesh;
+  uint8_t *lo, *hi;
+  int stride, i, mask;
+
+  mesh = worker->mesh;
+  stride = mesh->number[0] + 2;
+
+  lo = &worker->sample[z - worker->layer + 1][(y + 1) * stride + x + 1];
+  hi = &worker->sample[z - worker->layer + 2][(y + 1) * stride + x + 1];
+
+  /* Corner n of the cell (bit 0 for X, 1 for Y, 2 for Z) is bit n of the mask */
+  mask = lo[0] | (lo[1] << 1) | (lo[stride] << 2) | (lo[stride + 1] << 3) |
+         (hi[0] << 4) | (hi[1] << 5) | (hi[stride] << 6) | (hi[stride + 1] << 7);
+
+  for (i = 0; i < 3; i++)
+    vertex[i] = (float)(mesh->offset[i] + mesh->pitch[i] * (mesh->vertex[mask][i] + (i == 0 ? x : i == 1 ? y : z)));
+}
+
+/**
+ * Store 'value' at 'dst' as the 4 little-endian bytes binary STL asks for, no
+ * matter the byte order of the host.
+ */
+
+static void
+gcode_mesh_put (char *dst, uint32_t value)
+{
+  int i;
+
+  for (i = 0; i < 4; i++)
+    dst[i] = (char)((value >> (8 * i)) & 0xFF);
+}
+
+/**
+ * Store the float 'value' at 'dst' as 4 little-endian bytes of IEEE 754.
+ */
+
+static void
+gcode_mesh_put_float (char *dst, float value)
+{
+  uint32_t bits;
+
+  memcpy (&bits, &value, sizeof (bits));
+  gcode_mesh_put (dst, bits);
+}
+
+/**
+ * Add the two triangles of the quad 'v' to the worker's triangles, the normal
+ * of each taken from its vertices
+ */
+
+static void
+gcode_mesh_quad (gcode_mesh_worker_t *worker, float v[4][3])
+{
+  float record[12];
+  char *triangle;
+  gfloat_t n[3], mag;
+  int t, i, c0, c1, c2;
+
+  if (worker->triangle_num + 2 > worker->triangle_max)
+  {
+    triangle = realloc (worker->triangle, (worker->triangle_max * 2 + 256) * GCODE_MESH_TRIANGLE_SIZE);
+
+    if (!triangle)
+    {
+      worker->failed = 1;
+      return;
+    }
+
+    worker->triangle = triangle;
+    worker->triangle_max = worker->triangle_max * 2 + 256;
+  }
+
+  for (t = 0; t < 2; t++)
+  {
+    c0 = 0;
+    c1 = t + 1;
+    c2 = t + 2;
+
+    n[0] = (v[c1][1] - v[c0][1]) * (v[c2][2] - v[c0][2]) - (v[c1][2] - v[c0][2]) * (v[c2][1] - v[c0][1]);
+    n[1] = (v[c1][2] - v[c0][2]) * (v[c2][0] - v[c0][0]) - (v[c1][0] - v[c0][0]) * (v[c2][2] - v[c0][2]);
+    n[2] = (v[c1][0] - v[c0][0]) * (v[c2][1] - v[c0][1]) - (v[c1][1] - v[c0][1]) * (v[c2][0] - v[c0][0]);
+
+    mag = sqrt (n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+    if (mag > 0.0)
+      mag = 1.0 / mag;
+
+    for (i = 0; i < 3; i++)
+    {
+      record[i] = (float)(n[i] * mag);
+      record[3 + i] = v[c0][i];
+      record[6 + i] = v[c1][i];
+      record[9 + i] = v[c2][i];
+    }
+
+    triangle = &worker->triangle[worker->triangle_num * GCODE_MESH_TRIANGLE_SIZE];
+
+    for (i = 0; i < 12; i++)
+      gcode_mesh_put_float (&triangle[4 * i], record[i]);
+
+    triangle[48] = triangle[49] = 0;                                            // The attribute byte count (0);
+
+    worker->triangle_num++;
+  }
+}
+
+/**
+ * Build the quads of every edge starting on voxel layer 'layer' of the worker
+ * whose ends are one solid and one empty voxel: edges along X and Y within the
+ * layer and along Z up to the next one. Each quad faces away from the solid
+ * end; its corners are the vertices of the four cells around the edge, in
+ * counter-clockwise order seen from there.
+ */
+
+static void *
+gcode_mesh_worker (void *data)
+{
+  gcode_mesh_worker_t *worker;
+  gcode_mesh_t *mesh;
+  float v[4][3], swap[3];
+  uint8_t *here, *next;
+  int stride, x, y, z, a, b, c, i, d[3], cell[3], corner[4][2] = { { -1, -1 }, { 0, -1 }, { 0, 0 }, { -1, 0 } };
+
+  worker = (gcode_mesh_worker_t *)data;
+  mesh = worker->mesh;
+  stride = mesh->number[0] + 2;
+  z = worker->layer;
+
+  for (i = 0; i < 3; i++)
+    gcode_mesh_load (mesh, z - 1 + i, worker->sample[i]);
+
+  for (a = 0; a < 3; a++)
+  {
+    if ((a < 2) && ((z < 0) || (z >= mesh->number[2])))                         // Nothing is solid along X or Y outside the stock;
+      continue;
+
+    b = (a + 1) % 3;
+    c = (a + 2) % 3;
+
+    d[0] = a == 0;
+    d[1] = a == 1;
+    d[2] = a == 2;
+
+    for (y = -1; y < mesh->number[1]; y++)
+    {
+      for (x = -1; x < mesh->number[0]; x++)
+      {
+        here = &worker->sample[1][(y + 1) * stride + x + 1];
+        next = &worker->sample[1 + d[2]][(y + 1 + d[1]) * stride + x + 1 + d[0]];
+
+        if (*here == *next)
+          continue;
+
+        for (i = 0; i < 4; i++)
+        {
+          cell[0] = x;
+          cell[1] = y;
+          cell[2] = z;
+          cell[b] += corner[i][0];
+          cell[c] += corner[i][1];
+
+          gcode_mesh_cell (worker, cell[0], cell[1], cell[2], v[i]);
+        }
+
+        if (!*here)                                                             // Solid past the edge: face the other way;
+        {
+          memcpy (swap, v[1], sizeof (swap));
+          memcpy (v[1], v[3], sizeof (swap));
+          memcpy (v[3], swap, sizeof (swap));
+        }
+
+        gcode_mesh_quad (worker, v);
+      }
+    }
+  }
+
+  return (NULL);
+}
+
+/**
+ * Export the surface of the simulated stock to 'filename' as binary STL, in
+ * program coordinates. Returns non-zero on failure.
+ */
+
+int
+gcode_mesh_export (gcode_t *gcode, char *filename)
+{
+  gcode_mesh_t mesh;
+  gcode_mesh_worker_t *worker;
+  pthread_t *thread;
+  FILE *fh;
+  char header[80], bytes[4];
+  uint32_t count;
+  size_t size;
+  int threads, started, failed, unwritten, layer, t, i;
+
+  if (!gcode->voxel_map && !gcode->height_map)
+  {
+    REMARK ("No simulated stock to export\n");
+    return (1);
+  }
+
+  mesh.gcode = gcode;
+
+  for (i = 0; i < 3; i++)
+  {
+    mesh.number[i] = gcode->voxel_number[i];
+    mesh.pitch[i] = gcode->material_size[i] / (gfloat_t)gcode->voxel_number[i];
+  }
+
+  /* Material coordinates run from 0 to the size in X and Y and from minus the size to 0 in Z */
+  mesh.offset[0] = 0.5 * mesh.pitch[0] - gcode->material_origin[0];
+  mesh.offset[1] = 0.5 * mesh.pitch[1] - gcode->material_origin[1];
+  mesh.offset[2] = 0.5 * mesh.pitch[2] - gcode->material_size[2] + gcode->material_origin[2];
+
+  gcode_mesh_vertex_table (&mesh);
+
+  threads = gcode->simulation_threads;
+
+  if (threads <= 0)
+    threads = gcode_util_processors ();
+
+  fh = fopen (filename, "wb");
+
+  if (!fh)
+  {
+    REMARK ("Failed to open file '%s'\n", basename (filename));
+    return (1);
+  }
+
+  worker = calloc (threads, sizeof (gcode_mesh_worker_t));
+  thread = malloc (threads * sizeof (pthread_t));
+  size = (size_t)(mesh.number[0] + 2) * (mesh.number[1] + 2);
+  failed = !worker || !thread;
+
+  for (t = 0; !failed && (t < threads); t++)
+  {
+    worker[t].mesh = &mesh;
+
+    for (i = 0; i < 3; i++)
+      failed |= !(worker[t].sample[i] = malloc (size));
+  }
+
+  memset (header, 0, sizeof (header));
+  snprintf (header, sizeof (header), "GCAM stock of %s", gcode->name);
+
+  count = 0;
+  gcode_mesh_put (bytes, count);                                                // Filled in once known;
+  unwritten = (fwrite (header, 1, sizeof (header), fh) != sizeof (header)) || (fwrite (bytes, 1, 4, fh) != 4);
+
+  /* Layers -1 (the floor below the stock) to the top one, a layer per worker at a time */
+  for (layer = -1; !failed && !unwritten && (layer < mesh.number[2]); layer += threads)
+  {
+    for (t = 0; t < threads; t++)                                               // Every worker gets its layer before any starts, as those that don't start are run here;
+    {
+      worker[t].layer = layer + t;
+      worker[t].triangle_num = 0;
+    }
+
+    for (t = 0, started = 0; t < threads; t++)
+    {
+      if ((worker[t].layer >= mesh.number[2]) || (pthread_create (&thread[t], NULL, gcode_mesh_worker, &worker[t]) != 0))
+        break;
+
+      started++;
+    }
+
+    for (t = started; (t < threads) && (worker[t].layer < mesh.number[2]); t++) // Should any worker fail to start, do its share right here;
+      gcode_mesh_worker (&worker[t]);
+
+    for (t = 0; t < started; t++)
+      pthread_join (thread[t], NULL);
+
+    for (t = 0; (t < threads) && (worker[t].layer < mesh.number[2]); t++)
+    {
+      failed |= worker[t].failed;
+
+      unwritten |= fwrite (worker[t].triangle, GCODE_MESH_TRIANGLE_SIZE, worker[t].triangle_num, fh) != worker[t].triangle_num;
+      count += worker[t].triangle_num;
+    }
+
+    if (gcode->progress_callback)
+      gcode->progress_callback (gcode->gui, fmin ((gfloat_t)(layer + threads + 1) / (gfloat_t)(mesh.number[2] + 1), 1.0));
+  }
+
+  if (failed)
+    REMARK ("Failed to allocate memory for the stock mesh\n");
+
+  gcode_mesh_put (bytes, count);
+  unwritten |= (fseek (fh, sizeof (header), SEEK_SET) != 0) || (fwrite (bytes, 1, 4, fh) != 4);
+  unwritten |= fclose (fh) != 0;
+
+  if (unwritten)
+    REMARK ("Failed to write file '%s'\n", basename (filename));
+
+  failed |= unwritten;
+
+  for (t = 0; worker && (t < threads); t++)
+  {
+    for (i = 0; i < 3; i++)
+      free (worker[t].sample[i]);
+
+    free (worker[t].triangle);
+  }
+
+  free (worker);
+  free (thread);
+
+  if (gcode->progress_callback)
+    gcode->progress_callback (gcode->gui, 0.0);
+
+  return (failed);
+}
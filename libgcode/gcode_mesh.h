@@ -0,0 +1,43 @@
+/**
+ *  gcode_mesh.h
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _GCODE_MESH_H
+#define _GCODE_MESH_H
+
+#include "gcode_internal.h"
+
+/**
+ * Surface of the simulated stock as a closed triangle mesh, written out as
+ * binary STL: every voxel cell the surface passes through gets one vertex, at
+ * the mean of the points where the surface crosses its edges, and every edge
+ * between a solid and an empty voxel becomes a quad joining the vertices of the
+ * four cells around it (surface nets, the simplest of the dual contouring
+ * methods). Voxels outside the stock count as empty, so the mesh always closes.
+ * It gets built one layer of voxels at a time, a layer per worker, and every
+ * layer is written out as soon as those before it are, so memory stays bounded
+ * by a few layers however fine the stock is.
+ */
+
+int gcode_mesh_export (gcode_t *gcode, char *filename);
+
+#endif
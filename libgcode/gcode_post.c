@@ -0,0 +1,971 @@
+/**
+ *  gcode_post.c
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gcode_post.h"
+#include <string.h>
+#include <math.h>
+
+#define GCODE_POST_AXES         (GCODE_IR_X | GCODE_IR_Y | GCODE_IR_Z)
+#define GCODE_POST_ARC_MIN      3                                               /* Fewest feed moves worth putting an arc in place of */
+#define GCODE_POST_UNKNOWN      0xFF                                            /* Motion in effect not known (after text or a tool change) */
+
+#define GCODE_POST_TEXT_NONE    0x00                                            /* Line made of ops only */
+#define GCODE_POST_TEXT_BLANK   0x01                                            /* Line with text, but nothing in it besides comments and spaces */
+#define GCODE_POST_TEXT_CODE    0x02                                            /* Line with text holding code of its own */
+
+/**
+ * One line of the program: the ops it is made of, the last of which ends it
+ */
+
+typedef struct gcode_post_line_s
+{
+  uint32_t begin;
+  uint32_t end;
+  uint32_t op;                                                                  /* its first op with words, if any */
+  uint16_t ops;                                                                 /* number of ops with words (text ops aside) */
+  uint8_t text;                                                                 /* any text in it (see above) */
+  uint8_t comment;                                                              /* it ends with a comment */
+} gcode_post_line_t;
+
+/**
+ * The state the code written out so far leaves the machine in: positions are
+ * kept in units of the last decimal written, and feeds in thousandths, as
+ * only what makes it to the text counts.
+ */
+
+typedef struct gcode_post_s
+{
+  gcode_t *gcode;
+  gcode_ir_t *in;
+  gcode_ir_t out;
+  gcode_post_line_t *line;
+  uint32_t line_num;
+  gfloat_t scale;                                                               /* 10 to the power of the decimals written */
+  int64_t pos[3];                                                               /* where the tool is */
+  gfloat_t pos_value[3];                                                        /* and the values it was written with */
+  uint8_t known;                                                                /* axes of it known, as X, Y and Z word bits */
+  uint8_t modal;                                                                /* motion in effect (op type), or UNKNOWN */
+  int64_t feed;                                                                 /* feed in effect */
+  uint8_t feed_known;
+  int64_t want;                                                                 /* feed the program wants in effect from its next feed move on */
+  gfloat_t want_value;
+  uint8_t want_known;
+  gfloat_t arc_tolerance;                                                       /* how far arcs may stray from the moves they stand for, 0 for none */
+} gcode_post_t;
+
+/**
+ * Whether 'text' holds anything besides spaces, line ends and comments
+ */
+
+static int
+gcode_post_has_code (const char *text)
+{
+  for (; *text; text++)
+  {
+    if ((*text == ' ') || (*text == '\t') || (*text == '\r') || (*text == '\n'))
+      continue;
+
+    if (*text == '(')
+    {
+      while (*text && (*text != ')'))
+        text++;
+
+      if (!*text)
+        return (0);
+    }
+    else if (*text == ';')
+    {
+      while (*text && (*text != '\n'))
+        text++;
+
+      if (!*text)
+        return (0);
+    }
+    else
+    {
+      return (1);
+    }
+  }
+
+  return (0);
+}
+
+/**
+ * Split the program into lines; a line ends with a comment op (with or without
+ * a comment) or with text ending in a new line.
+ */
+
+static int
+gcode_post_split (gcode_post_t *post)
+{
+  gcode_ir_t *ir;
+  gcode_post_line_t *line;
+  const char *text;
+  uint32_t i;
+  size_t len;
+
+  ir = post->in;
+
+  post->line = malloc ((ir->op_num + 1) * sizeof (gcode_post_line_t));
+
+  if (!post->line)
+  {
+    REMARK ("Failed to allocate memory for the lines of the program\n");
+    return (1);
+  }
+
+  post->line_num = 0;
+  line = NULL;
+
+  for (i = 0; i < ir->op_num; i++)
+  {
+    if (!line)
+    {
+      line = &post->line[post->line_num++];
+
+      line->begin = i;
+      line->op = i;
+      line->ops = 0;
+      line->text = GCODE_POST_TEXT_NONE;
+      line->comment = 0;
+    }
+
+    line->end = i + 1;
+
+    if (ir->op[i].type == GCODE_IR_TEXT)
+    {
+      text = &ir->text[ir->op[i].arg];
+      len = strlen (text);
+
+      if (gcode_post_has_code (text))
+        line->text = GCODE_POST_TEXT_CODE;
+      else if (line->text == GCODE_POST_TEXT_NONE)
+        line->text = GCODE_POST_TEXT_BLANK;
+
+      if (len && (text[len - 1] == '\n'))
+        line = NULL;
+    }
+    else if (ir->op[i].type == GCODE_IR_COMMENT)
+    {
+      line->comment = ir->text[ir->op[i].arg] != '\0';
+      line = NULL;
+    }
+    else
+    {
+      if (!line->ops)
+        line->op = i;
+
+      line->ops++;
+    }
+  }
+
+  if (line)                                                                     // A last line without an end is left as it is;
+    line->text = GCODE_POST_TEXT_CODE;
+
+  for (i = 0; i < post->line_num; i++)                                          // Ops mixed with text are taken for text;
+    if (post->line[i].ops && (post->line[i].text == GCODE_POST_TEXT_BLANK))
+      post->line[i].text = GCODE_POST_TEXT_CODE;
+
+  return (0);
+}
+
+/**
+ * Value 'value' of a word, in units of the last decimal written
+ */
+
+static int64_t
+gcode_post_units (gcode_post_t *post, gfloat_t value)
+{
+  return (llround (gcode_ir_value (value, post->gcode->decimals) * post->scale));
+}
+
+static int64_t
+gcode_post_feed_units (gfloat_t value)
+{
+  return (llround (gcode_ir_value (value, 3) * 1000.0));
+}
+
+/**
+ * Values of the words of 'op', one per word bit
+ */
+
+static void
+gcode_post_values (gcode_post_t *post, gcode_ir_op_t *op, gfloat_t *value)
+{
+  gfloat_t *sp;
+  int w;
+
+  sp = &post->in->value[op->arg];
+
+  for (w = 0; w < 8; w++)
+    if (op->words & (1 << w))
+      value[w] = *sp++;
+}
+
+/**
+ * Where 'op' takes the tool from where it is (axes it has no word for stay put)
+ */
+
+static void
+gcode_post_target (gcode_post_t *post, gcode_ir_op_t *op, gfloat_t *value, int64_t *target)
+{
+  int a;
+
+  gcode_post_values (post, op, value);
+
+  for (a = 0; a < 3; a++)
+  {
+    if (op->words & (1 << a))
+      target[a] = gcode_post_units (post, value[a]);
+    else
+      target[a] = post->pos[a];
+  }
+}
+
+/**
+ * Append an op with the words of 'words' and their values from 'value'
+ */
+
+static void
+gcode_post_emit (gcode_post_t *post, uint8_t type, uint16_t flags, uint8_t words, gfloat_t *value)
+{
+  int w;
+
+  gcode_ir_op (&post->out, type, flags);
+
+  if ((type == GCODE_IR_SPEED) || (type == GCODE_IR_TOOL_CHANGE))
+    gcode_ir_word (&post->out, GCODE_IR_VALUE, value[0]);
+
+  for (w = 0; w < 8; w++)
+    if (words & (1 << w))
+      gcode_ir_word (&post->out, 1 << w, value[w]);
+}
+
+/**
+ * End the line with the comment of op 'index', header or not
+ */
+
+static void
+gcode_post_comment (gcode_post_t *post, uint32_t index)
+{
+  gcode_ir_op_t *op;
+
+  op = &post->in->op[index];
+
+  if (op->flags & GCODE_IR_HEADER)
+    gcode_ir_header (&post->out, &post->in->text[op->arg]);
+  else
+    gcode_ir_comment (&post->out, &post->in->text[op->arg]);
+}
+
+/**
+ * Give a feed move the F word it needs to run at the feed the program wants,
+ * or take the one it has away if that feed is in effect already.
+ */
+
+static void
+gcode_post_feed (gcode_post_t *post, uint8_t *words, gfloat_t *value)
+{
+  if (post->want_known && (!post->feed_known || (post->feed != post->want)))
+  {
+    *words |= GCODE_IR_F;
+    value[5] = post->want_value;
+
+    post->feed = post->want;
+    post->feed_known = 1;
+  }
+  else
+  {
+    *words &= ~GCODE_IR_F;
+  }
+}
+
+/**
+ * Note the F word of 'op' (if it has one) as the feed the program wants
+ */
+
+static void
+gcode_post_want (gcode_post_t *post, gcode_ir_op_t *op, gfloat_t *value)
+{
+  if (!(op->words & GCODE_IR_F))
+    return;
+
+  post->want = gcode_post_feed_units (value[5]);
+  post->want_value = value[5];
+  post->want_known = 1;
+}
+
+/**
+ * Copy line 'line' as it is; text with code of its own leaves the state of the
+ * machine unknown, so the feed the program wants gets put in effect before it.
+ */
+
+static void
+gcode_post_copy (gcode_post_t *post, gcode_post_line_t *line)
+{
+  gcode_ir_op_t *op;
+  gfloat_t value[8];
+  uint32_t i;
+
+  if (line->text == GCODE_POST_TEXT_CODE)
+  {
+    if (post->want_known && (!post->feed_known || (post->feed != post->want)))
+    {
+      value[5] = post->want_value;
+      gcode_post_emit (post, GCODE_IR_WORDS, 0, GCODE_IR_F, value);
+      gcode_ir_comment (&post->out, "");
+    }
+
+    post->known = 0;
+    post->modal = GCODE_POST_UNKNOWN;
+    post->feed_known = 0;
+    post->want_known = 0;
+  }
+
+  for (i = line->begin; i < line->end; i++)
+  {
+    op = &post->in->op[i];
+
+    if (op->type == GCODE_IR_TEXT)
+    {
+      gcode_ir_text (&post->out, &post->in->text[op->arg]);
+    }
+    else if (op->type == GCODE_IR_COMMENT)
+    {
+      gcode_post_comment (post, i);
+    }
+    else
+    {
+      if ((op->type == GCODE_IR_SPEED) || (op->type == GCODE_IR_TOOL_CHANGE))
+        value[0] = post->in->value[op->arg];
+
+      gcode_post_values (post, op, value);
+      gcode_post_emit (post, op->type, op->flags, op->words, value);
+    }
+  }
+}
+
+/**
+ * Write line 'line' out with whatever it has that is in effect already left
+ * out; a line with nothing left to do goes altogether, comment included.
+ */
+
+static void
+gcode_post_write (gcode_post_t *post, gcode_post_line_t *line)
+{
+  gcode_ir_op_t *op;
+  gfloat_t value[8];
+  int64_t target[3];
+  uint32_t i, emitted;
+  uint16_t flags;
+  uint8_t words;
+  int a;
+
+  if ((line->text != GCODE_POST_TEXT_NONE) || !line->ops)
+  {
+    gcode_post_copy (post, line);
+    return;
+  }
+
+  emitted = 0;
+
+  for (i = line->begin; i < line->end; i++)
+  {
+    op = &post->in->op[i];
+
+    if (op->type == GCODE_IR_COMMENT)
+      break;
+
+    flags = op->flags & GCODE_IR_SPACE;
+    words = op->words;
+
+    if ((op->type == GCODE_IR_SPEED) || (op->type == GCODE_IR_TOOL_CHANGE))
+      value[0] = post->in->value[op->arg];
+    gcode_post_target (post, op, value, target);
+    gcode_post_want (post, op, value);
+
+    switch (op->type)
+    {
+      case GCODE_IR_RAPID:
+      case GCODE_IR_LINE:
+
+        for (a = 0; a < 3; a++)                                                 // Axes already there need no word;
+          if ((post->known & (1 << a)) && (target[a] == post->pos[a]))
+            words &= ~(1 << a);
+
+        if (!(words & GCODE_POST_AXES))                                         // A move going nowhere is no move at all;
+          continue;
+
+        if (post->modal == op->type)
+          flags |= GCODE_IR_MODAL;
+
+        post->modal = op->type;
+
+        if (op->type == GCODE_IR_LINE)
+          gcode_post_feed (post, &words, value);
+        else
+          words &= ~GCODE_IR_F;
+
+        break;
+
+      case GCODE_IR_ARC_CW:
+      case GCODE_IR_ARC_CCW:
+
+        if (post->modal == op->type)
+          flags |= GCODE_IR_MODAL;
+
+        post->modal = op->type;
+
+        gcode_post_feed (post, &words, value);
+
+        break;
+
+      case GCODE_IR_WORDS:
+
+        if (!(words & GCODE_POST_AXES))                                         // A feed alone waits for the move that needs it;
+          continue;
+
+        if (post->modal != GCODE_IR_RAPID)
+          gcode_post_feed (post, &words, value);
+        else
+          words &= ~GCODE_IR_F;
+
+        break;
+
+      case GCODE_IR_DRILL:
+      case GCODE_IR_PECK_DRILL:
+
+        post->modal = op->type;
+
+        gcode_post_feed (post, &words, value);
+
+        break;
+
+      case GCODE_IR_HOME:
+      case GCODE_IR_TOOL_CHANGE:
+
+        post->modal = GCODE_POST_UNKNOWN;
+
+        break;
+    }
+
+    gcode_post_emit (post, op->type, flags, words, value);
+    emitted++;
+
+    switch (op->type)
+    {
+      case GCODE_IR_RAPID:
+      case GCODE_IR_LINE:
+      case GCODE_IR_ARC_CW:
+      case GCODE_IR_ARC_CCW:
+      case GCODE_IR_WORDS:
+
+        if ((op->type == GCODE_IR_WORDS) && (post->modal != GCODE_IR_RAPID) && (post->modal != GCODE_IR_LINE))
+        {
+          post->known = 0;                                                      // Canned cycles end wherever they end;
+          break;
+        }
+
+        for (a = 0; a < 3; a++)
+        {
+          if (op->words & (1 << a))
+          {
+            post->pos[a] = target[a];
+            post->pos_value[a] = value[a];
+            post->known |= 1 << a;
+          }
+        }
+
+        break;
+
+      case GCODE_IR_DRILL:
+      case GCODE_IR_PECK_DRILL:
+
+        post->known &= ~GCODE_IR_Z;
+
+        break;
+
+      case GCODE_IR_HOME:
+      case GCODE_IR_TOOL_CHANGE:
+
+        post->known = 0;
+
+        break;
+    }
+  }
+
+  if (emitted)
+    gcode_post_comment (post, line->end - 1);
+}
+
+/**
+ * Whether line 'index' is a feed move along a straight line that the next one
+ * carries straight on along, in which case the two can be one: both moves may
+ * have nothing but axis words, and the first no comment. Only moves exactly in
+ * line (as written) qualify, so the path of the tool stays the same.
+ */
+
+static int
+gcode_post_collinear (gcode_post_t *post, uint32_t index)
+{
+  gcode_post_line_t *line[2];
+  gcode_ir_op_t *op;
+  gfloat_t value[8];
+  int64_t start[3], middle[3], end[3], u[3], v[3];
+  int i, a;
+
+  if ((index + 1 >= post->line_num) || (post->known != GCODE_POST_AXES) || (post->modal != GCODE_IR_LINE))
+    return (0);
+
+  line[0] = &post->line[index];
+  line[1] = &post->line[index + 1];
+
+  if (line[0]->comment)
+    return (0);
+
+  for (i = 0; i < 2; i++)
+  {
+    op = &post->in->op[line[i]->op];
+
+    if ((line[i]->text != GCODE_POST_TEXT_NONE) || (line[i]->ops != 1) || (op->type != GCODE_IR_LINE) || (op->words & ~GCODE_POST_AXES))
+      return (0);
+  }
+
+  memcpy (start, post->pos, sizeof (start));
+
+  gcode_post_target (post, &post->in->op[line[0]->op], value, middle);
+
+  memcpy (post->pos, middle, sizeof (middle));
+  gcode_post_target (post, &post->in->op[line[1]->op], value, end);
+  memcpy (post->pos, start, sizeof (start));
+
+  for (a = 0; a < 3; a++)
+  {
+    u[a] = middle[a] - start[a];
+    v[a] = end[a] - middle[a];
+  }
+
+  if ((u[1] * v[2] != u[2] * v[1]) || (u[2] * v[0] != u[0] * v[2]) || (u[0] * v[1] != u[1] * v[0]))
+    return (0);
+
+  return (u[0] * v[0] + u[1] * v[1] + u[2] * v[2] > 0);                         // Going on the same way, not back;
+}
+
+/**
+ * Gather the feed moves from line 'index' on that could make up an arc: moves
+ * in the plane the tool is in, with no words but X and Y (and a Z staying put),
+ * the first of them being the only one that may set a feed. Their end points
+ * (the start of the first one ahead of them) go to 'point', and in units of the
+ * last decimal to 'end' (axes a move has no word for are where the move before
+ * it left them); their number is what gets returned.
+ */
+
+static uint32_t
+gcode_post_arc_run (gcode_post_t *post, uint32_t index, gfloat_t point[][2], int64_t end[][2])
+{
+  gcode_post_line_t *line;
+  gcode_ir_op_t *op;
+  gfloat_t value[8];
+  int64_t start[3], pos[3];
+  uint32_t i, n;
+
+  if ((post->known != GCODE_POST_AXES) || (post->arc_tolerance <= 0.0))
+    return (0);
+
+  memcpy (start, post->pos, sizeof (start));
+  memcpy (pos, post->pos, sizeof (pos));
+
+  point[0][0] = pos[0] / post->scale;
+  point[0][1] = pos[1] / post->scale;
+  end[0][0] = pos[0];
+  end[0][1] = pos[1];
+
+  for (i = index, n = 0; (i < post->line_num) && (n < GCODE_POST_ARC_SEGMENTS); i++, n++)
+  {
+    line = &post->line[i];
+    op = &post->in->op[line->op];
+
+    if ((line->text != GCODE_POST_TEXT_NONE) || (line->ops != 1) || (op->type != GCODE_IR_LINE))
+      break;
+
+    if (op->words & ~(GCODE_POST_AXES | (i == index ? GCODE_IR_F : 0)))
+      break;
+
+    memcpy (post->pos, pos, sizeof (pos));
+    gcode_post_target (post, op, value, pos);
+
+    if ((pos[2] != start[2]) || ((pos[0] == post->pos[0]) && (pos[1] == post->pos[1])))
+      break;
+
+    point[n + 1][0] = pos[0] / post->scale;
+    point[n + 1][1] = pos[1] / post->scale;
+    end[n + 1][0] = pos[0];
+    end[n + 1][1] = pos[1];
+  }
+
+  memcpy (post->pos, start, sizeof (start));
+
+  return (n);
+}
+
+/**
+ * Whether the first 'n' moves of 'point' stay within the tolerance of the arc
+ * through their start, their end and the point half way between: every point
+ * and the middle of every move have to be that close to the circle and the
+ * moves all have to turn the same way round its centre. The centre goes to
+ * 'center', the way the arc turns (1 counter-clockwise, -1 clockwise) to 'dir'
+ * and how far the arc strays from a straight line to 'bulge'.
+ */
+
+static int
+gcode_post_arc_fit (gcode_post_t *post, gfloat_t point[][2], uint32_t n, gfloat_t *center, int *dir, gfloat_t *bulge)
+{
+  gfloat_t ax, ay, bx, by, det, radius, dx, dy, cross, sweep, step;
+  uint32_t i;
+
+  ax = point[n / 2][0] - point[0][0];
+  ay = point[n / 2][1] - point[0][1];
+  bx = point[n][0] - point[0][0];
+  by = point[n][1] - point[0][1];
+
+  det = 2.0 * (ax * by - ay * bx);
+
+  if (fabs (det) < GCODE_PRECISION * GCODE_PRECISION)                           // Points in line have no circle through them;
+    return (0);
+
+  center[0] = point[0][0] + (by * (ax * ax + ay * ay) - ay * (bx * bx + by * by)) / det;
+  center[1] = point[0][1] + (ax * (bx * bx + by * by) - bx * (ax * ax + ay * ay)) / det;
+
+  radius = hypot (point[0][0] - center[0], point[0][1] - center[1]);
+
+  *dir = det > 0.0 ? 1 : -1;
+  sweep = 0.0;
+
+  for (i = 0; i < n; i++)
+  {
+    if (fabs (hypot (point[i + 1][0] - center[0], point[i + 1][1] - center[1]) - radius) > post->arc_tolerance)
+      return (0);
+
+    dx = 0.5 * (point[i][0] + point[i + 1][0]) - center[0];
+    dy = 0.5 * (point[i][1] + point[i + 1][1]) - center[1];
+
+    if (fabs (hypot (dx, dy) - radius) > post->arc_tolerance)
+      return (0);
+
+    cross = (point[i][0] - center[0]) * (point[i + 1][1] - center[1]) - (point[i][1] - center[1]) * (point[i + 1][0] - center[0]);
+    step = atan2 (fabs (cross), (point[i][0] - center[0]) * (point[i + 1][0] - center[0]) + (point[i][1] - center[1]) * (point[i + 1][1] - center[1]));
+
+    if ((cross * *dir <= 0.0) || (step > GCODE_HPI))                            // Turning back, or leaping round the circle;
+      return (0);
+
+    sweep += step;
+  }
+
+  *bulge = radius * (1.0 - cos (fmin (sweep, GCODE_PI) / 2.0));
+
+  return (sweep < GCODE_2PI - GCODE_PRECISION);                                 // A full circle (or more) ends where it starts;
+}
+
+/**
+ * Write the feed moves from line 'index' on out as one arc if enough of them
+ * stay within the tolerance of one (see gcode_post_arc_fit), taking as many as
+ * will; moves that stray from a straight line by no more than the tolerance are
+ * left as they are. The arc keeps the comment of the last of the moves, the
+ * others go. Returns the last line the arc stands for in 'last'.
+ */
+
+static int
+gcode_post_arc (gcode_post_t *post, uint32_t index, uint32_t *last)
+{
+  gcode_ir_op_t *op;
+  gfloat_t point[GCODE_POST_ARC_SEGMENTS + 1][2], center[2], fit[2], value[8], bulge, best_bulge;
+  int64_t end[GCODE_POST_ARC_SEGMENTS + 1][2];
+  uint32_t n, k, best;
+  uint16_t flags;
+  uint8_t type, words;
+  int dir, best_dir;
+
+  n = gcode_post_arc_run (post, index, point, end);
+
+  best = 0;
+  best_dir = 0;
+  best_bulge = 0.0;
+
+  for (k = GCODE_POST_ARC_MIN; k <= n; k++)
+  {
+    if (!gcode_post_arc_fit (post, point, k, center, &dir, &bulge))             // Moves on an arc fit it however few of them are taken;
+      break;
+
+    best = k;
+    best_dir = dir;
+    best_bulge = bulge;
+    fit[0] = center[0];
+    fit[1] = center[1];
+  }
+
+  if (!best || (best_bulge <= post->arc_tolerance))
+    return (0);
+
+  *last = index + best - 1;
+
+  op = &post->in->op[post->line[index].op];                                     // The feed is set (if at all) by the first move;
+  gcode_post_values (post, op, value);
+  gcode_post_want (post, op, value);
+
+  type = best_dir > 0 ? GCODE_IR_ARC_CCW : GCODE_IR_ARC_CW;
+  flags = GCODE_IR_SPACE | (post->modal == type ? GCODE_IR_MODAL : 0);
+  words = GCODE_IR_X | GCODE_IR_Y | GCODE_IR_I | GCODE_IR_J;
+
+  value[0] = end[best][0] / post->scale;
+  value[1] = end[best][1] / post->scale;
+  value[3] = fit[0] - point[0][0];
+  value[4] = fit[1] - point[0][1];
+
+  gcode_post_feed (post, &words, value);
+  gcode_post_emit (post, type, flags, words, value);
+  gcode_post_comment (post, post->line[*last].end - 1);
+
+  post->modal = type;
+  post->pos[0] = end[best][0];
+  post->pos[1] = end[best][1];
+  post->pos_value[0] = value[0];
+  post->pos_value[1] = value[1];
+
+  return (1);
+}
+
+/**
+ * Whether line 'index' retracts the tool straight up from where it is to the
+ * traverse height or above, only for the lines after it to bring it back to
+ * that very point without cutting anything on the way: rapid moves that stay
+ * at the traverse height or above, and moves straight down onto it. A rapid
+ * move any lower but off that point may well have been put there on purpose,
+ * so the lines go out as they are. Returns the line the tool gets back on in
+ * 'back'; the feed the lines in between leave the program wanting goes to
+ * 'want'.
+ */
+
+static int
+gcode_post_excursion (gcode_post_t *post, uint32_t index, uint32_t *back)
+{
+  gcode_post_line_t *line;
+  gcode_ir_op_t *op;
+  gfloat_t value[8];
+  int64_t start[3], pos[3], clearance;
+  uint32_t i;
+  int found;
+
+  line = &post->line[index];
+
+  if ((post->known != GCODE_POST_AXES) || (line->text != GCODE_POST_TEXT_NONE) || (line->ops != 1))
+    return (0);
+
+  op = &post->in->op[line->op];
+
+  if ((op->type != GCODE_IR_RAPID) || (op->words & ~GCODE_POST_AXES))
+    return (0);
+
+  memcpy (start, post->pos, sizeof (start));
+
+  gcode_post_target (post, op, value, pos);
+
+  clearance = gcode_post_units (post, post->gcode->material_origin[2] + post->gcode->ztraverse);
+
+  if ((pos[0] != start[0]) || (pos[1] != start[1]) || (pos[2] <= start[2]) || (pos[2] < clearance))
+    return (0);
+
+  found = 0;
+
+  for (i = index + 1; (i < post->line_num) && (i <= index + GCODE_POST_LOOKAHEAD); i++)
+  {
+    line = &post->line[i];
+
+    if (line->text == GCODE_POST_TEXT_CODE)
+      break;
+
+    if ((line->text == GCODE_POST_TEXT_BLANK) || !line->ops)
+      continue;
+
+    op = &post->in->op[line->op];
+
+    if (line->ops != 1)
+      break;
+
+    if ((op->type == GCODE_IR_WORDS) && (op->words == GCODE_IR_F))
+      continue;
+
+    if (((op->type != GCODE_IR_RAPID) && (op->type != GCODE_IR_LINE)) || (op->words & ~(GCODE_POST_AXES | GCODE_IR_F)))
+      break;
+
+    memcpy (post->pos, pos, sizeof (pos));
+    gcode_post_target (post, op, value, pos);
+
+    if ((pos[0] != start[0]) || (pos[1] != start[1]) || (post->pos[0] != start[0]) || (post->pos[1] != start[1]))
+    {
+      if ((op->type != GCODE_IR_RAPID) || (post->pos[2] < clearance) || (pos[2] < clearance))
+        break;                                                                  // Off the point, only rapid moves from and to the traverse height or above;
+    }
+
+    if (pos[2] < start[2])
+      break;
+
+    if ((pos[0] == start[0]) && (pos[1] == start[1]) && (pos[2] == start[2]))
+    {
+      found = 1;
+      break;
+    }
+  }
+
+  memcpy (post->pos, start, sizeof (start));
+
+  if (!found)
+    return (0);
+
+  *back = i;
+
+  return (1);
+}
+
+/**
+ * Leave out lines 'index' to 'back' (see gcode_post_excursion) but for those
+ * with nothing but comments, minding the feed they leave the program wanting.
+ */
+
+static void
+gcode_post_skip (gcode_post_t *post, uint32_t index, uint32_t back)
+{
+  gcode_post_line_t *line;
+  gcode_ir_op_t *op;
+  gfloat_t value[8];
+  uint32_t i;
+
+  for (i = index; i <= back; i++)
+  {
+    line = &post->line[i];
+
+    if ((line->text != GCODE_POST_TEXT_NONE) || !line->ops)
+    {
+      gcode_post_copy (post, line);
+      continue;
+    }
+
+    op = &post->in->op[line->op];
+
+    gcode_post_values (post, op, value);
+    gcode_post_want (post, op, value);
+  }
+}
+
+/**
+ * Post-process the toolpath 'ir' of the whole program (see gcode_post.h) if the
+ * output is to be optimized; 'ir' is left as it is on failure, which gets a
+ * non-zero return.
+ */
+
+int
+gcode_post_process (gcode_t *gcode, gcode_ir_t *ir)
+{
+  gcode_post_t post;
+  uint32_t i, back;
+
+  if (!gcode->optimize_output)
+    return (0);
+
+  post.gcode = gcode;
+  post.in = ir;
+  post.scale = pow (10.0, gcode->decimals);
+  post.known = 0;
+  post.modal = GCODE_POST_UNKNOWN;
+  post.feed_known = 0;
+  post.want_known = 0;
+  post.arc_tolerance = GCODE_UNITS (gcode, gcode->arc_tolerance);
+
+  if (gcode_post_split (&post))
+    return (1);
+
+  gcode_ir_init (&post.out);
+
+  for (i = 0; i < post.line_num; i++)
+  {
+    if (gcode_post_excursion (&post, i, &back))
+    {
+      gcode_post_skip (&post, i, back);
+      i = back;
+    }
+    else if (gcode_post_arc (&post, i, &back))
+    {
+      i = back;
+    }
+    else if (!gcode_post_collinear (&post, i))                                  // A move the next one carries on is left to it;
+    {
+      gcode_post_write (&post, &post.line[i]);
+    }
+  }
+
+  free (post.line);
+
+  if (post.out.failed)
+  {
+    gcode_ir_free (&post.out);
+    return (1);
+  }
+
+  gcode_ir_free (ir);
+  *ir = post.out;
+
+  return (0);
+}
+
+/**
+ * Make the toolpath 'ir' of the whole program compact if the output is to be
+ * (see gcode_post.h): comments other than headers are left empty, and every
+ * op with words gets written compact, without a space to part it from what
+ * follows on its line.
+ */
+
+void
+gcode_post_compact (gcode_t *gcode, gcode_ir_t *ir)
+{
+  gcode_ir_op_t *op;
+  uint32_t i;
+
+  if (!gcode->compact_output)
+    return;
+
+  for (i = 0; i < ir->op_num; i++)
+  {
+    op = &ir->op[i];
+
+    if (op->type == GCODE_IR_TEXT)
+      continue;
+
+    if (op->type == GCODE_IR_COMMENT)
+    {
+      if (!(op->flags & GCODE_IR_HEADER))
+        op->arg += strlen (&ir->text[op->arg]);                                 // Its own terminating null makes it empty;
+    }
+    else
+    {
+      op->flags = (op->flags & ~GCODE_IR_SPACE) | GCODE_IR_COMPACT;
+    }
+  }
+}
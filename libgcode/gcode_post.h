@@ -0,0 +1,51 @@
+/**
+ *  gcode_post.h
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GCODE_POST_H
+#define _GCODE_POST_H
+
+#include "gcode_internal.h"
+
+/**
+ * Post-processing of the toolpath of the whole program on its way out: G and F
+ * words already in effect get left out, feed moves running on along the same
+ * straight line get merged into one and trips over the traverse height that
+ * take the tool away from a cut only to bring it back to the very same point
+ * get dropped. What the machine does stays exactly the same, but for the
+ * time those trips took.
+ * Given a tolerance, runs of short feed moves in the plane (curves flattened
+ * into lines by the SVG import, contours, ...) go on top of that as arcs that
+ * stray from them by no more than the tolerance.
+ *
+ * Compact output, for controllers fed over slow serial lines, goes on to drop
+ * every comment but those of the headers, and the spaces and trailing zeros
+ * of the words; axis words get no more decimals than the resolution of the
+ * machine calls for.
+ */
+
+#define GCODE_POST_LOOKAHEAD    256                                             /* Lines looked through for the tool to come back to where it left */
+#define GCODE_POST_ARC_SEGMENTS 256                                             /* Most feed moves put together into one arc */
+
+int gcode_post_process (gcode_t *gcode, gcode_ir_t *ir);
+void gcode_post_compact (gcode_t *gcode, gcode_ir_t *ir);
+
+#endif
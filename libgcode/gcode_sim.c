@@ -20,430 +20,2463 @@
  */
 
 #include "gcode_sim.h"
+#include "gcode_voxel.h"
+#include "gcode_deviation.h"
+#include "gcode_tool.h"
+#include "gcode_util.h"
 #include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+/**
+ * Add 'span' to 'spans', growing it as needed; if that fails the span is lost
+ * and 'failed' gets raised.
+ */
+
+static void
+gcode_sim_spans_add (gcode_sim_spans_t *spans, gcode_sim_span_t *span)
+{
+  gcode_sim_span_t *grown;
+  size_t max;
+
+  if (spans->num == spans->max)
+  {
+    max = spans->max ? 2 * spans->max : 1024;
+    grown = realloc (spans->span, max * sizeof (gcode_sim_span_t));
+
+    if (!grown)
+    {
+      spans->failed = 1;
+      return;
+    }
+
+    spans->span = grown;
+    spans->max = max;
+  }
+
+  spans->span[spans->num++] = *span;
+}
+
+/**
+ * Called back by 'gcode_voxel_clear' with every run of voxels it cleared in a
+ * column of 'context' (a tile being logged or counted).
+ */
+
+static void
+gcode_sim_cleared (void *context, size_t x, size_t y, size_t zmin, size_t zmax)
+{
+  gcode_sim_tile_t *tile;
+  gcode_sim_span_t span;
+
+  tile = (gcode_sim_tile_t *)context;
+
+  if (tile->tally)
+    tile->tally->cleared += zmax - zmin + 1;
+
+  if (!tile->spans)
+    return;
+
+  span.line = tile->line;
+  span.column = y * tile->spans->stride + x;
+  span.lo = (uint32_t)zmin;
+  span.hi = (uint32_t)zmax;
+
+  gcode_sim_spans_add (tile->spans, &span);
+}
+
+/**
+ * Clear the voxels of one column (xind, yind) lying between the heights 'zlo'
+ * and 'zhi' (in material coordinates); this is the only place that writes the
+ * stock, every motion ends up here exactly once per column it sweeps over.
+ * With the height field model the cutter always reaches up past the surface,
+ * so removal simply lowers the column to 'zlo' (never below the material).
+ * If the tile is being logged, whatever really got removed is logged.
+ */
+
+static void
+gcode_sim_clear_column (gcode_t *gcode, int xind, int yind, gfloat_t zlo, gfloat_t zhi, gcode_sim_tile_t *tile)
+{
+  gcode_sim_span_t span;
+  int zmin, zmax;
+  gfloat_t scale;
+
+  if (gcode->stock_model == GCODE_STOCK_HEIGHT)
+  {
+    float *height = &gcode->height_map[(size_t)yind * gcode->voxel_number[0] + xind];
+
+    if (zlo < -gcode->material_size[2])
+      zlo = -gcode->material_size[2];
+
+    if (tile->tally)                                                            // The cutter reaches from 'zlo' up past the top;
+    {
+      scale = (gfloat_t)gcode->voxel_number[2] / gcode->material_size[2];
+      zmin = (int)(scale * (gcode->material_size[2] + zlo));
+
+      tile->tally->columns++;
+
+      if (zmin < (int)gcode->voxel_number[2])
+        tile->tally->touched += gcode->voxel_number[2] - (zmin < 0 ? 0 : zmin);
+
+      if (zlo < *height)
+        tile->tally->cleared += (int)(scale * (gcode->material_size[2] + *height)) - zmin;
+    }
+
+    if (zlo < *height)
+    {
+      memcpy (&span.lo, height, sizeof (uint32_t));
+
+      *height = zlo;
+      tile->changed = 1;
+
+      if (tile->spans)
+      {
+        span.line = tile->line;
+        span.column = (size_t)yind * gcode->voxel_number[0] + xind;
+        memcpy (&span.hi, height, sizeof (uint32_t));
+
+        gcode_sim_spans_add (tile->spans, &span);
+      }
+    }
+
+    return;
+  }
+
+  scale = (gfloat_t)gcode->voxel_number[2] / gcode->material_size[2];
+
+  zmin = (int)(scale * (gcode->material_size[2] + zlo));
+  zmax = (int)(scale * (gcode->material_size[2] + zhi));
+
+  if (zmin < 0)
+    zmin = 0;
+
+  if (zmax >= (int)gcode->voxel_number[2])
+    zmax = gcode->voxel_number[2] - 1;
+
+  if (tile->tally)
+    tile->tally->columns++;
+
+  if (zmin > zmax)
+    return;
+
+  if (tile->tally)
+    tile->tally->touched += zmax - zmin + 1;
+
+  if (gcode_voxel_clear (gcode, xind, yind, zmin, zmax, tile->spans || tile->tally ? gcode_sim_cleared : NULL, tile))
+    tile->changed = 1;
+}
+
+/**
+ * Convert the span [lo, hi] along axis 'axis' (in material coordinates) to the
+ * range of voxel indices whose sample points fall inside it, limited to 'tile';
+ * returns zero if that range is empty (ie. the span falls between samples or
+ * outside the tile).
+ */
+
+static int
+gcode_sim_index_span (gcode_t *gcode, gcode_sim_tile_t *tile, int axis, gfloat_t lo, gfloat_t hi, int *min, int *max)
+{
+  gfloat_t scale;
+
+  scale = (gfloat_t)gcode->voxel_number[axis] / gcode->material_size[axis];
+
+  lo = ceil (lo * scale);
+  hi = floor (hi * scale);
+
+  if (lo < tile->min[axis])
+    lo = tile->min[axis];
+
+  if (hi > tile->max[axis])
+    hi = tile->max[axis];
+
+  if (lo > hi)
+    return (0);
+
+  *min = (int)lo;
+  *max = (int)hi;
+
+  return (1);
+}
+
+/**
+ * Narrow the span [lo, hi] down to the values of x satisfying c0 <= k*x + m <= c1;
+ * returns zero if nothing is left of the span.
+ */
+
+static int
+gcode_sim_clip_span (gfloat_t k, gfloat_t m, gfloat_t c0, gfloat_t c1, gfloat_t *lo, gfloat_t *hi)
+{
+  gfloat_t x0, x1;
+
+  if (fabs (k) < GCODE_PRECISION)
+    return ((m >= c0) && (m <= c1) && (*lo <= *hi));
+
+  x0 = (c0 - m) / k;
+  x1 = (c1 - m) / k;
+
+  if (k < 0.0)
+  {
+    gfloat_t t = x0;
+
+    x0 = x1;
+    x1 = t;
+  }
+
+  if (x0 > *lo)
+    *lo = x0;
+
+  if (x1 < *hi)
+    *hi = x1;
+
+  return (*lo <= *hi);
+}
+
+/**
+ * Position of the end mill expressed in material coordinates (the frame the
+ * voxel map lives in) instead of program coordinates.
+ */
+
+static void
+gcode_sim_material_pos (gcode_sim_t *sim, gcode_vec3d_t pos, gcode_vec3d_t mat)
+{
+  mat[0] = pos[0] + sim->origin[0];
+  mat[1] = pos[1] + sim->origin[1];
+  mat[2] = pos[2] - sim->origin[2];
+}
+
+/**
+ * Remove the volume swept by a flat end mill travelling in a straight line from
+ * 'p0' to 'p1' of 'motion': in XY that is a capsule, and each column inside it
+ * (and inside 'tile') gets cleared from the lowest point the tool tip reaches
+ * over it up to the cutting length (10x the tool radius, as tool length isn't
+ * used).
+ */
+
+static void
+gcode_sim_sweep_line (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_motion_t *motion, gcode_sim_tile_t *tile)
+{
+  int xind, yind, xmin, xmax, ymin, ymax;
+  gfloat_t rad, len, xt, yt, lo, hi, zlo, zhi, a, b, c, disc, t0, t1;
+  gfloat_t *p0, *p1;
+  gcode_vec3d_t dvec;
+  gcode_vec2d_t u, n;
+
+  rad = motion->rad;
+  p0 = motion->p0;
+  p1 = motion->p1;
+
+  GCODE_MATH_VEC3D_SUB (dvec, p1, p0);
+
+  len = sqrt (dvec[0] * dvec[0] + dvec[1] * dvec[1]);
+
+  GCODE_MATH_VEC2D_SET (u, 0.0, 0.0);                                           // No direction to speak of for a plunge;
+  GCODE_MATH_VEC2D_SET (n, 0.0, 0.0);
+
+  if (len > GCODE_PRECISION)
+  {
+    u[0] = dvec[0] / len;
+    u[1] = dvec[1] / len;
+    n[0] = -u[1];
+    n[1] = u[0];
+  }
+
+  if (!gcode_sim_index_span (gcode, tile, 1, motion->min[1], motion->max[1], &ymin, &ymax))
+    return;
+
+  a = dvec[0] * dvec[0] + dvec[1] * dvec[1];
+
+  for (yind = ymin; yind <= ymax; yind++)
+  {
+    gfloat_t span_lo, span_hi, dy, w;
+
+    yt = ((gfloat_t)yind * sim->vn_inv[1]) * gcode->material_size[1];
+
+    if (tile->tally)
+      tile->tally->steps++;
+
+    /**
+     * The capsule is convex, so its intersection with this row is one span:
+     * the hull of the chords of both end disks and of the rectangle between.
+     */
+
+    span_lo = FLT_MAX;
+    span_hi = -FLT_MAX;
+
+    dy = yt - p0[1];
+
+    if (fabs (dy) <= rad)
+    {
+      w = sqrt (rad * rad - dy * dy);
+      span_lo = fmin (span_lo, p0[0] - w);
+      span_hi = fmax (span_hi, p0[0] + w);
+    }
+
+    dy = yt - p1[1];
+
+    if (fabs (dy) <= rad)
+    {
+      w = sqrt (rad * rad - dy * dy);
+      span_lo = fmin (span_lo, p1[0] - w);
+      span_hi = fmax (span_hi, p1[0] + w);
+    }
+
+    if (len > GCODE_PRECISION)
+    {
+      lo = -FLT_MAX;
+      hi = FLT_MAX;
+
+      dy = yt - p0[1];
+
+      if (gcode_sim_clip_span (u[0], dy * u[1] - p0[0] * u[0], 0.0, len, &lo, &hi) &&
+          gcode_sim_clip_span (n[0], dy * n[1] - p0[0] * n[0], -rad, rad, &lo, &hi))
+      {
+        span_lo = fmin (span_lo, lo);
+        span_hi = fmax (span_hi, hi);
+      }
+    }
+
+    if (span_lo > span_hi)
+      continue;
+
+    if (!gcode_sim_index_span (gcode, tile, 0, span_lo, span_hi, &xmin, &xmax))
+      continue;
+
+    for (xind = xmin; xind <= xmax; xind++)
+    {
+      if (fabs (dvec[2]) < GCODE_PRECISION)
+      {
+        zlo = p0[2];
+        zhi = p0[2];
+      }
+      else
+      {
+        /**
+         * The tool tip descends linearly, so the lowest point it reaches over
+         * this column is at one end of the parameter range [t0, t1] for which
+         * the column lies within the cutter's radius.
+         */
+
+        xt = ((gfloat_t)xind * sim->vn_inv[0]) * gcode->material_size[0];
+
+        t0 = 0.0;
+        t1 = 1.0;
+
+        if (a > GCODE_PRECISION * GCODE_PRECISION)
+        {
+          b = (p0[0] - xt) * dvec[0] + (p0[1] - yt) * dvec[1];
+          c = (p0[0] - xt) * (p0[0] - xt) + (p0[1] - yt) * (p0[1] - yt) - rad * rad;
+          disc = b * b - a * c;
+
+          if (disc < 0.0)
+            continue;
+
+          disc = sqrt (disc);
+
+          t0 = fmax ((-b - disc) / a, 0.0);
+          t1 = fmin ((-b + disc) / a, 1.0);
+
+          if (t0 > t1)
+            continue;
+        }
+
+        zlo = fmin (p0[2] + t0 * dvec[2], p0[2] + t1 * dvec[2]);
+        zhi = fmax (p0[2] + t0 * dvec[2], p0[2] + t1 * dvec[2]);
+      }
+
+      gcode_sim_clear_column (gcode, xind, yind, zlo, zhi + 10.0 * rad, tile);
+    }
+  }
+}
+
+/**
+ * Remove the volume swept by a flat end mill travelling along the arc or helix
+ * of 'motion' (clipped to 'tile'): in XY that is a swept annulus, visited one
+ * row span at a time.
+ */
+
+static void
+gcode_sim_sweep_arc (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_motion_t *motion, gcode_sim_tile_t *tile)
+{
+  int xind, yind, xmin, xmax, ymin, ymax, i, k;
+  gfloat_t rad, xt, yt, dx, dy, dist, kappa, alpha, delta, umin, umax, lo, hi, zlo, zhi;
+  gfloat_t arc_rad, start, sweep, dir, z0, z1;
+  gfloat_t *orig;
+
+  rad = motion->rad;
+  orig = motion->p0;
+  arc_rad = motion->arc_rad;
+  start = motion->start;
+  sweep = motion->sweep;
+  dir = motion->dir;
+  z0 = motion->p0[2];
+  z1 = motion->p1[2];
+
+  if (!gcode_sim_index_span (gcode, tile, 1, motion->min[1], motion->max[1], &ymin, &ymax))
+    return;
+
+  for (yind = ymin; yind <= ymax; yind++)
+  {
+    gfloat_t span[2][2], wo, wi;
+    int spans;
+
+    yt = ((gfloat_t)yind * sim->vn_inv[1]) * gcode->material_size[1];
+    dy = yt - orig[1];
+
+    if (fabs (dy) > arc_rad + rad)
+      continue;
+
+    if (tile->tally)
+      tile->tally->steps++;
+
+    /* The annulus cuts each row into one span, or two if the row crosses the hole */
+    wo = sqrt ((arc_rad + rad) * (arc_rad + rad) - dy * dy);
+
+    if ((arc_rad > rad) && (fabs (dy) < arc_rad - rad))
+    {
+      wi = sqrt ((arc_rad - rad) * (arc_rad - rad) - dy * dy);
+
+      span[0][0] = orig[0] - wo;
+      span[0][1] = orig[0] - wi;
+      span[1][0] = orig[0] + wi;
+      span[1][1] = orig[0] + wo;
+      spans = 2;
+    }
+    else
+    {
+      span[0][0] = orig[0] - wo;
+      span[0][1] = orig[0] + wo;
+      spans = 1;
+    }
+
+    for (i = 0; i < spans; i++)
+    {
+      lo = fmax (span[i][0], motion->min[0]);
+      hi = fmin (span[i][1], motion->max[0]);
+
+      if ((lo > hi) || !gcode_sim_index_span (gcode, tile, 0, lo, hi, &xmin, &xmax))
+        continue;
+
+      for (xind = xmin; xind <= xmax; xind++)
+      {
+        xt = ((gfloat_t)xind * sim->vn_inv[0]) * gcode->material_size[0];
+        dx = xt - orig[0];
+
+        dist = sqrt (dx * dx + dy * dy);
+
+        /**
+         * The column is within reach of the cutter for tool angles no further
+         * than 'alpha' from its own angle; intersect that window (and its 2Pi
+         * shifted copies) with the swept range [0, sweep] to find where the
+         * tool passes over it first and last.
+         */
+
+        if (dist < GCODE_PRECISION)
+          kappa = (arc_rad <= rad) ? -1.0 : 2.0;
+        else
+          kappa = (arc_rad * arc_rad + dist * dist - rad * rad) / (2.0 * arc_rad * dist);
+
+        if (kappa > 1.0)
+          continue;
+
+        if (kappa <= -1.0)
+        {
+          umin = 0.0;
+          umax = sweep;
+        }
+        else
+        {
+          alpha = acos (kappa);
+          delta = fmod (dir * (atan2 (dy, dx) - start) + 2.0 * GCODE_2PI, GCODE_2PI);
+
+          umin = FLT_MAX;
+          umax = -FLT_MAX;
+
+          for (k = -1; k <= 1; k++)
+          {
+            lo = fmax (delta - alpha + k * GCODE_2PI, 0.0);
+            hi = fmin (delta + alpha + k * GCODE_2PI, sweep);
+
+            if (lo <= hi)
+            {
+              umin = fmin (umin, lo);
+              umax = fmax (umax, hi);
+            }
+          }
+
+          if (umin > umax)
+            continue;
+        }
+
+        zlo = fmin (z0 + (z1 - z0) * umin / sweep, z0 + (z1 - z0) * umax / sweep);
+        zhi = fmax (z0 + (z1 - z0) * umin / sweep, z0 + (z1 - z0) * umax / sweep);
+
+        gcode_sim_clear_column (gcode, xind, yind, zlo, zhi + 10.0 * rad, tile);
+      }
+    }
+  }
+}
+
+/**
+ * Compute the XY bounding box of the volume a motion sweeps (cutter included);
+ * for arcs that is spanned by both end points plus any axis extremes passed.
+ * Stencils reach past the cutter by as far as their centre gets snapped.
+ */
+
+static void
+gcode_sim_motion_bounds (gcode_sim_motion_t *motion)
+{
+  gfloat_t angle, delta, pad;
+  int i;
+
+  if (motion->type == GCODE_SIM_MOTION_LINE)
+  {
+    motion->min[0] = fmin (motion->p0[0], motion->p1[0]);
+    motion->min[1] = fmin (motion->p0[1], motion->p1[1]);
+    motion->max[0] = fmax (motion->p0[0], motion->p1[0]);
+    motion->max[1] = fmax (motion->p0[1], motion->p1[1]);
+  }
+  else
+  {
+    motion->min[0] = motion->max[0] = motion->p0[0] + motion->arc_rad * cos (motion->start);
+    motion->min[1] = motion->max[1] = motion->p0[1] + motion->arc_rad * sin (motion->start);
+
+    for (i = 0; i < 5; i++)
+    {
+      if (i < 4)
+      {
+        delta = fmod (motion->dir * (i * GCODE_HPI - motion->start) + 2.0 * GCODE_2PI, GCODE_2PI);
+
+        if (delta > motion->sweep)
+          continue;
+
+        angle = i * GCODE_HPI;
+      }
+      else
+      {
+        angle = motion->start + motion->dir * motion->sweep;
+      }
+
+      motion->min[0] = fmin (motion->min[0], motion->p0[0] + motion->arc_rad * cos (angle));
+      motion->max[0] = fmax (motion->max[0], motion->p0[0] + motion->arc_rad * cos (angle));
+      motion->min[1] = fmin (motion->min[1], motion->p0[1] + motion->arc_rad * sin (angle));
+      motion->max[1] = fmax (motion->max[1], motion->p0[1] + motion->arc_rad * sin (angle));
+    }
+  }
+
+  pad = motion->rad;
+
+  if (motion->stencil)                                                          // Stencils snap to the nearest column, up to half a pitch away;
+    pad += fmax (motion->stencil->pitch[0], motion->stencil->pitch[1]);
+
+  motion->min[0] -= pad;
+  motion->min[1] -= pad;
+  motion->max[0] += pad;
+  motion->max[1] += pad;
+}
+
+/**
+ * Look up the footprint of a cutter on the current voxel grid, build it if this
+ * is the first time around; depth offsets are measured from the tip to the
+ * underside of the cutter: a sphere for ball noses, a cone for v-bits.
+ */
+
+static gcode_sim_stencil_t *
+gcode_sim_stencil (gcode_t *gcode, gcode_sim_t *sim, gfloat_t diameter, uint8_t shape, gfloat_t angle)
+{
+  gcode_sim_stencil_t *stencil;
+  gcode_vec2d_t pitch;
+  gfloat_t rad, tip_rad, dy, dist;
+  int r, c, width;
+
+  pitch[0] = gcode->material_size[0] * sim->vn_inv[0];
+  pitch[1] = gcode->material_size[1] * sim->vn_inv[1];
+
+  for (stencil = sim->stencil; stencil; stencil = stencil->next)
+  {
+    if ((stencil->diameter == diameter) && (stencil->shape == shape) &&
+        (stencil->angle == angle) && (stencil->pitch[0] == pitch[0]) && (stencil->pitch[1] == pitch[1]))
+      return (stencil);
+  }
+
+  stencil = malloc (sizeof (gcode_sim_stencil_t));
+
+  if (!stencil)
+  {
+    REMARK ("Failed to allocate memory for cutter stencil\n");
+    return (NULL);
+  }
+
+  rad = 0.5 * diameter + 100.0 * GCODE_PRECISION;
+  tip_rad = 0.5 * diameter;
+
+  stencil->diameter = diameter;
+  stencil->shape = shape;
+  stencil->angle = angle;
+  stencil->pitch[0] = pitch[0];
+  stencil->pitch[1] = pitch[1];
+  stencil->reach[0] = (int)floor (rad / pitch[0]);
+  stencil->reach[1] = (int)floor (rad / pitch[1]);
+
+  width = 2 * stencil->reach[0] + 1;
+
+  stencil->span = malloc ((2 * stencil->reach[1] + 1) * sizeof (int));
+  stencil->depth = malloc ((2 * stencil->reach[1] + 1) * width * sizeof (gfloat_t));
+
+  if (!stencil->span || !stencil->depth)
+  {
+    REMARK ("Failed to allocate memory for cutter stencil\n");
+    free (stencil->span);
+    free (stencil->depth);
+    free (stencil);
+    return (NULL);
+  }
+
+  for (r = -stencil->reach[1]; r <= stencil->reach[1]; r++)
+  {
+    dy = r * pitch[1];
+
+    if (fabs (dy) > rad)
+      stencil->span[r + stencil->reach[1]] = -1;
+    else
+      stencil->span[r + stencil->reach[1]] = (int)floor (sqrt (rad * rad - dy * dy) / pitch[0]);
+
+    for (c = -stencil->reach[0]; c <= stencil->reach[0]; c++)
+    {
+      dist = fmin (sqrt (c * pitch[0] * c * pitch[0] + dy * dy), tip_rad);
+
+      if (stencil->shape == GCODE_TOOL_SHAPE_BALL)
+        stencil->depth[(r + stencil->reach[1]) * width + c + stencil->reach[0]] = tip_rad - sqrt (tip_rad * tip_rad - dist * dist);
+      else if (stencil->shape == GCODE_TOOL_SHAPE_VEE)
+        stencil->depth[(r + stencil->reach[1]) * width + c + stencil->reach[0]] = dist / tan (0.5 * stencil->angle * GCODE_DEG2RAD);
+      else
+        stencil->depth[(r + stencil->reach[1]) * width + c + stencil->reach[0]] = 0.0;
+    }
+  }
+
+  stencil->next = sim->stencil;
+  sim->stencil = stencil;
+
+  return (stencil);
+}
+
+/**
+ * Press a stencil into the stock with the tip at 'pos' (material coordinates);
+ * the centre snaps to the nearest column, which leaves every cell a plain span
+ * of voxels to clear, from its depth offset up to the cutting length.
+ */
+
+static void
+gcode_sim_stamp (gcode_t *gcode, gcode_sim_stencil_t *stencil, gfloat_t rad, gcode_vec3d_t pos, gcode_sim_tile_t *tile)
+{
+  gfloat_t *depth;
+  int xind, yind, xmin, xmax, ci, cj, r, w;
+
+  ci = (int)floor (pos[0] / stencil->pitch[0] + 0.5);
+  cj = (int)floor (pos[1] / stencil->pitch[1] + 0.5);
+
+  if (tile->tally)
+    tile->tally->steps++;
+
+  for (r = -stencil->reach[1]; r <= stencil->reach[1]; r++)
+  {
+    yind = cj + r;
+    w = stencil->span[r + stencil->reach[1]];
+
+    if ((w < 0) || (yind < tile->min[1]) || (yind > tile->max[1]))
+      continue;
+
+    xmin = ci - w < tile->min[0] ? tile->min[0] : ci - w;
+    xmax = ci + w > tile->max[0] ? tile->max[0] : ci + w;
+
+    depth = &stencil->depth[(r + stencil->reach[1]) * (2 * stencil->reach[0] + 1)];
+
+    for (xind = xmin; xind <= xmax; xind++)
+      gcode_sim_clear_column (gcode, xind, yind, pos[2] + depth[xind - ci + stencil->reach[0]], pos[2] + 10.0 * rad, tile);
+  }
+}
+
+/**
+ * Non-flat cutters get their stencil pressed in at steps of half a voxel pitch
+ * along the motion, with the tip height interpolated in between.
+ */
+
+static void
+gcode_sim_stamp_motion (gcode_t *gcode, gcode_sim_motion_t *motion, gcode_sim_tile_t *tile)
+{
+  gcode_vec3d_t pos;
+  gfloat_t len, angle, t;
+  int i, steps;
+
+  if (motion->type == GCODE_SIM_MOTION_LINE)
+    len = sqrt ((motion->p1[0] - motion->p0[0]) * (motion->p1[0] - motion->p0[0]) + (motion->p1[1] - motion->p0[1]) * (motion->p1[1] - motion->p0[1]));
+  else
+    len = motion->arc_rad * motion->sweep;
+
+  steps = (int)ceil (len / (0.5 * fmin (motion->stencil->pitch[0], motion->stencil->pitch[1])));
+
+  if (steps < 1)
+    steps = 1;
+
+  for (i = 0; i <= steps; i++)
+  {
+    t = (gfloat_t)i / (gfloat_t)steps;
+
+    if (motion->type == GCODE_SIM_MOTION_LINE)
+    {
+      pos[0] = motion->p0[0] + t * (motion->p1[0] - motion->p0[0]);
+      pos[1] = motion->p0[1] + t * (motion->p1[1] - motion->p0[1]);
+    }
+    else
+    {
+      angle = motion->start + motion->dir * t * motion->sweep;
+
+      pos[0] = motion->p0[0] + motion->arc_rad * cos (angle);
+      pos[1] = motion->p0[1] + motion->arc_rad * sin (angle);
+    }
+
+    pos[2] = motion->p0[2] + t * (motion->p1[2] - motion->p0[2]);
+
+    gcode_sim_stamp (gcode, motion->stencil, motion->rad, pos, tile);
+  }
+}
+
+/**
+ * Apply 'motion' to the part of the stock in 'tile'; if the tile counts the
+ * work done, that gets counted (and timed) for the line of the motion.
+ */
+
+static void
+gcode_sim_apply (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_motion_t *motion, gcode_sim_tile_t *tile)
+{
+  gfloat_t start;
+
+  tile->line = motion->line;
+  tile->tally = tile->tallies ? &tile->tallies[motion->line - tile->first] : NULL;
+
+  start = tile->tally ? gcode_stats_clock () : 0.0;
+
+  if (motion->stencil)
+    gcode_sim_stamp_motion (gcode, motion, tile);
+  else if (motion->type == GCODE_SIM_MOTION_LINE)
+    gcode_sim_sweep_line (gcode, sim, motion, tile);
+  else
+    gcode_sim_sweep_arc (gcode, sim, motion, tile);
+
+  if (tile->tally)
+    tile->tally->apply_time += gcode_stats_clock () - start;
+}
+
+/**
+ * Context of one worker applying the buffered motions to the tiles it owns:
+ * tiles are dealt out round-robin, so no two workers ever touch the same column.
+ */
+
+typedef struct gcode_sim_worker_s
+{
+  gcode_t *gcode;
+  gcode_sim_t *sim;
+  int index;
+  int step;                                                                     /* number of workers sharing the tiles */
+  gcode_sim_spans_t *spans;                                                     /* where to log removal, NULL if not logging */
+  gcode_stats_line_t *tallies;                                                  /* where to count the work done, NULL if not counting */
+  gcode_sim_dirty_t *dirty;                                                     /* where to flag the tiles changed, NULL if not streaming */
+} gcode_sim_worker_t;
+
+static void *
+gcode_sim_worker (void *data)
+{
+  gcode_sim_worker_t *worker;
+  gcode_sim_tile_t tile;
+  gcode_t *gcode;
+  gfloat_t tile_min[2], tile_max[2];
+  uint32_t i;
+  int t, tiles[2];
+
+  worker = (gcode_sim_worker_t *)data;
+  gcode = worker->gcode;
+
+  tile.spans = worker->spans;
+  tile.tallies = worker->tallies;
+  tile.first = worker->sim->motion[0].line;
+
+  tiles[0] = (gcode->voxel_number[0] + GCODE_SIM_TILE_SIZE - 1) / GCODE_SIM_TILE_SIZE;
+  tiles[1] = (gcode->voxel_number[1] + GCODE_SIM_TILE_SIZE - 1) / GCODE_SIM_TILE_SIZE;
+
+  for (t = worker->index; t < tiles[0] * tiles[1]; t += worker->step)
+  {
+    tile.min[0] = (t % tiles[0]) * GCODE_SIM_TILE_SIZE;
+    tile.min[1] = (t / tiles[0]) * GCODE_SIM_TILE_SIZE;
+    tile.max[0] = tile.min[0] + GCODE_SIM_TILE_SIZE - 1;
+    tile.max[1] = tile.min[1] + GCODE_SIM_TILE_SIZE - 1;
+
+    if (tile.max[0] >= gcode->voxel_number[0])
+      tile.max[0] = gcode->voxel_number[0] - 1;
+
+    if (tile.max[1] >= gcode->voxel_number[1])
+      tile.max[1] = gcode->voxel_number[1] - 1;
+
+    tile_min[0] = tile.min[0] * worker->sim->vn_inv[0] * gcode->material_size[0] - GCODE_PRECISION;
+    tile_min[1] = tile.min[1] * worker->sim->vn_inv[1] * gcode->material_size[1] - GCODE_PRECISION;
+    tile_max[0] = tile.max[0] * worker->sim->vn_inv[0] * gcode->material_size[0] + GCODE_PRECISION;
+    tile_max[1] = tile.max[1] * worker->sim->vn_inv[1] * gcode->material_size[1] + GCODE_PRECISION;
+
+    tile.changed = 0;
+
+    for (i = 0; i < worker->sim->motion_num; i++)
+    {
+      gcode_sim_motion_t *motion = &worker->sim->motion[i];
+
+      if (GCODE_MATH_IS_APART (motion->min, motion->max, tile_min, tile_max))
+        continue;
+
+      gcode_sim_apply (gcode, worker->sim, motion, &tile);
+    }
+
+    if (tile.changed && worker->dirty)
+      worker->dirty->tile[t] = 1;
+  }
+
+  return (NULL);
+}
+
+/**
+ * Make sure the dirty tile map fits the stock as it is now; a map made anew
+ * (for a new stock, or for the first time) has every tile flagged. Returns
+ * NULL if there is no memory for it.
+ */
+
+static gcode_sim_dirty_t *
+gcode_sim_dirty_prep (gcode_t *gcode)
+{
+  gcode_sim_dirty_t *dirty;
+  uint32_t tiles[2];
+
+  dirty = gcode->dirty_tiles;
+
+  if (dirty && (dirty->voxel_number[0] == gcode->voxel_number[0]) &&
+      (dirty->voxel_number[1] == gcode->voxel_number[1]) &&
+      (dirty->voxel_number[2] == gcode->voxel_number[2]))
+    return (dirty);
+
+  gcode_sim_dirty_free (gcode);
+
+  tiles[0] = (gcode->voxel_number[0] + GCODE_SIM_TILE_SIZE - 1) / GCODE_SIM_TILE_SIZE;
+  tiles[1] = (gcode->voxel_number[1] + GCODE_SIM_TILE_SIZE - 1) / GCODE_SIM_TILE_SIZE;
+
+  dirty = malloc (sizeof (gcode_sim_dirty_t));
+
+  if (dirty)
+    dirty->tile = malloc ((size_t)tiles[0] * tiles[1]);
+
+  if (!dirty || !dirty->tile)
+  {
+    REMARK ("Failed to allocate memory for streaming the simulation\n");
+    free (dirty);
+    return (NULL);
+  }
+
+  memcpy (dirty->voxel_number, gcode->voxel_number, sizeof (dirty->voxel_number));
+  dirty->tile_number[0] = tiles[0];
+  dirty->tile_number[1] = tiles[1];
+  memset (dirty->tile, 1, (size_t)tiles[0] * tiles[1]);
+
+  gcode->dirty_tiles = dirty;
+
+  return (dirty);
+}
+
+/**
+ * Drop the dirty tile map
+ */
+
+void
+gcode_sim_dirty_free (gcode_t *gcode)
+{
+  if (!gcode->dirty_tiles)
+    return;
+
+  free (gcode->dirty_tiles->tile);
+  free (gcode->dirty_tiles);
+
+  gcode->dirty_tiles = NULL;
+}
+
+/**
+ * Give up on the removal log, for lack of memory
+ */
+
+static void
+gcode_sim_log_drop (gcode_t *gcode, gcode_sim_t *sim)
+{
+  REMARK ("Failed to allocate memory for the removal log\n");
+
+  gcode_sim_log_free (gcode);
+  sim->log = NULL;
+}
+
+/**
+ * Move the spans the workers collected while applying the batch into the log,
+ * sorted by line: the motions of a batch come in line order, so its lines are
+ * a contiguous range starting at (or after) the last line logged so far.
+ */
+
+static void
+gcode_sim_log_merge (gcode_t *gcode, gcode_sim_t *sim)
+{
+  gcode_sim_log_t *log;
+  gcode_sim_span_t *span;
+  size_t *place, total, max, i;
+  uint32_t first, last, line_max, l;
+  size_t *line;
+  int t;
+
+  log = sim->log;
+
+  first = sim->motion[0].line;
+  last = sim->motion[sim->motion_num - 1].line;
+
+  for (t = 0, total = 0; t < sim->threads; t++)
+  {
+    if (sim->spans[t].failed)
+    {
+      gcode_sim_log_drop (gcode, sim);
+      return;
+    }
+
+    total += sim->spans[t].num;
+  }
+
+  /* Make room for the new lines and spans */
+  if (last + 2 > log->line_max)
+  {
+    line_max = 2 * log->line_max > last + 2 ? 2 * log->line_max : last + 2;
+    line = realloc (log->line, line_max * sizeof (size_t));
+
+    if (!line)
+    {
+      gcode_sim_log_drop (gcode, sim);
+      return;
+    }
+
+    log->line = line;
+    log->line_max = line_max;
+  }
+
+  if (log->spans.num + total > log->spans.max)
+  {
+    max = 2 * log->spans.max > log->spans.num + total ? 2 * log->spans.max : log->spans.num + total;
+    span = realloc (log->spans.span, max * sizeof (gcode_sim_span_t));
+
+    if (!span)
+    {
+      gcode_sim_log_drop (gcode, sim);
+      return;
+    }
+
+    log->spans.span = span;
+    log->spans.max = max;
+  }
+
+  place = calloc (last - first + 2, sizeof (size_t));
+
+  if (!place)
+  {
+    gcode_sim_log_drop (gcode, sim);
+    return;
+  }
+
+  /* Count the spans of each line, turn the counts into places, then deal them out */
+  for (t = 0; t < sim->threads; t++)
+    for (i = 0; i < sim->spans[t].num; i++)
+      place[sim->spans[t].span[i].line - first + 1]++;
+
+  place[0] = log->spans.num;
+
+  for (l = 1; l <= last - first + 1; l++)
+    place[l] += place[l - 1];
+
+  for (l = log->line_num; l < first; l++)                                       // Lines that cleared nothing at all;
+    log->line[l + 1] = log->spans.num;
+
+  for (l = first + 1; l <= last + 1; l++)
+    log->line[l] = place[l - first];
+
+  if (log->line_num < last + 1)
+    log->line_num = last + 1;
+
+  for (t = 0; t < sim->threads; t++)
+    for (i = 0; i < sim->spans[t].num; i++)
+      log->spans.span[place[sim->spans[t].span[i].line - first]++] = sim->spans[t].span[i];
+
+  log->spans.num += total;
+
+  free (place);
+}
+
+/**
+ * Apply every buffered motion to the stock tile by tile, the tiles shared out
+ * among 'sim->threads' workers (or all of them walked by one, serially); since
+ * removal only ever clears voxels (or lowers columns), both give bit-identical
+ * results, and a file-backed map gets read a tile at a time either way. A
+ * streaming render (one with a stream callback, not keeping a record for later
+ * passes) flags the tiles the batch changed and hands them to the callback.
+ */
+
+void
+gcode_sim_flush (gcode_t *gcode, gcode_sim_t *sim)
+{
+  gcode_sim_worker_t *worker, single;
+  gcode_sim_dirty_t *dirty;
+  gcode_stats_line_t *tallies;
+  pthread_t *thread;
+  gfloat_t start;
+  int t, started, parallel;
+
+  if (sim->motion_num == 0)
+    return;
+
+  worker = NULL;
+  thread = NULL;
+  tallies = NULL;
+  start = 0.0;
+
+  dirty = gcode->stream_callback && !sim->record ? gcode_sim_dirty_prep (gcode) : NULL;
+
+  if (sim->stats)
+  {
+    start = gcode_stats_clock ();
+    tallies = gcode_stats_batch (sim->stats, sim->threads, sim->motion[0].line, sim->motion[sim->motion_num - 1].line);
+  }
+
+  if (sim->log && !sim->spans)
+  {
+    sim->spans = calloc (sim->threads, sizeof (gcode_sim_spans_t));
+
+    if (!sim->spans)
+      gcode_sim_log_drop (gcode, sim);
+  }
+
+  if (sim->log)
+  {
+    for (t = 0; t < sim->threads; t++)
+    {
+      sim->spans[t].num = 0;
+      sim->spans[t].stride = gcode->voxel_number[0];
+    }
+  }
+
+  if (sim->threads > 1)
+  {
+    worker = malloc (sim->threads * sizeof (gcode_sim_worker_t));
+    thread = malloc (sim->threads * sizeof (pthread_t));
+  }
+
+  parallel = worker && thread;
+
+  if (parallel)
+  {
+    for (t = 0, started = 0; t < sim->threads; t++)
+    {
+      worker[t].gcode = gcode;
+      worker[t].sim = sim;
+      worker[t].index = t;
+      worker[t].step = sim->threads;
+      worker[t].spans = sim->log ? &sim->spans[t] : NULL;
+      worker[t].tallies = tallies ? &tallies[(size_t)t * sim->stats->batch_lines] : NULL;
+      worker[t].dirty = dirty;
+
+      if (pthread_create (&thread[t], NULL, gcode_sim_worker, &worker[t]) != 0)
+        break;
+
+      started++;
+    }
+
+    for (t = started; t < sim->threads; t++)                                    // Should any worker fail to start, do its share right here;
+      gcode_sim_worker (&worker[t]);
+
+    for (t = 0; t < started; t++)
+      pthread_join (thread[t], NULL);
+  }
+  else                                                                          // One worker owning every tile, so the stock still gets walked tile by tile;
+  {
+    single.gcode = gcode;
+    single.sim = sim;
+    single.index = 0;
+    single.step = 1;
+    single.spans = sim->log ? &sim->spans[0] : NULL;
+    single.tallies = tallies;
+    single.dirty = dirty;
+
+    gcode_sim_worker (&single);
+  }
+
+  free (worker);
+  free (thread);
+
+  if (sim->log)
+    gcode_sim_log_merge (gcode, sim);
+
+  if (sim->stats)
+  {
+    gcode_stats_merge (sim->stats, parallel ? sim->threads : 1);
+    sim->stats->flush_time += gcode_stats_clock () - start;
+  }
+
+  sim->motion_num = 0;
+
+  if (dirty)                                                                    // The clock starts once the viewer is done, however long it took;
+  {
+    gcode->stream_callback (gcode->gui);
+    sim->stream_time = gcode_stats_clock ();
+  }
+}
+
+/**
+ * Keep a copy of 'motion' for later replays, growing the record as needed; if
+ * that fails the whole record is dropped, which the caller can tell by 'record'
+ * being NULL.
+ */
+
+static void
+gcode_sim_record (gcode_sim_t *sim, gcode_sim_motion_t *motion)
+{
+  gcode_sim_motion_t *record;
+
+  if (sim->record_num == sim->record_max)
+  {
+    record = realloc (sim->record, 2 * sim->record_max * sizeof (gcode_sim_motion_t));
+
+    if (!record)
+    {
+      REMARK ("Failed to allocate memory for simulation motion record\n");
+      free (sim->record);
+      sim->record = NULL;
+      sim->record_num = 0;
+      sim->record_max = 0;
+      return;
+    }
+
+    sim->record = record;
+    sim->record_max *= 2;
+  }
+
+  sim->record[sim->record_num++] = *motion;
+}
+
+/**
+ * Queue up a motion to be applied to the stock; motions are buffered so that
+ * workers can be handed a decent amount of work at a time. A streaming render
+ * applies them more often than that, so the viewer keeps up with the cutter.
+ * Should the buffer have failed to allocate, each motion gets applied at once.
+ */
+
+static void
+gcode_sim_push (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_motion_t *motion)
+{
+  if (sim->dry)
+    return;
+
+  if (sim->motion && (sim->motion_num == GCODE_SIM_BATCH_SIZE))
+    gcode_sim_flush (gcode, sim);
+  else if (gcode->stream_callback && !sim->record && (sim->motion_num >= GCODE_SIM_STREAM_MOTIONS) &&
+           (gcode_stats_clock () - sim->stream_time >= GCODE_SIM_STREAM_PERIOD))
+    gcode_sim_flush (gcode, sim);
+
+  motion->rad = 0.5 * sim->tool_diameter + 100.0 * GCODE_PRECISION;
+  motion->line = sim->line;
+  motion->stencil = sim->tool_shape == GCODE_TOOL_SHAPE_FLAT ? NULL : gcode_sim_stencil (gcode, sim, sim->tool_diameter, sim->tool_shape, sim->tool_angle);
+
+  gcode_sim_motion_bounds (motion);
+
+  if (sim->record)
+    gcode_sim_record (sim, motion);
+
+  if (sim->stats && gcode_stats_grow (sim->stats, sim->line))
+    sim->stats->line[sim->line].motions++;
+
+  if (!sim->motion)                                                             // Without a buffer, apply each motion as a batch of its own;
+  {
+    sim->motion = motion;
+    sim->motion_num = 1;
+    gcode_sim_flush (gcode, sim);
+    sim->motion = NULL;
+    return;
+  }
+
+  sim->motion[sim->motion_num++] = *motion;
+}
+
+/**
+ * Apply the recorded motions [begin, end) to the stock once again, presumably
+ * at a different resolution: the geometry stays as it was, only the stencils
+ * get looked up anew for the current voxel pitch. Gives up between batches if
+ * 'simulation_stop' gets raised (by the progress callback); returns non-zero
+ * if it did.
+ */
+
+int
+gcode_sim_replay (gcode_t *gcode, gcode_sim_t *sim, size_t begin, size_t end)
+{
+  gcode_sim_stencil_t *recorded, *stencil;
+  gcode_sim_motion_t single, *buffer;
+  uint32_t batch;
+  size_t i;
+
+  recorded = NULL;
+  stencil = NULL;
+
+  buffer = sim->motion;
+  batch = GCODE_SIM_BATCH_SIZE;
+
+  if (!buffer)                                                                  // Without a buffer, replay one motion at a time;
+  {
+    sim->motion = &single;
+    batch = 1;
+  }
+
+  for (i = begin; i < end; i++)
+  {
+    if (sim->motion_num == batch)
+    {
+      gcode_sim_flush (gcode, sim);
+
+      if ((i - begin) % GCODE_SIM_BATCH_SIZE == 0)
+      {
+        if (gcode->progress_callback)
+          gcode->progress_callback (gcode->gui, (gfloat_t)i / (gfloat_t)sim->record_num);
+
+        if (gcode->simulation_stop)
+        {
+          sim->motion = buffer;
+          return (1);
+        }
+      }
+    }
+
+    sim->motion[sim->motion_num] = sim->record[i];
+
+    if (sim->record[i].stencil)
+    {
+      if (sim->record[i].stencil != recorded)                                   // Consecutive motions mostly share the same cutter;
+      {
+        recorded = sim->record[i].stencil;
+        stencil = gcode_sim_stencil (gcode, sim, recorded->diameter, recorded->shape, recorded->angle);
+      }
+
+      sim->motion[sim->motion_num].stencil = stencil;
+    }
+
+    sim->motion_num++;
+  }
+
+  gcode_sim_flush (gcode, sim);
+
+  sim->motion = buffer;
+
+  return (gcode->simulation_stop);
+}
+
+/**
+ * Convert the number at the start of [begin, end) and point 'tail' past it; no
+ * character at or after 'end' is ever looked at, so the text needs no closing
+ * '\0' (as the end of a mapped file doesn't have one). Numbers of up to 15
+ * digits come out exactly as strtod () would give them: an integer divided by
+ * a power of ten that is itself exact; longer ones are left to strtod () on a
+ * bounded copy.
+ */
+
+gfloat_t
+gcode_sim_number (char *begin, char *end, char **tail)
+{
+  static const double power[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+  char copy[64], *sp, *copy_tail;
+  uint64_t mantissa;
+  int digits, decimals, point, negative, seen;
+  gfloat_t value;
+
+  sp = begin;
+  negative = 0;
+
+  if ((sp < end) && ((*sp == '+') || (*sp == '-')))
+    negative = *sp++ == '-';
+
+  mantissa = 0;
+  digits = 0;
+  decimals = 0;
+  point = 0;
+  seen = 0;
+
+  for (; sp < end; sp++)
+  {
+    if ((*sp >= '0') && (*sp <= '9'))
+    {
+      seen = 1;
+
+      if (mantissa || (*sp != '0'))                                             // Leading zeros are not significant;
+        digits++;
+
+      if (digits <= 15)
+        mantissa = 10 * mantissa + (uint64_t)(*sp - '0');
+
+      if (point)
+        decimals++;
+    }
+    else if ((*sp == '.') && !point)
+    {
+      point = 1;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if (!seen)                                                                    // Nothing but a sign and/or a point;
+  {
+    *tail = begin;
+    return (0.0);
+  }
+
+  *tail = sp;
+
+  if ((digits > 15) || (decimals > 15))
+  {
+    if ((size_t)(sp - begin) >= sizeof (copy))
+      sp = begin + sizeof (copy) - 1;
+
+    memcpy (copy, begin, sp - begin);
+    copy[sp - begin] = '\0';
+
+    return (strtod (copy, &copy_tail));
+  }
+
+  value = (gfloat_t)mantissa / power[decimals];
+
+  return (negative ? -value : value);
+}
+
+/**
+ * Add the words of the code [begin, end) to those of 'line' in a single pass
+ * without modifying or copying it: values get converted right out of the code
+ * buffer, spaces may appear between a letter and its value, and nothing past
+ * the start of a comment is taken for a word. Returns non-zero if the rest of
+ * the line is to go unread: a comment started or there was no room for a word.
+ */
+
+static int
+gcode_sim_tokenize_more (gcode_sim_line_t *line, char *begin, char *end)
+{
+  char *tail;
+
+  while (begin < end)
+  {
+    if ((*begin == ' ') || (*begin == '\t') || (*begin == '\r'))
+    {
+      begin++;
+      continue;
+    }
+
+    if ((*begin == '(') || (*begin == ';'))
+    {
+      line->comment = begin + 1;
+      line->comment_end = end;
+
+      if (*begin == '(')
+      {
+        tail = memchr (line->comment, ')', end - line->comment);
+
+        if (tail)
+          line->comment_end = tail;
+      }
+
+      return (1);
+    }
+
+    if (line->word_num == GCODE_SIM_LINE_WORDS)
+      return (1);
+
+    line->letter[line->word_num] = toupper (*begin);
+    line->value[line->word_num] = 0.0;
+
+    begin++;
+
+    while ((begin < end) && (*begin == ' '))
+      begin++;
+
+    if ((begin < end) && strchr ("+-.0123456789", *begin))
+    {
+      line->value[line->word_num] = gcode_sim_number (begin, end, &tail);
+
+      begin = tail > begin ? tail : begin + 1;
+    }
+
+    line->word_num++;
+  }
+
+  return (0);
+}
+
+/**
+ * Split the line [begin, end) into words and a comment (see above)
+ */
+
+void
+gcode_sim_tokenize (gcode_sim_line_t *line, char *begin, char *end)
+{
+  line->word_num = 0;
+  line->comment = NULL;
+  line->comment_end = NULL;
+
+  gcode_sim_tokenize_more (line, begin, end);
+}
+
+/**
+ * Get 'reader' ready to read lines off toolpaths (see gcode_sim_read)
+ */
+
+void
+gcode_sim_reader_init (gcode_sim_reader_t *reader)
+{
+  reader->line.word_num = 0;
+  reader->line.comment = NULL;
+  reader->line.comment_end = NULL;
+  reader->ir = NULL;
+  reader->op = 0;
+  reader->offset = 0;
+  reader->pending = 0;
+  reader->skip = 0;
+}
+
+/**
+ * Have 'reader' go on with the toolpath 'ir'; a line left pending at the end
+ * of the last one carries on into it, as it would in the text of the program.
+ */
+
+void
+gcode_sim_reader_start (gcode_sim_reader_t *reader, gcode_ir_t *ir)
+{
+  reader->ir = ir;
+  reader->op = 0;
+  reader->offset = 0;
+}
+
+static void
+gcode_sim_reader_word (gcode_sim_reader_t *reader, char letter, gfloat_t value)
+{
+  if (reader->skip)
+    return;
+
+  if (reader->line.word_num == GCODE_SIM_LINE_WORDS)                            // Just as the rest of a line this long goes unread in text;
+  {
+    reader->skip = 1;
+    return;
+  }
+
+  reader->line.letter[reader->line.word_num] = letter;
+  reader->line.value[reader->line.word_num] = value;
+  reader->line.word_num++;
+}
+
+/**
+ * Read the next line of the toolpath into 'reader->line' straight from its ops,
+ * with no text written and parsed in between: every value comes out exactly as
+ * it would read back from the text gcode_ir_format () writes (to 'decimals'
+ * places, or 3 for feed rates), so the simulation follows the same path either
+ * way. Text ops get tokenized as text. Returns non-zero if a line got read,
+ * zero once the toolpath is used up (with a line left pending if its ops did
+ * not end it).
+ */
+
+int
+gcode_sim_read (gcode_t *gcode, gcode_sim_reader_t *reader)
+{
+  static const uint8_t code[] = { 0, 0, 0, 0, 1, 2, 3, 81, 83, 28 };
+  gcode_ir_t *ir;
+  gcode_ir_op_t *op;
+  gfloat_t *value;
+  char *sp, *tsp, *ep;
+  int w;
+
+  ir = reader->ir;
+
+  if (!reader->pending)                                                         // The last line read is done with;
+  {
+    reader->line.word_num = 0;
+    reader->line.comment = NULL;
+    reader->line.comment_end = NULL;
+    reader->skip = 0;
+  }
+
+  while (reader->op < ir->op_num)
+  {
+    op = &ir->op[reader->op];
+
+    if (op->type == GCODE_IR_TEXT)
+    {
+      sp = &ir->text[op->arg + reader->offset];
+      tsp = strchr (sp, '\n');
+      ep = tsp ? tsp : sp + strlen (sp);
+
+      if (ep > sp)
+      {
+        reader->pending = 1;
+
+        if (!reader->skip)
+          reader->skip = gcode_sim_tokenize_more (&reader->line, sp, ep);
+      }
+
+      if (tsp && tsp[1])
+      {
+        reader->offset = tsp + 1 - &ir->text[op->arg];
+      }
+      else
+      {
+        reader->op++;
+        reader->offset = 0;
+      }
+
+      if (tsp)
+      {
+        reader->pending = 0;
+        return (1);
+      }
+    }
+    else if (op->type == GCODE_IR_COMMENT)
+    {
+      sp = &ir->text[op->arg];
+
+      if (!reader->skip && *sp)
+      {
+        reader->line.comment = sp;
+        reader->line.comment_end = sp + strlen (sp);
+      }
+
+      reader->op++;
+      reader->pending = 0;
+      return (1);
+    }
+    else
+    {
+      value = &ir->value[op->arg];
+      reader->pending = 1;
+
+      if (op->type == GCODE_IR_SPEED)
+      {
+        gcode_sim_reader_word (reader, 'S', (gfloat_t)(int)value[0]);
+        value++;
+      }
+      else if (op->type == GCODE_IR_TOOL_CHANGE)
+      {
+        gcode_sim_reader_word (reader, 'M', 6.0);
+        gcode_sim_reader_word (reader, 'T', (gfloat_t)(int)value[0]);
+        value++;
+      }
+      else if ((op->type != GCODE_IR_WORDS) && !(op->flags & GCODE_IR_MODAL))
+      {
+        gcode_sim_reader_word (reader, 'G', (gfloat_t)code[op->type]);
+      }
+
+      for (w = 0; w < 8; w++)
+      {
+        if (!(op->words & (1 << w)))
+          continue;
+
+        gcode_sim_reader_word (reader, GCODE_IR_LETTERS[w], gcode_ir_value (*value++, (1 << w) == GCODE_IR_F ? 3 : gcode->decimals));
+      }
+
+      reader->op++;
+    }
+  }
+
+  return (0);
+}
+
+static void
+gcode_sim_parse_args (gcode_sim_t *sim, gcode_sim_line_t *line, gcode_vec3d_t xyz, gcode_vec3d_t ijk, gfloat_t *rad)
+{
+  int i;
+
+  GCODE_MATH_VEC3D_SET (ijk, 0.0, 0.0, 0.0);
+  *rad = 0.0;
+
+  /* Axes not on the line stay where they are, in either distance mode */
+  GCODE_MATH_VEC3D_COPY (xyz, sim->pos);
+
+  /**
+   * Extract arguments
+   * Scan for 'X', 'Y', and 'Z'
+   */
+  for (i = 0; i < line->word_num; i++)
+  {
+    switch (line->letter[i])
+    {
+      case 'I':
+        ijk[0] = line->value[i];
+        break;
+
+      case 'J':
+        ijk[1] = line->value[i];
+        break;
+
+      case 'K':
+        ijk[2] = line->value[i];
+        break;
+
+      case 'R':
+        *rad = line->value[i];
+        break;
+
+      case 'X':
+        xyz[0] = sim->absolute ? line->value[i] : sim->pos[0] + line->value[i];
+        break;
+
+      case 'Y':
+        xyz[1] = sim->absolute ? line->value[i] : sim->pos[1] + line->value[i];
+        break;
+
+      case 'Z':
+        xyz[2] = sim->absolute ? line->value[i] : sim->pos[2] + line->value[i];
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * Add the time a move of length 'dist' takes to the total: rapids and moves in
+ * units per minute mode go at the last feed rate given in that mode, a move in
+ * inverse time mode takes exactly as long as its F word says.
+ */
+
+static void
+gcode_sim_elapse (gcode_sim_t *sim, gfloat_t dist, int rapid)
+{
+  sim->distance += dist;
+
+  if (sim->inverse_time && !rapid)
+  {
+    if (sim->inverse_feed > GCODE_PRECISION)
+      sim->time_elapsed += 1.0 / sim->inverse_feed;
+  }
+  else if (sim->feed > GCODE_PRECISION)
+  {
+    sim->time_elapsed += dist / sim->feed;
+  }
+}
+
+void
+gcode_sim_init (gcode_sim_t *sim, gcode_t *gcode)
+{
+  sim->absolute = 1;
+
+  sim->feed = 10;
+  sim->inverse_feed = 0.0;
+  sim->inverse_time = 0;
+  sim->unit_scale = 1.0;
+  sim->tool_diameter = 1.0;
+  sim->tool_shape = GCODE_TOOL_SHAPE_FLAT;
+  sim->tool_angle = 90.0;
+
+  if (gcode->units == GCODE_UNITS_MILLIMETER)
+    sim->feed *= GCODE_INCH2MM;
+
+  sim->time_elapsed = 0.0;
+  sim->distance = 0.0;
+  sim->dry = 0;
+
+  sim->step_res = 1.0 / (gfloat_t)gcode->voxel_resolution;                      /* Default to 1/voxel_res inch stepping */
+
+  if (gcode->units == GCODE_UNITS_MILLIMETER)
+    sim->step_res *= GCODE_INCH2MM;
+
+  /**
+   * Position (0,0,0) refers to the left, back, top most corner.
+   * This allows us to treat the work piece as though it's in
+   * Quadrant-I of a 2d cartesian map.
+   */
+  GCODE_MATH_VEC3D_SET (sim->pos, 0.0, 0.0, GCODE_PRECISION);
+  GCODE_MATH_VEC3D_SET (sim->origin, 0.0, 0.0, 0.0);
+
+  sim->threads = gcode->simulation_threads;
+
+  if (sim->threads <= 0)
+    sim->threads = gcode_util_processors ();
+
+  sim->motion = malloc (GCODE_SIM_BATCH_SIZE * sizeof (gcode_sim_motion_t));
+  sim->motion_num = 0;
+
+  sim->stencil = NULL;
+
+  sim->record = NULL;
+  sim->record_num = 0;
+  sim->record_max = 0;
+
+  sim->log = NULL;
+  sim->spans = NULL;
+  sim->stats = NULL;
+  sim->stream_time = 0.0;
+  sim->line = 0;
+
+  sim->mode = GCODE_SIM_MODE_NONE;
+  sim->G83_depth = 0.0;
+  sim->G83_retract = 0.0;
+}
+
+void
+gcode_sim_free (gcode_sim_t *sim)
+{
+  gcode_sim_stencil_t *stencil;
+  int t;
+
+  free (sim->motion);
+  sim->motion = NULL;
+
+  free (sim->record);
+  sim->record = NULL;
+
+  if (sim->spans)
+  {
+    for (t = 0; t < sim->threads; t++)
+      free (sim->spans[t].span);
+
+    free (sim->spans);
+    sim->spans = NULL;
+  }
+
+  while (sim->stencil)
+  {
+    stencil = sim->stencil;
+    sim->stencil = stencil->next;
+
+    free (stencil->span);
+    free (stencil->depth);
+    free (stencil);
+  }
+}
+
+/**
+ * Common part of the rapid (rapid = 1) and the linear feed (rapid = 0) moves
+ */
+
+static void
+gcode_sim_move (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line, int rapid)
+{
+  gcode_vec3d_t xyz, ijk;
+  gcode_sim_motion_t motion;
+  gfloat_t dist, rad;
+
+  gcode_sim_parse_args (sim, line, xyz, ijk, &rad);
+
+  GCODE_MATH_VEC3D_DIST (dist, xyz, sim->pos);
+
+  /* If the move is shorter than the precision, no work to do */
+  if (dist < GCODE_PRECISION)
+    return;
+
+  /* Increment total time */
+  gcode_sim_elapse (sim, dist, rapid);
+
+  motion.type = GCODE_SIM_MOTION_LINE;
+
+  gcode_sim_material_pos (sim, sim->pos, motion.p0);
+  gcode_sim_material_pos (sim, xyz, motion.p1);
+
+  gcode_sim_push (gcode, sim, &motion);
+
+  GCODE_MATH_VEC3D_COPY (sim->pos, xyz);
+}
+
+void
+gcode_sim_G00 (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line)
+{
+  /**
+   * Rapid Move
+   * Move from the current position to the one derived from args.
+   */
+  gcode_sim_move (gcode, sim, line, 1);
+}
+
+void
+gcode_sim_G01 (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line)
+{
+  /**
+   * Linear Move
+   * Same path as a rapid move, only at the feed rate.
+   */
+  gcode_sim_move (gcode, sim, line, 0);
+}
+
+/**
+ * Common part of the clockwise (dir = -1) and counter-clockwise (dir = +1) arcs
+ */
 
 static void
-gcode_sim_intersect (gcode_t *gcode, gcode_sim_t *sim)
+gcode_sim_arc (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line, gfloat_t dir)
 {
-  int xind, yind, zind, min[3], max[3];
-  gfloat_t pos[3], xt, yt, xd, yd, rad;
+  gcode_vec3d_t xyz, ijk, orig;
+  gcode_sim_motion_t motion;
+  gfloat_t rad, src_angle, dst_angle, sweep;
+
+  gcode_sim_parse_args (sim, line, xyz, ijk, &rad);
+
+  if (rad > GCODE_PRECISION)                                                    /* XYZ Radius format */
+  {
+    /* Not implemented yet. */
+  }
+  else if (fabs (ijk[0]) > GCODE_PRECISION || fabs (ijk[1]) > GCODE_PRECISION || fabs (ijk[2]) > GCODE_PRECISION)       /* IJK format */
+  {
+    /* Calculate the origin */
+    GCODE_MATH_VEC3D_ADD (orig, sim->pos, ijk);
+
+    /**
+     * Radius is determined by the magnitude of ijk.
+     */
+    GCODE_MATH_VEC3D_MAG (rad, ijk);
+
+    src_angle = atan2 (sim->pos[1] - orig[1], sim->pos[0] - orig[0]);
+    dst_angle = atan2 (xyz[1] - orig[1], xyz[0] - orig[0]);
+
+    /**
+     * Add 2Pi to the sweep for 2 reasons:
+     * - Solves the problem of having dst_angle equal to src_angle for a complete circle.
+     * - Solves the problem of going from 270 degrees clockwise to 90 degrees.
+     */
+    sweep = dir * (dst_angle - src_angle);
+
+    while (sweep <= GCODE_PRECISION)
+      sweep += GCODE_2PI;
+
+    /* Increment total time */
+    gcode_sim_elapse (sim, sqrt (rad * sweep * rad * sweep + (xyz[2] - sim->pos[2]) * (xyz[2] - sim->pos[2])), 0);
+
+    motion.type = GCODE_SIM_MOTION_ARC;
+    motion.arc_rad = rad;
+    motion.start = src_angle;
+    motion.sweep = sweep;
+    motion.dir = dir;
 
-  rad = 0.5 * sim->tool_diameter + 100.0 * GCODE_PRECISION;
+    gcode_sim_material_pos (sim, orig, motion.p0);
+    gcode_sim_material_pos (sim, xyz, motion.p1);
 
-  /* Increment total movement */
-  sim->time_elapsed += sim->step_res;
+    motion.p0[2] = sim->pos[2] - sim->origin[2];                                // The centre takes the starting height of the helix;
+
+    gcode_sim_push (gcode, sim, &motion);
+
+    GCODE_MATH_VEC3D_COPY (sim->pos, xyz);
+  }
+}
 
-  pos[0] = sim->pos[0] + sim->origin[0];
-  pos[1] = sim->pos[1] + sim->origin[1];
-  pos[2] = sim->pos[2] - sim->origin[2];
+void
+gcode_sim_G02 (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line)
+{
+  /**
+   * Clockwise Arc
+   * Move clockwise until reaching the arc length specificed
+   * by xyz.
+   */
+  gcode_sim_arc (gcode, sim, line, -1.0);
+}
 
-  /* Take into account the origin of the cutter relative to the position of the cutter */
-  min[0] = (int)((gfloat_t)gcode->voxel_number[0]) * (pos[0] - rad) / gcode->material_size[0];
-  min[1] = (int)((gfloat_t)gcode->voxel_number[1]) * (pos[1] - rad) / gcode->material_size[1];
-  min[2] = (int)((gfloat_t)gcode->voxel_number[2]) * (gcode->material_size[2] + pos[2]) / gcode->material_size[2];
+void
+gcode_sim_G03 (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line)
+{
+  /**
+   * Counter-Clockwise Arc
+   * Move counter-clockwise until reaching the arc length specificed
+   * by xyz.
+   */
+  gcode_sim_arc (gcode, sim, line, 1.0);
+}
 
-  /* Set the cutter to be 0.5" high */
-  max[0] = (int)((gfloat_t)gcode->voxel_number[0]) * (pos[0] + rad) / gcode->material_size[0];
-  max[1] = (int)((gfloat_t)gcode->voxel_number[1]) * (pos[1] + rad) / gcode->material_size[1];
-  /* Because tool cutting length isn't used yet, use 10x the tool radius */
-  max[2] = (int)((gfloat_t)gcode->voxel_number[2]) * (gcode->material_size[2] + pos[2] + (10.0 * rad)) / gcode->material_size[2];
+void
+gcode_sim_G83 (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line, gfloat_t *G83_depth, gfloat_t *G83_retract, int init)
+{
+  gcode_vec3d_t xyz, ijk;
+  gcode_sim_motion_t motion;
+  gfloat_t retract;
 
-  if (min[0] < 0)
-    min[0] = 0;
+  gcode_sim_parse_args (sim, line, xyz, ijk, &retract);
 
-  if (min[1] < 0)
-    min[1] = 0;
+  if (init)
+  {
+    *G83_retract = retract;
+    *G83_depth = xyz[2];
+  }
 
-  if (min[2] < 0)
-    min[2] = 0;
+  sim->pos[0] = xyz[0];
+  sim->pos[1] = xyz[1];
+  sim->pos[2] = *G83_retract;
+  xyz[2] = *G83_depth;
 
-  if (max[0] < 0)
-    max[0] = min[0] - 1;
+  /* If the plunge is shorter than the precision, no work to do */
+  if (fabs (sim->pos[2] - xyz[2]) < GCODE_PRECISION)
+    return;
 
-  if (max[1] < 0)
-    max[1] = min[1] - 1;
+  /* Increment total time */
+  gcode_sim_elapse (sim, fabs (sim->pos[2] - xyz[2]), 0);
 
-  if (max[2] < 0)
-    max[2] = min[2] - 1;
+  /* The hole is a plain cylinder: the swept volume of a vertical line */
+  motion.type = GCODE_SIM_MOTION_LINE;
 
-  if (max[0] >= gcode->voxel_number[0])
-    max[0] = gcode->voxel_number[0] - 1;
+  gcode_sim_material_pos (sim, sim->pos, motion.p0);
+  gcode_sim_material_pos (sim, xyz, motion.p1);
 
-  if (max[1] >= gcode->voxel_number[1])
-    max[1] = gcode->voxel_number[1] - 1;
+  gcode_sim_push (gcode, sim, &motion);
 
-  if (max[2] >= gcode->voxel_number[2])
-    max[2] = gcode->voxel_number[2] - 1;
+  GCODE_MATH_VEC3D_COPY (sim->pos, xyz);
+}
 
-  if (min[0] >= gcode->voxel_number[0])
-    min[0] = max[0] + 1;
+/**
+ * Carry out one line of G-code the way a controller would: the words setting
+ * modal state - units (G20/G21), distance mode (G90/G91), feed rate mode (G93/
+ * G94) and the feed rate itself - take effect first, wherever they are on the
+ * line; then comes the motion, either the one named on the line or, for a line
+ * with nothing but axis words, the one still in effect from an earlier line.
+ * Lengths in inches get converted to millimeters and vice versa as needed to
+ * match the units of the project.
+ */
 
-  if (min[1] >= gcode->voxel_number[1])
-    min[1] = max[1] + 1;
+static void
+gcode_sim_follow (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line)
+{
+  uint32_t motion;
+  int i, axes, named, dwell;
 
-  if (min[2] >= gcode->voxel_number[2])
-    min[2] = max[2] + 1;
+  motion = sim->mode;
+  axes = 0;
+  named = 0;
+  dwell = 0;
 
-  for (yind = min[1]; yind <= max[1]; yind++)
+  for (i = 0; i < line->word_num; i++)
   {
-    yt = ((gfloat_t)yind * sim->vn_inv[1]) * gcode->material_size[1];
-    yd = yt - pos[1];
+    if (line->letter[i] != 'G')
+      continue;
 
-    for (xind = min[0]; xind <= max[0]; xind++)
+    switch ((int)line->value[i])
     {
-      xt = ((gfloat_t)xind * sim->vn_inv[0]) * gcode->material_size[0];
-      xd = xt - pos[0];
-
-      if ((xd * xd + yd * yd) <= rad * rad)
-        for (zind = min[2]; zind <= max[2]; zind++)
-          gcode->voxel_map[(zind * gcode->voxel_number[1] + yind) * gcode->voxel_number[0] + xind] = 0;
-    }
-  }
-}
-
-static void
-gcode_sim_parse_args (gcode_sim_t *sim, char *args, gcode_vec3d_t xyz, gcode_vec3d_t ijk, gfloat_t *rad)
-{
-  uint8_t sind, len;
-  char string[256];
-
-  GCODE_MATH_VEC3D_SET (ijk, 0.0, 0.0, 0.0);
-  *rad = 0.0;
+      case 0:
+      case 1:
+      case 2:
+      case 3:
+      case 80:
+      case 81:
+      case 83:
+        motion = (uint32_t)line->value[i];
+        named = 1;
+        break;
 
-  if (sim->absolute == 1)
-  {
-    GCODE_MATH_VEC3D_COPY (xyz, sim->pos);
-  }
-  else
-  {
-    GCODE_MATH_VEC3D_SET (xyz, 0.0, 0.0, 0.0);
-  }
+      case 4:
+        dwell = 1;
+        axes = -1;
+        break;
 
-  /**
-   * Extract arguments
-   * Scan for 'X', 'Y', and 'Z'
-   */
-  sind = 0;
+      case 10:                                                                  // Non-modal codes that take the axis words for themselves;
+      case 28:
+      case 30:
+      case 53:
+      case 92:
+        axes = -1;
+        break;
 
-  while (args[sind])
-  {
-    sind++;
+      case 20:
+        sim->unit_scale = gcode->units == GCODE_UNITS_MILLIMETER ? GCODE_INCH2MM : 1.0;
+        break;
 
-    len = strspn (&args[sind], "-.0123456789");
-    memset (string, 0, 256);
-    memcpy (string, &args[sind], len);
+      case 21:
+        sim->unit_scale = gcode->units == GCODE_UNITS_INCH ? GCODE_MM2INCH : 1.0;
+        break;
 
-    switch (args[sind - 1])
-    {
-      case 'F':
-      case 'f':
-        sim->feed = atof (string);
+      case 90:
+        sim->absolute = 1;
         break;
 
-      case 'I':
-      case 'i':
-        ijk[0] = atof (string);
+      case 91:
+        sim->absolute = 0;
         break;
 
-      case 'J':
-      case 'j':
-        ijk[1] = atof (string);
+      case 93:
+        sim->inverse_time = 1;
         break;
 
-      case 'K':
-      case 'k':
-        ijk[2] = atof (string);
+      case 94:
+        sim->inverse_time = 0;
         break;
 
-      case 'R':
-      case 'r':
-        *rad = atof (string);
+      default:
         break;
+    }
+  }
 
+  for (i = 0; i < line->word_num; i++)
+  {
+    switch (line->letter[i])
+    {
       case 'X':
-      case 'x':
-        xyz[0] = atof (string);
+      case 'Y':
+      case 'Z':
+        if (axes == 0)
+          axes = 1;
+        line->value[i] *= sim->unit_scale;
         break;
 
-      case 'Y':
-      case 'y':
-        xyz[1] = atof (string);
+      case 'I':
+      case 'J':
+      case 'K':
+      case 'Q':
+      case 'R':
+        line->value[i] *= sim->unit_scale;
         break;
 
-      case 'Z':
-      case 'z':
-        xyz[2] = atof (string);
+      case 'F':
+        if (sim->inverse_time)
+          sim->inverse_feed = line->value[i];
+        else
+          sim->feed = line->value[i] * sim->unit_scale;
+        break;
+
+      case 'P':
+        if (dwell)                                                              // Dwell for P seconds;
+          sim->time_elapsed += line->value[i] / 60.0;
         break;
 
       default:
         break;
     }
-
-    sind += len;
   }
-}
 
-void
-gcode_sim_init (gcode_sim_t *sim, gcode_t *gcode)
-{
-  sim->absolute = 1;
+  sim->mode = motion;
 
-  sim->feed = 10;
-  sim->tool_diameter = 1.0;
+  if (!named && (axes != 1))                                                    // No motion on this line;
+    return;
 
-  if (gcode->units == GCODE_UNITS_MILLIMETER)
-    sim->feed *= GCODE_INCH2MM;
+  switch (motion)
+  {
+    case 0:
+      gcode_sim_G00 (gcode, sim, line);
+      break;
 
-  sim->time_elapsed = 0.0;
+    case 1:
+      gcode_sim_G01 (gcode, sim, line);
+      break;
 
-  sim->step_res = 1.0 / (gfloat_t)gcode->voxel_resolution;                      /* Default to 1/voxel_res inch stepping */
+    case 2:
+      gcode_sim_G02 (gcode, sim, line);
+      break;
 
-  if (gcode->units == GCODE_UNITS_MILLIMETER)
-    sim->step_res *= GCODE_INCH2MM;
+    case 3:
+      gcode_sim_G03 (gcode, sim, line);
+      break;
 
-  /**
-   * Position (0,0,0) refers to the left, back, top most corner.
-   * This allows us to treat the work piece as though it's in
-   * Quadrant-I of a 2d cartesian map.
-   */
-  GCODE_MATH_VEC3D_SET (sim->pos, 0.0, 0.0, GCODE_PRECISION);
-}
+    case 81:
+    case 83:
+      gcode_sim_G83 (gcode, sim, line, &sim->G83_depth, &sim->G83_retract, named);
+      break;
 
-void
-gcode_sim_free (gcode_sim_t *sim)
-{
+    default:
+      break;
+  }
 }
 
+/**
+ * Simulate one line of G-code (see gcode_sim_follow); while statistics are being
+ * gathered, the length of its path and the time it took to follow (batches of
+ * motions it got applied along the way aside) go to the line.
+ */
+
 void
-gcode_sim_G00 (gcode_t *gcode, gcode_sim_t *sim, char *args)
+gcode_sim_line (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line)
 {
-  gcode_vec3d_t xyz, ijk, dvec, orig;
-  gfloat_t cur_dist, tot_dist, mag, rad;
+  gcode_stats_line_t *stats;
+  gfloat_t start, flush_time, distance;
 
-  /**
-   * Rapid Move
-   * Move from the current position to the one derived from args.
-   */
-  gcode_sim_parse_args (sim, args, xyz, ijk, &rad);
+  if (!sim->stats)
+  {
+    gcode_sim_follow (gcode, sim, line);
+    return;
+  }
 
-  GCODE_MATH_VEC3D_COPY (orig, sim->pos);
-  GCODE_MATH_VEC3D_DIST (tot_dist, xyz, orig);
+  start = gcode_stats_clock ();
+  flush_time = sim->stats->flush_time;
+  distance = sim->distance;
 
-  /* Build delta vector */
-  GCODE_MATH_VEC3D_SUB (dvec, xyz, orig);
+  gcode_sim_follow (gcode, sim, line);
 
-  /* If the delta vector is zero, no work to do */
-  GCODE_MATH_VEC3D_MAG (mag, dvec);
+  stats = gcode_stats_grow (sim->stats, sim->line);
 
-  if (mag < GCODE_PRECISION)
+  if (!stats)
     return;
 
-  GCODE_MATH_VEC3D_UNITIZE (dvec);
-  GCODE_MATH_VEC3D_MUL_SCALAR (dvec, dvec, sim->step_res);
-  GCODE_MATH_VEC3D_MAG (mag, dvec);
+  stats->length += sim->distance - distance;
+  stats->parse_time += gcode_stats_clock () - start - (sim->stats->flush_time - flush_time);
+}
+
+/**
+ * Hand every line of the program to 'func' along with 'data' and the top level
+ * block the line starts in, read right off the toolpath of each block (see
+ * gcode_sim_read) exactly as the simulation reads it, so that line numbers
+ * agree with those of the removal log.
+ */
+
+void
+gcode_sim_walk (gcode_t *gcode, void *data, gcode_sim_walk_t *func)
+{
+  gcode_block_t *index_block, *line_block;
+  gcode_sim_reader_t reader;
+
+  gcode_sim_reader_init (&reader);
+
+  line_block = NULL;
 
-  do
+  for (index_block = gcode->listhead; index_block; index_block = index_block->next)
   {
-    GCODE_MATH_VEC3D_ADD (sim->pos, sim->pos, dvec);
+    if (!reader.pending)                                                        // A line left pending belongs to the block it started in;
+      line_block = index_block;
 
-    GCODE_MATH_VEC3D_DIST (cur_dist, sim->pos, orig);
+    gcode_sim_reader_start (&reader, &index_block->ir);
 
-    /* Clamp the position once it gets close to its destination */
-    if (cur_dist > tot_dist)
+    while (gcode_sim_read (gcode, &reader))
     {
-      gcode_vec3d_t tvec;
-      gfloat_t tmag;
+      func (data, line_block, &reader.line);
 
-      GCODE_MATH_VEC3D_SUB (tvec, sim->pos, xyz);
-      GCODE_MATH_VEC3D_MAG (tmag, tvec);
-
-      GCODE_MATH_VEC3D_COPY (sim->pos, xyz);
+      line_block = index_block;
     }
+  }
 
-    /* Perform Intersection test */
-    gcode_sim_intersect (gcode, sim);
-  } while (cur_dist < tot_dist);
+  if (reader.pending)                                                           // A last line without a newline;
+    func (data, line_block, &reader.line);
 }
 
+/**
+ * Record the state of the simulator in 'checkpoint'; the caller fills in the
+ * rest (block and hash).
+ */
+
 void
-gcode_sim_G01 (gcode_t *gcode, gcode_sim_t *sim, char *args)
+gcode_sim_checkpoint_save_state (gcode_sim_t *sim, gcode_sim_checkpoint_t *checkpoint)
 {
-  gcode_sim_G00 (gcode, sim, args);
+  GCODE_MATH_VEC3D_COPY (checkpoint->pos, sim->pos);
+  GCODE_MATH_VEC3D_COPY (checkpoint->origin, sim->origin);
+
+  checkpoint->tool_diameter = sim->tool_diameter;
+  checkpoint->tool_shape = sim->tool_shape;
+  checkpoint->tool_angle = sim->tool_angle;
+  checkpoint->feed = sim->feed;
+  checkpoint->inverse_feed = sim->inverse_feed;
+  checkpoint->inverse_time = sim->inverse_time;
+  checkpoint->unit_scale = sim->unit_scale;
+  checkpoint->absolute = sim->absolute;
+  checkpoint->time_elapsed = sim->time_elapsed;
+  checkpoint->line = sim->line;
+  checkpoint->mode = sim->mode;
+  checkpoint->G83_depth = sim->G83_depth;
+  checkpoint->G83_retract = sim->G83_retract;
 }
 
+/**
+ * Record the stock in 'checkpoint' after applying every buffered motion
+ */
+
 void
-gcode_sim_G02 (gcode_t *gcode, gcode_sim_t *sim, char *args)
+gcode_sim_checkpoint_save_stock (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_checkpoint_t *checkpoint)
 {
-  gcode_vec3d_t xyz, ijk, tvec, orig;
-  gfloat_t rad, step_angle, src_angle, dst_angle;
+  gcode_sim_flush (gcode, sim);
 
-  /**
-   * Clockwise Arc
-   * Move clockwise until reaching the arc length specificed
-   * by xyz.
-   */
-  gcode_sim_parse_args (sim, args, xyz, ijk, &rad);
+  free (checkpoint->stock);
 
-  if (rad > GCODE_PRECISION)                                                    /* XYZ Radius format */
+  if (gcode->stock_model == GCODE_STOCK_HEIGHT)
   {
-    /* Not implemented yet. */
+    checkpoint->stock = gcode_util_pack_words ((uint32_t *)gcode->height_map, (size_t)gcode->voxel_number[0] * gcode->voxel_number[1], &checkpoint->stock_count);
   }
-  else if (fabs (ijk[0]) > GCODE_PRECISION || fabs (ijk[1]) > GCODE_PRECISION || fabs (ijk[2]) > GCODE_PRECISION)       /* IJK format */
+  else if (gcode->voxel_map)
   {
-    /* Calculate the origin */
-    GCODE_MATH_VEC3D_ADD (orig, sim->pos, ijk);
+    checkpoint->stock = gcode_voxel_pack (gcode, &checkpoint->stock_count);
+  }
+  else
+  {
+    checkpoint->stock = NULL;
+  }
+}
 
-    /**
-     * Radius is determined by the magnitude of ijk.
-     */
-    GCODE_MATH_VEC3D_MAG (rad, ijk);
+void
+gcode_sim_checkpoint_restore_stock (gcode_t *gcode, gcode_sim_checkpoint_t *checkpoint)
+{
+  if (gcode->stock_model == GCODE_STOCK_HEIGHT)
+    gcode_util_unpack_words (checkpoint->stock, checkpoint->stock_count, (uint32_t *)gcode->height_map);
+  else
+    gcode_voxel_unpack (gcode, checkpoint->stock, checkpoint->stock_count);
+}
 
-    step_angle = sim->step_res / rad;
+void
+gcode_sim_checkpoint_restore (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_checkpoint_t *checkpoint)
+{
+  gcode_sim_checkpoint_restore_stock (gcode, checkpoint);
+
+  GCODE_MATH_VEC3D_COPY (sim->pos, checkpoint->pos);
+  GCODE_MATH_VEC3D_COPY (sim->origin, checkpoint->origin);
+
+  sim->tool_diameter = checkpoint->tool_diameter;
+  sim->tool_shape = checkpoint->tool_shape;
+  sim->tool_angle = checkpoint->tool_angle;
+  sim->feed = checkpoint->feed;
+  sim->inverse_feed = checkpoint->inverse_feed;
+  sim->inverse_time = checkpoint->inverse_time;
+  sim->unit_scale = checkpoint->unit_scale;
+  sim->absolute = checkpoint->absolute;
+  sim->time_elapsed = checkpoint->time_elapsed;
+  sim->line = checkpoint->line;
+  sim->mode = checkpoint->mode;
+  sim->G83_depth = checkpoint->G83_depth;
+  sim->G83_retract = checkpoint->G83_retract;
+}
 
-    GCODE_MATH_VEC3D_SUB (tvec, sim->pos, orig);
-    GCODE_MATH_VEC3D_UNITIZE (tvec);
-    GCODE_MATH_VEC3D_ANGLE (src_angle, tvec[0], tvec[1]);
+/**
+ * Drop every checkpoint: called whenever the stock gets reallocated, as none of
+ * them would fit the new one.
+ */
 
-    GCODE_MATH_VEC3D_SUB (tvec, xyz, orig);
-    GCODE_MATH_VEC3D_UNITIZE (tvec);
-    GCODE_MATH_VEC3D_ANGLE (dst_angle, tvec[0], tvec[1]);
-    /**
-     * Add 2Pi to dst_angle for 2 reasons:
-     * - Solves the problem of having dst_angle equal to src_angle for a complete circle.
-     * - Solves the problem of going from 270 degrees clockwise to 90 degrees.
-     */
-    if (src_angle - GCODE_PRECISION <= dst_angle)
-      src_angle += GCODE_2PI;
+void
+gcode_sim_checkpoint_free (gcode_t *gcode)
+{
+  uint32_t i;
 
-    /* Go from src_angle to dst_angle by step_angle increments */
-    while (src_angle - step_angle > dst_angle)
-    {
-      tvec[0] = rad * cos (src_angle);
-      tvec[1] = rad * sin (src_angle);
-      tvec[2] = 0;
-      GCODE_MATH_VEC3D_ADD (sim->pos, orig, tvec);
-      gcode_sim_intersect (gcode, sim);
+  for (i = 0; i < gcode->checkpoint_num; i++)
+    free (gcode->checkpoint[i].stock);
 
-      src_angle -= step_angle;
-    }
-    GCODE_MATH_VEC3D_COPY (sim->pos, xyz);
-  }
+  free (gcode->checkpoint);
+
+  gcode->checkpoint = NULL;
+  gcode->checkpoint_num = 0;
 }
 
-void
-gcode_sim_G03 (gcode_t *gcode, gcode_sim_t *sim, char *args)
+/**
+ * Get the removal log ready to record the render about to start, keeping what
+ * was logged for the first 'line' lines (from a render of the same stock that
+ * got at least that far); returns NULL if there is no log that could be kept
+ * or no memory for a new one.
+ */
+
+gcode_sim_log_t *
+gcode_sim_log_start (gcode_t *gcode, uint32_t line)
 {
-  gcode_vec3d_t xyz, ijk, tvec, orig;
-  gfloat_t rad, step_angle, src_angle, dst_angle;
+  gcode_sim_log_t *log;
 
-  /**
-   * Clockwise Arc
-   * Move clockwise until reaching the arc length specificed
-   * by xyz.
-   */
-  gcode_sim_parse_args (sim, args, xyz, ijk, &rad);
+  log = gcode->removal_log;
 
-  if (rad > GCODE_PRECISION)                                                    /* XYZ Radius format */
+  if (log && line)
   {
-    /* Not implemented yet. */
+    if ((log->voxel_number[0] != gcode->voxel_number[0]) || (log->voxel_number[1] != gcode->voxel_number[1]) ||
+        (log->voxel_number[2] != gcode->voxel_number[2]) || (log->line_num < line))
+    {
+      gcode_sim_log_free (gcode);
+      return (NULL);
+    }
   }
-  else if (fabs (ijk[0]) > GCODE_PRECISION || fabs (ijk[1]) > GCODE_PRECISION || fabs (ijk[2]) > GCODE_PRECISION)       /* IJK format */
+  else if (line)
   {
-    /* Calculate the origin */
-    GCODE_MATH_VEC3D_ADD (orig, sim->pos, ijk);
-
-    /**
-     * Radius is determined by the magnitude of ijk.
-     */
-    GCODE_MATH_VEC3D_MAG (rad, ijk);
-
-    step_angle = sim->step_res / rad;
+    return (NULL);
+  }
 
-    GCODE_MATH_VEC3D_SUB (tvec, sim->pos, orig);
-    GCODE_MATH_VEC3D_UNITIZE (tvec);
-    GCODE_MATH_VEC3D_ANGLE (src_angle, tvec[0], tvec[1]);
+  if (!log)
+  {
+    log = malloc (sizeof (gcode_sim_log_t));
 
-    GCODE_MATH_VEC3D_SUB (tvec, xyz, orig);
-    GCODE_MATH_VEC3D_UNITIZE (tvec);
-    GCODE_MATH_VEC3D_ANGLE (dst_angle, tvec[0], tvec[1]);
+    if (!log)
+    {
+      REMARK ("Failed to allocate memory for the removal log\n");
+      return (NULL);
+    }
 
-    /**
-     * Add 2Pi to dst_angle for 2 reasons:
-     * - Solves the problem of having dst_angle equal to src_angle for a complete circle.
-     * - Solves the problem of going from 270 degrees clockwise to 90 degrees.
-     */
-    if (src_angle + GCODE_PRECISION >= dst_angle)
-      dst_angle += GCODE_2PI;
+    log->spans.span = NULL;
+    log->spans.max = 0;
+    log->spans.failed = 0;
+    log->line = malloc (1024 * sizeof (size_t));
+    log->line_max = 1024;
+    log->line_num = 0;
 
-    /* Go from src_angle to dst_angle by step_angle increments */
-    while (src_angle + step_angle < dst_angle)
+    if (!log->line)
     {
-      tvec[0] = rad * cos (src_angle);
-      tvec[1] = rad * sin (src_angle);
-      tvec[2] = 0;
-      GCODE_MATH_VEC3D_ADD (sim->pos, orig, tvec);
-      gcode_sim_intersect (gcode, sim);
-
-      src_angle += step_angle;
+      REMARK ("Failed to allocate memory for the removal log\n");
+      free (log);
+      return (NULL);
     }
-    GCODE_MATH_VEC3D_COPY (sim->pos, xyz);
+
+    log->line[0] = 0;
+
+    gcode->removal_log = log;
   }
+
+  log->spans.num = log->line[line];
+  log->line_num = line;
+  log->position = line;
+
+  return (log);
 }
 
+/**
+ * Close the log of a render that went all the way through 'sim->line' lines
+ */
+
 void
-gcode_sim_G83 (gcode_t *gcode, gcode_sim_t *sim, char *args, gfloat_t *G83_depth, gfloat_t *G83_retract, int init)
+gcode_sim_log_finish (gcode_t *gcode, gcode_sim_t *sim)
 {
-  gcode_vec3d_t xyz, ijk, dvec, orig;
-  gfloat_t cur_dist, tot_dist, mag, retract;
+  gcode_sim_log_t *log;
+  size_t *line;
 
-  gcode_sim_parse_args (sim, args, xyz, ijk, &retract);
+  log = sim->log;
 
-  if (init)
+  if (sim->line + 1 > log->line_max)
   {
-    *G83_retract = retract;
-    *G83_depth = xyz[2];
+    line = realloc (log->line, (sim->line + 1) * sizeof (size_t));
+
+    if (!line)
+    {
+      gcode_sim_log_drop (gcode, sim);
+      return;
+    }
+
+    log->line = line;
+    log->line_max = sim->line + 1;
   }
 
-  sim->pos[0] = xyz[0];
-  sim->pos[1] = xyz[1];
-  sim->pos[2] = *G83_retract;
-  xyz[2] = *G83_depth;
+  for (; log->line_num < sim->line; log->line_num++)
+    log->line[log->line_num + 1] = log->spans.num;
+
+  log->voxel_number[0] = gcode->voxel_number[0];
+  log->voxel_number[1] = gcode->voxel_number[1];
+  log->voxel_number[2] = gcode->voxel_number[2];
 
-  GCODE_MATH_VEC3D_COPY (orig, sim->pos);
-  GCODE_MATH_VEC3D_DIST (tot_dist, xyz, orig);
+  log->position = log->line_num;
+}
+
+/**
+ * Bring the stock to how it was right after the first 'line' lines, applying
+ * or reverting the spans of the lines in between; the time it takes depends on
+ * those lines only, not on the size of the stock or the program.
+ */
 
-  /* Build delta vector */
-  GCODE_MATH_VEC3D_SUB (dvec, xyz, orig);
+void
+gcode_sim_log_seek (gcode_t *gcode, uint32_t line)
+{
+  gcode_sim_log_t *log;
+  gcode_sim_span_t *span;
+  size_t i, x, y;
 
-  /* If the delta vector is zero, no work to do */
-  GCODE_MATH_VEC3D_MAG (mag, dvec);
+  log = gcode->removal_log;
+
+  if (!log)
+    return;
 
-  if (mag < GCODE_PRECISION)
+  if ((log->voxel_number[0] != gcode->voxel_number[0]) || (log->voxel_number[1] != gcode->voxel_number[1]) ||
+      (log->voxel_number[2] != gcode->voxel_number[2]))
     return;
 
-  GCODE_MATH_VEC3D_UNITIZE (dvec);
-  GCODE_MATH_VEC3D_MUL_SCALAR (dvec, dvec, sim->step_res);
-  GCODE_MATH_VEC3D_MAG (mag, dvec);
+  if (line > log->line_num)
+    line = log->line_num;
 
-  do
+  if (line != log->position)                                                    // The walls compared to the design are about to move;
+    gcode_deviation_free (gcode);
+
+  while (log->position > line)                                                  // Going back: put the material back in place;
   {
-    GCODE_MATH_VEC3D_ADD (sim->pos, sim->pos, dvec);
+    log->position--;
 
-    GCODE_MATH_VEC3D_DIST (cur_dist, sim->pos, orig);
+    for (i = log->line[log->position]; i < log->line[log->position + 1]; i++)
+    {
+      span = &log->spans.span[i];
+
+      if (gcode->stock_model == GCODE_STOCK_HEIGHT)
+      {
+        memcpy (&gcode->height_map[span->column], &span->lo, sizeof (uint32_t));
+      }
+      else
+      {
+        x = span->column % gcode->voxel_number[0];
+        y = span->column / gcode->voxel_number[0];
+
+        gcode_voxel_set (gcode, x, y, span->lo, span->hi);
+      }
+    }
+  }
 
-    /* Clamp the position once it gets close to its destination */
-    if (cur_dist > tot_dist)
+  while (log->position < line)                                                  // Going forward: take it away again;
+  {
+    for (i = log->line[log->position]; i < log->line[log->position + 1]; i++)
     {
-      gcode_vec3d_t tvec;
-      gfloat_t tmag;
+      span = &log->spans.span[i];
+
+      if (gcode->stock_model == GCODE_STOCK_HEIGHT)
+      {
+        memcpy (&gcode->height_map[span->column], &span->hi, sizeof (uint32_t));
+      }
+      else
+      {
+        x = span->column % gcode->voxel_number[0];
+        y = span->column / gcode->voxel_number[0];
+
+        gcode_voxel_clear (gcode, x, y, span->lo, span->hi, NULL, NULL);
+      }
+    }
+
+    log->position++;
+  }
+}
+
+/**
+ * Volume of material line 'line' of the last render removed, according to the
+ * removal log; zero if there is no log or it doesn't go that far.
+ */
+
+gfloat_t
+gcode_sim_log_volume (gcode_t *gcode, uint32_t line)
+{
+  gcode_sim_log_t *log;
+  gcode_sim_span_t *span;
+  gfloat_t cell, volume;
+  float lo, hi;
+  size_t i;
+
+  log = gcode->removal_log;
+
+  if (!log || (line >= log->line_num))
+    return (0.0);
 
-      GCODE_MATH_VEC3D_SUB (tvec, sim->pos, xyz);
-      GCODE_MATH_VEC3D_MAG (tmag, tvec);
+  cell = (gcode->material_size[0] / log->voxel_number[0]) * (gcode->material_size[1] / log->voxel_number[1]);
 
-      GCODE_MATH_VEC3D_COPY (sim->pos, xyz);
+  if (gcode->stock_model != GCODE_STOCK_HEIGHT)
+    cell *= gcode->material_size[2] / log->voxel_number[2];
+
+  volume = 0.0;
+
+  for (i = log->line[line]; i < log->line[line + 1]; i++)
+  {
+    span = &log->spans.span[i];
+
+    if (gcode->stock_model == GCODE_STOCK_HEIGHT)                               // Tops of the column before and after;
+    {
+      memcpy (&lo, &span->lo, sizeof (float));
+      memcpy (&hi, &span->hi, sizeof (float));
+
+      volume += lo - hi;
+    }
+    else
+    {
+      volume += span->hi - span->lo + 1;
     }
+  }
+
+  return (volume * cell);
+}
+
+void
+gcode_sim_log_free (gcode_t *gcode)
+{
+  if (!gcode->removal_log)
+    return;
+
+  free (gcode->removal_log->spans.span);
+  free (gcode->removal_log->line);
+  free (gcode->removal_log);
 
-    /* Perform Intersection test */
-    gcode_sim_intersect (gcode, sim);
-  } while (cur_dist < tot_dist);
+  gcode->removal_log = NULL;
 }
@@ -23,26 +23,265 @@
 #define _GCODE_SIM_H
 
 #include "gcode_internal.h"
+#include "gcode_stats.h"
+#include "gcode_voxel.h"
+
+#define GCODE_SIM_MOTION_LINE   0x00
+#define GCODE_SIM_MOTION_ARC    0x01
+
+#define GCODE_SIM_BATCH_SIZE    0x10000                                         /* Motions buffered before they get applied to the stock */
+#define GCODE_SIM_TILE_SIZE     GCODE_VOXEL_REGION_SIZE                         /* Edge length (in columns) of the tiles workers own: one region of the voxel map */
+
+#define GCODE_SIM_STREAM_MOTIONS  256                                           /* Motions buffered at the least before a streaming render applies them */
+#define GCODE_SIM_STREAM_PERIOD   0.1                                           /* Seconds between batches applied by a streaming render */
+
+#define GCODE_SIM_LINE_WORDS    32                                              /* Words kept per line; any further ones are ignored */
+
+#define GCODE_SIM_MODE_NONE     80                                              /* No motion in effect (G80) */
+
+/**
+ * One line of G-code split into words (a letter and the value following it) and
+ * a comment; the comment is not copied, it points into the code it came from.
+ */
+
+typedef struct gcode_sim_line_s
+{
+  uint8_t word_num;
+  char letter[GCODE_SIM_LINE_WORDS];
+  gfloat_t value[GCODE_SIM_LINE_WORDS];
+  char *comment;                                                                /* text following '(' or ';', NULL if none */
+  char *comment_end;                                                            /* end of that text (exclusive) */
+} gcode_sim_line_t;
+
+/**
+ * Where reading lines off the toolpaths of blocks is at (see gcode_sim_read)
+ */
+
+typedef struct gcode_sim_reader_s
+{
+  gcode_sim_line_t line;                                                        /* line read last, or being read */
+  gcode_ir_t *ir;                                                               /* toolpath being read */
+  uint32_t op;                                                                  /* next op of it to read */
+  uint32_t offset;                                                              /* how far into the text of that op (text ops only) */
+  uint8_t pending;                                                              /* the line being read has been started on */
+  uint8_t skip;                                                                 /* the rest of that line goes unread */
+} gcode_sim_reader_t;
+
+/**
+ * Footprint of a cutter on the voxel grid, centred on a column: for each row of
+ * the footprint the half-width (in columns) of the cells it covers, and for each
+ * cell the height of the cutter's underside above the tip; built once for every
+ * distinct (diameter, shape, voxel pitch) and kept around for reuse.
+ */
+
+typedef struct gcode_sim_stencil_s
+{
+  gfloat_t diameter;
+  uint8_t shape;
+  gfloat_t angle;
+  gcode_vec2d_t pitch;
+  int reach[2];                                                                 /* rows/columns covered on either side of the centre */
+  int *span;                                                                    /* half-width of each row; -1 if the row is not touched */
+  gfloat_t *depth;                                                              /* height offset of each cell, row after row */
+  struct gcode_sim_stencil_s *next;
+} gcode_sim_stencil_t;
+
+/**
+ * A single motion reduced to the geometry of the volume it sweeps, expressed in
+ * material coordinates; lines run from 'p0' to 'p1', arcs turn around 'p0' with
+ * radius 'arc_rad' from angle 'start' through 'sweep' radians in direction 'dir'
+ * (+1 CCW, -1 CW) while the height changes from p0[2] to p1[2].
+ */
+
+typedef struct gcode_sim_motion_s
+{
+  uint8_t type;
+  gfloat_t rad;                                                                 /* cutter radius */
+  gcode_sim_stencil_t *stencil;                                                 /* footprint of non-flat cutters (NULL for flat ones) */
+  gcode_vec3d_t p0;
+  gcode_vec3d_t p1;
+  gfloat_t arc_rad;
+  gfloat_t start;
+  gfloat_t sweep;
+  gfloat_t dir;
+  gcode_vec2d_t min;                                                            /* XY bounding box of the swept volume */
+  gcode_vec2d_t max;
+  uint32_t line;                                                                /* line of the program it came from */
+} gcode_sim_motion_t;
+
+/**
+ * Voxels 'lo' to 'hi' of column 'column' (y * voxel_number[0] + x) that line
+ * 'line' of the program cleared; with the height field model 'lo' and 'hi' hold
+ * the top of the column (the bits of the float, that is) before and after.
+ */
+
+typedef struct gcode_sim_span_s
+{
+  uint32_t line;
+  size_t column;
+  uint32_t lo;
+  uint32_t hi;
+} gcode_sim_span_t;
+
+/**
+ * Growable array of spans; workers each collect those of the motions they apply
+ * in one, to be merged into the removal log in line order after every batch.
+ */
+
+typedef struct gcode_sim_spans_s
+{
+  gcode_sim_span_t *span;
+  size_t num;
+  size_t max;
+  uint32_t stride;                                                              /* columns per row of the stock */
+  uint8_t failed;                                                               /* ran out of memory, some spans are missing */
+} gcode_sim_spans_t;
+
+/**
+ * Removal log of the last render: the spans of every line of the program, in
+ * line order, 'line[n]' being the first span of line n and 'line[line_num]' one
+ * past the last of all; the stock shows the removal by the first 'position'
+ * lines, scrubbing moves it by applying or reverting whole lines of spans.
+ */
+
+typedef struct gcode_sim_log_s
+{
+  uint32_t voxel_number[3];                                                     /* stock the spans belong to */
+  gcode_sim_spans_t spans;
+  size_t *line;
+  uint32_t line_num;
+  uint32_t line_max;
+  uint32_t position;
+} gcode_sim_log_t;
+
+/**
+ * Rectangle of voxel columns (inclusive index bounds) a sweep is confined to,
+ * along with where to log the voxels it clears (if anywhere) and for what line,
+ * and where to count the work it takes
+ */
+
+typedef struct gcode_sim_tile_s
+{
+  int min[2];
+  int max[2];
+  gcode_sim_spans_t *spans;
+  uint32_t line;
+  gcode_stats_line_t *tallies;                                                  /* where to count the work done by line (if anywhere) */
+  uint32_t first;                                                               /* line the first of 'tallies' is for */
+  gcode_stats_line_t *tally;                                                    /* that of the line being applied, NULL if not counting */
+  uint8_t changed;                                                              /* raised once anything in the tile gets removed */
+} gcode_sim_tile_t;
+
+/**
+ * Tiles of the stock a streaming render changed since the viewer last looked:
+ * the simulator raises the flag of every tile it removes anything from as it
+ * applies a batch, the viewer clears the flags of the tiles it draws anew.
+ */
+
+typedef struct gcode_sim_dirty_s
+{
+  uint32_t voxel_number[3];                                                     /* stock the tiles belong to */
+  uint32_t tile_number[2];
+  uint8_t *tile;                                                                /* one flag per tile, X running fastest */
+} gcode_sim_dirty_t;
+
+/**
+ * Snapshot taken as the simulation reached 'block' (NULL past the last block):
+ * the stock packed by gcode_util_pack_words () and the simulator's state; valid
+ * only as long as 'hash' still matches the code of 'block' and of all blocks
+ * before it matched theirs.
+ */
+
+typedef struct gcode_sim_checkpoint_s
+{
+  gcode_block_t *block;
+  uint64_t hash;                                                                /* hash of the code of 'block' */
+  uint32_t *stock;                                                              /* packed stock, NULL if none could be taken */
+  size_t stock_count;
+  gcode_vec3d_t pos;
+  gfloat_t tool_diameter;
+  uint8_t tool_shape;
+  gfloat_t tool_angle;
+  gfloat_t origin[3];
+  gfloat_t feed;
+  gfloat_t inverse_feed;
+  uint8_t inverse_time;
+  gfloat_t unit_scale;
+  uint8_t absolute;
+  gfloat_t time_elapsed;
+  uint32_t mode;
+  gfloat_t G83_depth;
+  gfloat_t G83_retract;
+  uint32_t line;                                                                /* lines simulated before it */
+  size_t motion;                                                                /* motions recorded before it (progressive rendering) */
+  uint8_t pending;                                                              /* taken on a coarse pass, stock still to be saved */
+} gcode_sim_checkpoint_t;
 
 typedef struct gcode_sim_s
 {
   gcode_vec3d_t pos;                                                            /* end mill position */
   gfloat_t tool_diameter;                                                       /* end mill diameter */
+  uint8_t tool_shape;                                                           /* end mill shape */
+  gfloat_t tool_angle;                                                          /* included angle of v-bits */
   gfloat_t origin[3];                                                           /* material origin */
   gfloat_t feed;                                                                /* units per minute */
+  gfloat_t inverse_feed;                                                        /* moves per minute while in inverse time mode */
+  uint8_t inverse_time;                                                         /* feed rate mode: units per minute (G94) or inverse time (G93) */
+  gfloat_t unit_scale;                                                          /* program units to project units (G20/G21) */
   uint8_t absolute;                                                             /* absolute or relative coordinates */
-  gfloat_t time_elapsed;                                                        /* time elapsed */
+  gfloat_t time_elapsed;                                                        /* time elapsed (minutes) */
+  gfloat_t distance;                                                            /* length of the path travelled so far */
+  uint8_t dry;                                                                  /* only follow the code, leave the stock alone */
   gfloat_t step_res;                                                            /* step resolution */
   gcode_vec3d_t vn_inv;                                                         /* voxel number inverse */
+  int threads;                                                                  /* number of workers applying motions (1 = serial) */
+  gcode_sim_motion_t *motion;                                                   /* motions not yet applied to the stock */
+  uint32_t motion_num;
+  gcode_sim_stencil_t *stencil;                                                 /* cutter footprints built so far */
+  gcode_sim_motion_t *record;                                                   /* every motion pushed while this is allocated */
+  size_t record_num;
+  size_t record_max;
+  gcode_sim_log_t *log;                                                         /* removal log being recorded, NULL if none */
+  gcode_sim_spans_t *spans;                                                     /* spans collected by each worker */
+  gcode_stats_t *stats;                                                         /* statistics being gathered, NULL if none */
+  gfloat_t stream_time;                                                         /* when the viewer last got to show a batch (streaming only) */
+  uint32_t line;                                                                /* line of the program being simulated */
+  uint32_t mode;                                                                /* motion in effect: 0, 1, 2, 3, 81, 83 or none (80) */
+  gfloat_t G83_depth;
+  gfloat_t G83_retract;
 } gcode_sim_t;
 
+typedef void gcode_sim_walk_t (void *data, gcode_block_t *block, gcode_sim_line_t *line);
+
 void gcode_sim_init (gcode_sim_t *sim, gcode_t *gcode);
 void gcode_sim_free (gcode_sim_t *sim);
+void gcode_sim_flush (gcode_t *gcode, gcode_sim_t *sim);
+int gcode_sim_replay (gcode_t *gcode, gcode_sim_t *sim, size_t begin, size_t end);
+void gcode_sim_checkpoint_save_state (gcode_sim_t *sim, gcode_sim_checkpoint_t *checkpoint);
+void gcode_sim_checkpoint_save_stock (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_checkpoint_t *checkpoint);
+void gcode_sim_checkpoint_restore_stock (gcode_t *gcode, gcode_sim_checkpoint_t *checkpoint);
+void gcode_sim_checkpoint_restore (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_checkpoint_t *checkpoint);
+void gcode_sim_checkpoint_free (gcode_t *gcode);
+void gcode_sim_dirty_free (gcode_t *gcode);
+
+gcode_sim_log_t *gcode_sim_log_start (gcode_t *gcode, uint32_t line);
+void gcode_sim_log_finish (gcode_t *gcode, gcode_sim_t *sim);
+void gcode_sim_log_seek (gcode_t *gcode, uint32_t line);
+gfloat_t gcode_sim_log_volume (gcode_t *gcode, uint32_t line);
+void gcode_sim_log_free (gcode_t *gcode);
+
+gfloat_t gcode_sim_number (char *begin, char *end, char **tail);
+void gcode_sim_tokenize (gcode_sim_line_t *line, char *begin, char *end);
+void gcode_sim_reader_init (gcode_sim_reader_t *reader);
+void gcode_sim_reader_start (gcode_sim_reader_t *reader, gcode_ir_t *ir);
+int gcode_sim_read (gcode_t *gcode, gcode_sim_reader_t *reader);
+void gcode_sim_line (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line);
+void gcode_sim_walk (gcode_t *gcode, void *data, gcode_sim_walk_t *func);
 
-void gcode_sim_G00 (gcode_t *gcode, gcode_sim_t *sim, char *args);
-void gcode_sim_G01 (gcode_t *gcode, gcode_sim_t *sim, char *args);
-void gcode_sim_G02 (gcode_t *gcode, gcode_sim_t *sim, char *args);
-void gcode_sim_G03 (gcode_t *gcode, gcode_sim_t *sim, char *args);
-void gcode_sim_G83 (gcode_t *gcode, gcode_sim_t *sim, char *args, gfloat_t *G83_depth, gfloat_t *G83_retract, int init);
+void gcode_sim_G00 (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line);
+void gcode_sim_G01 (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line);
+void gcode_sim_G02 (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line);
+void gcode_sim_G03 (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line);
+void gcode_sim_G83 (gcode_t *gcode, gcode_sim_t *sim, gcode_sim_line_t *line, gfloat_t *G83_depth, gfloat_t *G83_retract, int init);
 
 #endif
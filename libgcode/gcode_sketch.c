@@ -571,7 +571,7 @@ gcode_sketch_free (gcode_block_t **block)
     tmp->free (&tmp);
   }
 
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
@@ -1037,8 +1037,7 @@ gcode_sketch_make (gcode_block_t *block)
                 index2_block->offset->z[0] = z;
                 index2_block->offset->z[1] = z;
 
-                index2_block->make (index2_block);
-                GCODE_APPEND (block, index2_block->code);
+                GCODE_MAKE_INTO (block, index2_block);
 
                 index2_block = index2_block->next;
               }
@@ -1098,8 +1097,7 @@ gcode_sketch_make (gcode_block_t *block)
           index2_block->offset->z[1] = z;
         }
 
-        index2_block->make (index2_block);                                      // FINALLY! Just make that darned block and be done with it...
-        GCODE_APPEND (block, index2_block->code);
+        GCODE_MAKE_INTO (block, index2_block);                                  // FINALLY! Just make that darned block and be done with it...
 
         index2_block = index2_block->next;                                      // ...well, not before we do the same thing for each of them.
       }
@@ -1130,6 +1128,122 @@ gcode_sketch_make (gcode_block_t *block)
   sketch->offset.eval = 0.0;
 }
 
+/**
+ * Collect the closed outlines the sketch is meant to leave behind at depth 'z':
+ * the same sub-chains 'make' mills at that depth, offset by the taper and the
+ * extrusion profile but not by the tool radius - this is the wall of the part,
+ * not the path of the tool. Each outline is a zero-offset list of its own that
+ * the caller disposes of; open sub-chains have no inside and are left out.
+ */
+
+int
+gcode_sketch_outline (gcode_block_t *block, gfloat_t z, gcode_block_t ***outline_array, int *outline_num)
+{
+  gcode_sketch_t *sketch;
+  gcode_extrusion_t *extrusion;
+  gcode_block_t *sorted_listhead, *offset_listhead, **array;
+  gcode_block_t *start_block, *index_block;
+  gcode_vec2d_t p0, p1, e0, e1, t;
+  gfloat_t z0, z1, current_proffset;
+  int error;
+
+  *outline_array = NULL;
+  *outline_num = 0;
+
+  if (!block->listhead)
+    return (0);
+
+  sketch = (gcode_sketch_t *)block->pdata;
+  extrusion = (gcode_extrusion_t *)block->extruder->pdata;
+
+  block->extruder->ends (block->extruder, p0, p1, GCODE_GET);
+
+  z0 = fmax (p0[1], p1[1]);
+  z1 = fmin (p0[1], p1[1]);
+
+  gcode_extrusion_evaluate_offset (block->extruder, z, &current_proffset);
+
+  gcode_util_get_sublist_snapshot (&sorted_listhead, block->listhead, NULL);
+  gcode_util_remove_null_sections (&sorted_listhead);
+  gcode_util_merge_list_fragments (&sorted_listhead);
+
+  error = 0;
+
+  index_block = sorted_listhead;
+
+  while (index_block)
+  {
+    start_block = index_block;
+
+    while (index_block->next)                                                   // Find the end of the sub-chain exactly the way 'make' does;
+    {
+      index_block->ends (index_block, t, e0, GCODE_GET);
+      index_block->next->ends (index_block->next, e1, t, GCODE_GET);
+
+      if (GCODE_MATH_2D_MANHATTAN (e0, e1) > GCODE_TOLERANCE)
+        break;
+
+      index_block = index_block->next;
+    }
+
+    start_block->ends (start_block, e0, t, GCODE_GET);
+    index_block->ends (index_block, t, e1, GCODE_GET);
+
+    if (GCODE_MATH_2D_MANHATTAN (e0, e1) < GCODE_TOLERANCE)
+    {
+      array = realloc (*outline_array, (*outline_num + 1) * sizeof (gcode_block_t *));
+
+      if (!array)
+      {
+        error = 1;
+        break;
+      }
+
+      *outline_array = array;
+
+      sketch->offset.side = gcode_sketch_inside (start_block, index_block);     // The profile offset pushes the wall the same way it pushes the tool;
+      sketch->offset.tool = 0.0;                                                // the tool radius is what the wall should NOT be moved by;
+
+      if (extrusion->cut_side == GCODE_EXTRUSION_INSIDE)
+        sketch->offset.side *= -1.0;
+
+      sketch->offset.origin[0] = block->offset->origin[0];
+      sketch->offset.origin[1] = block->offset->origin[1];
+      sketch->offset.rotation = block->offset->rotation;
+
+      if (z0 - z1 > GCODE_PRECISION)
+      {
+        sketch->offset.origin[0] += sketch->taper_offset[0] * (z0 - z) / (z0 - z1);
+        sketch->offset.origin[1] += sketch->taper_offset[1] * (z0 - z) / (z0 - z1);
+      }
+
+      sketch->offset.eval = current_proffset;
+
+      gcode_util_get_sublist_snapshot (&offset_listhead, start_block, index_block);
+      gcode_util_convert_to_no_offset (offset_listhead);
+      gcode_util_remove_null_sections (&offset_listhead);
+
+      if (offset_listhead)
+      {
+        gcode_sketch_trim_intersections (offset_listhead, 1);
+        gcode_sketch_insert_transitions (offset_listhead, 1);
+
+        array[(*outline_num)++] = offset_listhead;
+      }
+    }
+
+    index_block = index_block->next;
+  }
+
+  gcode_list_free (&sorted_listhead);
+
+  sketch->offset.side = 0.0;
+  sketch->offset.tool = 0.0;
+  sketch->offset.eval = 0.0;
+
+  return (error);
+}
+
 /**
  * Draw the contents of the sketch either as several contour lines (one for each
  * milling pass as determined by the extrusion resolution) or as a single curve
@@ -52,6 +52,7 @@ void gcode_sketch_free (gcode_block_t **block);
 void gcode_sketch_save (gcode_block_t *block, FILE *fh);
 void gcode_sketch_load (gcode_block_t *block, FILE *fh);
 void gcode_sketch_make (gcode_block_t *block);
+int gcode_sketch_outline (gcode_block_t *block, gfloat_t z, gcode_block_t ***outline_array, int *outline_num);
 void gcode_sketch_draw (gcode_block_t *block, gcode_block_t *selected);
 void gcode_sketch_aabb (gcode_block_t *block, gcode_vec2d_t min, gcode_vec2d_t max);
 void gcode_sketch_move (gcode_block_t *block, gcode_vec2d_t delta);
@@ -0,0 +1,472 @@
+/**
+ *  gcode_stats.c
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gcode_stats.h"
+#include "gcode_sim.h"
+#include "gcode.h"
+#include <string.h>
+#include <libgen.h>
+#include <locale.h>
+#include <time.h>
+
+/**
+ * Seconds on a clock that only ever goes forward, good for timing intervals
+ */
+
+gfloat_t
+gcode_stats_clock (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return ((gfloat_t)now.tv_sec + 1e-9 * (gfloat_t)now.tv_nsec);
+}
+
+/**
+ * Start gathering the statistics of a render of code from 'source', dropping
+ * those of the last one; returns NULL (and leaves none) if out of memory.
+ */
+
+gcode_stats_t *
+gcode_stats_start (gcode_t *gcode, uint8_t source)
+{
+  gcode_stats_t *stats;
+
+  gcode_stats_free (gcode);
+
+  stats = malloc (sizeof (gcode_stats_t));
+
+  if (!stats)
+  {
+    REMARK ("Failed to allocate memory for the simulation statistics\n");
+    return (NULL);
+  }
+
+  stats->source = source;
+  stats->line = NULL;
+  stats->line_num = 0;
+  stats->line_max = 0;
+  stats->batch = NULL;
+  stats->batch_first = 0;
+  stats->batch_lines = 0;
+  stats->flush_time = 0.0;
+  stats->total_time = 0.0;
+  stats->failed = 0;
+
+  gcode->line_stats = stats;
+
+  return (stats);
+}
+
+/**
+ * Statistics of line 'line', making room for (and zeroing) every line up to it
+ * as needed; returns NULL if that fails, which also raises 'failed'.
+ */
+
+gcode_stats_line_t *
+gcode_stats_grow (gcode_stats_t *stats, uint32_t line)
+{
+  gcode_stats_line_t *grown;
+  uint32_t max;
+
+  if (line < stats->line_num)
+    return (&stats->line[line]);
+
+  if (line >= stats->line_max)
+  {
+    max = 2 * stats->line_max > line + 1 ? 2 * stats->line_max : line + 1;
+
+    if (max < 1024)
+      max = 1024;
+
+    grown = realloc (stats->line, max * sizeof (gcode_stats_line_t));
+
+    if (!grown)
+    {
+      stats->failed = 1;
+      return (NULL);
+    }
+
+    stats->line = grown;
+    stats->line_max = max;
+  }
+
+  memset (&stats->line[stats->line_num], 0, (line + 1 - stats->line_num) * sizeof (gcode_stats_line_t));
+  stats->line_num = line + 1;
+
+  return (&stats->line[line]);
+}
+
+/**
+ * Zeroed tallies for 'threads' workers to apply the batch of lines 'first' to
+ * 'last' with, one run of (last - first + 1) lines after the other; NULL if
+ * out of memory, in which case the batch goes uncounted.
+ */
+
+gcode_stats_line_t *
+gcode_stats_batch (gcode_stats_t *stats, int threads, uint32_t first, uint32_t last)
+{
+  free (stats->batch);
+
+  stats->batch_first = first;
+  stats->batch_lines = last - first + 1;
+  stats->batch = calloc ((size_t)threads * stats->batch_lines, sizeof (gcode_stats_line_t));
+
+  if (!stats->batch)
+    stats->failed = 1;
+
+  return (stats->batch);
+}
+
+/**
+ * Add up the tallies of the workers for the batch just applied into the
+ * statistics of its lines.
+ */
+
+void
+gcode_stats_merge (gcode_stats_t *stats, int threads)
+{
+  gcode_stats_line_t *line, *tally;
+  uint32_t l;
+  int t;
+
+  if (!stats->batch)
+    return;
+
+  for (l = 0; l < stats->batch_lines; l++)
+  {
+    line = gcode_stats_grow (stats, stats->batch_first + l);
+
+    if (!line)
+      break;
+
+    for (t = 0; t < threads; t++)
+    {
+      tally = &stats->batch[(size_t)t * stats->batch_lines + l];
+
+      line->steps += tally->steps;
+      line->columns += tally->columns;
+      line->touched += tally->touched;
+      line->cleared += tally->cleared;
+      line->apply_time += tally->apply_time;
+    }
+  }
+
+  free (stats->batch);
+  stats->batch = NULL;
+}
+
+/**
+ * Sum up the statistics of lines [begin, end) of the last render into 'sum';
+ * returns non-zero if there are none to sum up.
+ */
+
+int
+gcode_stats_sum (gcode_t *gcode, uint32_t begin, uint32_t end, gcode_stats_line_t *sum)
+{
+  gcode_stats_t *stats;
+  gcode_stats_line_t *line;
+  uint32_t l;
+
+  memset (sum, 0, sizeof (gcode_stats_line_t));
+
+  stats = gcode->line_stats;
+
+  if (!stats || (begin >= stats->line_num))
+    return (1);
+
+  if (end > stats->line_num)
+    end = stats->line_num;
+
+  for (l = begin; l < end; l++)
+  {
+    line = &stats->line[l];
+
+    sum->length += line->length;
+    sum->motions += line->motions;
+    sum->steps += line->steps;
+    sum->columns += line->columns;
+    sum->touched += line->touched;
+    sum->cleared += line->cleared;
+    sum->parse_time += line->parse_time;
+    sum->apply_time += line->apply_time;
+  }
+
+  return (0);
+}
+
+/**
+ * Writing the statistics out: the lines get walked the way the simulation
+ * split them, for the code and top level block of each to go along with its
+ * figures; lines of an external file go without.
+ */
+
+typedef struct gcode_stats_dump_s
+{
+  gcode_t *gcode;
+  gcode_stats_t *stats;
+  FILE *fh;
+  uint8_t format;
+  uint32_t line;
+  gcode_block_t *block;                                                         /* top level block of the last line written */
+  uint32_t block_index;
+} gcode_stats_dump_t;
+
+/**
+ * Write the text [begin, end) as part of a CSV field or JSON string
+ */
+
+static void
+gcode_stats_escape (FILE *fh, uint8_t format, const char *begin, const char *end)
+{
+  const char *sp;
+
+  for (sp = begin; sp < end; sp++)
+  {
+    if (*sp == '"')
+      fputs (format == GCODE_STATS_FORMAT_CSV ? "\"\"" : "\\\"", fh);
+    else if ((*sp == '\\') && (format == GCODE_STATS_FORMAT_JSON))
+      fputs ("\\\\", fh);
+    else if ((unsigned char)*sp < ' ')                                          // Carriage returns and tabs alike;
+      fputc (' ', fh);
+    else
+      fputc (*sp, fh);
+  }
+}
+
+/**
+ * Write the text [begin, end) as a quoted CSV field or JSON string
+ */
+
+static void
+gcode_stats_string (FILE *fh, uint8_t format, const char *begin, const char *end)
+{
+  fputc ('"', fh);
+  gcode_stats_escape (fh, format, begin, end);
+  fputc ('"', fh);
+}
+
+/**
+ * Write the words of 'line' (as the simulation read them) and its comment as a
+ * quoted CSV field or JSON string: G, M and T codes with two digits at least,
+ * feed rates with 3 decimals and other values with those of the project.
+ */
+
+static void
+gcode_stats_code (FILE *fh, uint8_t format, gcode_t *gcode, gcode_sim_line_t *line)
+{
+  char number[GCODE_IR_NUMBER_SIZE];
+  gfloat_t value;
+  int i;
+
+  fputc ('"', fh);
+
+  for (i = 0; i < line->word_num; i++)
+  {
+    value = line->value[i];
+
+    if (i)
+      fputc (' ', fh);
+
+    fputc (line->letter[i], fh);
+
+    if (strchr ("GMTS", line->letter[i]) && (value == (int)value))
+      fprintf (fh, "%0*d", line->letter[i] == 'S' ? 1 : 2, (int)value);
+    else
+      fwrite (number, 1, gcode_ir_number (number, value, line->letter[i] == 'F' ? 3 : gcode->decimals), fh);
+  }
+
+  if (line->comment)
+  {
+    fputs (line->word_num ? " (" : "(", fh);
+    gcode_stats_escape (fh, format, line->comment, line->comment_end);
+    fputc (')', fh);
+  }
+
+  fputc ('"', fh);
+}
+
+static void
+gcode_stats_dump_line (gcode_stats_dump_t *dump, gcode_block_t *block, gcode_sim_line_t *code)
+{
+  gcode_stats_line_t *line;
+  const char *comment;
+
+  if (dump->line >= dump->stats->line_num)
+    return;
+
+  line = &dump->stats->line[dump->line];
+
+  if (block != dump->block)
+  {
+    if (dump->block)
+      dump->block_index++;
+
+    dump->block = block;
+  }
+
+  comment = block ? block->comment : "";
+
+  if (dump->format == GCODE_STATS_FORMAT_CSV)
+  {
+    fprintf (dump->fh, "%u,", dump->line + 1);
+
+    if (block)
+      fprintf (dump->fh, "%u,", dump->block_index);
+    else
+      fputc (',', dump->fh);
+
+    gcode_stats_string (dump->fh, dump->format, comment, comment + strlen (comment));
+
+    fprintf (dump->fh, ",%.6f,%u,%llu,%llu,%llu,%llu,%.6f,%.6f,",
+             line->length, line->motions, (unsigned long long)line->steps, (unsigned long long)line->columns,
+             (unsigned long long)line->touched, (unsigned long long)line->cleared,
+             1000.0 * line->parse_time, 1000.0 * line->apply_time);
+
+    if (code)
+      gcode_stats_code (dump->fh, dump->format, dump->gcode, code);
+
+    fputc ('\n', dump->fh);
+  }
+  else
+  {
+    fprintf (dump->fh, "%s    { \"line\": %u, ", dump->line ? ",\n" : "", dump->line + 1);
+
+    if (block)
+    {
+      fprintf (dump->fh, "\"block\": %u, \"comment\": ", dump->block_index);
+      gcode_stats_string (dump->fh, dump->format, comment, comment + strlen (comment));
+      fputs (", ", dump->fh);
+    }
+
+    fprintf (dump->fh, "\"length\": %.6f, \"motions\": %u, \"steps\": %llu, \"columns\": %llu, \"touched\": %llu, \"cleared\": %llu, \"parse_ms\": %.6f, \"apply_ms\": %.6f",
+             line->length, line->motions, (unsigned long long)line->steps, (unsigned long long)line->columns,
+             (unsigned long long)line->touched, (unsigned long long)line->cleared,
+             1000.0 * line->parse_time, 1000.0 * line->apply_time);
+
+    if (code)
+    {
+      fputs (", \"code\": ", dump->fh);
+      gcode_stats_code (dump->fh, dump->format, dump->gcode, code);
+    }
+
+    fputs (" }", dump->fh);
+  }
+
+  dump->line++;
+}
+
+static void
+gcode_stats_dump_walk (void *data, gcode_block_t *block, gcode_sim_line_t *line)
+{
+  gcode_stats_dump_line ((gcode_stats_dump_t *)data, block, line);
+}
+
+/**
+ * Export the statistics of the last render to 'filename', as CSV (one row per
+ * line of the program) or JSON (the lines plus the totals of the render);
+ * times are in milliseconds. Returns non-zero on failure.
+ */
+
+int
+gcode_stats_export (gcode_t *gcode, char *filename, uint8_t format)
+{
+  gcode_stats_dump_t dump;
+  gcode_stats_line_t total;
+  int failed;
+
+  if (!gcode->line_stats)
+  {
+    REMARK ("No simulation statistics to export\n");
+    return (1);
+  }
+
+  dump.fh = fopen (filename, "w");
+
+  if (!dump.fh)
+  {
+    REMARK ("Failed to open file '%s'\n", basename (filename));
+    return (1);
+  }
+
+  /**
+   * Write the numbers with a period as the decimal separator whatever the
+   * locale of the user interface, or the columns of the CSV would split and
+   * the JSON would not parse.
+   */
+
+  setlocale (LC_NUMERIC, "C");
+
+  dump.gcode = gcode;
+  dump.stats = gcode->line_stats;
+  dump.format = format;
+  dump.line = 0;
+  dump.block = NULL;
+  dump.block_index = 0;
+
+  if (format == GCODE_STATS_FORMAT_CSV)
+    fprintf (dump.fh, "line,block,comment,length,motions,steps,columns,touched,cleared,parse_ms,apply_ms,code\n");
+  else
+    fprintf (dump.fh, "{\n  \"lines\": [\n");
+
+  if (dump.stats->source == GCODE_STATS_SOURCE_PROJECT)
+    gcode_sim_walk (gcode, &dump, gcode_stats_dump_walk);
+
+  while (dump.line < dump.stats->line_num)                                      // Lines of a file, or past the code of the project;
+    gcode_stats_dump_line (&dump, NULL, NULL);
+
+  if (format == GCODE_STATS_FORMAT_JSON)
+  {
+    gcode_stats_sum (gcode, 0, dump.stats->line_num, &total);
+
+    fprintf (dump.fh, "\n  ],\n  \"total\": { \"lines\": %u, \"length\": %.6f, \"motions\": %u, \"steps\": %llu, \"columns\": %llu, \"touched\": %llu, \"cleared\": %llu, \"parse_ms\": %.6f, \"apply_ms\": %.6f, \"render_ms\": %.6f, \"complete\": %s }\n}\n",
+             dump.stats->line_num, total.length, total.motions, (unsigned long long)total.steps, (unsigned long long)total.columns,
+             (unsigned long long)total.touched, (unsigned long long)total.cleared,
+             1000.0 * total.parse_time, 1000.0 * total.apply_time, 1000.0 * dump.stats->total_time,
+             dump.stats->failed ? "false" : "true");
+  }
+
+  setlocale (LC_NUMERIC, "");
+
+  failed = ferror (dump.fh) != 0;
+  failed |= fclose (dump.fh) != 0;
+
+  if (failed)
+    REMARK ("Failed to write file '%s'\n", basename (filename));
+
+  return (failed);
+}
+
+void
+gcode_stats_free (gcode_t *gcode)
+{
+  if (!gcode->line_stats)
+    return;
+
+  free (gcode->line_stats->batch);
+  free (gcode->line_stats->line);
+  free (gcode->line_stats);
+
+  gcode->line_stats = NULL;
+}
@@ -0,0 +1,77 @@
+/**
+ *  gcode_stats.h
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _GCODE_STATS_H
+#define _GCODE_STATS_H
+
+#include "gcode_internal.h"
+
+/**
+ * Statistics of a render, line by line: what the code of each line of the
+ * program asked of the simulator and what that cost it, to tell moves cutting
+ * nothing but air, passes going over material already gone and the lines the
+ * simulator spends its time on. Only gathered while 'collect_stats' is raised.
+ */
+
+#define GCODE_STATS_SOURCE_PROJECT      0                                       /* Lines of the code made from the project */
+#define GCODE_STATS_SOURCE_FILE         1                                       /* Lines of an external G-code file */
+
+#define GCODE_STATS_FORMAT_CSV          0
+#define GCODE_STATS_FORMAT_JSON         1
+
+typedef struct gcode_stats_line_s
+{
+  gfloat_t length;                                                              /* length of the path travelled, in project units */
+  uint32_t motions;                                                             /* motions handed to the stock */
+  uint64_t steps;                                                               /* cutter positions pressed in, or rows swept across (per tile) */
+  uint64_t columns;                                                             /* voxel columns visited */
+  uint64_t touched;                                                             /* voxels within reach of the cutter */
+  uint64_t cleared;                                                             /* voxels that were still there and got removed */
+  gfloat_t parse_time;                                                          /* seconds spent following the code */
+  gfloat_t apply_time;                                                          /* seconds spent applying its motions, summed over workers */
+} gcode_stats_line_t;
+
+typedef struct gcode_stats_s
+{
+  uint8_t source;
+  gcode_stats_line_t *line;
+  uint32_t line_num;
+  uint32_t line_max;
+  gcode_stats_line_t *batch;                                                    /* per worker tallies of the lines of the batch being applied */
+  uint32_t batch_first;                                                         /* line the tallies of the batch start at */
+  uint32_t batch_lines;
+  gfloat_t flush_time;                                                          /* seconds spent applying batches so far */
+  gfloat_t total_time;                                                          /* seconds the whole render took */
+  uint8_t failed;                                                               /* ran out of memory, the figures are incomplete */
+} gcode_stats_t;
+
+gfloat_t gcode_stats_clock (void);
+gcode_stats_t *gcode_stats_start (gcode_t *gcode, uint8_t source);
+gcode_stats_line_t *gcode_stats_grow (gcode_stats_t *stats, uint32_t line);
+gcode_stats_line_t *gcode_stats_batch (gcode_stats_t *stats, int threads, uint32_t first, uint32_t last);
+void gcode_stats_merge (gcode_stats_t *stats, int threads);
+int gcode_stats_sum (gcode_t *gcode, uint32_t begin, uint32_t end, gcode_stats_line_t *sum);
+int gcode_stats_export (gcode_t *gcode, char *filename, uint8_t format);
+void gcode_stats_free (gcode_t *gcode);
+
+#endif
@@ -85,7 +85,7 @@ gcode_stl_free (gcode_block_t **block)
   free (stl->slice_list);
   free (stl->tri_list);
 
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
@@ -0,0 +1,554 @@
+/**
+ *  gcode_stock.c
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gcode_stock.h"
+#include "gcode_voxel.h"
+#include "gcode_util.h"
+#include "gcode.h"
+#include <string.h>
+#include <libgen.h>
+
+void
+gcode_stock_free (gcode_t *gcode)
+{
+  gcode_stock_start_t *stock;
+
+  stock = gcode->starting_stock;
+
+  if (!stock)
+    return;
+
+  free (stock->column);
+  free (stock->lo);
+  free (stock->hi);
+  free (stock);
+
+  gcode->starting_stock = NULL;
+}
+
+/**
+ * Runs of solid voxels of every column of the stock of 'gcode', bottom up;
+ * returns NULL if memory could not be allocated.
+ */
+
+static gcode_stock_start_t *
+gcode_stock_runs (gcode_t *gcode)
+{
+  gcode_stock_start_t *stock;
+  size_t columns, run_num, run_max, c;
+  uint32_t *lo, *hi, x, y, z, top;
+  int solid;
+
+  stock = calloc (1, sizeof (gcode_stock_start_t));
+
+  if (!stock)
+    return (NULL);
+
+  stock->units = gcode->units;
+
+  for (x = 0; x < 3; x++)
+  {
+    stock->voxel_number[x] = gcode->voxel_number[x];
+    stock->material_size[x] = gcode->material_size[x];
+    stock->material_origin[x] = gcode->material_origin[x];
+  }
+
+  columns = (size_t)gcode->voxel_number[0] * gcode->voxel_number[1];
+
+  stock->column = malloc ((columns + 1) * sizeof (size_t));
+  run_num = 0;
+  run_max = columns + 1;
+  stock->lo = malloc (run_max * sizeof (uint32_t));
+  stock->hi = malloc (run_max * sizeof (uint32_t));
+
+  if (!stock->column || !stock->lo || !stock->hi)
+    goto failed;
+
+  for (y = 0; y < gcode->voxel_number[1]; y++)
+  {
+    for (x = 0; x < gcode->voxel_number[0]; x++)
+    {
+      c = (size_t)y * gcode->voxel_number[0] + x;
+      stock->column[c] = run_num;
+
+      if (gcode->stock_model == GCODE_STOCK_HEIGHT)
+      {
+        top = (uint32_t)fmax (0.0, (gfloat_t)gcode->voxel_number[2] / gcode->material_size[2] * (gcode->material_size[2] + gcode->height_map[c]));
+
+        if (top > gcode->voxel_number[2])
+          top = gcode->voxel_number[2];
+
+        if (top)
+        {
+          stock->lo[run_num] = 0;
+          stock->hi[run_num] = top;
+          run_num++;
+        }
+
+        continue;
+      }
+
+      for (z = 0; z < gcode->voxel_number[2]; z++)
+      {
+        solid = gcode_voxel_get (gcode, x, y, z);
+
+        if (solid && ((z == 0) || !gcode_voxel_get (gcode, x, y, z - 1)))       // A run starts here;
+        {
+          if (run_num == run_max)
+          {
+            run_max *= 2;
+            lo = realloc (stock->lo, run_max * sizeof (uint32_t));
+
+            if (lo)
+              stock->lo = lo;
+
+            hi = realloc (stock->hi, run_max * sizeof (uint32_t));
+
+            if (hi)
+              stock->hi = hi;
+
+            if (!lo || !hi)
+              goto failed;
+          }
+
+          stock->lo[run_num] = z;
+          stock->hi[run_num] = z + 1;
+          run_num++;
+        }
+        else if (solid)
+        {
+          stock->hi[run_num - 1] = z + 1;
+        }
+      }
+    }
+  }
+
+  stock->column[columns] = run_num;
+
+  return (stock);
+
+failed:
+  free (stock->column);
+  free (stock->lo);
+  free (stock->hi);
+  free (stock);
+
+  return (NULL);
+}
+
+/**
+ * Write 'count' words at 'data' to 'fh' packed by gcode_util_pack_words,
+ * preceded by the number of words packed; returns non-zero on failure.
+ */
+
+static int
+gcode_stock_write_words (FILE *fh, uint32_t *data, size_t count)
+{
+  uint32_t *packed;
+  uint64_t packed_count;
+  size_t n;
+
+  packed = gcode_util_pack_words (data, count, &n);
+
+  if (!packed)
+    return (1);
+
+  packed_count = n;
+  fwrite (&packed_count, sizeof (uint64_t), 1, fh);
+  fwrite (packed, sizeof (uint32_t), n, fh);
+
+  free (packed);
+
+  return (0);
+}
+
+/**
+ * Read words written by gcode_stock_write_words, which have to unpack to
+ * exactly 'count' words, into 'data'; returns non-zero on failure.
+ */
+
+static int
+gcode_stock_read_words (FILE *fh, uint32_t *data, size_t count)
+{
+  uint32_t *packed;
+  uint64_t packed_count, total, i;
+
+  if (fread (&packed_count, sizeof (uint64_t), 1, fh) != 1)
+    return (1);
+
+  packed = malloc ((packed_count + 1) * sizeof (uint32_t));
+
+  if (!packed)
+    return (1);
+
+  if (fread (packed, sizeof (uint32_t), packed_count, fh) != packed_count)
+  {
+    free (packed);
+    return (1);
+  }
+
+  for (i = 0, total = 0; i + 1 < packed_count; i += 2)
+    total += packed[i];
+
+  if (total != count)
+  {
+    free (packed);
+    return (1);
+  }
+
+  gcode_util_unpack_words (packed, packed_count, data);
+
+  free (packed);
+
+  return (0);
+}
+
+/**
+ * Save the stock of the last render to 'filename', along with the frame of its
+ * material: the number of runs of every column, then the lowest and the top
+ * voxels of all runs, each run-length packed. Returns non-zero on failure.
+ */
+
+int
+gcode_stock_save (gcode_t *gcode, char *filename)
+{
+  gcode_stock_start_t *stock;
+  FILE *fh;
+  uint32_t header, version, *count;
+  size_t columns, c;
+  int failed;
+
+  if (!gcode->voxel_map && !gcode->height_map)
+  {
+    REMARK ("No simulated stock to save\n");
+    return (1);
+  }
+
+  stock = gcode_stock_runs (gcode);
+  columns = (size_t)gcode->voxel_number[0] * gcode->voxel_number[1];
+  count = malloc (columns * sizeof (uint32_t));
+
+  if (!stock || !count)
+  {
+    REMARK ("Failed to allocate memory for saving the stock\n");
+    free (count);
+
+    if (stock)
+    {
+      free (stock->column);
+      free (stock->lo);
+      free (stock->hi);
+      free (stock);
+    }
+
+    return (1);
+  }
+
+  for (c = 0; c < columns; c++)
+    count[c] = stock->column[c + 1] - stock->column[c];
+
+  fh = fopen (filename, "wb");
+  failed = !fh;
+
+  if (fh)
+  {
+    header = GCODE_STOCK_FILE_HEADER;
+    version = GCODE_STOCK_FILE_VERSION;
+
+    fwrite (&header, sizeof (uint32_t), 1, fh);
+    fwrite (&version, sizeof (uint32_t), 1, fh);
+    fwrite (&stock->units, sizeof (uint8_t), 1, fh);
+    fwrite (stock->voxel_number, sizeof (uint32_t), 3, fh);
+    fwrite (stock->material_size, sizeof (gfloat_t), 3, fh);
+    fwrite (stock->material_origin, sizeof (gfloat_t), 3, fh);
+
+    failed |= gcode_stock_write_words (fh, count, columns);
+    failed |= gcode_stock_write_words (fh, stock->lo, stock->column[columns]);
+    failed |= gcode_stock_write_words (fh, stock->hi, stock->column[columns]);
+
+    failed |= ferror (fh) != 0;
+    fclose (fh);
+  }
+
+  if (failed)
+    REMARK ("Failed to save the stock to '%s'\n", basename (filename));
+
+  free (count);
+  free (stock->column);
+  free (stock->lo);
+  free (stock->hi);
+  free (stock);
+
+  return (failed);
+}
+
+/**
+ * Load the stock saved in 'filename' as the starting stock of the project, in
+ * place of the one it had (if any), with its material where it was in the
+ * project it was saved from; the stock of the project is remade from it.
+ * Returns non-zero on failure, leaving the project as it was.
+ */
+
+int
+gcode_stock_load (gcode_t *gcode, char *filename)
+{
+  gcode_stock_start_t *stock;
+  FILE *fh;
+  uint32_t header, version, *count;
+  size_t columns, c;
+  int failed, i;
+
+  fh = fopen (filename, "rb");
+
+  if (!fh)
+  {
+    REMARK ("Failed to open file '%s'\n", basename (filename));
+    return (1);
+  }
+
+  stock = calloc (1, sizeof (gcode_stock_start_t));
+  count = NULL;
+  failed = !stock;
+
+  if (!failed)
+  {
+    failed |= fread (&header, sizeof (uint32_t), 1, fh) != 1;
+    failed |= fread (&version, sizeof (uint32_t), 1, fh) != 1;
+    failed |= fread (&stock->units, sizeof (uint8_t), 1, fh) != 1;
+    failed |= fread (stock->voxel_number, sizeof (uint32_t), 3, fh) != 3;
+    failed |= fread (stock->material_size, sizeof (gfloat_t), 3, fh) != 3;
+    failed |= fread (stock->material_origin, sizeof (gfloat_t), 3, fh) != 3;
+
+    failed |= (header != GCODE_STOCK_FILE_HEADER) || (version != GCODE_STOCK_FILE_VERSION);
+
+    for (i = 0; i < 3; i++)
+      failed |= (stock->voxel_number[i] == 0) || !(stock->material_size[i] > 0.0);
+  }
+
+  if (!failed)
+  {
+    columns = (size_t)stock->voxel_number[0] * stock->voxel_number[1];
+    count = malloc (columns * sizeof (uint32_t));
+    stock->column = malloc ((columns + 1) * sizeof (size_t));
+
+    failed = !count || !stock->column || gcode_stock_read_words (fh, count, columns);
+  }
+
+  if (!failed)
+  {
+    stock->column[0] = 0;
+
+    for (c = 0; c < columns; c++)
+      stock->column[c + 1] = stock->column[c] + count[c];
+
+    stock->lo = malloc ((stock->column[columns] + 1) * sizeof (uint32_t));
+    stock->hi = malloc ((stock->column[columns] + 1) * sizeof (uint32_t));
+
+    failed = !stock->lo || !stock->hi ||
+             gcode_stock_read_words (fh, stock->lo, stock->column[columns]) ||
+             gcode_stock_read_words (fh, stock->hi, stock->column[columns]);
+  }
+
+  fclose (fh);
+  free (count);
+
+  if (failed)
+  {
+    REMARK ("Failed to load the stock from '%s'\n", basename (filename));
+
+    if (stock)
+    {
+      free (stock->column);
+      free (stock->lo);
+      free (stock->hi);
+      free (stock);
+    }
+
+    return (1);
+  }
+
+  gcode_stock_free (gcode);
+  gcode->starting_stock = stock;
+
+  GCODE_MATH_VEC3D_SET (stock->offset, 0.0, 0.0, 0.0);
+  stock->flip = GCODE_STOCK_FLIP_NONE;
+  stock->angle = 0.0;
+
+  gcode_prep (gcode);
+
+  return (0);
+}
+
+/**
+ * Place the starting stock in the project: turned over as 'flip' says, spun by
+ * 'angle' degrees about Z and moved by 'offset'; the stock of the project is
+ * remade from it.
+ */
+
+void
+gcode_stock_place (gcode_t *gcode, uint8_t flip, gfloat_t angle, gcode_vec3d_t offset)
+{
+  if (!gcode->starting_stock)
+    return;
+
+  gcode->starting_stock->flip = flip;
+  gcode->starting_stock->angle = angle;
+  GCODE_MATH_VEC3D_COPY (gcode->starting_stock->offset, offset);
+
+  gcode_prep (gcode);
+}
+
+/**
+ * Make the stock of the project whole again: a block of material as big as the
+ * project says, or the starting stock where one was loaded. Each column of the
+ * stock takes the runs of the column of the starting stock its centre falls in
+ * (the placement never tilts a column, a flip only turns it upside down) and
+ * keeps the voxels whose centres fall inside them; a height field can only
+ * keep what is below the top of the highest run.
+ */
+
+void
+gcode_stock_fill (gcode_t *gcode)
+{
+  gcode_stock_start_t *stock;
+  gcode_vec3d_t pitch, src_pitch, centre;
+  gfloat_t scale, cos_angle, sin_angle, px, py, qx, qy, zsign, z0, z1, swap;
+  size_t c, r, first, last;
+  long sx, sy;
+  uint32_t x, y, kmin, kmax, kend;
+  int i, n;
+
+  stock = gcode->starting_stock;
+
+  if (!stock)
+  {
+    if (gcode->stock_model == GCODE_STOCK_HEIGHT)
+    {
+      for (c = 0; c < (size_t)gcode->voxel_number[0] * gcode->voxel_number[1]; c++)
+        gcode->height_map[c] = 0.0;
+    }
+    else
+    {
+      gcode_voxel_fill (gcode);
+    }
+
+    return;
+  }
+
+  if (gcode->stock_model == GCODE_STOCK_VOXEL)
+    gcode_voxel_fill (gcode);
+
+  /* Lengths of the starting stock in the units of this project */
+  scale = 1.0;
+
+  if ((stock->units == GCODE_UNITS_INCH) && (gcode->units == GCODE_UNITS_MILLIMETER))
+    scale = GCODE_INCH2MM;
+  else if ((stock->units == GCODE_UNITS_MILLIMETER) && (gcode->units == GCODE_UNITS_INCH))
+    scale = GCODE_MM2INCH;
+
+  for (i = 0; i < 3; i++)
+  {
+    pitch[i] = gcode->material_size[i] / (gfloat_t)gcode->voxel_number[i];
+    src_pitch[i] = scale * stock->material_size[i] / (gfloat_t)stock->voxel_number[i];
+  }
+
+  /* Flips turn the starting stock over in place, about the centre of its material */
+  centre[0] = scale * (0.5 * stock->material_size[0] - stock->material_origin[0]);
+  centre[1] = scale * (0.5 * stock->material_size[1] - stock->material_origin[1]);
+  centre[2] = scale * (stock->material_origin[2] - 0.5 * stock->material_size[2]);
+
+  cos_angle = cos (stock->angle * GCODE_DEG2RAD);
+  sin_angle = sin (stock->angle * GCODE_DEG2RAD);
+  zsign = stock->flip == GCODE_STOCK_FLIP_NONE ? 1.0 : -1.0;
+
+  for (y = 0; y < gcode->voxel_number[1]; y++)
+  {
+    for (x = 0; x < gcode->voxel_number[0]; x++)
+    {
+      /* Undo the placement: program coordinates of this project to those of the starting stock */
+      qx = (x + 0.5) * pitch[0] - gcode->material_origin[0] - stock->offset[0];
+      qy = (y + 0.5) * pitch[1] - gcode->material_origin[1] - stock->offset[1];
+
+      px = cos_angle * qx + sin_angle * qy;
+      py = -sin_angle * qx + cos_angle * qy;
+
+      if (stock->flip == GCODE_STOCK_FLIP_X)
+        py = centre[1] * 2.0 - py;
+      else if (stock->flip == GCODE_STOCK_FLIP_Y)
+        px = centre[0] * 2.0 - px;
+
+      sx = (long)floor ((px + scale * stock->material_origin[0]) / src_pitch[0]);
+      sy = (long)floor ((py + scale * stock->material_origin[1]) / src_pitch[1]);
+
+      first = last = 0;
+
+      if ((sx >= 0) && (sy >= 0) && (sx < (long)stock->voxel_number[0]) && (sy < (long)stock->voxel_number[1]))
+      {
+        first = stock->column[(size_t)sy * stock->voxel_number[0] + sx];
+        last = stock->column[(size_t)sy * stock->voxel_number[0] + sx + 1];
+      }
+
+      kend = 0;                                                                 // Voxels below this one are dealt with;
+
+      /* Runs go bottom up, or top down once turned over, so that they come out in order either way */
+      for (n = 0; n < (int)(last - first); n++)
+      {
+        r = zsign > 0.0 ? first + n : last - 1 - n;
+
+        /* Ends of the run in program coordinates of the starting stock, then in material coordinates of this project */
+        z0 = stock->lo[r] * src_pitch[2] + scale * (stock->material_origin[2] - stock->material_size[2]);
+        z1 = stock->hi[r] * src_pitch[2] + scale * (stock->material_origin[2] - stock->material_size[2]);
+
+        z0 = centre[2] + zsign * (z0 - centre[2]) + stock->offset[2] - gcode->material_origin[2];
+        z1 = centre[2] + zsign * (z1 - centre[2]) + stock->offset[2] - gcode->material_origin[2];
+
+        if (z0 > z1)
+        {
+          swap = z0;
+          z0 = z1;
+          z1 = swap;
+        }
+
+        z0 = ceil ((z0 + gcode->material_size[2]) / pitch[2] - 0.5);
+        z1 = ceil ((z1 + gcode->material_size[2]) / pitch[2] - 0.5) - 1.0;
+
+        if ((z1 < 0.0) || (z0 > gcode->voxel_number[2] - 1.0) || (z0 > z1))
+          continue;
+
+        kmin = z0 < 0.0 ? 0 : (uint32_t)z0;
+        kmax = z1 > gcode->voxel_number[2] - 1.0 ? gcode->voxel_number[2] - 1 : (uint32_t)z1;
+
+        if ((gcode->stock_model == GCODE_STOCK_VOXEL) && (kmin > kend))
+          gcode_voxel_clear (gcode, x, y, kend, kmin - 1, NULL, NULL);
+
+        if (kmax + 1 > kend)
+          kend = kmax + 1;
+      }
+
+      if (gcode->stock_model == GCODE_STOCK_HEIGHT)
+        gcode->height_map[(size_t)y * gcode->voxel_number[0] + x] = (float)fmin (kend * pitch[2] - gcode->material_size[2] + GCODE_PRECISION, 0.0);
+      else if (kend < gcode->voxel_number[2])
+        gcode_voxel_clear (gcode, x, y, kend, gcode->voxel_number[2] - 1, NULL, NULL);
+    }
+  }
+}
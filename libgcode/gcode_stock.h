@@ -0,0 +1,65 @@
+/**
+ *  gcode_stock.h
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _GCODE_STOCK_H
+#define _GCODE_STOCK_H
+
+#include "gcode_internal.h"
+
+/**
+ * Simulated stock carried over from one project to another: the stock left by
+ * the render of one setup gets saved with the frame of its material, and can
+ * then be loaded by the project of the next setup to render from in place of a
+ * whole block of material - turned over and moved to where the part sits in the
+ * next setup. The stock is kept as the runs of solid voxels of each column,
+ * which any stock model and resolution can be filled from.
+ */
+
+#define GCODE_STOCK_FILE_HEADER   0x4B534347                                    /* "GCSK" */
+#define GCODE_STOCK_FILE_VERSION  0x00000001
+
+#define GCODE_STOCK_FLIP_NONE     0x00
+#define GCODE_STOCK_FLIP_X        0x01                                          /* Turned over about a line along X through the centre of its material */
+#define GCODE_STOCK_FLIP_Y        0x02                                          /* Turned over about a line along Y through the centre of its material */
+
+typedef struct gcode_stock_start_s
+{
+  uint8_t units;                                                                /* units of the project the stock was saved from */
+  uint32_t voxel_number[3];
+  gfloat_t material_size[3];
+  gfloat_t material_origin[3];
+  size_t *column;                                                               /* first run of each column (y * voxel_number[0] + x), then one past the last */
+  uint32_t *lo;                                                                 /* lowest voxel of each run */
+  uint32_t *hi;                                                                 /* one past its highest */
+  uint8_t flip;                                                                 /* placement in this project: turned over first, */
+  gfloat_t angle;                                                               /* then spun about Z (degrees), */
+  gcode_vec3d_t offset;                                                         /* then moved (program coordinates) */
+} gcode_stock_start_t;
+
+int gcode_stock_save (gcode_t *gcode, char *filename);
+int gcode_stock_load (gcode_t *gcode, char *filename);
+void gcode_stock_place (gcode_t *gcode, uint8_t flip, gfloat_t angle, gcode_vec3d_t offset);
+void gcode_stock_fill (gcode_t *gcode);
+void gcode_stock_free (gcode_t *gcode);
+
+#endif
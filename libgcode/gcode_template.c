@@ -89,7 +89,7 @@ gcode_template_free (gcode_block_t **block)
     tmp->free (&tmp);
   }
 
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
@@ -316,9 +316,7 @@ gcode_template_make (gcode_block_t *block)
 
   while (index_block)
   {
-    index_block->make (index_block);
-
-    GCODE_APPEND (block, index_block->code);
+    GCODE_MAKE_INTO (block, index_block);
 
     index_block = index_block->next;
   }
@@ -0,0 +1,518 @@
+/**
+ *  gcode_time.c
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gcode_time.h"
+#include "gcode_sim.h"
+#include "gcode.h"
+#include <string.h>
+
+/**
+ * A move as the planner sees it, in project units and seconds: its length, the
+ * direction it starts and ends along and the speed, acceleration and jerk it is
+ * held to; 'junction' is the fastest it may start at given the corner it makes
+ * with the move before it, 'entry' the fastest it may start at and still come
+ * to a stop by the end of the moves looked ahead.
+ */
+
+typedef struct gcode_time_move_s
+{
+  gfloat_t length;
+  gcode_vec3d_t dir0;                                                           /* unit direction at the start */
+  gcode_vec3d_t dir1;                                                           /* unit direction at the end */
+  gfloat_t speed;                                                               /* cruising speed */
+  gfloat_t accel;                                                               /* 0 if unlimited */
+  gfloat_t jerk;                                                                /* 0 if unlimited */
+  gfloat_t junction;
+  gfloat_t entry;
+  uint32_t block;                                                               /* top level block it belongs to */
+} gcode_time_move_t;
+
+typedef struct gcode_time_s
+{
+  gcode_t *gcode;
+  gcode_sim_t sim;                                                              /* dry simulator following the code */
+  gcode_vec3d_t max_speed;                                                      /* limits of the machine in project units and seconds */
+  gcode_vec3d_t accel;
+  gfloat_t jerk;
+  gcode_time_move_t move[GCODE_TIME_WINDOW];                                    /* ring of moves whose speeds are not settled yet */
+  uint32_t first;
+  uint32_t move_num;
+  gfloat_t entry;                                                               /* speed the first of them starts at */
+  gcode_vec3d_t last_dir;                                                       /* direction the last move queued ends along */
+  gfloat_t last_speed;                                                          /* and its cruising speed, 0 if the machine stopped since */
+  gcode_block_t **block;                                                        /* every top level block, in order */
+  gfloat_t *block_ms;
+  uint32_t block_num;
+  uint32_t block_index;                                                         /* block of the line being looked at */
+  gfloat_t total;                                                               /* seconds */
+} gcode_time_t;
+
+/**
+ * Time it takes to change speed by 'dv': acceleration builds up at the jerk
+ * limit, holds at the acceleration limit if there's time for it and dies down
+ * again at the jerk limit; the speed runs through its mean over the change.
+ */
+
+static gfloat_t
+gcode_time_ramp (gfloat_t dv, gfloat_t accel, gfloat_t jerk)
+{
+  if ((dv <= 0.0) || (accel <= 0.0))
+    return (0.0);
+
+  if (jerk <= 0.0)
+    return (dv / accel);
+
+  if (dv >= accel * accel / jerk)                                               // Long enough to reach full acceleration;
+    return (dv / accel + accel / jerk);
+
+  return (2.0 * sqrt (dv / jerk));
+}
+
+/**
+ * Distance covered speeding up from 'entry' to 'peak' and slowing down from
+ * there to 'exit'
+ */
+
+static gfloat_t
+gcode_time_span (gcode_time_move_t *move, gfloat_t entry, gfloat_t peak, gfloat_t exit)
+{
+  return (0.5 * (entry + peak) * gcode_time_ramp (peak - entry, move->accel, move->jerk) +
+          0.5 * (peak + exit) * gcode_time_ramp (peak - exit, move->accel, move->jerk));
+}
+
+/**
+ * Fastest speed a move of 'length' can get to from 'speed' (or down to it from)
+ */
+
+static gfloat_t
+gcode_time_reach (gfloat_t speed, gfloat_t accel, gfloat_t length)
+{
+  if (accel <= 0.0)
+    return (HUGE_VAL);
+
+  return (sqrt (speed * speed + 2.0 * accel * length));
+}
+
+/**
+ * Time a move takes starting at 'entry' and ending at 'exit': it speeds up to
+ * its cruising speed, cruises and slows down again; a move too short to get up
+ * to speed peaks at whatever speed it can reach instead.
+ */
+
+static gfloat_t
+gcode_time_profile (gcode_time_move_t *move, gfloat_t entry, gfloat_t exit)
+{
+  gfloat_t lo, hi, peak, span;
+  int i;
+
+  lo = fmax (entry, exit);
+  peak = fmax (move->speed, lo);
+
+  if (move->accel <= 0.0)
+    return (move->length / peak);
+
+  span = gcode_time_span (move, entry, peak, exit);
+
+  if (span > move->length)
+  {
+    if (gcode_time_span (move, entry, lo, exit) >= move->length)                // Too short even for the speed change the planner asked for;
+      return (2.0 * move->length / (entry + exit));
+
+    hi = peak;
+
+    for (i = 0; i < 32; i++)
+    {
+      peak = 0.5 * (lo + hi);
+
+      if (gcode_time_span (move, entry, peak, exit) > move->length)
+        hi = peak;
+      else
+        lo = peak;
+    }
+
+    peak = lo;
+    span = gcode_time_span (move, entry, peak, exit);
+  }
+
+  return (gcode_time_ramp (peak - entry, move->accel, move->jerk) +
+          gcode_time_ramp (peak - exit, move->accel, move->jerk) +
+          (move->length - span) / peak);
+}
+
+/**
+ * Settle the speeds of the first 'retire' moves queued and add up the time they
+ * take; a backward pass finds how fast each move may start so that the machine
+ * could still stop by the end of the last move queued, a forward pass how fast
+ * each one does start given how fast the one before it could get.
+ */
+
+static void
+gcode_time_plan (gcode_time_t *time, uint32_t retire)
+{
+  gcode_time_move_t *move;
+  gfloat_t entry, exit, seconds;
+  uint32_t i;
+
+  entry = 0.0;
+
+  for (i = time->move_num; i-- > 0;)
+  {
+    move = &time->move[(time->first + i) % GCODE_TIME_WINDOW];
+    move->entry = fmin (move->junction, gcode_time_reach (entry, move->accel, move->length));
+    entry = move->entry;
+  }
+
+  entry = time->entry;
+
+  for (i = 0; i < retire; i++)
+  {
+    move = &time->move[(time->first + i) % GCODE_TIME_WINDOW];
+
+    entry = fmin (entry, move->entry);
+    exit = i + 1 < time->move_num ? time->move[(time->first + i + 1) % GCODE_TIME_WINDOW].entry : 0.0;
+    exit = fmin (exit, gcode_time_reach (entry, move->accel, move->length));
+
+    seconds = gcode_time_profile (move, entry, exit);
+
+    time->block_ms[move->block] += 1000.0 * seconds;
+    time->total += seconds;
+
+    entry = exit;
+  }
+
+  time->entry = entry;
+  time->first = (time->first + retire) % GCODE_TIME_WINDOW;
+  time->move_num -= retire;
+}
+
+/**
+ * Bring the machine to a stop at the end of the moves queued
+ */
+
+static void
+gcode_time_stop (gcode_time_t *time)
+{
+  gcode_time_plan (time, time->move_num);
+
+  time->entry = 0.0;
+  time->last_speed = 0.0;
+}
+
+/**
+ * Queue a move; 'weight' is how much of the speed along the path each axis
+ * takes at most, 'speed' the speed the code asks for (0 for a rapid move).
+ */
+
+static void
+gcode_time_push (gcode_time_t *time, gfloat_t length, gcode_vec3d_t dir0, gcode_vec3d_t dir1, gcode_vec3d_t weight, gfloat_t speed)
+{
+  gcode_time_move_t *move;
+  gfloat_t top, cos_angle;
+  int i;
+
+  if (time->move_num == GCODE_TIME_WINDOW)
+    gcode_time_plan (time, GCODE_TIME_WINDOW / 2);
+
+  move = &time->move[(time->first + time->move_num) % GCODE_TIME_WINDOW];
+
+  top = HUGE_VAL;
+  move->accel = 0.0;
+
+  for (i = 0; i < 3; i++)
+  {
+    if (weight[i] < GCODE_PRECISION)
+      continue;
+
+    if (time->max_speed[i] > 0.0)
+      top = fmin (top, time->max_speed[i] / weight[i]);
+
+    if (time->accel[i] > 0.0)
+      move->accel = move->accel > 0.0 ? fmin (move->accel, time->accel[i] / weight[i]) : time->accel[i] / weight[i];
+  }
+
+  if (speed <= 0.0)                                                             // Rapids go as fast as the axes do, or at the feed if nothing says how fast that is;
+    speed = top < HUGE_VAL ? top : time->sim.feed / 60.0;
+
+  speed = fmin (speed, top);
+
+  if (speed < GCODE_PRECISION)
+    return;
+
+  move->length = length;
+  GCODE_MATH_VEC3D_COPY (move->dir0, dir0);
+  GCODE_MATH_VEC3D_COPY (move->dir1, dir1);
+  move->speed = speed;
+  move->jerk = time->jerk;
+  move->block = time->block_index;
+
+  /* Corners: only the part of the speed that keeps going the same way carries through */
+  cos_angle = time->last_dir[0] * dir0[0] + time->last_dir[1] * dir0[1] + time->last_dir[2] * dir0[2];
+  move->junction = fmin (time->last_speed, speed) * fmax (cos_angle, 0.0);
+
+  GCODE_MATH_VEC3D_COPY (time->last_dir, dir1);
+  time->last_speed = speed;
+
+  time->move_num++;
+}
+
+/**
+ * Queue a straight move from 'p0' to 'p1'
+ */
+
+static void
+gcode_time_straight (gcode_time_t *time, gcode_vec3d_t p0, gcode_vec3d_t p1, gfloat_t speed)
+{
+  gcode_vec3d_t dir, weight;
+  gfloat_t length;
+
+  GCODE_MATH_VEC3D_DIST (length, p1, p0);
+
+  if (length < GCODE_PRECISION)
+    return;
+
+  GCODE_MATH_VEC3D_SUB (dir, p1, p0);
+  GCODE_MATH_VEC3D_MUL_SCALAR (dir, dir, 1.0 / length);
+  GCODE_MATH_VEC3D_SET (weight, fabs (dir[0]), fabs (dir[1]), fabs (dir[2]));
+
+  gcode_time_push (time, length, dir, dir, weight, speed);
+}
+
+/**
+ * Queue an arc of 'length' from 'p0' to 'p1' around the centre 'p0 + ijk' in
+ * direction 'dir' (+1 CCW, -1 CW); as the tangent of an arc sweeps past every
+ * direction in the plane, X and Y are both held to the whole of its speed in
+ * the plane.
+ */
+
+static void
+gcode_time_arc (gcode_time_t *time, gcode_vec3d_t p0, gcode_vec3d_t p1, gcode_vec3d_t ijk, gfloat_t dir, gfloat_t length, gfloat_t speed)
+{
+  gcode_vec3d_t dir0, dir1, weight;
+  gfloat_t rad, dz, planar;
+
+  rad = sqrt (ijk[0] * ijk[0] + ijk[1] * ijk[1]);
+
+  if (rad < GCODE_PRECISION)
+  {
+    gcode_time_straight (time, p0, p1, speed);
+    return;
+  }
+
+  dz = p1[2] - p0[2];
+  planar = sqrt (fmax (length * length - dz * dz, 0.0)) / length;
+
+  /* Tangents at either end: the radius turned a quarter turn the way the arc goes */
+  GCODE_MATH_VEC3D_SET (dir0, dir * ijk[1] / rad * planar, -dir * ijk[0] / rad * planar, dz / length);
+  GCODE_MATH_VEC3D_SET (dir1, -dir * (p1[1] - p0[1] - ijk[1]) / rad * planar, dir * (p1[0] - p0[0] - ijk[0]) / rad * planar, dz / length);
+  GCODE_MATH_VEC3D_SET (weight, planar, planar, fabs (dz) / length);
+
+  gcode_time_push (time, length, dir0, dir1, weight, speed);
+}
+
+/**
+ * Follow a line of the code with the dry simulator and queue the moves it
+ * makes; a dwell, or any M code, stops the machine first.
+ */
+
+static void
+gcode_time_line (void *data, gcode_block_t *block, gcode_sim_line_t *line)
+{
+  gcode_time_t *time;
+  gcode_vec3d_t p0, p1, ijk;
+  gfloat_t distance, elapsed, length, speed;
+  int i, stop;
+
+  time = (gcode_time_t *)data;
+
+  while (time->block[time->block_index] != block)
+    time->block_index++;
+
+  GCODE_MATH_VEC3D_COPY (p0, time->sim.pos);
+  distance = time->sim.distance;
+  elapsed = time->sim.time_elapsed;
+
+  gcode_sim_line (time->gcode, &time->sim, line);
+
+  length = time->sim.distance - distance;
+
+  GCODE_MATH_VEC3D_SET (ijk, 0.0, 0.0, 0.0);
+  stop = 0;
+
+  for (i = 0; i < line->word_num; i++)
+  {
+    if (line->letter[i] == 'I')
+      ijk[0] = line->value[i];
+    else if (line->letter[i] == 'J')
+      ijk[1] = line->value[i];
+    else if (line->letter[i] == 'M')
+      stop = 1;
+  }
+
+  if (time->sim.inverse_time)
+    speed = length * time->sim.inverse_feed / 60.0;
+  else
+    speed = time->sim.feed / 60.0;
+
+  if (length > GCODE_PRECISION)
+  {
+    switch (time->sim.mode)
+    {
+      case 0:
+        gcode_time_straight (time, p0, time->sim.pos, 0.0);
+        break;
+
+      case 1:
+        gcode_time_straight (time, p0, time->sim.pos, speed);
+        break;
+
+      case 2:
+      case 3:
+        gcode_time_arc (time, p0, time->sim.pos, ijk, time->sim.mode == 3 ? 1.0 : -1.0, length, speed);
+        break;
+
+      case 81:
+      case 83:
+        /**
+         * Canned cycle: over to the hole and down to the retract plane at the
+         * rapid rate, down to depth at the feed and back up again; the tool
+         * is left at the retract plane, as G99 has it.
+         */
+        speed = time->sim.feed / 60.0;
+
+        GCODE_MATH_VEC3D_SET (p1, time->sim.pos[0], time->sim.pos[1], p0[2]);
+        gcode_time_straight (time, p0, p1, 0.0);
+
+        GCODE_MATH_VEC3D_COPY (p0, p1);
+        p1[2] = time->sim.G83_retract;
+        gcode_time_straight (time, p0, p1, 0.0);
+
+        gcode_time_straight (time, p1, time->sim.pos, speed);
+        gcode_time_straight (time, time->sim.pos, p1, 0.0);
+
+        time->sim.pos[2] = time->sim.G83_retract;
+        break;
+
+      default:
+        break;
+    }
+  }
+  else if (time->sim.time_elapsed > elapsed)                                    // A dwell;
+  {
+    gcode_time_stop (time);
+
+    time->block_ms[time->block_index] += 60000.0 * (time->sim.time_elapsed - elapsed);
+    time->total += 60.0 * (time->sim.time_elapsed - elapsed);
+  }
+
+  if (stop)
+    gcode_time_stop (time);
+}
+
+/**
+ * Estimate how long the program takes to run on a machine with 'limits': the
+ * total in 'total_ms' and the time spent on each top level block, in the order
+ * of the blocks, in 'block_ms' (to be freed by the caller) of 'block_num'
+ * entries; the times are in milliseconds. Returns non-zero on failure.
+ */
+
+int
+gcode_time_estimate (gcode_t *gcode, gcode_time_limits_t *limits, gfloat_t *total_ms, gfloat_t **block_ms, uint32_t *block_num)
+{
+  gcode_time_t *time;
+  gcode_block_t *index_block;
+  gfloat_t scale;
+  uint32_t i;
+
+  *total_ms = 0.0;
+  *block_ms = NULL;
+  *block_num = 0;
+
+  gcode_list_make (gcode);
+
+  time = malloc (sizeof (gcode_time_t));
+
+  if (!time)
+  {
+    REMARK ("Failed to allocate memory for cycle time estimation\n");
+    return (1);
+  }
+
+  time->block_num = 0;
+
+  for (index_block = gcode->listhead; index_block; index_block = index_block->next)
+    time->block_num++;
+
+  time->block = malloc ((time->block_num + 1) * sizeof (gcode_block_t *));
+  time->block_ms = calloc (time->block_num + 1, sizeof (gfloat_t));
+
+  if (!time->block || !time->block_ms)
+  {
+    REMARK ("Failed to allocate memory for cycle time estimation\n");
+    free (time->block);
+    free (time->block_ms);
+    free (time);
+    return (1);
+  }
+
+  for (i = 0, index_block = gcode->listhead; index_block; i++, index_block = index_block->next)
+    time->block[i] = index_block;
+
+  scale = gcode->units == GCODE_UNITS_MILLIMETER ? GCODE_INCH2MM : 1.0;
+
+  for (i = 0; i < 3; i++)
+  {
+    time->max_speed[i] = limits->max_ipm[i] * scale / 60.0;
+    time->accel[i] = limits->accel[i] * scale;
+  }
+
+  time->jerk = limits->jerk * scale;
+
+  time->gcode = gcode;
+  time->first = 0;
+  time->move_num = 0;
+  time->entry = 0.0;
+  time->last_speed = 0.0;
+  time->block_index = 0;
+  time->total = 0.0;
+  GCODE_MATH_VEC3D_SET (time->last_dir, 0.0, 0.0, 0.0);
+
+  gcode_sim_init (&time->sim, gcode);
+  time->sim.dry = 1;
+
+  free (time->sim.motion);                                                      // A dry simulator never buffers any motions;
+  time->sim.motion = NULL;
+
+  gcode_sim_walk (gcode, time, gcode_time_line);
+  gcode_time_stop (time);
+
+  gcode_sim_free (&time->sim);
+
+  *total_ms = 1000.0 * time->total;
+  *block_ms = time->block_ms;
+  *block_num = time->block_num;
+
+  free (time->block);
+  free (time);
+
+  return (0);
+}
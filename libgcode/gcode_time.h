@@ -0,0 +1,56 @@
+/**
+ *  gcode_time.h
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _GCODE_TIME_H
+#define _GCODE_TIME_H
+
+#include "gcode_internal.h"
+
+/**
+ * Cycle time of the program as a machine would run it: every move takes as
+ * long as it takes to cover its exact length (arcs included) speeding up and
+ * slowing down within the acceleration and jerk limits of the machine, going
+ * no faster than the feed asks and the axes allow, and slowing down at every
+ * corner; the voxel map is never touched, so this works on any program size.
+ */
+
+#define GCODE_TIME_WINDOW       256                                             /* Moves looked ahead to plan the speed at each junction */
+
+/**
+ * Limits of a machine as given in machines.xml, in inches and seconds; a limit
+ * of 0 stands for one not given: axes without a top speed don't hold rapids
+ * back (rapids go at the feed if no axis has one), no acceleration limit means
+ * speed changes take no time and no jerk limit means acceleration changes take
+ * no time.
+ */
+
+typedef struct gcode_time_limits_s
+{
+  gfloat_t max_ipm[3];                                                          /* top speed of each axis (inches per minute) */
+  gfloat_t accel[3];                                                            /* acceleration of each axis (inches per second^2) */
+  gfloat_t jerk;                                                                /* inches per second^3 */
+} gcode_time_limits_t;
+
+int gcode_time_estimate (gcode_t *gcode, gcode_time_limits_t *limits, gfloat_t *total_ms, gfloat_t **block_ms, uint32_t *block_num);
+
+#endif
@@ -66,6 +66,8 @@ gcode_tool_init (gcode_block_t **block, gcode_t *gcode, gcode_block_t *parent)
   tool->plunge_ratio = 0.2;                                                     /* 20% */
   tool->spindle_rpm = 2000;                                                     /* 2,000 RPM */
   tool->coolant = ((*block)->gcode->machine_options & GCODE_MACHINE_OPTION_COOLANT) == 0 ? 0 : 1;
+  tool->shape = GCODE_TOOL_SHAPE_FLAT;
+  tool->angle = 90.0;
 
   gcode_tool_calc (*block);
 }
@@ -73,7 +75,7 @@ gcode_tool_init (gcode_block_t **block, gcode_t *gcode, gcode_block_t *parent)
 void
 gcode_tool_free (gcode_block_t **block)
 {
-  free ((*block)->code);
+  gcode_ir_free (&(*block)->ir);
   free ((*block)->pdata);
   free (*block);
   *block = NULL;
@@ -114,6 +116,8 @@ gcode_tool_save (gcode_block_t *block, FILE *fh)
     GCODE_WRITE_XML_ATTR_1D_FLT (fh, GCODE_XML_ATTR_TOOL_PLUNGE_RATIO, tool->plunge_ratio);
     GCODE_WRITE_XML_ATTR_1D_INT (fh, GCODE_XML_ATTR_TOOL_SPINDLE_RPM, tool->spindle_rpm);
     GCODE_WRITE_XML_ATTR_1D_INT (fh, GCODE_XML_ATTR_TOOL_COOLANT, tool->coolant);
+    GCODE_WRITE_XML_ATTR_1D_INT (fh, GCODE_XML_ATTR_TOOL_SHAPE, tool->shape);
+    GCODE_WRITE_XML_ATTR_1D_FLT (fh, GCODE_XML_ATTR_TOOL_ANGLE, tool->angle);
     GCODE_WRITE_XML_CL_TAG_TAIL (fh);
     GCODE_WRITE_XML_END_OF_LINE (fh);
   }
@@ -129,6 +133,8 @@ gcode_tool_save (gcode_block_t *block, FILE *fh)
     GCODE_WRITE_BINARY_NUM_DATA (fh, GCODE_BIN_DATA_TOOL_PLUNGE_RATIO, sizeof (gfloat_t), &tool->plunge_ratio);
     GCODE_WRITE_BINARY_NUM_DATA (fh, GCODE_BIN_DATA_TOOL_SPINDLE_RPM, sizeof (uint32_t), &tool->spindle_rpm);
     GCODE_WRITE_BINARY_NUM_DATA (fh, GCODE_BIN_DATA_TOOL_COOLANT, sizeof (uint8_t), &tool->coolant);
+    GCODE_WRITE_BINARY_NUM_DATA (fh, GCODE_BIN_DATA_TOOL_SHAPE, sizeof (uint8_t), &tool->shape);
+    GCODE_WRITE_BINARY_NUM_DATA (fh, GCODE_BIN_DATA_TOOL_ANGLE, sizeof (gfloat_t), &tool->angle);
   }
 }
 
@@ -200,6 +206,14 @@ gcode_tool_load (gcode_block_t *block, FILE *fh)
         fread (&tool->coolant, dsize, 1, fh);
         break;
 
+      case GCODE_BIN_DATA_TOOL_SHAPE:
+        fread (&tool->shape, dsize, 1, fh);
+        break;
+
+      case GCODE_BIN_DATA_TOOL_ANGLE:
+        fread (&tool->angle, dsize, 1, fh);
+        break;
+
       default:
         fseek (fh, dsize, SEEK_CUR);
         break;
@@ -228,10 +242,21 @@ gcode_tool_make (gcode_block_t *block)
   GCODE_NEWLINE (block);
 
   sprintf (string, "Selected Tool: %s", tool->label);
-  GCODE_COMMENT (block, string);
+  GCODE_HEADER (block, string);
 
   sprintf (string, "Tool Diameter: %f", tool->diameter);
-  GCODE_COMMENT (block, string);
+  GCODE_HEADER (block, string);
+
+  if (tool->shape == GCODE_TOOL_SHAPE_BALL)                                     // Flat end mills go without, so existing output stays the same;
+  {
+    sprintf (string, "Tool Shape: ball nose");
+    GCODE_HEADER (block, string);
+  }
+  else if (tool->shape == GCODE_TOOL_SHAPE_VEE)
+  {
+    sprintf (string, "Tool Shape: v-bit %f", tool->angle);
+    GCODE_HEADER (block, string);
+  }
 
   if (tool->prompt)
   {
@@ -247,8 +272,7 @@ gcode_tool_make (gcode_block_t *block)
 
   if (tool->prompt || (block->gcode->machine_options & GCODE_MACHINE_OPTION_AUTOMATIC_TOOL_CHANGE))
   {
-    sprintf (string, "M06 T%.2d", tool->number);
-    GCODE_COMMAND (block, string, tool->label);
+    GCODE_TOOL_CHANGE (block, tool->number, tool->label);
   }
 
   if (block->gcode->machine_options & GCODE_MACHINE_OPTION_SPINDLE_CONTROL)
@@ -364,6 +388,16 @@ gcode_tool_parse (gcode_block_t *block, const char **xmlattr)
       if (GCODE_PARSE_XML_ATTR_1D_INT (m, value))
         tool->coolant = m;
     }
+    else if (strcmp (name, GCODE_XML_ATTR_TOOL_SHAPE) == 0)
+    {
+      if (GCODE_PARSE_XML_ATTR_1D_INT (m, value))
+        tool->shape = m;
+    }
+    else if (strcmp (name, GCODE_XML_ATTR_TOOL_ANGLE) == 0)
+    {
+      if (GCODE_PARSE_XML_ATTR_1D_FLT (w, value))
+        tool->angle = (gfloat_t)w;
+    }
   }
 }
 
@@ -399,6 +433,8 @@ gcode_tool_clone (gcode_block_t **block, gcode_t *gcode, gcode_block_t *model)
   tool->plunge_ratio = model_tool->plunge_ratio;
   tool->spindle_rpm = model_tool->spindle_rpm;
   tool->coolant = model_tool->coolant;
+  tool->shape = model_tool->shape;
+  tool->angle = model_tool->angle;
 }
 
 void
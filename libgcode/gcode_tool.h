@@ -36,6 +36,12 @@
 #define GCODE_BIN_DATA_TOOL_PLUNGE_RATIO     0x07
 #define GCODE_BIN_DATA_TOOL_SPINDLE_RPM      0x08
 #define GCODE_BIN_DATA_TOOL_COOLANT          0x09
+#define GCODE_BIN_DATA_TOOL_SHAPE            0x0A
+#define GCODE_BIN_DATA_TOOL_ANGLE            0x0B
+
+#define GCODE_TOOL_SHAPE_FLAT                0x00
+#define GCODE_TOOL_SHAPE_BALL                0x01
+#define GCODE_TOOL_SHAPE_VEE                 0x02
 
 static const char *GCODE_XML_ATTR_TOOL_DIAMETER = "diameter";
 static const char *GCODE_XML_ATTR_TOOL_LENGTH = "length";
@@ -47,6 +53,8 @@ static const char *GCODE_XML_ATTR_TOOL_NUMBER = "number";
 static const char *GCODE_XML_ATTR_TOOL_PLUNGE_RATIO = "plunge-ratio";
 static const char *GCODE_XML_ATTR_TOOL_SPINDLE_RPM = "spindle-rpm";
 static const char *GCODE_XML_ATTR_TOOL_COOLANT = "coolant";
+static const char *GCODE_XML_ATTR_TOOL_SHAPE = "shape";
+static const char *GCODE_XML_ATTR_TOOL_ANGLE = "angle";
 
 typedef struct gcode_tool_s
 {
@@ -62,6 +70,8 @@ typedef struct gcode_tool_s
   gfloat_t plunge_ratio;
   uint32_t spindle_rpm;
   uint8_t coolant;
+  uint8_t shape;                                                                /* flat bottom, ball nose or v-bit */
+  gfloat_t angle;                                                               /* included angle of a v-bit's tip (degrees) */
 } gcode_tool_t;
 
 void gcode_tool_init (gcode_block_t **block, gcode_t *gcode, gcode_block_t *parent);
@@ -22,6 +22,11 @@
 
 #include "gcode_util.h"
 #include <inttypes.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 #include "gcode.h"
 #include "gcode_arc.h"
 #include "gcode_line.h"
@@ -182,6 +187,139 @@ gcode_util_filter_newlines (char *string)
   string[i] = '\0';
 }
 
+/**
+ * Remove the spaces (and tabs) ending the lines of 'string' and the lines left
+ * with nothing in them altogether.
+ */
+
+void
+gcode_util_filter_blanks (char *string)
+{
+  uint32_t i, j, line;
+
+  i = j = line = 0;                                                             // 'line' is where the line being copied starts in the result;
+
+  for (; string[j] != '\0'; j++)
+  {
+    if (string[j] == '\n')
+    {
+      while ((i > line) && ((string[i - 1] == ' ') || (string[i - 1] == '\t')))
+        i--;
+
+      if (i == line)                                                            // Nothing (left) on the line, not even its newline goes;
+        continue;
+
+      string[i++] = '\n';
+      line = i;
+    }
+    else
+    {
+      string[i++] = string[j];
+    }
+  }
+
+  string[i] = '\0';
+}
+
+/**
+ * Number of processors available to run worker threads on; 1 if it cannot be
+ * told.
+ */
+
+int
+gcode_util_processors (void)
+{
+  int processors;
+
+#ifdef WIN32
+  SYSTEM_INFO info;
+
+  GetSystemInfo (&info);
+  processors = (int)info.dwNumberOfProcessors;
+#elif defined (_SC_NPROCESSORS_ONLN)
+  processors = (int)sysconf (_SC_NPROCESSORS_ONLN);
+#else
+  processors = 1;
+#endif
+
+  return (processors > 0 ? processors : 1);
+}
+
+/**
+ * 64-bit FNV-1a hash of 'size' bytes at 'data'; good enough to tell whether a
+ * piece of code has changed since the last time it was looked at.
+ */
+
+uint64_t
+gcode_util_hash (const char *data, size_t size)
+{
+  uint64_t hash;
+  size_t i;
+
+  hash = 0xcbf29ce484222325ULL;
+
+  for (i = 0; i < size; i++)
+  {
+    hash ^= (uint8_t)data[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return (hash);
+}
+
+/**
+ * Run-length encode 'count' words at 'data' into (run length, word) pairs; the
+ * returned array holds 'packed_count' words and has to be freed by the caller.
+ * Returns NULL if memory could not be allocated.
+ */
+
+uint32_t *
+gcode_util_pack_words (const uint32_t *data, size_t count, size_t *packed_count)
+{
+  uint32_t *packed;
+  size_t i, j, runs;
+
+  runs = 0;
+
+  for (i = 0; i < count; i++)
+    if ((i == 0) || (data[i] != data[i - 1]))
+      runs++;
+
+  packed = malloc ((2 * runs + 1) * sizeof (uint32_t));
+
+  if (!packed)
+  {
+    REMARK ("Failed to allocate memory for packed data\n");
+    return (NULL);
+  }
+
+  for (i = 0, j = 0; i < count; i++)
+  {
+    if ((i == 0) || (data[i] != data[i - 1]))
+    {
+      packed[j++] = 0;
+      packed[j++] = data[i];
+    }
+
+    packed[j - 2]++;
+  }
+
+  *packed_count = j;
+
+  return (packed);
+}
+
+void
+gcode_util_unpack_words (const uint32_t *packed, size_t packed_count, uint32_t *data)
+{
+  size_t i;
+  uint32_t n;
+
+  for (i = 0; i + 1 < packed_count; i += 2)
+    for (n = 0; n < packed[i]; n++)
+      *data++ = packed[i + 1];
+}
+
 void
 gcode_util_remove_duplicate_scalars (gfloat_t *array, uint32_t *num)
 {
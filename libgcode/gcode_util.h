@@ -31,6 +31,11 @@ int gcode_util_qsort_compare_asc (const void *a, const void *b);
 void gcode_util_remove_spaces (char *string);
 void gcode_util_remove_comment (char *string);
 void gcode_util_filter_newlines (char *string);
+void gcode_util_filter_blanks (char *string);
+int gcode_util_processors (void);
+uint64_t gcode_util_hash (const char *data, size_t size);
+uint32_t *gcode_util_pack_words (const uint32_t *data, size_t count, size_t *packed_count);
+void gcode_util_unpack_words (const uint32_t *packed, size_t packed_count, uint32_t *data);
 void gcode_util_remove_duplicate_scalars (gfloat_t *array, uint32_t *num);
 void gcode_util_qdbb (gcode_block_t *block, gcode_vec2d_t min, gcode_vec2d_t max);
 int gcode_util_intersect (gcode_block_t *block_a, gcode_block_t *block_b, gcode_vec2d_t ip_array[2], int *ip_num);
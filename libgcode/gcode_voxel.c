@@ -0,0 +1,668 @@
+/**
+ *  gcode_voxel.c
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gcode_voxel.h"
+#include "gcode_util.h"
+#include <string.h>
+#include <unistd.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+#define BRICK_INDEX(_map, _bx, _by, _bz) \
+        (((_by) * (_map)->brick_number[0] + (_bx)) * (_map)->brick_number[2] + (_bz))
+
+#define BRICK_DATA(_map, _id) \
+        ((_map)->chunk[(_id) >> (_map)->chunk_bits] + ((_id) & ((1 << (_map)->chunk_bits) - 1)) * GCODE_VOXEL_BRICK_WORDS)
+
+#define REGION_SHIFT (GCODE_VOXEL_REGION_BITS - GCODE_VOXEL_BRICK_BITS)
+
+#define REGION_INDEX(_map, _bx, _by) \
+        (((_by) >> REGION_SHIFT) * (_map)->region_number[0] + ((_bx) >> REGION_SHIFT))
+
+/**
+ * Map a sparse file of 'size' bytes into memory for the voxel map to live in;
+ * the file is unlinked right away, so it goes as soon as the map does. Returns
+ * non-zero on failure, as it always does where there is no mapping files into
+ * memory like that (WIN32).
+ */
+
+static int
+gcode_voxel_file (gcode_voxel_map_t *map, size_t size)
+{
+#ifndef WIN32
+  char path[256], *dir;
+
+  dir = getenv ("TMPDIR");
+
+  snprintf (path, sizeof (path), "%s/gcam-stock-XXXXXX", dir && *dir ? dir : "/tmp");
+
+  map->fd = mkstemp (path);
+
+  if (map->fd < 0)
+    return (1);
+
+  unlink (path);
+
+  if (ftruncate (map->fd, (off_t)size) == 0)                                    // Sparse: blocks only get used as they are written;
+  {
+    map->file = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, map->fd, 0);
+
+    if (map->file != MAP_FAILED)
+    {
+      map->file_size = size;
+      return (0);
+    }
+  }
+
+  close (map->fd);
+
+  map->fd = -1;
+  map->file = NULL;
+#endif
+
+  return (1);
+}
+
+/**
+ * Let go of the file the voxel map lives in (see gcode_voxel_file)
+ */
+
+static void
+gcode_voxel_unfile (gcode_voxel_map_t *map)
+{
+#ifndef WIN32
+  munmap (map->file, map->file_size);
+  close (map->fd);
+#endif
+
+  map->fd = -1;
+  map->file = NULL;
+}
+
+/**
+ * (Re)allocate the voxel map to match the current voxel numbers; the contents
+ * are undefined until the next 'gcode_voxel_fill'. Should the map take more
+ * than 'voxel_memory' megabytes with every brick mixed, it goes to a file.
+ * Returns non-zero on failure.
+ */
+
+int
+gcode_voxel_init (gcode_t *gcode)
+{
+  gcode_voxel_map_t *map;
+  size_t bricks, region_bricks, chunk_bytes, table_bytes, page;
+  int i;
+
+  gcode_voxel_free (gcode);
+
+  map = malloc (sizeof (gcode_voxel_map_t));
+
+  if (!map)
+  {
+    REMARK ("Failed to allocate memory for the voxel map\n");
+    return (1);
+  }
+
+  for (i = 0; i < 3; i++)
+    map->brick_number[i] = ((size_t)gcode->voxel_number[i] + GCODE_VOXEL_BRICK_SIZE - 1) >> GCODE_VOXEL_BRICK_BITS;
+
+  for (i = 0; i < 2; i++)
+    map->region_number[i] = (map->brick_number[i] + (1 << REGION_SHIFT) - 1) >> REGION_SHIFT;
+
+  bricks = map->brick_number[0] * map->brick_number[1] * map->brick_number[2];
+
+  /* Chunks no larger than a region needs, for thin stock not to waste most of each one */
+  region_bricks = ((size_t)1 << (2 * REGION_SHIFT)) * map->brick_number[2];
+
+  map->chunk_bits = 0;
+
+  while ((map->chunk_bits < GCODE_VOXEL_CHUNK_BITS) && (((size_t)1 << map->chunk_bits) < region_bricks))
+    map->chunk_bits++;
+
+  map->chunk_number = map->region_number[0] * map->region_number[1] * ((region_bricks + ((size_t)1 << map->chunk_bits) - 1) >> map->chunk_bits);
+
+  if ((map->chunk_number << map->chunk_bits) >= GCODE_VOXEL_BRICK_EMPTY)
+  {
+    REMARK ("Too many voxels for the voxel map\n");
+    free (map);
+    return (1);
+  }
+
+  chunk_bytes = ((size_t)GCODE_VOXEL_BRICK_WORDS * sizeof (uint64_t)) << map->chunk_bits;
+
+#ifndef WIN32
+  page = (size_t)sysconf (_SC_PAGESIZE);
+#else
+  page = 1;                                                                     // Never mapped, so no pages to line the chunks up with;
+#endif
+  table_bytes = (bricks * sizeof (uint32_t) + page - 1) / page * page;
+
+  map->fd = -1;
+  map->file = NULL;
+  map->file_size = 0;
+  map->file_chunks = table_bytes;
+
+  if (gcode->voxel_memory && (table_bytes + map->chunk_number * chunk_bytes > ((size_t)gcode->voxel_memory << 20)))
+    if (gcode_voxel_file (map, table_bytes + map->chunk_number * chunk_bytes))
+      REMARK ("Failed to map a file for the voxel map, keeping it in memory\n");
+
+  map->brick = map->file ? (uint32_t *)map->file : malloc (bricks * sizeof (uint32_t));
+  map->chunk = calloc (map->chunk_number, sizeof (uint64_t *));
+  map->region = malloc (map->region_number[0] * map->region_number[1] * sizeof (gcode_voxel_region_t));
+
+  if (!map->brick || !map->chunk || !map->region)
+  {
+    REMARK ("Failed to allocate memory for the voxel map\n");
+
+    if (map->file)
+      gcode_voxel_unfile (map);
+    else
+      free (map->brick);
+
+    free (map->chunk);
+    free (map->region);
+    free (map);
+    return (1);
+  }
+
+  map->chunk_used = 0;
+
+  pthread_mutex_init (&map->lock, NULL);
+
+  gcode->voxel_map = map;
+
+  return (0);
+}
+
+void
+gcode_voxel_free (gcode_t *gcode)
+{
+  gcode_voxel_map_t *map;
+  size_t i;
+
+  map = gcode->voxel_map;
+
+  if (!map)
+    return;
+
+  if (map->file)
+  {
+    gcode_voxel_unfile (map);
+  }
+  else
+  {
+    for (i = 0; i < map->chunk_number; i++)
+      free (map->chunk[i]);
+
+    free (map->brick);
+  }
+
+  pthread_mutex_destroy (&map->lock);
+
+  free (map->chunk);
+  free (map->region);
+  free (map);
+
+  gcode->voxel_map = NULL;
+}
+
+/**
+ * Turn every voxel back on: all bricks become solid, and the storage of mixed
+ * bricks is kept around to be handed out again.
+ */
+
+void
+gcode_voxel_fill (gcode_t *gcode)
+{
+  gcode_voxel_map_t *map;
+  size_t i, bricks, regions;
+
+  map = gcode->voxel_map;
+
+  bricks = map->brick_number[0] * map->brick_number[1] * map->brick_number[2];
+  regions = map->region_number[0] * map->region_number[1];
+
+  for (i = 0; i < bricks; i++)
+    map->brick[i] = GCODE_VOXEL_BRICK_SOLID;
+
+  for (i = 0; i < regions; i++)
+  {
+    map->region[i].chunk = GCODE_VOXEL_CHUNK_NONE;
+    map->region[i].used = 0;
+    map->region[i].free = GCODE_VOXEL_BRICK_EMPTY;
+  }
+
+  map->chunk_used = 0;
+}
+
+int
+gcode_voxel_get (gcode_t *gcode, size_t x, size_t y, size_t z)
+{
+  gcode_voxel_map_t *map;
+  uint32_t id;
+
+  map = gcode->voxel_map;
+
+  id = map->brick[BRICK_INDEX (map, x >> GCODE_VOXEL_BRICK_BITS, y >> GCODE_VOXEL_BRICK_BITS, z >> GCODE_VOXEL_BRICK_BITS)];
+
+  if (id == GCODE_VOXEL_BRICK_SOLID)
+    return (1);
+
+  if (id == GCODE_VOXEL_BRICK_EMPTY)
+    return (0);
+
+  return ((BRICK_DATA (map, id)[y & 7] >> ((x & 7) * 8 + (z & 7))) & 1);
+}
+
+/**
+ * State of brick (bx, by, bz): GCODE_VOXEL_BRICK_SOLID, GCODE_VOXEL_BRICK_EMPTY
+ * or anything else for a mixed one.
+ */
+
+uint32_t
+gcode_voxel_brick (gcode_t *gcode, size_t bx, size_t by, size_t bz)
+{
+  gcode_voxel_map_t *map;
+
+  map = gcode->voxel_map;
+
+  return (map->brick[BRICK_INDEX (map, bx, by, bz)]);
+}
+
+/**
+ * Hand out storage for one more mixed brick of the region of brick column
+ * (bx, by), from the chunk of that region; returns GCODE_VOXEL_BRICK_EMPTY if
+ * there is no memory left for it.
+ */
+
+static uint32_t
+gcode_voxel_brick_alloc (gcode_voxel_map_t *map, size_t bx, size_t by)
+{
+  gcode_voxel_region_t *region;
+  uint32_t id, c;
+
+  region = &map->region[REGION_INDEX (map, bx, by)];
+
+  pthread_mutex_lock (&map->lock);
+
+  if (region->free != GCODE_VOXEL_BRICK_EMPTY)
+  {
+    id = region->free;
+    region->free = (uint32_t)BRICK_DATA (map, id)[0];
+  }
+  else if ((region->chunk != GCODE_VOXEL_CHUNK_NONE) && (region->used < (1U << map->chunk_bits)))
+  {
+    id = (region->chunk << map->chunk_bits) | region->used++;
+  }
+  else
+  {
+    id = GCODE_VOXEL_BRICK_EMPTY;
+    c = map->chunk_used;
+
+    if (c < map->chunk_number)
+    {
+      if (!map->chunk[c])
+        map->chunk[c] = map->file ? (uint64_t *)(map->file + map->file_chunks + (((size_t)c * GCODE_VOXEL_BRICK_WORDS * sizeof (uint64_t)) << map->chunk_bits)) :
+                                    malloc (((size_t)GCODE_VOXEL_BRICK_WORDS * sizeof (uint64_t)) << map->chunk_bits);
+
+      if (map->chunk[c])
+      {
+        map->chunk_used++;
+
+        region->chunk = c;
+        region->used = 1;
+
+        id = c << map->chunk_bits;
+      }
+    }
+  }
+
+  pthread_mutex_unlock (&map->lock);
+
+  return (id);
+}
+
+static void
+gcode_voxel_brick_release (gcode_voxel_map_t *map, size_t bx, size_t by, uint32_t id)
+{
+  gcode_voxel_region_t *region;
+
+  region = &map->region[REGION_INDEX (map, bx, by)];
+
+  pthread_mutex_lock (&map->lock);
+
+  BRICK_DATA (map, id)[0] = region->free;
+  region->free = id;
+
+  pthread_mutex_unlock (&map->lock);
+}
+
+/**
+ * Contents of brick (bx, by, bz) with all its voxels set - all of those inside
+ * the stock, that is: bricks along the far edges of the stock hang over it, and
+ * those bits must stay clear for an emptied brick to be told apart by all its
+ * words being zero.
+ */
+
+static void
+gcode_voxel_brick_whole (gcode_t *gcode, size_t bx, size_t by, size_t bz, uint64_t *data)
+{
+  uint64_t row, zbyte;
+  size_t left;
+  int lx, ly;
+
+  left = gcode->voxel_number[2] - (bz << GCODE_VOXEL_BRICK_BITS);
+  zbyte = left >= 8 ? 0xFF : (1 << left) - 1;
+
+  row = 0;
+
+  for (lx = 0; lx < 8; lx++)
+    if ((bx << GCODE_VOXEL_BRICK_BITS) + lx < gcode->voxel_number[0])
+      row |= zbyte << (lx * 8);
+
+  for (ly = 0; ly < 8; ly++)
+    data[ly] = (by << GCODE_VOXEL_BRICK_BITS) + ly < gcode->voxel_number[1] ? row : 0;
+}
+
+/**
+ * Turn solid brick (bx, by, bz) into a mixed one with all its voxels set
+ */
+
+static uint32_t
+gcode_voxel_brick_expand (gcode_t *gcode, size_t bx, size_t by, size_t bz)
+{
+  gcode_voxel_map_t *map;
+  uint32_t id;
+
+  map = gcode->voxel_map;
+
+  id = gcode_voxel_brick_alloc (map, bx, by);
+
+  if (id == GCODE_VOXEL_BRICK_EMPTY)
+  {
+    REMARK ("Failed to allocate memory for the voxel map\n");
+    return (id);
+  }
+
+  gcode_voxel_brick_whole (gcode, bx, by, bz, BRICK_DATA (map, id));
+
+  map->brick[BRICK_INDEX (map, bx, by, bz)] = id;
+
+  return (id);
+}
+
+/**
+ * Turn off the voxels 'zmin' to 'zmax' (inclusive) of column (x, y): one byte
+ * of each brick crossed is masked, empty bricks are skipped, solid ones become
+ * mixed and mixed ones that end up with nothing left in them become empty.
+ * Unless 'cleared' is NULL it gets told about every run of voxels that really
+ * went from set to clear, lowest first. Returns non-zero if there were any.
+ */
+
+int
+gcode_voxel_clear (gcode_t *gcode, size_t x, size_t y, size_t zmin, size_t zmax, gcode_voxel_cleared_t *cleared, void *context)
+{
+  gcode_voxel_map_t *map;
+  uint64_t *data, mask, gone, any;
+  uint32_t *entry;
+  size_t bx, by, bz, lo, hi, z, run;
+  int shift;
+
+  if (zmin > zmax)
+    return (0);
+
+  map = gcode->voxel_map;
+
+  bx = x >> GCODE_VOXEL_BRICK_BITS;
+  by = y >> GCODE_VOXEL_BRICK_BITS;
+
+  shift = (x & 7) * 8;
+  run = SIZE_MAX;
+  any = 0;
+
+  for (bz = zmin >> GCODE_VOXEL_BRICK_BITS; bz <= zmax >> GCODE_VOXEL_BRICK_BITS; bz++)
+  {
+    entry = &map->brick[BRICK_INDEX (map, bx, by, bz)];
+
+    lo = bz << GCODE_VOXEL_BRICK_BITS;
+    hi = lo + 7;
+
+    lo = zmin > lo ? zmin & 7 : 0;
+    hi = zmax < hi ? zmax & 7 : 7;
+
+    mask = ((0xFFULL >> (7 - hi)) & (0xFFULL << lo)) << shift;
+    gone = 0;
+
+    if (*entry == GCODE_VOXEL_BRICK_SOLID)                                      // Stays solid if it cannot be expanded;
+      gcode_voxel_brick_expand (gcode, bx, by, bz);
+
+    if ((*entry != GCODE_VOXEL_BRICK_EMPTY) && (*entry != GCODE_VOXEL_BRICK_SOLID))
+    {
+      data = BRICK_DATA (map, *entry);
+
+      gone = data[y & 7] & mask;
+      data[y & 7] &= ~mask;
+      any |= gone;
+
+      if ((data[0] | data[1] | data[2] | data[3] | data[4] | data[5] | data[6] | data[7]) == 0)
+      {
+        gcode_voxel_brick_release (map, bx, by, *entry);
+        *entry = GCODE_VOXEL_BRICK_EMPTY;
+      }
+    }
+
+    if (!cleared)
+      continue;
+
+    for (z = lo; z <= hi; z++)                                                  // Runs may well carry on into the next brick;
+    {
+      if ((gone >> (shift + z)) & 1)
+      {
+        if (run == SIZE_MAX)
+          run = (bz << GCODE_VOXEL_BRICK_BITS) + z;
+      }
+      else if (run != SIZE_MAX)
+      {
+        cleared (context, x, y, run, (bz << GCODE_VOXEL_BRICK_BITS) + z - 1);
+        run = SIZE_MAX;
+      }
+    }
+  }
+
+  if (cleared && (run != SIZE_MAX))
+    cleared (context, x, y, run, zmax);
+
+  return (any != 0);
+}
+
+/**
+ * Turn the voxels 'zmin' to 'zmax' (inclusive) of column (x, y) back on: the
+ * reverse of 'gcode_voxel_clear', down to mixed bricks that end up whole going
+ * back to being solid.
+ */
+
+void
+gcode_voxel_set (gcode_t *gcode, size_t x, size_t y, size_t zmin, size_t zmax)
+{
+  gcode_voxel_map_t *map;
+  uint64_t *data, mask, whole[GCODE_VOXEL_BRICK_WORDS];
+  uint32_t *entry;
+  size_t bx, by, bz, lo, hi;
+
+  if (zmin > zmax)
+    return;
+
+  map = gcode->voxel_map;
+
+  bx = x >> GCODE_VOXEL_BRICK_BITS;
+  by = y >> GCODE_VOXEL_BRICK_BITS;
+
+  for (bz = zmin >> GCODE_VOXEL_BRICK_BITS; bz <= zmax >> GCODE_VOXEL_BRICK_BITS; bz++)
+  {
+    entry = &map->brick[BRICK_INDEX (map, bx, by, bz)];
+
+    if (*entry == GCODE_VOXEL_BRICK_SOLID)
+      continue;
+
+    if (*entry == GCODE_VOXEL_BRICK_EMPTY)
+    {
+      *entry = gcode_voxel_brick_alloc (map, bx, by);
+
+      if (*entry == GCODE_VOXEL_BRICK_EMPTY)
+      {
+        REMARK ("Failed to allocate memory for the voxel map\n");
+        continue;
+      }
+
+      memset (BRICK_DATA (map, *entry), 0, GCODE_VOXEL_BRICK_WORDS * sizeof (uint64_t));
+    }
+
+    lo = bz << GCODE_VOXEL_BRICK_BITS;
+    hi = lo + 7;
+
+    lo = zmin > lo ? zmin & 7 : 0;
+    hi = zmax < hi ? zmax & 7 : 7;
+
+    mask = ((0xFFULL >> (7 - hi)) & (0xFFULL << lo)) << ((x & 7) * 8);
+
+    data = BRICK_DATA (map, *entry);
+    data[y & 7] |= mask;
+
+    gcode_voxel_brick_whole (gcode, bx, by, bz, whole);
+
+    if (memcmp (data, whole, sizeof (whole)) == 0)
+    {
+      gcode_voxel_brick_release (map, bx, by, *entry);
+      *entry = GCODE_VOXEL_BRICK_SOLID;
+    }
+  }
+}
+
+/**
+ * Serialize the voxel map (the brick table, mixed bricks renumbered in order,
+ * followed by the contents of those) and run-length pack it with the help of
+ * 'gcode_util_pack_words'; returns NULL on failure.
+ */
+
+uint32_t *
+gcode_voxel_pack (gcode_t *gcode, size_t *packed_count)
+{
+  gcode_voxel_map_t *map;
+  uint32_t *flat, *packed, mixed;
+  size_t i, bricks, count;
+
+  map = gcode->voxel_map;
+
+  bricks = map->brick_number[0] * map->brick_number[1] * map->brick_number[2];
+
+  for (i = 0, mixed = 0; i < bricks; i++)
+    if ((map->brick[i] != GCODE_VOXEL_BRICK_SOLID) && (map->brick[i] != GCODE_VOXEL_BRICK_EMPTY))
+      mixed++;
+
+  count = bricks + (size_t)mixed * 2 * GCODE_VOXEL_BRICK_WORDS;
+
+  flat = malloc (count * sizeof (uint32_t));
+
+  if (!flat)
+  {
+    REMARK ("Failed to allocate memory for packing the voxel map\n");
+    return (NULL);
+  }
+
+  for (i = 0, mixed = 0; i < bricks; i++)
+  {
+    if ((map->brick[i] == GCODE_VOXEL_BRICK_SOLID) || (map->brick[i] == GCODE_VOXEL_BRICK_EMPTY))
+    {
+      flat[i] = map->brick[i];
+    }
+    else
+    {
+      memcpy (&flat[bricks + (size_t)mixed * 2 * GCODE_VOXEL_BRICK_WORDS], BRICK_DATA (map, map->brick[i]), GCODE_VOXEL_BRICK_WORDS * sizeof (uint64_t));
+      flat[i] = mixed++;
+    }
+  }
+
+  packed = gcode_util_pack_words (flat, count, packed_count);
+
+  free (flat);
+
+  return (packed);
+}
+
+/**
+ * Rebuild the voxel map from what 'gcode_voxel_pack' produced for a stock of
+ * the same size; returns non-zero on failure.
+ */
+
+int
+gcode_voxel_unpack (gcode_t *gcode, uint32_t *packed, size_t packed_count)
+{
+  gcode_voxel_map_t *map;
+  uint32_t *flat, id;
+  size_t i, bricks, count;
+
+  map = gcode->voxel_map;
+
+  bricks = map->brick_number[0] * map->brick_number[1] * map->brick_number[2];
+
+  for (i = 0, count = 0; i + 1 < packed_count; i += 2)
+    count += packed[i];
+
+  flat = malloc (count * sizeof (uint32_t));
+
+  if (!flat)
+  {
+    REMARK ("Failed to allocate memory for unpacking the voxel map\n");
+    return (1);
+  }
+
+  gcode_util_unpack_words (packed, packed_count, flat);
+
+  gcode_voxel_fill (gcode);
+
+  for (i = 0; i < bricks; i++)
+  {
+    if ((flat[i] == GCODE_VOXEL_BRICK_SOLID) || (flat[i] == GCODE_VOXEL_BRICK_EMPTY))
+    {
+      map->brick[i] = flat[i];
+      continue;
+    }
+
+    id = gcode_voxel_brick_alloc (map, (i / map->brick_number[2]) % map->brick_number[0], (i / map->brick_number[2]) / map->brick_number[0]);
+
+    if (id == GCODE_VOXEL_BRICK_EMPTY)
+    {
+      REMARK ("Failed to allocate memory for the voxel map\n");
+      free (flat);
+      return (1);
+    }
+
+    memcpy (BRICK_DATA (map, id), &flat[bricks + (size_t)flat[i] * 2 * GCODE_VOXEL_BRICK_WORDS], GCODE_VOXEL_BRICK_WORDS * sizeof (uint64_t));
+
+    map->brick[i] = id;
+  }
+
+  free (flat);
+
+  return (0);
+}
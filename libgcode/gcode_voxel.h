@@ -0,0 +1,99 @@
+/**
+ *  gcode_voxel.h
+ *  Source code file for G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GCODE_VOXEL_H
+#define _GCODE_VOXEL_H
+
+#include "gcode_internal.h"
+#include <pthread.h>
+
+/**
+ * Every access to the voxel map goes through these functions, so the storage
+ * layout can change without touching the simulator or the display code.
+ * The stock is cut into bricks of 8x8x8 voxels; a brick is either wholly solid,
+ * wholly empty, or mixed - only mixed bricks store their voxels (one bit each,
+ * the 8 Z values of every column of the brick packed into one byte), so stock
+ * that was never touched or got cleared out completely costs next to nothing.
+ * Mixed bricks are stored region by region - a region being the bricks of a
+ * square of 64x64 columns, the tiles the simulator works through one at a time
+ * - so working on one tile touches a few chunks of storage and nothing else.
+ * A map too large for the memory it is allowed gets its storage from a sparse
+ * file mapped into memory instead, which the system pages in and out as the
+ * simulator moves from one tile to the next.
+ */
+
+#define GCODE_VOXEL_BRICK_BITS    3                                             /* Bricks are 2^3 = 8 voxels along each axis */
+#define GCODE_VOXEL_BRICK_SIZE    (1 << GCODE_VOXEL_BRICK_BITS)
+#define GCODE_VOXEL_BRICK_WORDS   8                                             /* 512 bits; one 64-bit word per row of columns */
+
+#define GCODE_VOXEL_BRICK_SOLID   0xFFFFFFFF
+#define GCODE_VOXEL_BRICK_EMPTY   0xFFFFFFFE
+
+#define GCODE_VOXEL_REGION_BITS   6                                             /* Regions are 2^6 = 64 columns along X and Y */
+#define GCODE_VOXEL_REGION_SIZE   (1 << GCODE_VOXEL_REGION_BITS)
+
+#define GCODE_VOXEL_CHUNK_BITS    12                                            /* Mixed bricks get allocated up to 4096 at a time */
+#define GCODE_VOXEL_CHUNK_BRICKS  (1 << GCODE_VOXEL_CHUNK_BITS)
+#define GCODE_VOXEL_CHUNK_NONE    0xFFFFFFFF
+
+typedef void gcode_voxel_cleared_t (void *context, size_t x, size_t y, size_t zmin, size_t zmax);
+
+/**
+ * Storage of the mixed bricks of one region: the chunk being filled and how
+ * many bricks of it are handed out, plus those released to be handed out again
+ */
+
+typedef struct gcode_voxel_region_s
+{
+  uint32_t chunk;                                                               /* NONE until the region gets its first mixed brick */
+  uint32_t used;
+  uint32_t free;                                                                /* first of the released bricks, chained through their first word */
+} gcode_voxel_region_t;
+
+typedef struct gcode_voxel_map_s
+{
+  size_t brick_number[3];                                                       /* bricks along each axis */
+  uint32_t *brick;                                                              /* SOLID, EMPTY or the index of a mixed brick; Z runs fastest */
+  uint64_t **chunk;                                                             /* storage of mixed bricks, never moved once allocated */
+  size_t chunk_number;
+  uint32_t chunk_used;                                                          /* chunks handed out to regions so far */
+  int chunk_bits;                                                               /* bricks per chunk (log 2), no more than a region holds */
+  size_t region_number[2];                                                      /* regions along X and Y */
+  gcode_voxel_region_t *region;
+  int fd;                                                                       /* file backing the map, -1 if kept in memory */
+  char *file;                                                                   /* mapping of the whole file: brick table, then chunks */
+  size_t file_size;
+  size_t file_chunks;                                                           /* offset of the first chunk in the file */
+  pthread_mutex_t lock;                                                         /* guards the above when workers clear voxels in parallel */
+} gcode_voxel_map_t;
+
+int gcode_voxel_init (gcode_t *gcode);
+void gcode_voxel_free (gcode_t *gcode);
+void gcode_voxel_fill (gcode_t *gcode);
+int gcode_voxel_get (gcode_t *gcode, size_t x, size_t y, size_t z);
+int gcode_voxel_clear (gcode_t *gcode, size_t x, size_t y, size_t zmin, size_t zmax, gcode_voxel_cleared_t *cleared, void *context);
+void gcode_voxel_set (gcode_t *gcode, size_t x, size_t y, size_t zmin, size_t zmax);
+uint32_t gcode_voxel_brick (gcode_t *gcode, size_t bx, size_t by, size_t bz);
+uint32_t *gcode_voxel_pack (gcode_t *gcode, size_t *packed_count);
+int gcode_voxel_unpack (gcode_t *gcode, uint32_t *packed, size_t packed_count);
+
+#endif
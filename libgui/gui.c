@@ -91,6 +91,23 @@ opengl_context_key_event (GtkWidget *widget, GdkEventKey *event, gpointer data)
   return (TRUE);
 }
 
+/**
+ * Show the rendered stock as it was after the number of lines of the program
+ * picked on the scrub slider, by moving through the removal log of the render.
+ */
+
+static void
+scrub_slider_value_changed_event (GtkRange *range, gpointer data)
+{
+  if (gui.ignore_signals || (gui.opengl.mode != GUI_OPENGL_MODE_RENDER))
+    return;
+
+  gcode_sim_log_seek (&gui.gcode, (uint32_t)gtk_range_get_value (range));
+
+  gui_opengl_build_simulate_display_list (&gui.opengl);
+  gui_opengl_context_redraw (&gui.opengl, NULL);
+}
+
 static gboolean
 opengl_context_button_event (GtkWidget *widget, GdkEventButton *event)
 {
@@ -824,8 +841,17 @@ gui_attach (gcode_t *gcode, gui_t *gui)
 
   gcode->progress_callback = update_progress;
   gcode->message_callback = generic_dialog;
+  gcode->preview_callback = update_preview;
+  gcode->stream_callback = update_stream;
 
   gcode->voxel_resolution = gui->settings.voxel_resolution;
+  gcode->stock_model = gui->settings.stock_model;
+  gcode->simulation_threads = gui->settings.simulation_threads;
+  gcode->simulation_levels = gui->settings.simulation_levels;
+  gcode->voxel_memory = gui->settings.voxel_memory;
+  gcode->optimize_output = gui->settings.optimize_output;
+  gcode->arc_tolerance = gui->settings.arc_tolerance;
+  gcode->compact_output = gui->settings.compact_output;
 }
 
 /**
@@ -1098,6 +1124,16 @@ gui_init (char *filename)
     gtk_box_pack_end (GTK_BOX (window_vbox_minor), gui.progress_bar, FALSE, FALSE, 0);
   }
 
+  /* Scrub Slider (lines of the rendered program shown as cut) */
+  {
+    gui.scrub_slider = gtk_hscale_new_with_range (0.0, 1.0, 1.0);
+    gtk_scale_set_digits (GTK_SCALE (gui.scrub_slider), 0);
+    gtk_scale_set_value_pos (GTK_SCALE (gui.scrub_slider), GTK_POS_LEFT);
+    gtk_widget_set_sensitive (gui.scrub_slider, FALSE);
+    g_signal_connect (G_OBJECT (gui.scrub_slider), "value-changed", G_CALLBACK (scrub_slider_value_changed_event), NULL);
+    gtk_box_pack_end (GTK_BOX (window_vbox_minor), gui.scrub_slider, FALSE, FALSE, 0);
+  }
+
   gtk_widget_show_all (gui.window);
 
   /* Try to load command line specified project if any */
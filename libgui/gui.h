@@ -63,6 +63,7 @@ typedef struct gui_s
   GtkTreeViewDropPosition row_drop_spot;
 
   GtkWidget *progress_bar;
+  GtkWidget *scrub_slider;
   gcode_block_t *selected_block;
 
   char title[64];
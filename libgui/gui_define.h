@@ -44,6 +44,10 @@ static const gfloat_t GCODE_OPENGL_MEDIUM_GRID_COLOR[3] = { 0.55, 0.55, 0.55 };
 static const gfloat_t GCODE_OPENGL_COARSE_GRID_COLOR[3] = { 0.85, 0.85, 0.85 };
 static const gfloat_t GCODE_OPENGL_GRID_BORDER_COLOR[3] = { 0.70, 0.70, 0.70 };
 static const gfloat_t GCODE_OPENGL_GRID_ORIGIN_COLOR[3] = { 0.70, 0.20, 0.20 };
+static const gfloat_t GCODE_OPENGL_STOCK_COLOR[3] = { 0.60, 0.60, 0.60 };
+static const gfloat_t GCODE_OPENGL_DEVIATION_EXACT_COLOR[3] = { 0.20, 0.90, 0.20 };
+static const gfloat_t GCODE_OPENGL_DEVIATION_EXCESS_COLOR[3] = { 0.10, 0.30, 1.00 };
+static const gfloat_t GCODE_OPENGL_DEVIATION_GOUGE_COLOR[3] = { 1.00, 0.10, 0.10 };
 
 static const gfloat_t GCODE_OPENGL_SMALL_POINT_SIZE = 5;
 static const gfloat_t GCODE_OPENGL_BREAK_POINT_SIZE = 7;
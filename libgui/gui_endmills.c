@@ -74,6 +74,8 @@ start (void *data, const char *xmlelem, const char **xmlattr)
     new_endmill->number = 0;
     new_endmill->diameter = 0.0;
     new_endmill->unit = DEF_UNITS;
+    new_endmill->shape = GCODE_TOOL_SHAPE_FLAT;
+    new_endmill->angle = 90.0;
 
     new_endmill->origin = GUI_ENDMILL_INTERNAL;
 
@@ -106,6 +108,21 @@ start (void *data, const char *xmlelem, const char **xmlattr)
           new_endmill->unit = GCODE_UNITS_MILLIMETER;
         }
       }
+      else if (strcmp (name, GCODE_XML_ATTR_ENDMILL_TYPE) == 0)
+      {
+        if (strcmp (value, GCODE_XML_VAL_ENDMILL_TYPE_BALL) == 0)
+        {
+          new_endmill->shape = GCODE_TOOL_SHAPE_BALL;
+        }
+        else if (strcmp (value, GCODE_XML_VAL_ENDMILL_TYPE_VEE) == 0)
+        {
+          new_endmill->shape = GCODE_TOOL_SHAPE_VEE;
+        }
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_ENDMILL_ANGLE) == 0)
+      {
+        new_endmill->angle = atof (value);
+      }
       else if (strcmp (name, GCODE_XML_ATTR_ENDMILL_DESCRIPTION) == 0)
       {
         strncpy (new_endmill->description, value, sizeof (new_endmill->description));
@@ -230,7 +247,7 @@ gui_endmills_find (gui_endmill_list_t *endmill_list, char *description, uint8_t
 }
 
 void
-gui_endmills_tack (gui_endmill_list_t *endmill_list, uint8_t number, gfloat_t diameter, uint8_t unit, char *description)
+gui_endmills_tack (gui_endmill_list_t *endmill_list, uint8_t number, gfloat_t diameter, uint8_t unit, uint8_t shape, gfloat_t angle, char *description)
 {
   gui_endmill_t *new_endmill;
 
@@ -245,6 +262,8 @@ gui_endmills_tack (gui_endmill_list_t *endmill_list, uint8_t number, gfloat_t di
   new_endmill->number = number;
   new_endmill->diameter = diameter;
   new_endmill->unit = unit;
+  new_endmill->shape = shape;
+  new_endmill->angle = angle;
 
   new_endmill->origin = GUI_ENDMILL_EXTERNAL;
 
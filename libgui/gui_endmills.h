@@ -37,16 +37,22 @@ static const char *GCODE_XML_ATTR_ENDMILL_TYPE = "type";
 static const char *GCODE_XML_ATTR_ENDMILL_DIAMETER = "diameter";
 static const char *GCODE_XML_ATTR_ENDMILL_UNIT = "unit";
 static const char *GCODE_XML_ATTR_ENDMILL_DESCRIPTION = "description";
+static const char *GCODE_XML_ATTR_ENDMILL_ANGLE = "angle";
 
 static const char *GCODE_XML_VAL_ENDMILL_UNIT_INCH = "inch";
 static const char *GCODE_XML_VAL_ENDMILL_UNIT_MILLIMETER = "millimeter";
 
+static const char *GCODE_XML_VAL_ENDMILL_TYPE_BALL = "ball nose";
+static const char *GCODE_XML_VAL_ENDMILL_TYPE_VEE = "v-bit";
+
 typedef struct gui_endmill_s
 {
   uint8_t number;
   gfloat_t diameter;
   uint8_t unit;
   uint8_t origin;
+  uint8_t shape;
+  gfloat_t angle;
   char description[64];
 } gui_endmill_t;
 
@@ -61,7 +67,7 @@ void gui_endmills_free (gui_endmill_list_t *endmill_list);
 int gui_endmills_read (gui_endmill_list_t *endmill_list);
 gfloat_t gui_endmills_size (gui_endmill_t *endmill, uint8_t unit);
 gui_endmill_t *gui_endmills_find (gui_endmill_list_t *endmill_list, char *description, uint8_t fallback);
-void gui_endmills_tack (gui_endmill_list_t *endmill_list, uint8_t number, gfloat_t diameter, uint8_t unit, char *description);
+void gui_endmills_tack (gui_endmill_list_t *endmill_list, uint8_t number, gfloat_t diameter, uint8_t unit, uint8_t shape, gfloat_t angle, char *description);
 void gui_endmills_cull (gui_endmill_list_t *endmill_list);
 
 #endif
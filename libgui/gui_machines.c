@@ -79,6 +79,16 @@ start (void *data, const char *xmlelem, const char **xmlattr)
     new_machine->maxipm[1] = 0.0;
     new_machine->maxipm[2] = 0.0;
 
+    new_machine->maxaccel[0] = 0.0;
+    new_machine->maxaccel[1] = 0.0;
+    new_machine->maxaccel[2] = 0.0;
+
+    new_machine->maxjerk = 0.0;
+
+    new_machine->resolution[0] = 0.0;
+    new_machine->resolution[1] = 0.0;
+    new_machine->resolution[2] = 0.0;
+
     new_machine->options = 0;
 
     for (i = 0; xmlattr[i]; i += 2)
@@ -139,6 +149,34 @@ start (void *data, const char *xmlelem, const char **xmlattr)
       {
         new_machine->maxipm[2] = atof (value);
       }
+      else if (strcmp (name, GCODE_XML_ATTR_PROPERTY_MAX_ACCEL_X) == 0)
+      {
+        new_machine->maxaccel[0] = atof (value);
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_PROPERTY_MAX_ACCEL_Y) == 0)
+      {
+        new_machine->maxaccel[1] = atof (value);
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_PROPERTY_MAX_ACCEL_Z) == 0)
+      {
+        new_machine->maxaccel[2] = atof (value);
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_PROPERTY_MAX_JERK) == 0)
+      {
+        new_machine->maxjerk = atof (value);
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_PROPERTY_RESOLUTION_X) == 0)
+      {
+        new_machine->resolution[0] = atof (value);
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_PROPERTY_RESOLUTION_Y) == 0)
+      {
+        new_machine->resolution[1] = atof (value);
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_PROPERTY_RESOLUTION_Z) == 0)
+      {
+        new_machine->resolution[2] = atof (value);
+      }
       else if (strcmp (name, GCODE_XML_ATTR_PROPERTY_SPINDLE_CONTROL) == 0)
       {
         if (strcmp (value, GCODE_XML_VAL_PROPERTY_YES) == 0)
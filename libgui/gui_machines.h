@@ -38,6 +38,13 @@ static const char *GCODE_XML_ATTR_PROPERTY_TRAVEL_Z = "travel-z";
 static const char *GCODE_XML_ATTR_PROPERTY_MAX_IPM_X = "max-ipm-x";
 static const char *GCODE_XML_ATTR_PROPERTY_MAX_IPM_Y = "max-ipm-y";
 static const char *GCODE_XML_ATTR_PROPERTY_MAX_IPM_Z = "max-ipm-z";
+static const char *GCODE_XML_ATTR_PROPERTY_MAX_ACCEL_X = "max-accel-x";
+static const char *GCODE_XML_ATTR_PROPERTY_MAX_ACCEL_Y = "max-accel-y";
+static const char *GCODE_XML_ATTR_PROPERTY_MAX_ACCEL_Z = "max-accel-z";
+static const char *GCODE_XML_ATTR_PROPERTY_MAX_JERK = "max-jerk";
+static const char *GCODE_XML_ATTR_PROPERTY_RESOLUTION_X = "resolution-x";
+static const char *GCODE_XML_ATTR_PROPERTY_RESOLUTION_Y = "resolution-y";
+static const char *GCODE_XML_ATTR_PROPERTY_RESOLUTION_Z = "resolution-z";
 static const char *GCODE_XML_ATTR_PROPERTY_SPINDLE_CONTROL = "spindle-control";
 static const char *GCODE_XML_ATTR_PROPERTY_TOOL_CHANGE = "tool-change";
 static const char *GCODE_XML_ATTR_PROPERTY_HOME_SWITCHES = "home-switches";
@@ -51,6 +58,9 @@ typedef struct gui_machine_s
   char name[64];
   gfloat_t travel[3];
   gfloat_t maxipm[3];
+  gfloat_t maxaccel[3];                                                         /* inches per second^2, 0 if not given */
+  gfloat_t maxjerk;                                                             /* inches per second^3, 0 if not given */
+  gfloat_t resolution[3];                                                       /* inches per step, 0 if not given */
   unsigned char options;
 } gui_machine_t;
 
@@ -42,6 +42,7 @@ static GtkActionEntry gui_menu_entries[] = {
   { "Save As",                     GTK_STOCK_SAVE_AS,                 "Save Project _As",             "<control>A",        "Save current GCAM Project As",     G_CALLBACK (gui_menu_file_save_project_as_menuitem_callback) },
   { "Close",                       GTK_STOCK_CLOSE,                   "_Close Project",               "<control>W",        "Close current GCAM Project",       G_CALLBACK (gui_menu_file_close_project_menuitem_callback) },
   { "Export",                      GTK_STOCK_CONVERT,                 "_Export G-Code",               "<control>E",        "Export Project to G-Code",         G_CALLBACK (gui_menu_file_export_gcode_menuitem_callback) },
+  { "Export Adaptive Feed",        GTK_STOCK_CONVERT,                 "Export With Adaptive _Feed",   NULL,                "Export with Feed Adapted to Load", G_CALLBACK (gui_menu_file_export_adaptive_feed_menuitem_callback) },
   { "Import GCAM",                 GTK_STOCK_OPEN,                    "_Import GCAM",                 "<control>I",        "Import Blocks from GCAM File",     G_CALLBACK (gui_menu_file_import_gcam_menuitem_callback) },
   { "Import Gerber (RS274X)",      GTK_STOCK_OPEN,                    "Import _Gerber (RS274X)",      "<control>G",        "Import Gerber (RS274X) to Sketch", G_CALLBACK (gui_menu_file_import_gerber_menuitem_callback) },
   { "Import Excellon Drill Holes", GTK_STOCK_OPEN,                    "Import E_xcellon Drill Holes", "<control>X",        "Import Excellon Drill Holes",      G_CALLBACK (gui_menu_file_import_excellon_menuitem_callback) },
@@ -83,6 +84,15 @@ static GtkActionEntry gui_menu_entries[] = {
   { "Back",                        GCAM_STOCK_VIEW_BACK,              "_Back",                        NULL,                "View Back",                        G_CALLBACK (gui_menu_view_back_menuitem_callback) },
   { "RenderMenu",                  NULL,                              "_Render" },
   { "FinalPart",                   GTK_STOCK_EXECUTE,                 "_Final Part",                  "<control>F",        "Render Final Part",                G_CALLBACK (gui_menu_view_render_final_part_menuitem_callback) },
+  { "StopRefining",                GTK_STOCK_STOP,                    "_Stop Rendering",              "Escape",            "Stop Rendering Final Part",        G_CALLBACK (gui_menu_view_stop_refining_menuitem_callback) },
+  { "Deviation",                   NULL,                              "_Deviation From Design",       "<control>M",        "Compare Final Part To Design",     G_CALLBACK (gui_menu_view_render_deviation_menuitem_callback) },
+  { "SimulateFile",                GTK_STOCK_OPEN,                    "Simulate G-Code _File...",     NULL,                "Simulate External G-Code File",    G_CALLBACK (gui_menu_view_render_file_menuitem_callback) },
+  { "ExportMesh",                  GTK_STOCK_SAVE_AS,                 "Export Final Part _Mesh...",   NULL,                "Export Final Part As STL",         G_CALLBACK (gui_menu_view_render_export_mesh_menuitem_callback) },
+  { "SaveStock",                   GTK_STOCK_SAVE,                    "_Save Final Part Stock...",    NULL,                "Save Stock For A Later Setup",     G_CALLBACK (gui_menu_view_render_save_stock_menuitem_callback) },
+  { "LoadStock",                   GTK_STOCK_OPEN,                    "Start From Saved S_tock...",   NULL,                "Render From Stock Of A Setup",     G_CALLBACK (gui_menu_view_render_load_stock_menuitem_callback) },
+  { "ClearStock",                  NULL,                              "Start From _Whole Material",   NULL,                "Render From Whole Material",       G_CALLBACK (gui_menu_view_render_clear_stock_menuitem_callback) },
+  { "ExportStats",                 GTK_STOCK_SAVE_AS,                 "Export Line S_tatistics...",   NULL,                "Export Simulation Cost Per Line",  G_CALLBACK (gui_menu_view_render_export_stats_menuitem_callback) },
+  { "CycleTime",                   NULL,                              "Estimate _Cycle Time",         NULL,                "Estimate Cycle Time On Machine",   G_CALLBACK (gui_menu_view_render_cycle_time_menuitem_callback) },
   { "HelpMenu",                    NULL,                              "_Help" },
   { "Manual",                      GTK_STOCK_HELP,                    "_Manual",                      NULL,                "GCAM Manual",                      G_CALLBACK (gui_menu_help_manual_menuitem_callback) },
   { "About",                       GTK_STOCK_ABOUT,                   "_About",                       NULL,                "About GCAM",                       G_CALLBACK (gui_menu_help_about_menuitem_callback) },
@@ -99,6 +109,7 @@ static const char *gui_menu_description =
 "      <menuitem action='Close'/>"
 "      <separator/>"
 "      <menuitem action='Export'/>"
+"      <menuitem action='Export Adaptive Feed'/>"
 "      <separator/>"
 "      <menuitem action='Import GCAM'/>"
 "      <menuitem action='Import Gerber (RS274X)'/>"
@@ -160,6 +171,15 @@ static const char *gui_menu_description =
 "    </menu>"
 "    <menu action='RenderMenu'>"
 "      <menuitem action='FinalPart'/>"
+"      <menuitem action='StopRefining'/>"
+"      <menuitem action='Deviation'/>"
+"      <menuitem action='SimulateFile'/>"
+"      <menuitem action='ExportMesh'/>"
+"      <menuitem action='SaveStock'/>"
+"      <menuitem action='LoadStock'/>"
+"      <menuitem action='ClearStock'/>"
+"      <menuitem action='CycleTime'/>"
+"      <menuitem action='ExportStats'/>"
 "    </menu>"
 "    <menu action='HelpMenu'>"
 "      <menuitem action='Manual'/>"
@@ -173,6 +173,8 @@ new_project_on_assistant_apply (GtkWidget *assistant, gpointer data)
 
     tool->diameter = tool_diameter;
     tool->number = tool_number;
+    tool->shape = endmill->shape;
+    tool->angle = endmill->angle;
     strcpy (tool->label, tool_name);
 
     block->make (block);
@@ -769,11 +771,13 @@ static void
 export_gcode_on_assistant_apply (GtkWidget *assistant, gpointer data)
 {
   gui_t *gui;
+  gui_machine_t *machine;
   GtkWidget **wlist;
   GtkWidget *dialog;
   GtkFileFilter *filter;
   char proposed_filename[64];
   char *text_field;
+  int i;
 
   wlist = (GtkWidget **)data;
 
@@ -824,6 +828,11 @@ export_gcode_on_assistant_apply (GtkWidget *assistant, gpointer data)
 
   g_free (text_field);
 
+  machine = gui_machines_find (&gui->machines, gui->gcode.machine_name, TRUE);
+
+  for (i = 0; i < 3; i++)                                                       // Compact output writes no more decimals than the machine can use;
+    gui->gcode.machine_resolution[i] = machine ? machine->resolution[i] : 0.0;
+
   dialog = gtk_file_chooser_dialog_new ("Export G-Code",
                                         GTK_WINDOW (gui->window),
                                         GTK_FILE_CHOOSER_ACTION_SAVE,
@@ -1030,6 +1039,79 @@ gui_menu_file_export_gcode_menuitem_callback (GtkWidget *widget, gpointer data)
   gtk_widget_show (assistant);
 }
 
+/**
+ * Export the project to G-code with feed rates adapted to how much material
+ * each move removes, as the simulation tells; the feeds of the project tools
+ * are never exceeded. The estimated build time before and after is reported.
+ * NOTE: This is a callback for the "Export G-Code With Adaptive Feed" item of
+ * the "File" menu
+ */
+
+void
+gui_menu_file_export_adaptive_feed_menuitem_callback (GtkWidget *widget, gpointer data)
+{
+  GtkWidget *dialog;
+  GtkFileFilter *filter;
+  gui_t *gui;
+  char proposed_filename[64], message[256], *filename;
+  gfloat_t time_before, time_after;
+  int failed;
+
+  gui = (gui_t *)data;
+
+  dialog = gtk_file_chooser_dialog_new ("Export G-Code With Adaptive Feed",
+                                        GTK_WINDOW (gui->window),
+                                        GTK_FILE_CHOOSER_ACTION_SAVE,
+                                        GTK_STOCK_CANCEL,
+                                        GTK_RESPONSE_CANCEL,
+                                        GTK_STOCK_SAVE,
+                                        GTK_RESPONSE_ACCEPT,
+                                        NULL);
+
+  gtk_file_chooser_set_do_overwrite_confirmation (GTK_FILE_CHOOSER (dialog), TRUE);
+
+  sprintf (proposed_filename, "%s.nc", gui->gcode.name);
+  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (dialog), proposed_filename);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, "*.nc");
+  gtk_file_filter_add_pattern (filter, "*.nc");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (dialog), filter);
+
+  if (*gui->current_folder)
+    gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER (dialog), gui->current_folder);
+
+  if (gtk_dialog_run (GTK_DIALOG (dialog)) != GTK_RESPONSE_ACCEPT)
+  {
+    gtk_widget_destroy (dialog);
+    return;
+  }
+
+  filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
+
+  gtk_widget_destroy (dialog);
+
+  failed = gcode_feed_export (&gui->gcode, filename, &time_before, &time_after);
+
+  g_free (filename);
+
+  update_progress (gui, 0.0);
+
+  if (failed)
+  {
+    generic_dialog (gui, "\nUnable to export with adaptive feed:\nthe final part could not be simulated.\n");
+    return;
+  }
+
+  gui->first_render = 1;                                                        // The stock got rendered along the way, but the view doesn't show it;
+
+  sprintf (message, "\nEstimated Build Time: %dH %dM %.0f sec\nWith Adaptive Feed: %dH %dM %.0f sec\n",
+           (int)(time_before / 3600.0), (int)(fmod (time_before, 3600.0) / 60.0), fmod (time_before, 60.0),
+           (int)(time_after / 3600.0), (int)(fmod (time_after, 3600.0) / 60.0), fmod (time_after, 60.0));
+
+  generic_dialog (gui, message);
+}
+
 /**
  * Destroy or free every dynamic resource related to the import list dialog;
  * NOTE: This is a callback for the "cancel" event of the import list dialog
@@ -1462,6 +1544,8 @@ gerber_on_assistant_apply (GtkWidget *assistant, gpointer data)
   tool->feed = gtk_spin_button_get_value (GTK_SPIN_BUTTON (wlist[3]));
   tool->diameter = tool_diameter;
   tool->number = tool_number;
+  tool->shape = endmill->shape;
+  tool->angle = endmill->angle;
   strcpy (tool->label, tool_name);
 
   pass_depth = -gtk_spin_button_get_value (GTK_SPIN_BUTTON (wlist[4]));
@@ -38,6 +38,7 @@ void gui_menu_file_save_project_menuitem_callback (GtkWidget *widget, gpointer d
 gint gui_menu_file_save_project_as_menuitem_callback (GtkWidget *widget, gpointer data);
 void gui_menu_file_close_project_menuitem_callback (GtkWidget *widget, gpointer data);
 void gui_menu_file_export_gcode_menuitem_callback (GtkWidget *widget, gpointer data);
+void gui_menu_file_export_adaptive_feed_menuitem_callback (GtkWidget *widget, gpointer data);
 void gui_menu_file_import_gcam_menuitem_callback (GtkWidget *widget, gpointer data);
 void gui_menu_file_import_gerber_menuitem_callback (GtkWidget *widget, gpointer data);
 void gui_menu_file_import_excellon_menuitem_callback (GtkWidget *widget, gpointer data);
@@ -46,6 +46,8 @@ gui_menu_insert_tool_change_menuitem_callback (GtkWidget *widget, gpointer data)
   strcpy (tool->label, endmill->description);
   tool->diameter = gui_endmills_size (endmill, gui->gcode.units);
   tool->number = endmill->number;
+  tool->shape = endmill->shape;
+  tool->angle = endmill->angle;
 
   get_selected_block (gui, &selected_block, &selected_iter);
 
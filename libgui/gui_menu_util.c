@@ -110,6 +110,7 @@ update_progress (void *gui, gfloat_t progress)
   static clock_t old_clock = 0;
   clock_t now_clock;
   uint8_t update;
+  char text[64];
 
   update = 0;
 
@@ -131,6 +132,16 @@ update_progress (void *gui, gfloat_t progress)
   {
     gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (((gui_t *)gui)->progress_bar), progress);
 
+    if (((gui_t *)gui)->gcode.simulation_level)                                 // A progressive render tells which pass it is on;
+    {
+      snprintf (text, sizeof (text), "Refining %d of %d (Esc to stop)", ((gui_t *)gui)->gcode.simulation_level, ((gui_t *)gui)->gcode.simulation_levels);
+      gtk_progress_bar_set_text (GTK_PROGRESS_BAR (((gui_t *)gui)->progress_bar), text);
+    }
+    else
+    {
+      gtk_progress_bar_set_text (GTK_PROGRESS_BAR (((gui_t *)gui)->progress_bar), NULL);
+    }
+
     while (gtk_events_pending ())                                               // One iteration (or even several more) are not enough for reliable updates;
       gtk_main_iteration ();                                                    // By flushing the queue, updates are shown even if we're hammering the CPU.
 
@@ -139,6 +150,36 @@ update_progress (void *gui, gfloat_t progress)
   }
 }
 
+/**
+ * Show the stock left by a coarse pass of a progressive render while the next,
+ * finer one gets simulated
+ */
+
+void
+update_preview (void *gui)
+{
+  gui_opengl_build_simulate_display_list (&((gui_t *)gui)->opengl);
+
+  ((gui_t *)gui)->opengl.mode = GUI_OPENGL_MODE_RENDER;
+
+  gui_opengl_context_redraw (&((gui_t *)gui)->opengl, NULL);
+}
+
+/**
+ * Show the stock as a render cuts it: only the tiles the simulation changed
+ * since the last time get built anew
+ */
+
+void
+update_stream (void *gui)
+{
+  gui_opengl_build_stream_display_lists (&((gui_t *)gui)->opengl);
+
+  ((gui_t *)gui)->opengl.mode = GUI_OPENGL_MODE_RENDER;
+
+  gui_opengl_context_redraw (&((gui_t *)gui)->opengl, NULL);
+}
+
 /**
  * Display a generic 'info' styled message box
  */
@@ -1026,6 +1067,15 @@ update_menu_by_project_state (gui_t *gui, uint8_t state)
     gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/ViewMenu/Front"), 0);
     gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/ViewMenu/Back"), 0);
     gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/FinalPart"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/StopRefining"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/Deviation"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/SimulateFile"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ExportMesh"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/SaveStock"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/LoadStock"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ClearStock"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/CycleTime"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ExportStats"), 0);
   }
 
   /* Widgets to enable when project is open, disable when project is closed */
@@ -1036,6 +1086,7 @@ update_menu_by_project_state (gui_t *gui, uint8_t state)
   gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/FileMenu/Import Excellon Drill Holes"), open);
   gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/FileMenu/Import SVG Paths"), open);
   gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/FileMenu/Export"), open);
+  gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/FileMenu/Export Adaptive Feed"), open);
   gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/EditMenu/Project Settings"), open);
 }
 
@@ -1091,6 +1142,15 @@ update_menu_by_selected_item (gui_t *gui, gcode_block_t *selected_block)
   gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/ViewMenu/Front"), 1);
   gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/ViewMenu/Back"), 1);
   gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/FinalPart"), 1);
+  gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/StopRefining"), 1);
+  gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/Deviation"), 1);
+  gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/SimulateFile"), 1);
+  gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ExportMesh"), 1);
+  gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/SaveStock"), 1);
+  gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/LoadStock"), 1);
+  gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ClearStock"), 1);
+  gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/CycleTime"), 1);
+  gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ExportStats"), 1);
 
   /* FILLETING */
   if (selected_block->type == GCODE_TYPE_LINE)
@@ -1162,6 +1222,15 @@ update_menu_by_selected_item (gui_t *gui, gcode_block_t *selected_block)
       gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/ViewMenu/Front"), 0);
       gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/ViewMenu/Back"), 0);
       gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/FinalPart"), 0);
+      gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/StopRefining"), 0);
+      gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/Deviation"), 0);
+      gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/SimulateFile"), 0);
+      gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ExportMesh"), 0);
+      gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/SaveStock"), 0);
+      gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/LoadStock"), 0);
+      gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ClearStock"), 0);
+      gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/CycleTime"), 0);
+      gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ExportStats"), 0);
     }
 
   if (selected_block->type == GCODE_TYPE_EXTRUSION)
@@ -1174,6 +1243,15 @@ update_menu_by_selected_item (gui_t *gui, gcode_block_t *selected_block)
     gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/ViewMenu/Front"), 0);
     gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/ViewMenu/Back"), 0);
     gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/FinalPart"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/StopRefining"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/Deviation"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/SimulateFile"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ExportMesh"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/SaveStock"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/LoadStock"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ClearStock"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/CycleTime"), 0);
+    gtk_action_set_sensitive (gtk_ui_manager_get_action (gui->ui_manager, "/MainMenu/RenderMenu/ExportStats"), 0);
   }
 
   /* EDIT MENU */
@@ -28,6 +28,8 @@
 
 void base_unit_changed_callback (GtkWidget *widget, gpointer data);
 void update_progress (void *gui, gfloat_t progress);
+void update_preview (void *gui);
+void update_stream (void *gui);
 void generic_dialog (void *gui, char *message);
 void generic_error (void *gui, char *message);
 void generic_fatal (void *gui, char *message);
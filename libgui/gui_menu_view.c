@@ -22,6 +22,7 @@
 #include "gui_menu_view.h"
 #include "gui.h"
 #include "gui_menu_util.h"
+#include "gui_machines.h"
 #include "gcode.h"
 
 void
@@ -154,6 +155,19 @@ gui_menu_view_render_final_part_menuitem_callback (GtkWidget *widget, gpointer d
     gui->first_render = 0;
     gcode_render_final (&gui->gcode, &time_elapsed);
     gui_opengl_build_simulate_display_list (&gui->opengl);
+
+    /* Let the scrub slider run through every line of the program, starting at the end */
+    gui->ignore_signals = 1;
+
+    if (gui->gcode.removal_log && gui->gcode.removal_log->line_num)
+    {
+      gtk_range_set_range (GTK_RANGE (gui->scrub_slider), 0.0, (gdouble)gui->gcode.removal_log->line_num);
+      gtk_range_set_value (GTK_RANGE (gui->scrub_slider), (gdouble)gui->gcode.removal_log->line_num);
+    }
+
+    gtk_widget_set_sensitive (gui->scrub_slider, gui->gcode.removal_log && gui->gcode.removal_log->line_num);
+
+    gui->ignore_signals = 0;
   }
 
   gui->opengl.mode = GUI_OPENGL_MODE_RENDER;
@@ -167,3 +181,488 @@ gui_menu_view_render_final_part_menuitem_callback (GtkWidget *widget, gpointer d
 
   update_progress (gui, 0.0);
 }
+
+/**
+ * Ask a render underway to stop: a progressive render drops the pass being
+ * simulated and leaves the viewer with the last complete (coarser) one, any
+ * other stops right where it got to (as the streaming viewer shows it).
+ */
+
+void
+gui_menu_view_stop_refining_menuitem_callback (GtkWidget *widget, gpointer data)
+{
+  gui_t *gui;
+
+  gui = (gui_t *)data;
+
+  gui->gcode.simulation_stop = 1;
+}
+
+/**
+ * Colour the walls of the final part by how far they are from the design; the
+ * part gets rendered first if it isn't up to date with the project.
+ */
+
+void
+gui_menu_view_render_deviation_menuitem_callback (GtkWidget *widget, gpointer data)
+{
+  gui_t *gui;
+
+  gui = (gui_t *)data;
+
+  if (gui->modified || gui->first_render || (!gui->gcode.voxel_map && !gui->gcode.height_map))
+    gui_menu_view_render_final_part_menuitem_callback (widget, data);
+
+  if (gcode_deviation_build (&gui->gcode))
+  {
+    generic_dialog (gui, "\nUnable to compare the final part to the design:\nno sketch or bolt holes leave walls in the stock to compare.\n");
+    return;
+  }
+
+  gui_opengl_build_simulate_display_list (&gui->opengl);
+
+  gui->opengl.mode = GUI_OPENGL_MODE_RENDER;
+
+  gui_opengl_context_redraw (&gui->opengl, NULL);
+
+  update_progress (gui, 0.0);
+}
+
+/**
+ * Simulate a G-code file made elsewhere on the stock of the project, in place
+ * of the project's own code; the next render of the final part puts the latter
+ * back.
+ */
+
+void
+gui_menu_view_render_file_menuitem_callback (GtkWidget *widget, gpointer data)
+{
+  GtkWidget *dialog;
+  GtkFileFilter *filter;
+  gui_t *gui;
+  gfloat_t time_elapsed;
+  char *filename;
+  int failed;
+
+  gui = (gui_t *)data;
+
+  dialog = gtk_file_chooser_dialog_new ("Simulate G-Code File",
+                                        GTK_WINDOW (gui->window),
+                                        GTK_FILE_CHOOSER_ACTION_OPEN,
+                                        GTK_STOCK_CANCEL,
+                                        GTK_RESPONSE_CANCEL,
+                                        GTK_STOCK_OPEN,
+                                        GTK_RESPONSE_ACCEPT,
+                                        NULL);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, "G-Code (*.nc,*.ngc,*.tap,*.gcode)");
+  gtk_file_filter_add_pattern (filter, "*.nc");
+  gtk_file_filter_add_pattern (filter, "*.ngc");
+  gtk_file_filter_add_pattern (filter, "*.tap");
+  gtk_file_filter_add_pattern (filter, "*.gcode");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (dialog), filter);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, "All files (*.*)");
+  gtk_file_filter_add_pattern (filter, "*.*");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (dialog), filter);
+
+  if (*gui->current_folder)
+    gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER (dialog), gui->current_folder);
+
+  if (gtk_dialog_run (GTK_DIALOG (dialog)) != GTK_RESPONSE_ACCEPT)
+  {
+    gtk_widget_destroy (dialog);
+    return;
+  }
+
+  filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
+
+  gtk_widget_destroy (dialog);
+
+  failed = gcode_render_file (&gui->gcode, filename, &time_elapsed);
+
+  g_free (filename);
+
+  if (failed)
+  {
+    generic_dialog (gui, "\nUnable to simulate the G-code file:\nthe file could not be opened.\n");
+    return;
+  }
+
+  gui->first_render = 1;                                                        // The stock no longer shows the project's own code;
+
+  gui_opengl_build_simulate_display_list (&gui->opengl);
+
+  gui->ignore_signals = 1;
+
+  if (gui->gcode.removal_log && gui->gcode.removal_log->line_num)
+  {
+    gtk_range_set_range (GTK_RANGE (gui->scrub_slider), 0.0, (gdouble)gui->gcode.removal_log->line_num);
+    gtk_range_set_value (GTK_RANGE (gui->scrub_slider), (gdouble)gui->gcode.removal_log->line_num);
+  }
+
+  gtk_widget_set_sensitive (gui->scrub_slider, gui->gcode.removal_log && gui->gcode.removal_log->line_num);
+
+  gui->ignore_signals = 0;
+
+  gui->opengl.mode = GUI_OPENGL_MODE_RENDER;
+
+  gui_opengl_context_redraw (&gui->opengl, NULL);
+
+  update_progress (gui, 0.0);
+}
+
+/**
+ * Save the surface of the final part as a binary STL mesh; the part gets
+ * rendered first if it isn't up to date with the project.
+ */
+
+void
+gui_menu_view_render_export_mesh_menuitem_callback (GtkWidget *widget, gpointer data)
+{
+  GtkWidget *dialog;
+  GtkFileFilter *filter;
+  gui_t *gui;
+  char proposed_filename[64], *filename;
+  int failed;
+
+  gui = (gui_t *)data;
+
+  dialog = gtk_file_chooser_dialog_new ("Export Final Part Mesh",
+                                        GTK_WINDOW (gui->window),
+                                        GTK_FILE_CHOOSER_ACTION_SAVE,
+                                        GTK_STOCK_CANCEL,
+                                        GTK_RESPONSE_CANCEL,
+                                        GTK_STOCK_SAVE,
+                                        GTK_RESPONSE_ACCEPT,
+                                        NULL);
+
+  gtk_file_chooser_set_do_overwrite_confirmation (GTK_FILE_CHOOSER (dialog), TRUE);
+
+  sprintf (proposed_filename, "%s.stl", gui->gcode.name);
+  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (dialog), proposed_filename);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, "*.stl");
+  gtk_file_filter_add_pattern (filter, "*.stl");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (dialog), filter);
+
+  if (*gui->current_folder)
+    gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER (dialog), gui->current_folder);
+
+  if (gtk_dialog_run (GTK_DIALOG (dialog)) != GTK_RESPONSE_ACCEPT)
+  {
+    gtk_widget_destroy (dialog);
+    return;
+  }
+
+  filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
+
+  gtk_widget_destroy (dialog);
+
+  if (gui->modified || gui->first_render || (!gui->gcode.voxel_map && !gui->gcode.height_map))
+    gui_menu_view_render_final_part_menuitem_callback (widget, data);
+
+  failed = gcode_mesh_export (&gui->gcode, filename);
+
+  g_free (filename);
+
+  update_progress (gui, 0.0);
+
+  if (failed)
+    generic_dialog (gui, "\nUnable to export the final part:\nthe file could not be written.\n");
+}
+
+/**
+ * Save the stock of the final part, to start the render of a later setup from;
+ * the part gets rendered first if it isn't up to date with the project.
+ */
+
+void
+gui_menu_view_render_save_stock_menuitem_callback (GtkWidget *widget, gpointer data)
+{
+  GtkWidget *dialog;
+  GtkFileFilter *filter;
+  gui_t *gui;
+  char proposed_filename[64], *filename;
+  int failed;
+
+  gui = (gui_t *)data;
+
+  dialog = gtk_file_chooser_dialog_new ("Save Final Part Stock",
+                                        GTK_WINDOW (gui->window),
+                                        GTK_FILE_CHOOSER_ACTION_SAVE,
+                                        GTK_STOCK_CANCEL,
+                                        GTK_RESPONSE_CANCEL,
+                                        GTK_STOCK_SAVE,
+                                        GTK_RESPONSE_ACCEPT,
+                                        NULL);
+
+  gtk_file_chooser_set_do_overwrite_confirmation (GTK_FILE_CHOOSER (dialog), TRUE);
+
+  sprintf (proposed_filename, "%s.gcsk", gui->gcode.name);
+  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (dialog), proposed_filename);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, "*.gcsk");
+  gtk_file_filter_add_pattern (filter, "*.gcsk");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (dialog), filter);
+
+  if (*gui->current_folder)
+    gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER (dialog), gui->current_folder);
+
+  if (gtk_dialog_run (GTK_DIALOG (dialog)) != GTK_RESPONSE_ACCEPT)
+  {
+    gtk_widget_destroy (dialog);
+    return;
+  }
+
+  filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
+
+  gtk_widget_destroy (dialog);
+
+  if (gui->modified || gui->first_render || (!gui->gcode.voxel_map && !gui->gcode.height_map))
+    gui_menu_view_render_final_part_menuitem_callback (widget, data);
+
+  failed = gcode_stock_save (&gui->gcode, filename);
+
+  g_free (filename);
+
+  if (failed)
+    generic_dialog (gui, "\nUnable to save the stock:\nthe file could not be written.\n");
+}
+
+/**
+ * Render the final part from stock saved by an earlier setup instead of a whole
+ * block of material, turned over as chosen in the file dialog.
+ */
+
+void
+gui_menu_view_render_load_stock_menuitem_callback (GtkWidget *widget, gpointer data)
+{
+  GtkWidget *dialog, *hbox, *label, *flip_combo;
+  GtkFileFilter *filter;
+  gcode_vec3d_t offset;
+  gui_t *gui;
+  char *filename;
+  int failed, flip;
+
+  gui = (gui_t *)data;
+
+  dialog = gtk_file_chooser_dialog_new ("Start From Saved Stock",
+                                        GTK_WINDOW (gui->window),
+                                        GTK_FILE_CHOOSER_ACTION_OPEN,
+                                        GTK_STOCK_CANCEL,
+                                        GTK_RESPONSE_CANCEL,
+                                        GTK_STOCK_OPEN,
+                                        GTK_RESPONSE_ACCEPT,
+                                        NULL);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, "*.gcsk");
+  gtk_file_filter_add_pattern (filter, "*.gcsk");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (dialog), filter);
+
+  hbox = gtk_hbox_new (FALSE, 6);
+
+  label = gtk_label_new ("Turn Over");
+  gtk_box_pack_start (GTK_BOX (hbox), label, FALSE, FALSE, 0);
+
+  flip_combo = gtk_combo_box_new_text ();
+  gtk_combo_box_append_text (GTK_COMBO_BOX (flip_combo), "No");
+  gtk_combo_box_append_text (GTK_COMBO_BOX (flip_combo), "About X");
+  gtk_combo_box_append_text (GTK_COMBO_BOX (flip_combo), "About Y");
+  gtk_combo_box_set_active (GTK_COMBO_BOX (flip_combo), GCODE_STOCK_FLIP_NONE);
+  gtk_box_pack_start (GTK_BOX (hbox), flip_combo, FALSE, FALSE, 0);
+
+  gtk_widget_show_all (hbox);
+  gtk_file_chooser_set_extra_widget (GTK_FILE_CHOOSER (dialog), hbox);
+
+  if (*gui->current_folder)
+    gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER (dialog), gui->current_folder);
+
+  if (gtk_dialog_run (GTK_DIALOG (dialog)) != GTK_RESPONSE_ACCEPT)
+  {
+    gtk_widget_destroy (dialog);
+    return;
+  }
+
+  filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
+  flip = gtk_combo_box_get_active (GTK_COMBO_BOX (flip_combo));
+
+  gtk_widget_destroy (dialog);
+
+  failed = gcode_stock_load (&gui->gcode, filename);
+
+  g_free (filename);
+
+  if (failed)
+  {
+    generic_dialog (gui, "\nUnable to start from the saved stock:\nthe file could not be read.\n");
+    return;
+  }
+
+  GCODE_MATH_VEC3D_SET (offset, 0.0, 0.0, 0.0);
+  gcode_stock_place (&gui->gcode, flip, 0.0, offset);
+
+  gui->first_render = 1;                                                        // Whatever got rendered started from other stock;
+}
+
+/**
+ * Go back to rendering the final part from a whole block of material
+ */
+
+void
+gui_menu_view_render_clear_stock_menuitem_callback (GtkWidget *widget, gpointer data)
+{
+  gui_t *gui;
+
+  gui = (gui_t *)data;
+
+  if (!gui->gcode.starting_stock)
+    return;
+
+  gcode_stock_free (&gui->gcode);
+  gcode_prep (&gui->gcode);
+
+  gui->first_render = 1;
+}
+
+/**
+ * Estimate how long the program takes to run on the machine of the project,
+ * with its speed, acceleration and jerk limits; unlike the estimate of a render
+ * this needs no simulation of the stock. Shows the total along with the time
+ * spent on each top level block.
+ */
+
+void
+gui_menu_view_render_cycle_time_menuitem_callback (GtkWidget *widget, gpointer data)
+{
+  gui_t *gui;
+  gui_machine_t *machine;
+  gcode_time_limits_t limits;
+  gcode_block_t *index_block;
+  gfloat_t total_ms, *block_ms, s;
+  uint32_t block_num, i;
+  char message[2048];
+  int len;
+
+  gui = (gui_t *)data;
+
+  machine = gui_machines_find (&gui->machines, gui->gcode.machine_name, TRUE);
+
+  if (!machine)
+  {
+    generic_dialog (gui, "\nUnable to estimate the cycle time:\nno machine is known.\n");
+    return;
+  }
+
+  for (i = 0; i < 3; i++)
+  {
+    limits.max_ipm[i] = machine->maxipm[i];
+    limits.accel[i] = machine->maxaccel[i];
+  }
+
+  limits.jerk = machine->maxjerk;
+
+  if (gcode_time_estimate (&gui->gcode, &limits, &total_ms, &block_ms, &block_num))
+  {
+    generic_dialog (gui, "\nUnable to estimate the cycle time:\nout of memory.\n");
+    return;
+  }
+
+  s = 0.001 * total_ms;
+  len = sprintf (message, "\nEstimated Cycle Time on %s: %dH %dM %.0f sec\n\n",
+                 machine->name, (int)(s / 3600.0), (int)(fmod (s, 3600.0) / 60.0), fmod (s, 60.0));
+
+  for (i = 0, index_block = gui->gcode.listhead; (i < block_num) && index_block; i++, index_block = index_block->next)
+  {
+    if (i == 16)                                                                // Keep the dialog within the screen;
+    {
+      len += sprintf (&message[len], "(%d more)\n", block_num - i);
+      break;
+    }
+
+    s = 0.001 * block_ms[i];
+    len += sprintf (&message[len], "%.64s: %dH %dM %.0f sec\n",
+                    index_block->comment, (int)(s / 3600.0), (int)(fmod (s, 3600.0) / 60.0), fmod (s, 60.0));
+  }
+
+  free (block_ms);
+
+  generic_dialog (gui, message);
+}
+
+/**
+ * Render the final part once more counting what every line of the program
+ * costs the simulation, and export that as CSV or JSON (by the extension of
+ * the file chosen).
+ */
+
+void
+gui_menu_view_render_export_stats_menuitem_callback (GtkWidget *widget, gpointer data)
+{
+  GtkWidget *dialog;
+  GtkFileFilter *filter;
+  gui_t *gui;
+  char proposed_filename[64], *filename;
+  uint8_t format;
+  int failed;
+
+  gui = (gui_t *)data;
+
+  dialog = gtk_file_chooser_dialog_new ("Export Line Statistics",
+                                        GTK_WINDOW (gui->window),
+                                        GTK_FILE_CHOOSER_ACTION_SAVE,
+                                        GTK_STOCK_CANCEL,
+                                        GTK_RESPONSE_CANCEL,
+                                        GTK_STOCK_SAVE,
+                                        GTK_RESPONSE_ACCEPT,
+                                        NULL);
+
+  gtk_file_chooser_set_do_overwrite_confirmation (GTK_FILE_CHOOSER (dialog), TRUE);
+
+  sprintf (proposed_filename, "%s.csv", gui->gcode.name);
+  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (dialog), proposed_filename);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, "*.csv");
+  gtk_file_filter_add_pattern (filter, "*.csv");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (dialog), filter);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, "*.json");
+  gtk_file_filter_add_pattern (filter, "*.json");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (dialog), filter);
+
+  if (*gui->current_folder)
+    gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER (dialog), gui->current_folder);
+
+  if (gtk_dialog_run (GTK_DIALOG (dialog)) != GTK_RESPONSE_ACCEPT)
+  {
+    gtk_widget_destroy (dialog);
+    return;
+  }
+
+  filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
+
+  gtk_widget_destroy (dialog);
+
+  format = g_str_has_suffix (filename, ".json") ? GCODE_STATS_FORMAT_JSON : GCODE_STATS_FORMAT_CSV;
+
+  gui->gcode.collect_stats = 1;
+  gui->first_render = 1;
+
+  gui_menu_view_render_final_part_menuitem_callback (widget, data);
+
+  gui->gcode.collect_stats = 0;
+
+  failed = gcode_stats_export (&gui->gcode, filename, format);
+
+  g_free (filename);
+
+  if (failed)
+    generic_dialog (gui, "\nUnable to export the line statistics:\nthe file could not be written.\n");
+}
@@ -32,5 +32,14 @@ void gui_menu_view_right_menuitem_callback (GtkWidget *widget, gpointer data);
 void gui_menu_view_front_menuitem_callback (GtkWidget *widget, gpointer data);
 void gui_menu_view_back_menuitem_callback (GtkWidget *widget, gpointer data);
 void gui_menu_view_render_final_part_menuitem_callback (GtkWidget *widget, gpointer data);
+void gui_menu_view_stop_refining_menuitem_callback (GtkWidget *widget, gpointer data);
+void gui_menu_view_render_deviation_menuitem_callback (GtkWidget *widget, gpointer data);
+void gui_menu_view_render_file_menuitem_callback (GtkWidget *widget, gpointer data);
+void gui_menu_view_render_export_mesh_menuitem_callback (GtkWidget *widget, gpointer data);
+void gui_menu_view_render_save_stock_menuitem_callback (GtkWidget *widget, gpointer data);
+void gui_menu_view_render_load_stock_menuitem_callback (GtkWidget *widget, gpointer data);
+void gui_menu_view_render_clear_stock_menuitem_callback (GtkWidget *widget, gpointer data);
+void gui_menu_view_render_cycle_time_menuitem_callback (GtkWidget *widget, gpointer data);
+void gui_menu_view_render_export_stats_menuitem_callback (GtkWidget *widget, gpointer data);
 
 #endif
@@ -25,89 +25,70 @@
 #include "gui_tab.h"
 #include "gui_menu_util.h"
 #include <GL/glu.h>
+#include <string.h>
 
 static void
 sum_normal (gui_opengl_t *opengl, int i, int j, int k, gcode_vec3d_t nor)
 {
-  int ind;
+  gcode_t *gcode;
 
-  if (i < 0 || j < 0 || k < 0 || i >= opengl->gcode->voxel_number[0] || j >= opengl->gcode->voxel_number[1] || k >= opengl->gcode->voxel_number[2])
-    return;
+  gcode = opengl->gcode;
 
-  ind = i + j * opengl->gcode->voxel_number[0] + k * (opengl->gcode->voxel_number[0] * opengl->gcode->voxel_number[1]);
+  if (i < 0 || j < 0 || k < 0 || i >= gcode->voxel_number[0] || j >= gcode->voxel_number[1] || k >= gcode->voxel_number[2])
+    return;
 
   /**
    * Compute Normal Based on Existance of Neighbors
-   * -x = -1
-   * +x = +1
-   * -y = -opengl->gcode->voxel_number[1]
-   * +y = +opengl->gcode->voxel_number[1]
-   * -z = -(opengl->gcode->voxel_number[0] * opengl->gcode->voxel_number[1])
-   * +z = +(opengl->gcode->voxel_number[0] * opengl->gcode->voxel_number[1])
+   * (anything beyond the edge of the material counts as an empty neighbor)
    */
 
   /* X */
-  if (i > 0)
-  {
-    if (!opengl->gcode->voxel_map[ind - 1])
-      nor[0] += -1.0;
-  }
-  else
-  {
+  if (i == 0 || !gcode_voxel_get (gcode, i - 1, j, k))
     nor[0] += -1.0;
-  }
 
-  if (i < opengl->gcode->voxel_number[0] - 1)
-  {
-    if (!opengl->gcode->voxel_map[ind + 1])
-      nor[0] += 1.0;
-  }
-  else
-  {
+  if (i == gcode->voxel_number[0] - 1 || !gcode_voxel_get (gcode, i + 1, j, k))
     nor[0] += 1.0;
-  }
 
   /* Y */
-  if (j > 0)
-  {
-    if (!opengl->gcode->voxel_map[ind - opengl->gcode->voxel_number[0]])
-      nor[1] += -1.0;
-  }
-  else
-  {
+  if (j == 0 || !gcode_voxel_get (gcode, i, j - 1, k))
     nor[1] += -1.0;
-  }
 
-  if (j < opengl->gcode->voxel_number[1] - 1)
-  {
-    if (!opengl->gcode->voxel_map[ind + opengl->gcode->voxel_number[0]])
-      nor[1] += 1.0;
-  }
-  else
-  {
+  if (j == gcode->voxel_number[1] - 1 || !gcode_voxel_get (gcode, i, j + 1, k))
     nor[1] += 1.0;
-  }
 
   /* Z */
-  if (k > 0)
-  {
-    if (!opengl->gcode->voxel_map[ind - opengl->gcode->voxel_number[0] * opengl->gcode->voxel_number[1]])
-      nor[2] += -1.0;
-  }
-  else
-  {
+  if (k == 0 || !gcode_voxel_get (gcode, i, j, k - 1))
     nor[2] += -1.0;
-  }
 
-  if (k < opengl->gcode->voxel_number[2] - 1)
-  {
-    if (!opengl->gcode->voxel_map[ind + opengl->gcode->voxel_number[0] * opengl->gcode->voxel_number[1]])
-      nor[2] += 1.0;
-  }
-  else
-  {
+  if (k == gcode->voxel_number[2] - 1 || !gcode_voxel_get (gcode, i, j, k + 1))
     nor[2] += 1.0;
-  }
+}
+
+/**
+ * Tell whether solid brick (bx, by, bz) is surrounded by solid bricks on all 26
+ * sides, all of them whole (not hanging over the edge of the material)
+ */
+
+static int
+buried_brick (gcode_t *gcode, size_t bx, size_t by, size_t bz)
+{
+  int dx, dy, dz;
+
+  if ((bx == 0) || (by == 0) || (bz == 0))
+    return (0);
+
+  if (((bx + 2) * GCODE_VOXEL_BRICK_SIZE > gcode->voxel_number[0]) ||
+      ((by + 2) * GCODE_VOXEL_BRICK_SIZE > gcode->voxel_number[1]) ||
+      ((bz + 2) * GCODE_VOXEL_BRICK_SIZE > gcode->voxel_number[2]))
+    return (0);
+
+  for (dz = -1; dz <= 1; dz++)
+    for (dy = -1; dy <= 1; dy++)
+      for (dx = -1; dx <= 1; dx++)
+        if (gcode_voxel_brick (gcode, bx + dx, by + dy, bz + dz) != GCODE_VOXEL_BRICK_SOLID)
+          return (0);
+
+  return (1);
 }
 
 /**
@@ -376,24 +357,212 @@ gui_opengl_build_gridxz_display_list (gui_opengl_t *opengl)
   glEndList ();
 }
 
-void
-gui_opengl_build_simulate_display_list (gui_opengl_t *opengl)
+/**
+ * Colour voxel (i, j, k) by its deviation from the design: green right on the
+ * design, shading into blue for material left standing and into red for cuts
+ * that went too far, all the way at the edge of the band compared; voxels that
+ * were not compared keep the colour of the stock.
+ */
+
+static void
+deviation_color (gui_opengl_t *opengl, int i, int j, int k)
 {
-  int16_t i, j, k;
+  const gfloat_t *far_color;
+  gfloat_t deviation, t;
+
+  if ((k < 0) || !gcode_deviation_get (opengl->gcode, i, j, k, &deviation))
+  {
+    glColor3f (GCODE_OPENGL_STOCK_COLOR[0], GCODE_OPENGL_STOCK_COLOR[1], GCODE_OPENGL_STOCK_COLOR[2]);
+    return;
+  }
+
+  t = fabs (deviation) / opengl->gcode->deviation_map->band;
+
+  if (t > 1.0)
+    t = 1.0;
+
+  far_color = (deviation > 0.0) ? GCODE_OPENGL_DEVIATION_EXCESS_COLOR : GCODE_OPENGL_DEVIATION_GOUGE_COLOR;
+
+  glColor3f (GCODE_OPENGL_DEVIATION_EXACT_COLOR[0] + t * (far_color[0] - GCODE_OPENGL_DEVIATION_EXACT_COLOR[0]),
+             GCODE_OPENGL_DEVIATION_EXACT_COLOR[1] + t * (far_color[1] - GCODE_OPENGL_DEVIATION_EXACT_COLOR[1]),
+             GCODE_OPENGL_DEVIATION_EXACT_COLOR[2] + t * (far_color[2] - GCODE_OPENGL_DEVIATION_EXACT_COLOR[2]));
+}
+
+/**
+ * Emit the top surface of the part of a height field stock in columns [x0, x1)
+ * by [y0, y1) as one triangle strip per pair of adjacent rows (reaching one
+ * column and one row past the range, so that neighbouring parts join up);
+ * normals come straight from the central differences of the heights, so no
+ * neighbourhood scanning is needed at all.
+ */
+
+static void
+build_height_field_strips (gui_opengl_t *opengl, int x0, int x1, int y0, int y1, int progress)
+{
+  int i, j, n, row;
+  int nx, ny;
+  float *height;
+  gfloat_t vx, vy, dx, dy, scale;
+  gcode_vec3d_t nor;
+
+  nx = opengl->gcode->voxel_number[0];
+  ny = opengl->gcode->voxel_number[1];
+  height = opengl->gcode->height_map;
+
+  dx = opengl->gcode->material_size[0] / (gfloat_t)nx;
+  dy = opengl->gcode->material_size[1] / (gfloat_t)ny;
+
+  scale = (gfloat_t)opengl->gcode->voxel_number[2] / opengl->gcode->material_size[2];
+
+  if (x1 > nx - 1)
+    x1 = nx - 1;
+
+  if (y1 > ny - 1)
+    y1 = ny - 1;
+
+  for (j = y0; j < y1; j++)
+  {
+    /* Update Progress based on Y */
+    if (progress)
+      opengl->progress_callback (opengl->gcode->gui, (gfloat_t)(j + 1 - y0) / (gfloat_t)(y1 - y0));
+
+    glBegin (GL_TRIANGLE_STRIP);
+
+    for (i = x0; i <= x1; i++)
+    {
+      vx = -opengl->gcode->material_size[0] * 0.5 + ((gfloat_t)i / (gfloat_t)nx) * opengl->gcode->material_size[0];
+
+      for (n = 0; n < 2; n++)
+      {
+        row = j + n;
+
+        vy = -opengl->gcode->material_size[1] * 0.5 + ((gfloat_t)row / (gfloat_t)ny) * opengl->gcode->material_size[1];
+
+        nor[0] = -(height[row * nx + (i < nx - 1 ? i + 1 : i)] - height[row * nx + (i > 0 ? i - 1 : i)]) / (2.0 * dx);
+        nor[1] = -(height[(row < ny - 1 ? row + 1 : row) * nx + i] - height[(row > 0 ? row - 1 : row) * nx + i]) / (2.0 * dy);
+        nor[2] = 1.0;
+
+        if (opengl->gcode->deviation_map)
+          deviation_color (opengl, i, row, (int)(scale * (opengl->gcode->material_size[2] + height[row * nx + i])) - 1);
+
+        glNormal3f (nor[0], nor[1], nor[2]);
+        glVertex3f (vx, vy, height[row * nx + i]);
+      }
+    }
+
+    glEnd ();
+  }
+}
+
+/**
+ * Emit a point for every voxel on the surface of the part of a voxel stock in
+ * bricks [bx0, bx1) by [by0, by1) (as far as the stock goes), all the way
+ * through in Z.
+ */
+
+static void
+build_voxel_points (gui_opengl_t *opengl, size_t bx0, size_t bx1, size_t by0, size_t by1, int progress)
+{
+  size_t bx, by, bz, bricks;
+  uint32_t state;
+  int i, j, k;
   gfloat_t vx, vy, vz;
   gcode_vec3d_t nor;
-  int ind;
+
+  bricks = opengl->gcode->voxel_map->brick_number[2];
+
+  if (bx1 > opengl->gcode->voxel_map->brick_number[0])
+    bx1 = opengl->gcode->voxel_map->brick_number[0];
+
+  if (by1 > opengl->gcode->voxel_map->brick_number[1])
+    by1 = opengl->gcode->voxel_map->brick_number[1];
+
+  glPointSize (GCODE_OPENGL_VOXEL_POINT_SIZE);
+  glBegin (GL_POINTS);
+
+  /**
+   * Walk the stock brick by brick: empty bricks have nothing to show, and solid
+   * ones buried among solid bricks on all 26 sides can't have a single voxel on
+   * the surface either (the normal of a voxel depends on voxels up to 2 steps
+   * away); that leaves the surface of the stock and the mixed bricks.
+   */
+
+  for (bz = 0; bz < bricks; bz++)
+  {
+    /* Update Progress based on Z for now */
+    if (progress)
+      opengl->progress_callback (opengl->gcode->gui, (gfloat_t)(bz + 1) / (gfloat_t)bricks);
+
+    for (by = by0; by < by1; by++)
+    {
+      for (bx = bx0; bx < bx1; bx++)
+      {
+        state = gcode_voxel_brick (opengl->gcode, bx, by, bz);
+
+        if (state == GCODE_VOXEL_BRICK_EMPTY)
+          continue;
+
+        if ((state == GCODE_VOXEL_BRICK_SOLID) && buried_brick (opengl->gcode, bx, by, bz))
+          continue;
+
+        for (k = bz * GCODE_VOXEL_BRICK_SIZE; (k < (bz + 1) * GCODE_VOXEL_BRICK_SIZE) && (k < (int)opengl->gcode->voxel_number[2]); k++)
+        {
+          vz = ((gfloat_t)k / (gfloat_t)opengl->gcode->voxel_number[2]) * opengl->gcode->material_size[2] - opengl->gcode->material_size[2];
+
+          for (j = by * GCODE_VOXEL_BRICK_SIZE; (j < (by + 1) * GCODE_VOXEL_BRICK_SIZE) && (j < (int)opengl->gcode->voxel_number[1]); j++)
+          {
+            vy = -opengl->gcode->material_size[1] * 0.5 + ((gfloat_t)j / (gfloat_t)opengl->gcode->voxel_number[1]) * opengl->gcode->material_size[1];
+
+            for (i = bx * GCODE_VOXEL_BRICK_SIZE; (i < (bx + 1) * GCODE_VOXEL_BRICK_SIZE) && (i < (int)opengl->gcode->voxel_number[0]); i++)
+            {
+              vx = -opengl->gcode->material_size[0] * 0.5 + ((gfloat_t)i / (gfloat_t)opengl->gcode->voxel_number[0]) * opengl->gcode->material_size[0];
+
+              if (gcode_voxel_get (opengl->gcode, i, j, k))
+              {
+                nor[0] = 0.0;
+                nor[1] = 0.0;
+                nor[2] = 0.0;
+
+                sum_normal (opengl, i, j, k, nor);
+
+                sum_normal (opengl, i - 1, j, k, nor);
+                sum_normal (opengl, i + 1, j, k, nor);
+                sum_normal (opengl, i, j - 1, k, nor);
+                sum_normal (opengl, i, j + 1, k, nor);
+                sum_normal (opengl, i, j, k - 1, nor);
+                sum_normal (opengl, i, j, k + 1, nor);
+
+                if (fabs (nor[0]) + fabs (nor[1]) + fabs (nor[2]) > 0.0)
+                {
+                  if (opengl->gcode->deviation_map)
+                    deviation_color (opengl, i, j, k);
+
+                  glNormal3f (nor[0], nor[1], nor[2]);
+                  glVertex3f (vx, vy, vz);
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  glEnd ();
+}
+
+/**
+ * Lighting and material the stock gets drawn with
+ */
+
+static void
+set_stock_material (gui_opengl_t *opengl)
+{
   GLfloat mat_ambient[] = { 1.0, 1.0, 1.0, 1.0 };
   GLfloat mat_diffuse[] = { 0.6, 0.6, 0.6, 1.0 };
   GLfloat mat_specular[] = { 0.0, 0.0, 0.0, 1.0 };
   GLfloat mat_shininess[] = { 0.0 };
 
-  if (!opengl->gcode->voxel_map)
-    return;
-
-  opengl->simulate_display_list = glGenLists (5);
-  glNewList (opengl->simulate_display_list, GL_COMPILE);
-
   glLightModeli (GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
 
   glEnable (GL_LIGHTING);
@@ -404,56 +573,139 @@ gui_opengl_build_simulate_display_list (gui_opengl_t *opengl)
   glMaterialfv (GL_FRONT_AND_BACK, GL_SPECULAR, mat_specular);
   glMaterialfv (GL_FRONT_AND_BACK, GL_SHININESS, mat_shininess);
 
-  glPointSize (GCODE_OPENGL_VOXEL_POINT_SIZE);
-  glBegin (GL_POINTS);
+  if (opengl->gcode->deviation_map)                                             // Walls compared to the design get coloured point by point;
+  {
+    glColorMaterial (GL_FRONT_AND_BACK, GL_DIFFUSE);
+    glEnable (GL_COLOR_MATERIAL);
+  }
+}
+
+/**
+ * Drop the lists of the tiles of a streaming render, if there are any
+ */
 
-  ind = 0;
+static void
+end_stream (gui_opengl_t *opengl)
+{
+  if (!opengl->stream_display_list)
+    return;
+
+  glDeleteLists (opengl->stream_display_list, opengl->stream_tile_number[0] * opengl->stream_tile_number[1]);
+
+  opengl->stream_display_list = 0;
+  opengl->stream_tile_number[0] = 0;
+  opengl->stream_tile_number[1] = 0;
+}
+
+void
+gui_opengl_build_simulate_display_list (gui_opengl_t *opengl)
+{
+  gcode_voxel_map_t *map;
+
+  end_stream (opengl);                                                          // The whole stock gets one list again;
+
+  if (!opengl->gcode->voxel_map && !opengl->gcode->height_map)
+    return;
 
-  for (k = 0; k < opengl->gcode->voxel_number[2]; k++)
+  opengl->simulate_display_list = glGenLists (5);
+  glNewList (opengl->simulate_display_list, GL_COMPILE);
+
+  set_stock_material (opengl);
+
+  if (opengl->gcode->stock_model == GCODE_STOCK_HEIGHT)
+  {
+    build_height_field_strips (opengl, 0, opengl->gcode->voxel_number[0], 0, opengl->gcode->voxel_number[1], 1);
+  }
+  else
   {
-    vz = ((gfloat_t)k / (gfloat_t)opengl->gcode->voxel_number[2]) * opengl->gcode->material_size[2] - opengl->gcode->material_size[2];
+    map = opengl->gcode->voxel_map;
 
-    /* Update Progress based on Z for now */
-    opengl->progress_callback (opengl->gcode->gui, (gfloat_t)(k + 1) / (gfloat_t)opengl->gcode->voxel_number[2]);
+    build_voxel_points (opengl, 0, map->brick_number[0], 0, map->brick_number[1], 1);
+  }
+
+  glDisable (GL_COLOR_MATERIAL);
+
+  glEndList ();
+}
+
+/**
+ * Bring the view of a streaming render up to date: the stock gets one list per
+ * tile of the simulator, and only the tiles the simulation changed since the
+ * last look get built anew - along with the tiles next to them, as cutting at
+ * the edge of a tile uncovers voxels (and turns normals) across it. The first
+ * look at a stock builds every tile.
+ */
+
+void
+gui_opengl_build_stream_display_lists (gui_opengl_t *opengl)
+{
+  gcode_sim_dirty_t *dirty;
+  uint32_t tx, ty, x0, x1, y0, y1, x, y, tiles;
+  int build;
+
+  dirty = opengl->gcode->dirty_tiles;
+
+  if (!dirty || (!opengl->gcode->voxel_map && !opengl->gcode->height_map))
+    return;
+
+  tiles = dirty->tile_number[0] * dirty->tile_number[1];
+
+  if ((opengl->stream_tile_number[0] != dirty->tile_number[0]) || (opengl->stream_tile_number[1] != dirty->tile_number[1]))
+    end_stream (opengl);
+
+  if (!opengl->stream_display_list)
+  {
+    opengl->stream_display_list = glGenLists (tiles);
+
+    if (!opengl->stream_display_list)
+      return;
 
-    for (j = 0; j < opengl->gcode->voxel_number[1]; j++)
+    opengl->stream_tile_number[0] = dirty->tile_number[0];
+    opengl->stream_tile_number[1] = dirty->tile_number[1];
+
+    memset (dirty->tile, 1, tiles);
+  }
+
+  for (ty = 0; ty < dirty->tile_number[1]; ty++)
+  {
+    for (tx = 0; tx < dirty->tile_number[0]; tx++)
     {
-      vy = -opengl->gcode->material_size[1] * 0.5 + ((gfloat_t)j / (gfloat_t)opengl->gcode->voxel_number[1]) * opengl->gcode->material_size[1];
+      x0 = tx > 0 ? tx - 1 : 0;
+      y0 = ty > 0 ? ty - 1 : 0;
+      x1 = tx + 1 < dirty->tile_number[0] ? tx + 1 : tx;
+      y1 = ty + 1 < dirty->tile_number[1] ? ty + 1 : ty;
 
-      for (i = 0; i < opengl->gcode->voxel_number[0]; i++)
-      {
-        vx = -opengl->gcode->material_size[0] * 0.5 + ((gfloat_t)i / (gfloat_t)opengl->gcode->voxel_number[0]) * opengl->gcode->material_size[0];
+      build = 0;
 
-        if (opengl->gcode->voxel_map[ind])
-        {
-          nor[0] = 0.0;
-          nor[1] = 0.0;
-          nor[2] = 0.0;
+      for (y = y0; y <= y1; y++)
+        for (x = x0; x <= x1; x++)
+          build |= dirty->tile[y * dirty->tile_number[0] + x];
 
-          sum_normal (opengl, i, j, k, nor);
+      if (!build)
+        continue;
 
-          sum_normal (opengl, i - 1, j, k, nor);
-          sum_normal (opengl, i + 1, j, k, nor);
-          sum_normal (opengl, i, j - 1, k, nor);
-          sum_normal (opengl, i, j + 1, k, nor);
-          sum_normal (opengl, i, j, k - 1, nor);
-          sum_normal (opengl, i, j, k + 1, nor);
+      glNewList (opengl->stream_display_list + ty * dirty->tile_number[0] + tx, GL_COMPILE);
 
-          if (fabs (nor[0]) + fabs (nor[1]) + fabs (nor[2]) > 0.0)
-          {
-            glNormal3f (nor[0], nor[1], nor[2]);
-            glVertex3f (vx, vy, vz);
-          }
-        }
+      set_stock_material (opengl);
 
-        ind++;
+      if (opengl->gcode->stock_model == GCODE_STOCK_HEIGHT)
+      {
+        build_height_field_strips (opengl, tx * GCODE_SIM_TILE_SIZE, (tx + 1) * GCODE_SIM_TILE_SIZE,
+                                   ty * GCODE_SIM_TILE_SIZE, (ty + 1) * GCODE_SIM_TILE_SIZE, 0);
       }
+      else
+      {
+        build_voxel_points (opengl, tx * (GCODE_SIM_TILE_SIZE / GCODE_VOXEL_BRICK_SIZE), (tx + 1) * (GCODE_SIM_TILE_SIZE / GCODE_VOXEL_BRICK_SIZE),
+                            ty * (GCODE_SIM_TILE_SIZE / GCODE_VOXEL_BRICK_SIZE), (ty + 1) * (GCODE_SIM_TILE_SIZE / GCODE_VOXEL_BRICK_SIZE), 0);
+      }
+
+      glDisable (GL_COLOR_MATERIAL);
+
+      glEndList ();
     }
   }
 
-  glEnd ();
-
-  glEndList ();
+  memset (dirty->tile, 0, tiles);
 }
 
 /**
@@ -748,7 +1000,17 @@ gui_opengl_context_redraw (gui_opengl_t *opengl, gcode_block_t *block)
         else
           size = (int)((opengl->context_w / 500.0) * 5.0 / opengl->views[view].grid);
 
-        glCallList (opengl->simulate_display_list);
+        if (opengl->stream_display_list)                                        // A streaming render shows the stock tile by tile;
+        {
+          uint32_t t;
+
+          for (t = 0; t < opengl->stream_tile_number[0] * opengl->stream_tile_number[1]; t++)
+            glCallList (opengl->stream_display_list + t);
+        }
+        else
+        {
+          glCallList (opengl->simulate_display_list);
+        }
 
         break;
       }
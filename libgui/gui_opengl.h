@@ -71,6 +71,8 @@ typedef struct gui_opengl_s
   uint32_t gridxy_3_display_list;
   uint32_t gridxz_display_list;
   uint32_t simulate_display_list;
+  uint32_t stream_display_list;                                                 /* first of the lists of the tiles of a streaming render, 0 if none */
+  uint32_t stream_tile_number[2];
 
   uint32_t view_display_list;
   uint32_t rebuild_view_display_list;
@@ -89,6 +91,7 @@ typedef struct gui_opengl_s
 void gui_opengl_build_gridxy_display_list (gui_opengl_t *opengl);
 void gui_opengl_build_gridxz_display_list (gui_opengl_t *opengl);
 void gui_opengl_build_simulate_display_list (gui_opengl_t *opengl);
+void gui_opengl_build_stream_display_lists (gui_opengl_t *opengl);
 void gui_opengl_context_redraw (gui_opengl_t *opengl, gcode_block_t *block);
 
 void gui_opengl_pick (gui_opengl_t *opengl, int x, int y);
@@ -35,6 +35,13 @@ void
 gui_settings_init (gui_settings_t *settings)
 {
   settings->voxel_resolution = 250;
+  settings->stock_model = GCODE_STOCK_VOXEL;
+  settings->simulation_threads = 0;
+  settings->simulation_levels = 1;
+  settings->voxel_memory = 0;
+  settings->optimize_output = 0;
+  settings->arc_tolerance = 0.0;
+  settings->compact_output = 0;
 }
 
 void
@@ -74,6 +81,49 @@ start (void *data, const char *xmlelem, const char **xmlattr)
       {
         settings->voxel_resolution = atoi (value);
       }
+      else if (strcmp (name, GCODE_XML_ATTR_SETTING_STOCK_MODEL) == 0)
+      {
+        if (strcmp (value, GCODE_XML_VAL_SETTING_STOCK_MODEL_HEIGHT) == 0)
+          settings->stock_model = GCODE_STOCK_HEIGHT;
+        else
+          settings->stock_model = GCODE_STOCK_VOXEL;
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_SETTING_SIMULATION_THREADS) == 0)
+      {
+        settings->simulation_threads = atoi (value);
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_SETTING_SIMULATION_LEVELS) == 0)
+      {
+        settings->simulation_levels = atoi (value);
+
+        if (settings->simulation_levels < 1)                                    // Each level halves the resolution: past a few
+          settings->simulation_levels = 1;                                      // of them there's hardly anything left to see;
+
+        if (settings->simulation_levels > 4)
+          settings->simulation_levels = 4;
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_SETTING_VOXEL_MEMORY) == 0)
+      {
+        settings->voxel_memory = atoi (value);
+
+        if (settings->voxel_memory < 0)
+          settings->voxel_memory = 0;
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_SETTING_OPTIMIZE_OUTPUT) == 0)
+      {
+        settings->optimize_output = atoi (value) ? 1 : 0;
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_SETTING_ARC_TOLERANCE) == 0)
+      {
+        settings->arc_tolerance = atof (value);                                 // In inches, whatever units the project is in;
+
+        if (settings->arc_tolerance < 0.0)
+          settings->arc_tolerance = 0.0;
+      }
+      else if (strcmp (name, GCODE_XML_ATTR_SETTING_COMPACT_OUTPUT) == 0)
+      {
+        settings->compact_output = atoi (value) ? 1 : 0;
+      }
     }
   }
 }
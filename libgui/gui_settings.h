@@ -30,10 +30,26 @@ static const char *GCODE_XML_SETTINGS_FILENAME = "settings.xml";
 static const char *GCODE_XML_TAG_SETTING = "setting";
 
 static const char *GCODE_XML_ATTR_SETTING_VOXEL_RESOLUTION = "voxel-resolution";
+static const char *GCODE_XML_ATTR_SETTING_STOCK_MODEL = "stock-model";
+static const char *GCODE_XML_ATTR_SETTING_SIMULATION_THREADS = "simulation-threads";
+static const char *GCODE_XML_ATTR_SETTING_SIMULATION_LEVELS = "simulation-levels";
+static const char *GCODE_XML_ATTR_SETTING_VOXEL_MEMORY = "voxel-memory";
+static const char *GCODE_XML_ATTR_SETTING_OPTIMIZE_OUTPUT = "optimize-output";
+static const char *GCODE_XML_ATTR_SETTING_ARC_TOLERANCE = "arc-tolerance";
+static const char *GCODE_XML_ATTR_SETTING_COMPACT_OUTPUT = "compact-output";
+
+static const char *GCODE_XML_VAL_SETTING_STOCK_MODEL_HEIGHT = "height-field";
 
 typedef struct gui_settings_s
 {
   int voxel_resolution;
+  int stock_model;
+  int simulation_threads;
+  int simulation_levels;
+  int voxel_memory;
+  int optimize_output;
+  double arc_tolerance;
+  int compact_output;
 } gui_settings_t;
 
 void gui_settings_init (gui_settings_t *settings);
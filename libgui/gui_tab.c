@@ -1958,6 +1958,8 @@ tool_update_callback (GtkWidget *widget, gpointer data)
 
     tool->diameter = gui_endmills_size (endmill, gui->gcode.units);
     tool->number = endmill->number;
+    tool->shape = endmill->shape;
+    tool->angle = endmill->angle;
   }
 
   g_free (text_field);
@@ -2059,7 +2061,7 @@ gui_tab_tool (gui_t *gui, gcode_block_t *block)
   /* Should not be needed, but we rely on being able to find this tool later */
 
   if (!gui_endmills_find (&gui->endmills, tool->label, FALSE))
-    gui_endmills_tack (&gui->endmills, tool->number, tool->diameter, gui->gcode.units, tool->label);
+    gui_endmills_tack (&gui->endmills, tool->number, tool->diameter, gui->gcode.units, tool->shape, tool->angle, tool->label);
 
   selind = -1;
   boxind = 0;
@@ -0,0 +1,193 @@
+/**
+ *  test_post_arc.c
+ *  Test for the G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ */
+
+
+/**
+ * Arc fitting puts G02/G03 in place of runs of short feed moves along a circle;
+ * the arcs have to end where the moves did, also when the last of them leaves
+ * out an axis it doesn't move.
+ */
+
+#include "gcode.h"
+#include "gcode_ir.h"
+#include "gcode_post.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define TEST_TOLERANCE 0.0005
+#define TEST_FIRST     1.0                                                      /* Degrees */
+#define TEST_STEP      2.0
+#define TEST_STEPS     45
+
+/**
+ * Chords of the unit circle round the origin from TEST_FIRST degrees on, each
+ * move leaving out the axes that stay put at the decimals written.
+ */
+
+static void
+test_program (gcode_t *gcode, gcode_ir_t *ir, gfloat_t *end)
+{
+  gfloat_t angle, x, y, last_x, last_y;
+  int i;
+
+  last_x = gcode_ir_value (cos (TEST_FIRST * GCODE_DEG2RAD), gcode->decimals);
+  last_y = gcode_ir_value (sin (TEST_FIRST * GCODE_DEG2RAD), gcode->decimals);
+
+  gcode_ir_op (ir, GCODE_IR_RAPID, GCODE_IR_SPACE);
+  gcode_ir_word (ir, GCODE_IR_X, last_x);
+  gcode_ir_word (ir, GCODE_IR_Y, last_y);
+  gcode_ir_word (ir, GCODE_IR_Z, -0.1);
+  gcode_ir_comment (ir, "");
+
+  for (i = 1; i <= TEST_STEPS; i++)
+  {
+    angle = (TEST_FIRST + i * TEST_STEP) * GCODE_DEG2RAD;
+    x = gcode_ir_value (cos (angle), gcode->decimals);
+    y = gcode_ir_value (sin (angle), gcode->decimals);
+
+    gcode_ir_op (ir, GCODE_IR_LINE, GCODE_IR_SPACE);
+
+    if (x != last_x)
+      gcode_ir_word (ir, GCODE_IR_X, x);
+
+    if (y != last_y)
+      gcode_ir_word (ir, GCODE_IR_Y, y);
+
+    gcode_ir_comment (ir, "");
+
+    last_x = x;
+    last_y = y;
+  }
+
+  end[0] = last_x;
+  end[1] = last_y;
+}
+
+/**
+ * Follow the X and Y words of 'code' line by line: every point the tool gets to
+ * has to be on the unit circle, every arc (a line with I and J words, modal or
+ * not) has to turn round the origin and the tool has to end up at 'end'.
+ * Returns the number of arcs, or -1 if any of that doesn't hold.
+ */
+
+static int
+test_follow (char *code, gfloat_t *end)
+{
+  gfloat_t pos[2], start[2], center[2];
+  char *line, *next, *c;
+  int arcs, arc;
+
+  pos[0] = pos[1] = 0.0;
+  arcs = 0;
+
+  for (line = code; *line; line = next)
+  {
+    next = strchr (line, '\n');
+    next = next ? next + 1 : line + strlen (line);
+
+    start[0] = pos[0];
+    start[1] = pos[1];
+    center[0] = center[1] = 0.0;
+    arc = 0;
+
+    for (c = line; (c < next) && (*c != '(') && (*c != ';'); c++)
+    {
+      if (*c == 'X')
+        pos[0] = strtod (c + 1, NULL);
+      else if (*c == 'Y')
+        pos[1] = strtod (c + 1, NULL);
+      else if ((*c == 'I') || (*c == 'J'))
+      {
+        center[*c - 'I'] = strtod (c + 1, NULL);
+        arc = 1;
+      }
+    }
+
+    if ((pos[0] != start[0]) || (pos[1] != start[1]))
+    {
+      if (fabs (hypot (pos[0], pos[1]) - 1.0) > TEST_TOLERANCE)
+      {
+        fprintf (stderr, "Move to X%f Y%f is off the circle:\n%s", pos[0], pos[1], code);
+        return (-1);
+      }
+    }
+
+    if (arc)
+    {
+      if (hypot (start[0] + center[0], start[1] + center[1]) > TEST_TOLERANCE)
+      {
+        fprintf (stderr, "Arc from X%f Y%f turns round the wrong centre:\n%s", start[0], start[1], code);
+        return (-1);
+      }
+
+      arcs++;
+    }
+  }
+
+  if ((fabs (pos[0] - end[0]) > GCODE_PRECISION) || (fabs (pos[1] - end[1]) > GCODE_PRECISION))
+  {
+    fprintf (stderr, "Tool ends up at X%f Y%f, not X%f Y%f:\n%s", pos[0], pos[1], end[0], end[1], code);
+    return (-1);
+  }
+
+  return (arcs);
+}
+
+int
+main (void)
+{
+  gcode_t gcode;
+  gcode_ir_t ir;
+  gfloat_t end[2];
+  char *code;
+  size_t length;
+  int arcs;
+
+  gcode_init (&gcode);
+
+  gcode.units = GCODE_UNITS_INCH;
+  gcode.optimize_output = 1;
+  gcode.arc_tolerance = TEST_TOLERANCE;
+
+  gcode_ir_init (&ir);
+  test_program (&gcode, &ir, end);
+
+  if (ir.failed || gcode_post_process (&gcode, &ir) || !(code = gcode_ir_format (&gcode, &ir, &length)))
+  {
+    fprintf (stderr, "Failed to post-process the program\n");
+    gcode_ir_free (&ir);
+    gcode_free (&gcode);
+    return (1);
+  }
+
+  arcs = test_follow (code, end);
+
+  if (arcs == 0)
+    fprintf (stderr, "No arc fitted to the moves:\n%s", code);
+
+  free (code);
+  gcode_ir_free (&ir);
+  gcode_free (&gcode);
+
+  return (arcs <= 0);
+}
@@ -0,0 +1,143 @@
+/**
+ *  test_post_excursion.c
+ *  Test for the G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Post-processing drops trips that take the tool up from a cut and back down
+ * onto the very same point, but only when they keep over the traverse height:
+ * a rapid move any lower has to go out as it is.
+ */
+
+#include "gcode.h"
+#include "gcode_ir.h"
+#include "gcode_post.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define TEST_TRAVERSE 0.1
+
+/**
+ * Append a move of type 'type' with the words of 'words' (X, Y and Z only) and
+ * their values from 'value', ending its line.
+ */
+
+static void
+test_move (gcode_ir_t *ir, uint8_t type, uint8_t words, gfloat_t x, gfloat_t y, gfloat_t z)
+{
+  gcode_ir_op (ir, type, GCODE_IR_SPACE);
+
+  if (words & GCODE_IR_X)
+    gcode_ir_word (ir, GCODE_IR_X, x);
+
+  if (words & GCODE_IR_Y)
+    gcode_ir_word (ir, GCODE_IR_Y, y);
+
+  if (words & GCODE_IR_Z)
+    gcode_ir_word (ir, GCODE_IR_Z, z);
+
+  gcode_ir_comment (ir, "");
+}
+
+/**
+ * Three trips from a cut at X0 Y0 Z-0.1 and back: one over the traverse height
+ * all the way (X1.25, to be dropped), one with a rapid move below the top of
+ * the stock (X2.5 at Z-0.05, to be kept) and one retracting no higher than
+ * that (X3.75, to be kept).
+ */
+
+static void
+test_program (gcode_ir_t *ir)
+{
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_X | GCODE_IR_Y | GCODE_IR_Z, 0.0, 0.0, 0.2);
+  test_move (ir, GCODE_IR_LINE, GCODE_IR_Z, 0.0, 0.0, -0.1);
+
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_Z, 0.0, 0.0, 0.2);
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_X, 1.25, 0.0, 0.0);
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_X, 0.0, 0.0, 0.0);
+  test_move (ir, GCODE_IR_LINE, GCODE_IR_Z, 0.0, 0.0, -0.1);
+
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_Z, 0.0, 0.0, 0.2);
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_X, 2.5, 0.0, 0.0);
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_Z, 0.0, 0.0, -0.05);
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_Z, 0.0, 0.0, 0.2);
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_X, 0.0, 0.0, 0.0);
+  test_move (ir, GCODE_IR_LINE, GCODE_IR_Z, 0.0, 0.0, -0.1);
+
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_Z, 0.0, 0.0, -0.05);
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_X, 3.75, 0.0, 0.0);
+  test_move (ir, GCODE_IR_RAPID, GCODE_IR_X, 0.0, 0.0, 0.0);
+  test_move (ir, GCODE_IR_LINE, GCODE_IR_Z, 0.0, 0.0, -0.1);
+}
+
+int
+main (void)
+{
+  gcode_t gcode;
+  gcode_ir_t ir;
+  char *code;
+  size_t length;
+  int failed;
+
+  gcode_init (&gcode);
+
+  gcode.units = GCODE_UNITS_INCH;
+  gcode.ztraverse = TEST_TRAVERSE;
+  gcode.optimize_output = 1;
+
+  gcode_ir_init (&ir);
+  test_program (&ir);
+
+  if (ir.failed || gcode_post_process (&gcode, &ir) || !(code = gcode_ir_format (&gcode, &ir, &length)))
+  {
+    fprintf (stderr, "Failed to post-process the program\n");
+    gcode_ir_free (&ir);
+    gcode_free (&gcode);
+    return (1);
+  }
+
+  failed = 0;
+
+  if (strstr (code, "X1.25"))
+  {
+    fprintf (stderr, "Trip over the traverse height kept:\n%s", code);
+    failed = 1;
+  }
+
+  if (!strstr (code, "X2.5") || !strstr (code, "Z-0.05"))
+  {
+    fprintf (stderr, "Trip with a rapid move below the stock dropped:\n%s", code);
+    failed = 1;
+  }
+
+  if (!strstr (code, "X3.75"))
+  {
+    fprintf (stderr, "Trip retracting below the traverse height dropped:\n%s", code);
+    failed = 1;
+  }
+
+  free (code);
+  gcode_ir_free (&ir);
+  gcode_free (&gcode);
+
+  return (failed);
+}
@@ -0,0 +1,166 @@
+/**
+ *  test_sim_threads.c
+ *  Test for the G-Code generation, simulation, and visualization
+ *  library.
+ *
+ *  Copyright (C) 2006 - 2010 by Justin Shumaker
+ *  Copyright (C) 2014 by Asztalos Attila Oszkár
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * The stock a threaded render leaves has to be the very same as the one left by
+ * a serial render: ball nose cuts are stamped column by column, and cuts that
+ * reach past the edge of a tile must get cleared by the worker owning the
+ * neighbouring tile too.
+ */
+
+#include "gcode.h"
+#include "gcode_sim.h"
+#include "gcode_voxel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define TEST_FILENAME "test_sim_threads.nc"
+#define TEST_DIAMETER 0.1875
+#define TEST_CUTS     16
+
+/**
+ * Write a program of ball nose cuts running along X across the first tile edge:
+ * every cut starts a little further along than the one before, by a fraction of
+ * a column, so that one of them is bound to have its stencil centre snap to the
+ * column that puts its rim into the tile on the other side of the edge.
+ */
+
+static int
+test_write_program (gcode_t *gcode)
+{
+  FILE *fh;
+  gfloat_t pitch, x, y;
+  int n;
+
+  fh = fopen (TEST_FILENAME, "w");
+
+  if (!fh)
+    return (1);
+
+  fprintf (fh, "(Tool Diameter: %.6f)\n(Tool Shape: ball nose)\nG20\nG90\n", TEST_DIAMETER);
+
+  pitch = gcode->material_size[0] / gcode->voxel_number[0];
+
+  for (n = 0; n < TEST_CUTS; n++)
+  {
+    x = (GCODE_SIM_TILE_SIZE - 1) * pitch + 0.5 * TEST_DIAMETER + n * pitch / TEST_CUTS;
+    y = 0.2 + n * 0.16;
+
+    fprintf (fh, "G00 Z0.10000\nG00 X%.5f Y%.5f\nG01 Z-0.20000 F10.000\n", x, y);
+    fprintf (fh, "G01 X%.5f Y%.5f\n", x + 0.25, y + 0.1);
+  }
+
+  fclose (fh);
+
+  return (0);
+}
+
+/**
+ * Hash of the height of every column of the stock
+ */
+
+static uint32_t
+test_stock_hash (gcode_t *gcode)
+{
+  uint32_t i, j, k, top, hash;
+
+  hash = 0;
+
+  for (j = 0; j < gcode->voxel_number[1]; j++)
+  {
+    for (i = 0; i < gcode->voxel_number[0]; i++)
+    {
+      top = 0;
+
+      for (k = 0; k < gcode->voxel_number[2]; k++)
+        if (gcode_voxel_get (gcode, i, j, k))
+          top = k + 1;
+
+      hash = hash * 31 + top;
+    }
+  }
+
+  return (hash);
+}
+
+/**
+ * Render the program on a fresh stock with 'threads' workers
+ */
+
+static int
+test_render (int threads, uint32_t *hash)
+{
+  gcode_t gcode;
+  gfloat_t time_elapsed;
+  int failed;
+
+  gcode_init (&gcode);
+
+  gcode.units = GCODE_UNITS_INCH;
+  gcode.material_size[0] = 3.0;
+  gcode.material_size[1] = 3.0;
+  gcode.material_size[2] = 0.5;
+  gcode.voxel_resolution = 300;
+  gcode.stock_model = GCODE_STOCK_VOXEL;
+  gcode.simulation_threads = threads;
+
+  gcode_prep (&gcode);
+
+  if (test_write_program (&gcode))
+  {
+    fprintf (stderr, "Failed to write '%s'\n", TEST_FILENAME);
+    gcode_free (&gcode);
+    return (1);
+  }
+
+  failed = gcode_render_file (&gcode, TEST_FILENAME, &time_elapsed);
+
+  unlink (TEST_FILENAME);
+
+  if (failed)
+    fprintf (stderr, "Failed to render '%s'\n", TEST_FILENAME);
+  else
+    *hash = test_stock_hash (&gcode);
+
+  gcode_free (&gcode);
+
+  return (failed);
+}
+
+int
+main (void)
+{
+  uint32_t serial, threaded;
+
+  if (test_render (1, &serial) || test_render (4, &threaded))
+    return (1);
+
+  if (serial != threaded)
+  {
+    fprintf (stderr, "Serial stock %08x differs from threaded stock %08x\n", serial, threaded);
+    return (1);
+  }
+
+  return (0);
+}